@@ -1,4 +1,19 @@
 #include "src/gl_impl.h"
+#include "src/gl_loader.h"
+#include "src/job_system.h"
+#include "src/gl_async.h"
+#include "src/startup_profiler.h"
+#ifdef GOFRAN_GL_STATS
+#include "src/gl_stats.h"
+#endif
+#ifdef GOFRAN_HEADLESS
+#include "src/gl_capture.h"
+#if defined(GOFRAN_HEADLESS_SOFT)
+#include "src/gl_soft.h"
+#else
+#include "src/gl_headless.h"
+#endif
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -16,18 +31,110 @@ using namespace gofran;
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
+#ifdef GOFRAN_HEADLESS
+// Headless runs render a fixed number of frames into an FBO and exit:
+//   main_headless [-s widthxheight] [-n frames] [-o last_frame.ppm]
+//           [-c trace [-r first:count]]
+// -c records the GL calls of the drawn frames first..first+count-1 (all by
+// default) for gl_replay; the startup calls go into frame 0.
+struct headless_options {
+    int width = SCR_WIDTH;
+
+    int height = SCR_HEIGHT;
+
+    int frames = 100;
+
+    std::string output;
+
+    std::string trace;
+
+    uint32_t trace_first = 0;
+
+    uint32_t trace_frames = UINT32_MAX;
+};
+
+static bool parse_headless_options(int argc, const char* argv[], headless_options& options);
+
+#if defined(GOFRAN_HEADLESS_SOFT)
+// shaders/4.2_*.glsl for GLSoft.
+static soft_program_t soft_program_4_2();
+#endif
+#else
 static void init_opengl_env();
 
 static void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 
 static void process_input(GLFWwindow *window);
+#endif
+
+struct scene_assets {
+    std::shared_ptr<GLPipeline> pipeline;
+
+    std::shared_ptr<GLTextures> texture1;
+
+    std::shared_ptr<GLTextures> texture2;
+};
+
+static Task<void> load_scene(AssetLoader& assets, scene_assets& scene);
 
 void my_fun();
 
 int main(int argc, const char* argv[]) {
-    init_opengl_env();
+    StartupProfiler profiler;
+
+    JobSystem jobs;
+    AssetLoader assets(jobs);
+    assets.set_profiler(&profiler);
 
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+#ifdef GOFRAN_HEADLESS
+    headless_options options;
+    if (!parse_headless_options(argc, argv, options)) {
+        std::cout << "usage: main_headless [-s widthxheight] [-n frames] [-o last_frame.ppm]"
+                << " [-c trace [-r first:count]]" << std::endl;
+        return -1;
+    }
+
+    // Declared before everything that calls GL in its destructor, so the
+    // context is still there when they run.
+#if defined(GOFRAN_HEADLESS_SOFT)
+    GLSoft headless(jobs);
+#else
+    GLHeadless headless;
+#endif
+#endif
+
+    // Declared before the objects it tracks so it outlives them, their
+    // deferred deletions run when it is destroyed.
+    GLTimeline timeline;
+
+    scene_assets scene;
+
+#ifdef GOFRAN_GL_STATS
+    // Installed once GL is loaded, prints a line per frame.
+    GLStats gl_stats(std::cout);
+#endif
+
+#ifdef GOFRAN_HEADLESS
+    {
+        StartupProfiler::Phase phase(&profiler, "create context");
+        if (gli_success != headless.create(options.width, options.height)) {
+            std::cout << "Failed to create headless context" << std::endl;
+            return -1;
+        }
+    }
+
+    GLFWwindow* window = NULL;
+#else
+    {
+        StartupProfiler::Phase phase(&profiler, "glfw init");
+        init_opengl_env();
+    }
+
+    GLFWwindow* window = NULL;
+    {
+        StartupProfiler::Phase phase(&profiler, "create window");
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+    }
     if (window == NULL) {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -37,22 +144,37 @@ int main(int argc, const char* argv[]) {
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
     // 加载GLFW函数指针，在调用任何OpenGL函数之前必须调用该函数
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+    {
+        StartupProfiler::Phase phase(&profiler, "load gl");
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
     }
+#endif
 
-    GLPipeline pipeline;
-
-    int res = 0;
-    // std::string vertex_str(vertexShaderSource);
-    // res = pipeline.set_vertex_shader(vertex_str);
-    res = pipeline.set_vertex_file("../../shaders/4.2_vertex.glsl");
+#ifdef GOFRAN_GL_STATS
+    // Under the capture, so its time is not counted.
+    gl_stats.install();
+#endif
+#ifdef GOFRAN_HEADLESS
+    // Before anything else calls GL, a trace has to create its objects.
+    GLCapture capture;
+    if (!options.trace.empty()) {
+        capture.install();
+        if (gli_success != capture.open(options.trace, options.trace_first, options.trace_frames)) {
+            std::cout << "Failed to open " << options.trace << std::endl;
+            return -1;
+        }
+    }
+#endif
 
-    // std::string fragment_str(fragmentShaderSource);
-    // res = pipeline.set_fragment_shader(fragment_str);
-    res = pipeline.set_fragment_file("../../shaders/4.2_fragment.glsl");
-    res = pipeline.link();
+    // Started once nothing can fail before the end of main() waits for it:
+    // a load abandoned at an early return would stay parked on its GL steps
+    // while its decodes still run. Reads and decodes need no context and
+    // overlap the buffer uploads; the GL steps wait until the loop below
+    // runs main-affine jobs.
+    Task<void> scene_load = load_scene(assets, scene);
 
     float vertices[] = {
         // ---- 位置 ----       ---- 颜色 ----     - 纹理坐标 -
@@ -66,87 +188,205 @@ int main(int argc, const char* argv[]) {
         1, 2, 3  // second triangle
     };
 
-    GLVertexArray vao;
-    vao.generate();
-    vao.bind();
+    GLLoader loader;
+    loader.start(window);
 
     GLBuffer vbo(gli_buffertype::GLI_ARRAY_BUFFER);
-    vbo.generate();
-    vbo.bind();
-    vbo.set_data(vertices, sizeof(vertices));
+    auto vbo_upload = loader.submit([&]() {
+        StartupProfiler::Phase phase(&profiler, "upload vertex buffer");
+        vbo.generate();
+        return (gli_status)vbo.upload_data(vertices, sizeof(vertices));
+    });
 
     GLBuffer ebo(gli_buffertype::GLI_ELEMENT_ARRAY_BUFFER);
-    ebo.generate();
-    ebo.bind();
-    ebo.set_data(indices, sizeof(indices));
-
-    vao.set_attribute(0, 3, gli_type::GLI_FLOAT, false, 8 * sizeof(float), 0);
-    vao.set_attribute(1, 3, gli_type::GLI_FLOAT, false, 8 * sizeof(float), 3 * sizeof(float));
-    vao.set_attribute(2, 3, gli_type::GLI_FLOAT, false, 8 * sizeof(float), 6 * sizeof(float));
-
-    GLTextures texture1(gli_texturetype::GLI_TEXTURE_2D);
-    texture1.generate();
-    texture1.bind();
-    texture1.set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_WRAP_S, gli_textureparams::GLI_REPEAT);
-    texture1.set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_WRAP_T, gli_textureparams::GLI_REPEAT);
-    texture1.set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_MIN_FILTER, gli_textureparams::GLI_LINEAR);
-    texture1.set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_MAG_FILTER, gli_textureparams::GLI_LINEAR);
-
-    int width, height, nrChannels;
-    unsigned char *data = stbi_load("container.jpg", &width, &height, &nrChannels, 0);
-    if (data) {
-        texture1.load_texture(width, height, data, gli_pixelformat::GLI_RGB);
-    }
-    else {
-        std::cout << "Failed to load texture" << std::endl;
-    }
-    stbi_image_free(data);
-    texture1.unbind();
-
-    GLTextures texture2(gli_texturetype::GLI_TEXTURE_2D);
-    texture2.generate();
-    texture2.bind();
-    texture2.set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_WRAP_S, gli_textureparams::GLI_REPEAT);
-    texture2.set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_WRAP_T, gli_textureparams::GLI_REPEAT);
-    texture2.set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_MIN_FILTER, gli_textureparams::GLI_LINEAR);
-    texture2.set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_MAG_FILTER, gli_textureparams::GLI_LINEAR);
-
-    // int width, height, nrChannels;
-    data = stbi_load("awesomeface.png", &width, &height, &nrChannels, 0);
-    if (data) {
-        texture2.load_texture(width, height, data, gli_pixelformat::GLI_RGBA);
-    }
-    else {
-        std::cout << "Failed to load texture" << std::endl;
-    }
-    stbi_image_free(data);
-    texture2.unbind();
-
-    pipeline.use();
-    pipeline.set_uniform1("texture1", 0);
-    pipeline.set_uniform1("texture2", 1);
-
+    auto ebo_upload = loader.submit([&]() {
+        StartupProfiler::Phase phase(&profiler, "upload index buffer");
+        ebo.generate();
+        return (gli_status)ebo.upload_data(indices, sizeof(indices));
+    });
+
+    // Buffers are shared between contexts but vertex arrays are not, so the
+    // VAO is built here once the loader has published both buffers.
+    GLVertexArray vao;
+    bool scene_ready = false;
+
+#ifdef GOFRAN_HEADLESS
+    // Frames that drew the scene; startup frames before it are not counted.
+    int frame = 0;
+    double loop_start = 0.0;
+    while (frame < options.frames) {
+#else
     while (!glfwWindowShouldClose(window)) {
         process_input(window);
+#endif
 
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
-        texture1.active(0);
-        texture1.unbind();
-        texture2.active(1);
-        texture2.unbind();
+        jobs.run_main_jobs();
+        loader.poll();
+        if (!scene_ready && vbo_upload->is_ready() && ebo_upload->is_ready()
+                && scene_load.is_ready()) {
+            vao.generate();
+            vao.bind();
+            vbo.bind();
+            ebo.bind();
+            vao.set_attribute(0, 3, gli_type::GLI_FLOAT, false, 8 * sizeof(float), 0);
+            vao.set_attribute(1, 3, gli_type::GLI_FLOAT, false, 8 * sizeof(float), 3 * sizeof(float));
+            vao.set_attribute(2, 3, gli_type::GLI_FLOAT, false, 8 * sizeof(float), 6 * sizeof(float));
+            vao.unbind();
+            vao.attach(vbo);
+            vao.attach(ebo);
+
+            vbo.set_timeline(&timeline);
+            ebo.set_timeline(&timeline);
+            scene.texture1->set_timeline(&timeline);
+            scene.texture2->set_timeline(&timeline);
+
+#if defined(GOFRAN_HEADLESS_SOFT)
+            // Before the uniform lookups, the names come with the shaders.
+            headless.set_program(*scene.pipeline, soft_program_4_2());
+#endif
+            scene.pipeline->use();
+            scene.pipeline->set_uniform1("texture1", 0);
+            scene.pipeline->set_uniform1("texture2", 1);
+            scene_ready = true;
+        }
+
+        if (!scene_ready) {
+#ifdef GOFRAN_HEADLESS
+            headless.end_frame();
+            // Nothing to draw yet, don't spin on the loads.
+            std::this_thread::yield();
+#else
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+#endif
+#ifdef GOFRAN_GL_STATS
+            gl_stats.end_frame();
+#endif
+            continue;
+        }
+
+        scene.texture1->active(0);
+        scene.texture2->active(1);
 
-        pipeline.use();
+        scene.pipeline->use();
         vao.bind();
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-
+        vao.unbind();
+
+        // Each on its own unit, so every frame binds them again.
+        scene.texture2->unbind();
+        scene.texture1->active(0);
+        scene.texture1->unbind();
+
+        timeline.end_frame();
+#ifdef GOFRAN_HEADLESS
+        headless.end_frame();
+        capture.end_frame();
+        ++frame;
+#else
         glfwSwapBuffers(window);
         glfwPollEvents();
+#endif
+#ifdef GOFRAN_GL_STATS
+        gl_stats.end_frame();
+#endif
+
+        if (profiler.first_frame_ms() < 0.0) {
+            profiler.mark_first_frame();
+            profiler.report(std::cout);
+#ifdef GOFRAN_HEADLESS
+            loop_start = profiler.now_ms();
+#endif
+        }
     }
 
+#ifdef GOFRAN_HEADLESS
+    glFinish();
+    double loop_ms = profiler.now_ms() - loop_start;
+    std::cout << frame << " frames at " << options.width << "x" << options.height << " in " << loop_ms
+            << " ms, " << (frame > 1 ? (frame - 1) * 1000.0 / loop_ms : 0.0) << " fps" << std::endl;
+    if (!options.output.empty() && gli_success != headless.write_ppm(options.output)) {
+        std::cout << "Failed to write " << options.output << std::endl;
+    }
+#if defined(GOFRAN_HEADLESS_SOFT)
+    headless.report(std::cout);
+#endif
+    if (!options.trace.empty()) {
+        // Already closed when the range ended before the last frame.
+        if (gli_io_failed == capture.close()) {
+            std::cout << "Failed to write " << options.trace << std::endl;
+        }
+        std::cout << "trace: " << capture.calls() << " calls, " << capture.payloads() << " payloads of "
+                << capture.payload_bytes() << " bytes, " << capture.reused_bytes() << " bytes reused, "
+                << capture.file_bytes() << " bytes written" << std::endl;
+    }
+#endif
+
+#ifdef GOFRAN_GL_STATS
+    gl_stats.report(std::cout);
+#endif
+
+    // Coroutines still in flight reference locals of main(), let them finish
+    // before anything goes out of scope.
+    assets.wait(scene_load);
+    loader.stop();
 }
 
+#ifdef GOFRAN_HEADLESS
+bool parse_headless_options(int argc, const char* argv[], headless_options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ("-s" == arg && i + 1 < argc) {
+            if (2 != sscanf(argv[++i], "%dx%d", &options.width, &options.height)) {
+                return false;
+            }
+        } else if ("-n" == arg && i + 1 < argc) {
+            options.frames = std::atoi(argv[++i]);
+        } else if ("-o" == arg && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if ("-c" == arg && i + 1 < argc) {
+            options.trace = argv[++i];
+        } else if ("-r" == arg && i + 1 < argc) {
+            if (2 != sscanf(argv[++i], "%u:%u", &options.trace_first, &options.trace_frames)) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return options.width > 0 && options.height > 0 && options.frames > 0;
+}
+
+#if defined(GOFRAN_HEADLESS_SOFT)
+soft_program_t soft_program_4_2() {
+    soft_program_t program;
+    program.varyings = 5;
+    program.uniforms = { "texture1", "texture2" };
+    // ourColor, then TexCoord.
+    program.vertex = [](const soft_vertex_in_t& in, float position[4], float* varyings) {
+        position[0] = in.attribs[0][0];
+        position[1] = in.attribs[0][1];
+        position[2] = in.attribs[0][2];
+        position[3] = 1.0f;
+        memcpy(varyings, in.attribs[1], 3 * sizeof(float));
+        memcpy(varyings + 3, in.attribs[2], 2 * sizeof(float));
+    };
+    program.fragment = [](const soft_fragment_in_t& in, float rgba[4]) {
+        float texel1[4];
+        float texel2[4];
+        in.sample(in.uniforms->i[0], in.varyings[3], in.varyings[4], texel1);
+        in.sample(in.uniforms->i[1], in.varyings[3], in.varyings[4], texel2);
+        for (int i = 0; i < 4; ++i) {
+            rgba[i] = texel1[i] + (texel2[i] - texel1[i]) * 0.2f;
+        }
+    };
+    return program;
+}
+#endif
+#else
 void init_opengl_env() {
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -166,3 +406,28 @@ void process_input(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 }
+#endif
+
+// Startup as a dependency graph: shader reads and both decodes start at
+// once, the pipeline compiles on the render thread as soon as its sources
+// are in while the decodes keep running, and the textures upload together
+// in a single render-thread batch.
+Task<void> load_scene(AssetLoader& assets, scene_assets& scene) {
+    auto vs = assets.read_text("../../shaders/4.2_vertex.glsl");
+    auto fs = assets.read_text("../../shaders/4.2_fragment.glsl");
+    auto image1 = assets.decode_image("container.jpg");
+    auto image2 = assets.decode_image("awesomeface.png");
+
+    std::string vs_src = co_await vs;
+    std::string fs_src = co_await fs;
+
+    co_await resume_on_render{ assets.jobs() };
+    scene.pipeline = assets.build_pipeline(vs_src, fs_src);
+
+    DecodedImage decoded1 = co_await image1;
+    DecodedImage decoded2 = co_await image2;
+
+    co_await resume_on_render{ assets.jobs() };
+    scene.texture1 = assets.upload_texture(decoded1);
+    scene.texture2 = assets.upload_texture(decoded2);
+}
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/image_batch.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+
+using namespace gofran;
+
+// Throughput of ImageBatch for 1..N threads. The files on the command line are
+// repeated until the batch holds -n images (10000 by default) and decoded
+// from memory, or by file name with -l. "loop" is the same work done the
+// plain way for comparison: stbi_load per image inside a parallel_for, with
+// malloc for everything and a copy into a buffer the application owns.
+//
+//   bench_batch [-t max_threads] [-n images] [-c channels] [-l] files...
+
+static double now_ms() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+static bool read_file(const std::string& path, std::vector<unsigned char>& bytes) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    file.seekg(0, std::ios::end);
+    std::streamoff size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    bytes.resize((size_t)std::max<std::streamoff>(size, 0));
+    file.read((char*)bytes.data(), size);
+    return !bytes.empty();
+}
+
+static void report(const char* mode, size_t threads, double ms, size_t images,
+        double bytes, double pixels, size_t failed) {
+    std::cout << mode << "\t" << threads << "\t" << ms
+            << "\t" << images / (ms / 1000.0)
+            << "\t" << bytes / (ms * 1000.0)
+            << "\t" << pixels / (ms * 1000.0)
+            << "\t" << failed << std::endl;
+}
+
+int main(int argc, const char* argv[]) {
+    size_t max_threads = std::thread::hardware_concurrency();
+    size_t count = 10000;
+    int channels = 0;
+    bool from_file = false;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ("-t" == arg && i + 1 < argc) {
+            max_threads = std::strtoul(argv[++i], NULL, 10);
+        } else if ("-n" == arg && i + 1 < argc) {
+            count = std::strtoul(argv[++i], NULL, 10);
+        } else if ("-c" == arg && i + 1 < argc) {
+            channels = std::atoi(argv[++i]);
+        } else if ("-l" == arg) {
+            from_file = true;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty() || 0 == count) {
+        std::cout << "usage: bench_batch [-t max_threads] [-n images] [-c channels] [-l] files..." << std::endl;
+        return 1;
+    }
+    if (0 == max_threads) {
+        max_threads = 1;
+    }
+
+    std::vector<std::vector<unsigned char>> blobs(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (!read_file(paths[i], blobs[i])) {
+            std::cout << "Failed to read " << paths[i] << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<ImageBatchItem> items(count);
+    double bytes = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        size_t f = i % paths.size();
+        if (from_file) {
+            items[i].path = paths[f];
+        } else {
+            items[i].data = blobs[f].data();
+            items[i].size = blobs[f].size();
+        }
+        items[i].channels = channels;
+        bytes += (double)blobs[f].size();
+    }
+
+    std::cout << "mode\tthreads\tms\timages/s\tMB/s\tMpix/s\tfailed" << std::endl;
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        // The main thread takes part, so the pool gets threads - 1 workers.
+        JobSystem jobs((int)threads - 1);
+
+        {
+            std::vector<std::unique_ptr<unsigned char[]>> outputs(count);
+            std::vector<size_t> pixels(count, 0);
+            double start = now_ms();
+            jobs.parallel_for(0, count, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; ++i) {
+                    const ImageBatchItem& item = items[i];
+                    int w = 0, h = 0, n = 0;
+                    unsigned char* data = from_file
+                            ? stbi_load(item.path.c_str(), &w, &h, &n, channels)
+                            : stbi_load_from_memory(item.data, (int)item.size, &w, &h, &n, channels);
+                    if (NULL == data) {
+                        continue;
+                    }
+                    size_t size = (size_t)w * h * (channels ? channels : n);
+                    outputs[i].reset(new unsigned char[size]);
+                    std::copy(data, data + size, outputs[i].get());
+                    stbi_image_free(data);
+                    pixels[i] = (size_t)w * h;
+                }
+            });
+            double ms = now_ms() - start;
+
+            double total_pixels = 0.0;
+            size_t failed = 0;
+            for (size_t i = 0; i < count; ++i) {
+                total_pixels += (double)pixels[i];
+                failed += outputs[i] ? 0 : 1;
+            }
+            report("loop", threads, ms, count, bytes, total_pixels, failed);
+        }
+
+        {
+            ImageBatch batch(jobs);
+            double start = now_ms();
+            std::vector<ImageBatchResult> results = batch.decode(items);
+            double ms = now_ms() - start;
+
+            double total_pixels = 0.0;
+            size_t failed = 0;
+            for (const auto& result : results) {
+                total_pixels += (double)result.width * result.height;
+                failed += result.ok() ? 0 : 1;
+            }
+            report("batch", threads, ms, count, bytes, total_pixels, failed);
+        }
+
+        if (threads < max_threads && threads * 2 > max_threads) {
+            threads = max_threads / 2;
+        }
+    }
+
+    return 0;
+}
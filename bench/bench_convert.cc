@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/job_system.h"
+#include "../src/pixel_convert.h"
+
+using namespace gofran;
+
+// Throughput of the pixel_convert kernels on a w x h image (3840x2160 by
+// default), for every instruction set this CPU runs, then the best one split
+// over 1..N threads by rows. GB/s counts bytes read plus bytes written, so
+// kernels with different pixel sizes compare against memory bandwidth.
+//
+//   bench_convert [-w width] [-h height] [-n iterations] [-t max_threads]
+
+static double now_ms() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+struct kernel_t {
+    const char* name;
+
+    size_t src_pixel;
+
+    size_t dst_pixel;
+
+    // Converts one row of pixels.
+    std::function<void(const void*, void*, size_t, pixel_isa)> row;
+
+    // Whether the kernel has code for the instruction set, or falls back.
+    bool (*has_isa)(pixel_isa);
+};
+
+static bool all_isas(pixel_isa) {
+    return true;
+}
+
+static bool scalar_only(pixel_isa isa) {
+    return pixel_isa::PIXEL_SCALAR == isa;
+}
+
+static bool all_but_avx2(pixel_isa isa) {
+    return pixel_isa::PIXEL_AVX2 != isa;
+}
+
+static bool scalar_or_avx2(pixel_isa isa) {
+    return pixel_isa::PIXEL_SCALAR == isa || pixel_isa::PIXEL_AVX2 == isa;
+}
+
+static const char* isa_name(pixel_isa isa) {
+    switch (isa) {
+    case pixel_isa::PIXEL_SCALAR:
+        return "scalar";
+    case pixel_isa::PIXEL_SSE2:
+        return "sse2";
+    case pixel_isa::PIXEL_AVX2:
+        return "avx2";
+    case pixel_isa::PIXEL_NEON:
+        return "neon";
+    default:
+        return "best";
+    }
+}
+
+int main(int argc, const char* argv[]) {
+    size_t width = 3840;
+    size_t height = 2160;
+    int iterations = 20;
+    size_t max_threads = std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ("-w" == arg && i + 1 < argc) {
+            width = std::strtoul(argv[++i], NULL, 10);
+        } else if ("-h" == arg && i + 1 < argc) {
+            height = std::strtoul(argv[++i], NULL, 10);
+        } else if ("-n" == arg && i + 1 < argc) {
+            iterations = std::atoi(argv[++i]);
+        } else if ("-t" == arg && i + 1 < argc) {
+            max_threads = std::strtoul(argv[++i], NULL, 10);
+        } else {
+            std::cout << "usage: bench_convert [-w width] [-h height] [-n iterations] [-t max_threads]" << std::endl;
+            return 1;
+        }
+    }
+    if (0 == width || 0 == height || iterations <= 0) {
+        return 1;
+    }
+    if (0 == max_threads) {
+        max_threads = 1;
+    }
+
+    const kernel_t kernels[] = {
+        { "rgb8_to_rgba8", 3, 4, [](const void* s, void* d, size_t n, pixel_isa isa) {
+            rgb8_to_rgba8((const uint8_t*)s, (uint8_t*)d, n, isa);
+        }, all_isas },
+        { "premultiply_rgba8", 4, 4, [](const void* s, void* d, size_t n, pixel_isa isa) {
+            premultiply_rgba8((const uint8_t*)s, (uint8_t*)d, n, isa);
+        }, all_isas },
+        { "narrow_u16_to_u8", 8, 4, [](const void* s, void* d, size_t n, pixel_isa isa) {
+            narrow_u16_to_u8((const uint16_t*)s, (uint8_t*)d, n * 4, isa);
+        }, all_isas },
+        { "float_to_half", 16, 8, [](const void* s, void* d, size_t n, pixel_isa isa) {
+            float_to_half((const float*)s, (uint16_t*)d, n * 4, isa);
+        }, all_isas },
+        { "float_to_r11g11b10", 16, 4, [](const void* s, void* d, size_t n, pixel_isa isa) {
+            float_to_r11g11b10((const float*)s, (uint32_t*)d, n, 4, isa);
+        }, all_but_avx2 },
+        { "srgb8_to_linear8", 4, 4, [](const void* s, void* d, size_t n, pixel_isa) {
+            srgb8_to_linear8((const uint8_t*)s, (uint8_t*)d, n, 4);
+        }, scalar_only },
+        { "srgb8_to_linear_f32", 4, 16, [](const void* s, void* d, size_t n, pixel_isa) {
+            srgb8_to_linear_f32((const uint8_t*)s, (float*)d, n, 4);
+        }, scalar_only },
+        { "linear_f32_to_srgb8", 16, 4, [](const void* s, void* d, size_t n, pixel_isa isa) {
+            linear_f32_to_srgb8((const float*)s, (uint8_t*)d, n, 4, isa);
+        }, scalar_or_avx2 },
+    };
+
+    // Pixels of every format at once, filled with values in range for all of
+    // them: bytes for the 8-bit kernels, floats in [0, 1] for the float ones.
+    size_t pixels = width * height;
+    std::vector<float> src(pixels * 4);
+    unsigned seed = 1;
+    for (auto& x : src) {
+        seed = seed * 1664525u + 1013904223u;
+        x = (seed >> 8) * (1.0f / 16777216.0f);
+    }
+    std::vector<float> dst(pixels * 4);
+
+    const pixel_isa isas[] = {
+        pixel_isa::PIXEL_SCALAR, pixel_isa::PIXEL_SSE2, pixel_isa::PIXEL_AVX2, pixel_isa::PIXEL_NEON,
+    };
+
+    std::cout << "kernel\tisa\tthreads\tms\tGB/s\tMpix/s" << std::endl;
+    auto report = [&](const kernel_t& kernel, const char* isa, size_t threads, double ms) {
+        double bytes = (double)pixels * (kernel.src_pixel + kernel.dst_pixel);
+        std::cout << kernel.name << "\t" << isa << "\t" << threads << "\t" << ms
+                << "\t" << bytes / (ms * 1e6)
+                << "\t" << pixels / (ms * 1000.0) << std::endl;
+    };
+
+    for (const auto& kernel : kernels) {
+        for (pixel_isa isa : isas) {
+            if (detail::resolve_isa(isa) != isa || !kernel.has_isa(isa)) {
+                continue;
+            }
+
+            kernel.row(src.data(), dst.data(), pixels, isa);
+            double start = now_ms();
+            for (int i = 0; i < iterations; ++i) {
+                kernel.row(src.data(), dst.data(), pixels, isa);
+            }
+            report(kernel, isa_name(isa), 1, (now_ms() - start) / iterations);
+        }
+    }
+
+    for (size_t threads = 2; threads <= max_threads; threads *= 2) {
+        JobSystem jobs((int)threads - 1);
+        for (const auto& kernel : kernels) {
+            auto row = [&kernel, width](const void* s, void* d) {
+                kernel.row(s, d, width, pixel_isa::PIXEL_BEST);
+            };
+            convert_rows_parallel(jobs, src.data(), width * kernel.src_pixel,
+                    dst.data(), width * kernel.dst_pixel, height, row);
+            double start = now_ms();
+            for (int i = 0; i < iterations; ++i) {
+                convert_rows_parallel(jobs, src.data(), width * kernel.src_pixel,
+                        dst.data(), width * kernel.dst_pixel, height, row);
+            }
+            report(kernel, "best", threads, (now_ms() - start) / iterations);
+        }
+
+        if (threads < max_threads && threads * 2 > max_threads) {
+            threads = max_threads / 2;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,171 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/gl_headless.h"
+#include "../src/gif_player.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+
+using namespace gofran;
+
+// GifPlayer on a headless context: plays the file twice through, reading
+// every layer it shows back from the texture array and comparing it to the
+// same frame from stbi_load_gif_from_memory, so the ring, the rewind and
+// the uploads are all checked. Then update() cost per shown frame and what
+// stays resident, against holding every frame.
+//
+//   bench_gif [-w window] [-l loops] file.gif
+
+static double now_ms() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+static bool read_file(const std::string& path, std::vector<unsigned char>& bytes) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Layer layer of the player's texture array.
+static void read_layer(GifPlayer& player, int layer, std::vector<unsigned char>& pixels) {
+    size_t layer_size = (size_t)player.width() * player.height() * 4;
+    std::vector<unsigned char> all(layer_size * player.window());
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    player.texture()->bind();
+    glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, GL_UNSIGNED_BYTE, all.data());
+    player.texture()->unbind();
+    pixels.assign(all.begin() + layer_size * layer, all.begin() + layer_size * (layer + 1));
+}
+
+// Shows loops * frames frames, frame by frame: the clock moves on in small
+// steps, so update() never has a reason to skip one. check compares each
+// shown layer with the frame it should hold.
+static bool play(GifPlayer& player, int frames, int loops, const unsigned char* expected, bool check,
+        double& update_ms) {
+    size_t frame_size = (size_t)player.width() * player.height() * 4;
+    std::vector<unsigned char> pixels;
+    double clock = 0.0;
+    int shown = 0;
+    int last = -1;
+    update_ms = 0.0;
+    while (shown < loops * frames) {
+        double start = now_ms();
+        int layer = player.update(clock);
+        update_ms += now_ms() - start;
+        if (player.failed()) {
+            std::cout << "Decoding failed after " << shown << " frames" << std::endl;
+            return false;
+        }
+
+        if (layer < 0 || layer == last) {
+            // Waiting for the decoder, or for the frame's delay.
+            clock += 5.0;
+            std::this_thread::yield();
+            continue;
+        }
+
+        if (layer != shown % (int)player.window()) {
+            std::cout << "Frame " << shown << " in layer " << layer << std::endl;
+            return false;
+        }
+        if (check) {
+            read_layer(player, layer, pixels);
+            int frame = shown % frames;
+            if (0 != memcmp(pixels.data(), expected + frame_size * frame, frame_size)) {
+                std::cout << "Frame " << frame << " differs from stbi_load_gif_from_memory" << std::endl;
+                return false;
+            }
+        }
+        last = layer;
+        ++shown;
+    }
+    return true;
+}
+
+int main(int argc, const char* argv[]) {
+    size_t window = 8;
+    int loops = 2;
+    std::string path;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ("-w" == arg && i + 1 < argc) {
+            window = std::strtoul(argv[++i], NULL, 10);
+        } else if ("-l" == arg && i + 1 < argc) {
+            loops = std::atoi(argv[++i]);
+        } else if (path.empty()) {
+            path = arg;
+        } else {
+            path.clear();
+            break;
+        }
+    }
+    if (path.empty() || loops <= 0) {
+        std::cout << "usage: bench_gif [-w window] [-l loops] file.gif" << std::endl;
+        return 1;
+    }
+
+    std::vector<unsigned char> bytes;
+    if (!read_file(path, bytes)) {
+        std::cout << "Failed to read " << path << std::endl;
+        return 1;
+    }
+    int* delays = NULL;
+    int width = 0, height = 0, frames = 0, channels = 0;
+    unsigned char* expected = stbi_load_gif_from_memory(bytes.data(), (int)bytes.size(), &delays,
+            &width, &height, &frames, &channels, 4);
+    if (NULL == expected) {
+        std::cout << "Failed to decode " << path << ": " << stbi_failure_reason() << std::endl;
+        return 1;
+    }
+    stbi_image_free(delays);
+
+    GLHeadless headless;
+    if (gli_success != headless.create(width, height)) {
+        std::cout << "Failed to create headless context" << std::endl;
+        stbi_image_free(expected);
+        return 1;
+    }
+
+    bool ok = true;
+    {
+        JobSystem jobs;
+        GifPlayer checked(jobs, window);
+        ok = gli_success == checked.open(path) && width == checked.width() && height == checked.height();
+        double update_ms = 0.0;
+        ok = ok && play(checked, frames, loops, expected, true, update_ms);
+        if (ok) {
+            std::cout << path << ": " << width << "x" << height << ", " << frames << " frames, "
+                    << loops << " loops through a window of " << checked.window() << " match" << std::endl;
+        }
+
+        // Without the readbacks, for the time.
+        GifPlayer timed(jobs, window);
+        ok = ok && gli_success == timed.open(path) && play(timed, frames, loops, expected, false, update_ms);
+        if (ok) {
+            size_t frame_size = (size_t)width * height * 4;
+            std::cout << "update: " << update_ms * 1000.0 / (loops * frames) << " us per shown frame" << std::endl;
+            std::cout << "resident: " << frame_size * timed.window() / 1024 << " KiB window, "
+                    << frame_size * frames / 1024 << " KiB for every frame" << std::endl;
+        }
+    }
+    stbi_image_free(expected);
+
+    GLenum error = glGetError();
+    if (GL_NO_ERROR != error) {
+        std::cout << "GL error 0x" << std::hex << error << std::endl;
+        return 1;
+    }
+    return ok ? 0 : 1;
+}
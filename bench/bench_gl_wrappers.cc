@@ -0,0 +1,247 @@
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../src/gl_mock.h"
+
+using namespace gofran;
+
+// Cost of the gl_impl.h wrappers themselves, on GLMock instead of a driver.
+// First checks the exact GL calls the demo makes for one frame, then times
+// buffer and texture uploads, the demo frame and a uniform update, with call
+// recording off and on. GL calls/s counts the calls that reached the stubs,
+// bytes/op what was handed to glBufferData and glTexImage*.
+//
+//   bench_gl_wrappers [-n iterations]
+
+static double now_ms() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+static const char* vertex_src = "#version 330 core\nvoid main() {}\n";
+
+static const char* fragment_src = "#version 330 core\nvoid main() {}\n";
+
+// What the demo builds once its loads are done.
+struct scene_t {
+    GLTimeline timeline;
+
+    GLBuffer vbo;
+
+    GLBuffer ebo;
+
+    GLVertexArray vao;
+
+    GLTextures texture1;
+
+    GLTextures texture2;
+
+    GLPipeline pipeline;
+
+    scene_t() : vbo(gli_buffertype::GLI_ARRAY_BUFFER)
+            , ebo(gli_buffertype::GLI_ELEMENT_ARRAY_BUFFER)
+            , texture1(gli_texturetype::GLI_TEXTURE_2D)
+            , texture2(gli_texturetype::GLI_TEXTURE_2D) {
+    }
+};
+
+static void load_texture(GLTextures& texture, const std::vector<unsigned char>& pixels, int size) {
+    texture.generate();
+    texture.bind();
+    texture.set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_WRAP_S, gli_textureparams::GLI_REPEAT);
+    texture.set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_WRAP_T, gli_textureparams::GLI_REPEAT);
+    texture.set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_MIN_FILTER, gli_textureparams::GLI_LINEAR);
+    texture.set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_MAG_FILTER, gli_textureparams::GLI_LINEAR);
+    texture.load_texture(size, size, pixels.data(), gli_pixelformat::GLI_RGBA);
+    texture.unbind();
+}
+
+static bool build_scene(scene_t& scene) {
+    float vertices[32] = {};
+    unsigned int indices[] = { 0, 1, 3, 1, 2, 3 };
+    std::vector<unsigned char> pixels(64 * 64 * 4, 0x80);
+
+    scene.vbo.generate();
+    scene.vbo.upload_data(vertices, sizeof(vertices));
+    scene.ebo.generate();
+    scene.ebo.upload_data(indices, sizeof(indices));
+    load_texture(scene.texture1, pixels, 64);
+    load_texture(scene.texture2, pixels, 64);
+    if (gli_success != scene.pipeline.set_vertex_shader(vertex_src)
+            || gli_success != scene.pipeline.set_fragment_shader(fragment_src)
+            || gli_success != scene.pipeline.link()) {
+        return false;
+    }
+
+    scene.vao.generate();
+    scene.vao.bind();
+    scene.vbo.bind();
+    scene.ebo.bind();
+    scene.vao.set_attribute(0, 3, gli_type::GLI_FLOAT, false, 8 * sizeof(float), 0);
+    scene.vao.set_attribute(1, 3, gli_type::GLI_FLOAT, false, 8 * sizeof(float), 3 * sizeof(float));
+    scene.vao.set_attribute(2, 3, gli_type::GLI_FLOAT, false, 8 * sizeof(float), 6 * sizeof(float));
+    scene.vao.unbind();
+    scene.vao.attach(scene.vbo);
+    scene.vao.attach(scene.ebo);
+
+    scene.vbo.set_timeline(&scene.timeline);
+    scene.ebo.set_timeline(&scene.timeline);
+    scene.texture1.set_timeline(&scene.timeline);
+    scene.texture2.set_timeline(&scene.timeline);
+
+    scene.pipeline.use();
+    scene.pipeline.set_uniform1("texture1", 0);
+    scene.pipeline.set_uniform1("texture2", 1);
+    return true;
+}
+
+// The body of the demo's render loop once the scene is ready.
+static void draw_frame(scene_t& scene) {
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    scene.texture1.active(0);
+    scene.texture2.active(1);
+
+    scene.pipeline.use();
+    scene.vao.bind();
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    scene.vao.unbind();
+
+    scene.texture2.unbind();
+    scene.texture1.active(0);
+    scene.texture1.unbind();
+
+    scene.timeline.end_frame();
+}
+
+static bool check_frame(GLMock& mock, scene_t& scene) {
+    mock.clear();
+    draw_frame(scene);
+
+    bool ok = mock.expect_calls({
+        gl_call::ClearColor,
+        gl_call::Clear,
+        gl_call::ActiveTexture,
+        gl_call::BindTexture,
+        gl_call::ActiveTexture,
+        gl_call::BindTexture,
+        gl_call::UseProgram,
+        gl_call::BindVertexArray,
+        gl_call::DrawElements,
+        gl_call::BindVertexArray,
+        gl_call::BindTexture,
+        gl_call::ActiveTexture,
+        gl_call::BindTexture,
+        gl_call::FenceSync,
+        gl_call::ClientWaitSync,
+        gl_call::DeleteSync,
+    });
+    ok = ok && mock.errors().empty();
+    ok = ok && 0 == mock.bound_texture(GL_TEXTURE_2D);
+    for (const auto& error : mock.errors()) {
+        std::cout << "  " << error << std::endl;
+    }
+    ok = ok && 0 == mock.bound_vertex_array() && 0 != mock.current_program();
+    return ok;
+}
+
+static void run(GLMock& mock, const char* name, size_t iterations, const std::function<void()>& fn) {
+    for (int recording = 0; recording < 2; ++recording) {
+        mock.set_recording(1 == recording);
+        for (size_t i = 0; i < iterations / 10; ++i) {
+            fn();
+        }
+        mock.clear();
+
+        uint64_t calls = 0;
+        uint64_t bytes = 0;
+        double start = now_ms();
+        for (size_t i = 0; i < iterations; ++i) {
+            fn();
+            // Keep the recorded calls and errors from growing over the run.
+            if (mock.calls().size() > 4096 || mock.errors().size() > 4096) {
+                calls += mock.total_calls();
+                bytes += mock.bytes_uploaded();
+                mock.clear();
+            }
+        }
+        double ms = now_ms() - start;
+        calls += mock.total_calls();
+        bytes += mock.bytes_uploaded();
+
+        std::cout << name << "\t" << (recording ? "on" : "off")
+                << "\t" << ms * 1e6 / iterations
+                << "\t" << (double)calls / iterations
+                << "\t" << calls / (ms * 1000.0)
+                << "\t" << (double)bytes / iterations << std::endl;
+    }
+    mock.set_recording(true);
+    mock.clear();
+}
+
+int main(int argc, const char* argv[]) {
+    size_t iterations = 200000;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string("-n") == argv[i]) {
+            iterations = std::strtoul(argv[++i], NULL, 10);
+        }
+    }
+    if (0 == iterations) {
+        iterations = 1;
+    }
+
+    GLMock mock;
+    if (!mock.install()) {
+        std::cout << "Failed to install the GL mock" << std::endl;
+        return 1;
+    }
+
+    scene_t scene;
+    if (!build_scene(scene) || !mock.errors().empty()) {
+        std::cout << "Failed to build the scene" << std::endl;
+        for (const auto& error : mock.errors()) {
+            std::cout << "  " << error << std::endl;
+        }
+        return 1;
+    }
+    std::cout << "scene: " << mock.total_calls() << " GL calls, " << mock.bytes_uploaded() << " bytes, "
+            << mock.live_objects() << " objects" << std::endl;
+
+    std::cout << "frame calls:" << std::endl;
+    if (!check_frame(mock, scene)) {
+        std::cout << "Unexpected frame calls:" << std::endl << mock.trace();
+        return 1;
+    }
+
+    size_t live_objects = mock.live_objects();
+    std::vector<unsigned char> buffer_data(64 * 1024, 1);
+    std::vector<unsigned char> texture_data(256 * 256 * 4, 2);
+
+    std::cout << "op\trecord\tns/op\tcalls/op\tMcalls/s\tbytes/op" << std::endl;
+    run(mock, "buffer 64K", iterations, [&]() {
+        GLBuffer buffer(gli_buffertype::GLI_ARRAY_BUFFER);
+        buffer.generate();
+        buffer.upload_data(buffer_data.data(), buffer_data.size());
+    });
+    run(mock, "texture 256x256", iterations, [&]() {
+        GLTextures texture(gli_texturetype::GLI_TEXTURE_2D);
+        load_texture(texture, texture_data, 256);
+    });
+    run(mock, "frame", iterations, [&]() {
+        draw_frame(scene);
+    });
+    run(mock, "set_uniform1", iterations, [&]() {
+        scene.pipeline.set_uniform1("texture1", 0);
+    });
+
+    if (live_objects != mock.live_objects()) {
+        std::cout << "Leaked " << mock.live_objects() - live_objects << " GL objects" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "../src/job_system.h"
+#include "../src/stbi_arena.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+
+using namespace gofran;
+
+// Decode throughput of stb_image for 1..N threads. Every file given on the
+// command line is read once and decoded from memory, which is the path the
+// asset loader takes. JPEGs only split their entropy decode when they carry
+// restart markers (e.g. cjpeg -restart 1), the color conversion always.
+//
+//   bench_image [-t max_threads] [-n iterations] [-c channels] [-f flags] [-i] [-l] [-C] [-s scale] [-a] files...
+//
+// -c 4 measures the RGBA path textures take. -f delivers every image into
+// one reused buffer, as into a mapped pixel unpack buffer, applying
+// STBI_DEST_* flags (1 flips, 2 swaps to BGR) the way an application would
+// after stbi_load. -i does the same with stbi_load_into. -l loads by file
+// name instead, so reading the file is part of the time, and -C drops the
+// file from the page cache before every load to time it cold (where
+// posix_fadvise exists). -s 2, 4 or 8 decodes JPEGs reduced by that
+// factor with stbi_load_scaled (not with -i); Mpix/s still counts full size
+// pixels so the scales compare directly. -a gives stb_image's allocations
+// to a StbiArena that is reset after every load and prints how many it
+// asked for next to how many reached malloc. The peak RSS of the whole run
+// comes last; compare runs with and without -a. bench_image_sse2 is the same program built without
+// the AVX2 kernels, bench_image_stdio without memory mapped file loads.
+
+static double now_ms() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void jobs_parallel_for(void* user, int count, stbi_parallel_task* task, void* task_data) {
+    JobSystem* jobs = (JobSystem*)user;
+    jobs->parallel_for(0, (size_t)count, [task, task_data](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            task(task_data, (int)i);
+        }
+    }, 1);
+}
+
+static void swap_rb(unsigned char* data, size_t pixels, int channels) {
+    for (size_t i = 0; i < pixels; ++i, data += channels) {
+        std::swap(data[0], data[2]);
+    }
+}
+
+// Best effort, false where the kernel can't be asked to.
+static bool drop_page_cache(const std::string& path) {
+#if defined(POSIX_FADV_DONTNEED)
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    int result = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    return 0 == result;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+static double peak_rss_mib() {
+    rusage usage;
+    if (0 != getrusage(RUSAGE_SELF, &usage)) {
+        return 0.0;
+    }
+#if defined(__APPLE__)
+    return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+static bool read_file(const std::string& path, std::vector<unsigned char>& bytes) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    file.seekg(0, std::ios::end);
+    std::streamoff size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    bytes.resize((size_t)std::max<std::streamoff>(size, 0));
+    file.read((char*)bytes.data(), size);
+    return !bytes.empty();
+}
+
+int main(int argc, const char* argv[]) {
+    size_t max_threads = std::thread::hardware_concurrency();
+    int iterations = 10;
+    int channels_wanted = 0;
+    int dest_flags = -1;
+    bool into = false;
+    bool from_file = false;
+    bool cold = false;
+    int scale = 1;
+    bool use_arena = false;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ("-t" == arg && i + 1 < argc) {
+            max_threads = std::strtoul(argv[++i], NULL, 10);
+        } else if ("-n" == arg && i + 1 < argc) {
+            iterations = std::atoi(argv[++i]);
+        } else if ("-c" == arg && i + 1 < argc) {
+            channels_wanted = std::atoi(argv[++i]);
+        } else if ("-f" == arg && i + 1 < argc) {
+            dest_flags = std::atoi(argv[++i]);
+        } else if ("-i" == arg) {
+            into = true;
+        } else if ("-l" == arg) {
+            from_file = true;
+        } else if ("-C" == arg) {
+            from_file = true;
+            cold = true;
+        } else if ("-s" == arg && i + 1 < argc) {
+            scale = std::atoi(argv[++i]);
+        } else if ("-a" == arg) {
+            use_arena = true;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) {
+        std::cout << "usage: bench_image [-t max_threads] [-n iterations] [-c channels] [-f flags] [-i] [-l] [-C] [-s scale] [-a] files..." << std::endl;
+        return 1;
+    }
+    if (0 == max_threads) {
+        max_threads = 1;
+    }
+    if (iterations < 1) {
+        iterations = 1;
+    }
+
+    std::cout << "file\tthreads\tms\tMB/s\tMpix/s" << std::endl;
+    for (const auto& path : paths) {
+        std::vector<unsigned char> bytes;
+        if (!read_file(path, bytes)) {
+            std::cout << "Failed to read " << path << std::endl;
+            continue;
+        }
+
+        int width = 0, height = 0, channels = 0;
+        if (!stbi_info_from_memory(bytes.data(), (int)bytes.size(), &width, &height, &channels)) {
+            std::cout << "Failed to decode " << path << ": " << stbi_failure_reason() << std::endl;
+            continue;
+        }
+        double pixels = (double)width * height;
+        int out_channels = channels_wanted ? channels_wanted : channels;
+        bool deliver = into || dest_flags >= 0;
+        int flags = std::max(dest_flags, 0);
+        std::vector<unsigned char> dest_pixels(deliver ? (size_t)width * height * out_channels : 0);
+        stbi_dest dest = { dest_pixels.data(), dest_pixels.size(), 0, out_channels, flags };
+
+        for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+            // The main thread takes part, so the pool gets threads - 1 workers.
+            JobSystem jobs((int)threads - 1);
+            stbi_set_parallel_for(threads > 1 ? jobs_parallel_for : NULL, &jobs);
+
+            stbi_set_flip_vertically_on_load(!into && (flags & STBI_DEST_FLIP_VERTICALLY));
+            StbiArena& arena = StbiArena::this_thread();
+            arena.clear_stats();
+            double total = 0.0;
+            for (int i = 0; i < iterations; ++i) {
+                if (cold && !drop_page_cache(path)) {
+                    std::cout << "Can't drop " << path << " from the page cache" << std::endl;
+                    cold = false;
+                }
+
+                // One load, false when it failed.
+                auto decode = [&]() {
+                    if (into) {
+                        return 0 != (from_file
+                                ? stbi_load_into(path.c_str(), &dest, &width, &height, &channels)
+                                : stbi_load_into_from_memory(bytes.data(), (int)bytes.size(), &dest,
+                                        &width, &height, &channels));
+                    }
+
+                    unsigned char* data = from_file
+                            ? stbi_load_scaled(path.c_str(), scale, &width, &height, &channels, channels_wanted)
+                            : stbi_load_scaled_from_memory(bytes.data(), (int)bytes.size(), scale,
+                                    &width, &height, &channels, channels_wanted);
+                    if (NULL == data) {
+                        return false;
+                    }
+                    if ((flags & STBI_DEST_BGR) && out_channels >= 3) {
+                        swap_rb(data, (size_t)width * height, out_channels);
+                    }
+                    if (deliver) {
+                        size_t size = std::min(dest_pixels.size(), (size_t)width * height * out_channels);
+                        std::copy(data, data + size, dest_pixels.begin());
+                    }
+                    stbi_image_free(data);
+                    return true;
+                };
+
+                double start = now_ms();
+                bool decoded;
+                if (use_arena) {
+                    StbiArena::Scope scratch(arena);
+                    decoded = decode();
+                } else {
+                    decoded = decode();
+                }
+                total += now_ms() - start;
+                if (!decoded) {
+                    std::cout << "Failed to decode " << path << ": " << stbi_failure_reason() << std::endl;
+                    break;
+                }
+            }
+            double ms = total / iterations;
+            stbi_set_flip_vertically_on_load(0);
+
+            stbi_set_parallel_for(NULL, NULL);
+            std::cout << path << "\t" << threads << "\t" << ms
+                    << "\t" << bytes.size() / (ms * 1000.0)
+                    << "\t" << pixels / (ms * 1000.0) << std::endl;
+            if (use_arena) {
+                const StbiArena::stats_t& stats = arena.stats();
+                std::cout << "  per load: " << (double)stats.allocs / iterations << " allocs, "
+                        << (double)stats.resizes / iterations << " resizes ("
+                        << (double)stats.resized_in_place / iterations << " in place), "
+                        << stats.peak_bytes / 1024 << " KiB peak; "
+                        << stats.blocks << " mallocs for all " << iterations << std::endl;
+            }
+
+            if (threads < max_threads && threads * 2 > max_threads) {
+                threads = max_threads / 2;
+            }
+        }
+    }
+
+    std::cout << "peak RSS: " << peak_rss_mib() << " MiB" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/image_index.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+
+using namespace gofran;
+
+// ImageIndex over an asset directory for 1..N threads: a cold scan that
+// probes every file, then a rescan of the unchanged tree that only walks it.
+// Then saving and loading the index, and what sizing every image costs from
+// the index compared to probing each file with stbi_info.
+//
+//   bench_index [-t max_threads] [-o index_file] dir
+
+static double now_ms() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const char* mode, size_t threads, double ms, const ImageIndex::scan_stats_t& stats) {
+    std::cout << mode << "\t" << threads << "\t" << ms
+            << "\t" << stats.files / (ms / 1000.0)
+            << "\t" << stats.files << "\t" << stats.images
+            << "\t" << stats.probed << "\t" << stats.reused << std::endl;
+}
+
+int main(int argc, const char* argv[]) {
+    size_t max_threads = std::thread::hardware_concurrency();
+    std::string index_path = "bench_index.gidx";
+    std::string dir;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ("-t" == arg && i + 1 < argc) {
+            max_threads = std::strtoul(argv[++i], NULL, 10);
+        } else if ("-o" == arg && i + 1 < argc) {
+            index_path = argv[++i];
+        } else {
+            dir = arg;
+        }
+    }
+    if (dir.empty()) {
+        std::cout << "usage: bench_index [-t max_threads] [-o index_file] dir" << std::endl;
+        return 1;
+    }
+    if (0 == max_threads) {
+        max_threads = 1;
+    }
+
+    ImageIndex index;
+    std::cout << "mode\tthreads\tms\tfiles/s\tfiles\timages\tprobed\treused" << std::endl;
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        JobSystem jobs((int)threads - 1);
+
+        // Cold for the OS cache only the first time round.
+        index.clear();
+        double start = now_ms();
+        ImageIndex::scan_stats_t stats = index.scan(jobs, dir);
+        report("scan", threads, now_ms() - start, stats);
+
+        start = now_ms();
+        stats = index.scan(jobs, dir);
+        report("rescan", threads, now_ms() - start, stats);
+
+        if (threads < max_threads && threads * 2 > max_threads) {
+            threads = max_threads / 2;
+        }
+    }
+
+    double start = now_ms();
+    if (!index.save(index_path)) {
+        std::cout << "Failed to save " << index_path << std::endl;
+        return 1;
+    }
+    double save_ms = now_ms() - start;
+
+    ImageIndex loaded;
+    start = now_ms();
+    if (!loaded.load(index_path)) {
+        std::cout << "Failed to load " << index_path << std::endl;
+        return 1;
+    }
+    double load_ms = now_ms() - start;
+    std::cout << "save " << save_ms << " ms, load " << load_ms << " ms, "
+            << loaded.size() << " entries, "
+            << std::filesystem::file_size(index_path) << " bytes" << std::endl;
+
+    // Sizing every image, single threaded.
+    std::vector<std::string> paths;
+    std::error_code ec;
+    for (std::filesystem::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_regular_file(ec)) {
+            paths.push_back(it->path().generic_string());
+        }
+    }
+
+    size_t bytes = 0;
+    start = now_ms();
+    for (const auto& path : paths) {
+        int w = 0, h = 0, n = 0;
+        if (stbi_info(path.c_str(), &w, &h, &n)) {
+            bytes += (size_t)w * h * n;
+        }
+    }
+    double probe_ms = now_ms() - start;
+
+    size_t indexed_bytes = 0;
+    start = now_ms();
+    for (const auto& path : paths) {
+        const ImageIndexEntry* entry = loaded.find(path);
+        if (NULL != entry && entry->is_image()) {
+            indexed_bytes += entry->decoded_size();
+        }
+    }
+    double find_ms = now_ms() - start;
+
+    std::cout << "sizing " << paths.size() << " files: stbi_info " << probe_ms
+            << " ms, index " << find_ms << " ms, "
+            << (bytes == indexed_bytes ? "same" : "DIFFERENT") << " total of "
+            << indexed_bytes / (1024.0 * 1024.0) << " MiB" << std::endl;
+    return 0;
+}
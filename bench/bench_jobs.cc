@@ -0,0 +1,92 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "../src/job_system.h"
+
+using namespace gofran;
+
+// Scaling benchmark for JobSystem. Every scenario runs for 1..N threads:
+//   fine   - 1M iterations of a ~50ns body through parallel_for
+//   spawn  - 100k tiny independent jobs, stresses the deques directly
+//   coarse - 64 jobs of ~2ms each, ideal speedup is min(threads, 64)
+
+static double now_ms() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+static double spin(size_t iterations) {
+    double acc = 0.0;
+    for (size_t i = 0; i < iterations; ++i) {
+        acc += std::sqrt((double)i + acc);
+    }
+    return acc;
+}
+
+static double bench_fine(JobSystem& jobs) {
+    const size_t n = 1000000;
+    std::vector<double> out(n);
+
+    double start = now_ms();
+    jobs.parallel_for(0, n, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            out[i] = spin(8);
+        }
+    });
+    return now_ms() - start;
+}
+
+static double bench_spawn(JobSystem& jobs) {
+    const size_t n = 100000;
+    std::vector<double> out(n);
+
+    double start = now_ms();
+    JobCounter counter;
+    for (size_t i = 0; i < n; ++i) {
+        jobs.run([&out, i]() { out[i] = spin(16); }, &counter);
+    }
+    jobs.wait(&counter);
+    return now_ms() - start;
+}
+
+static double bench_coarse(JobSystem& jobs) {
+    const size_t n = 64;
+    std::vector<double> out(n);
+
+    double start = now_ms();
+    JobCounter counter;
+    for (size_t i = 0; i < n; ++i) {
+        jobs.run([&out, i]() { out[i] = spin(400000); }, &counter);
+    }
+    jobs.wait(&counter);
+    return now_ms() - start;
+}
+
+int main(int argc, const char* argv[]) {
+    size_t max_threads = std::thread::hardware_concurrency();
+    if (argc > 1) {
+        max_threads = std::strtoul(argv[1], NULL, 10);
+    }
+    if (0 == max_threads) {
+        max_threads = 1;
+    }
+
+    std::cout << "threads\tfine_ms\tspawn_ms\tcoarse_ms" << std::endl;
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        // The main thread takes part, so the pool gets threads - 1 workers.
+        JobSystem jobs((int)threads - 1);
+        std::cout << threads
+                << "\t" << bench_fine(jobs)
+                << "\t" << bench_spawn(jobs)
+                << "\t" << bench_coarse(jobs) << std::endl;
+
+        if (threads < max_threads && threads * 2 > max_threads) {
+            threads = max_threads / 2;
+        }
+    }
+
+    return 0;
+}
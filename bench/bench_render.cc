@@ -0,0 +1,510 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+#include "../src/gl_stats.h"
+#include "../src/gl_trace.h"
+#if defined(GOFRAN_HEADLESS_SOFT)
+#include "../src/gl_soft.h"
+#else
+#include "../src/gl_headless.h"
+#endif
+
+using namespace gofran;
+
+// Frame benchmark on a scene generated from the demo's textured quad:
+// objects quads spread over the frame, textures procedural textures, each
+// quad mixing two of them, and pipelines programs the quads are spread
+// over, all from a fixed seed. With -d every quad's vertices are uploaded
+// again each frame. warmup frames run first, then frames timed frames.
+//
+// Frame time is CPU time from the first call of a frame to the end of
+// end_frame(): submission and, on GLSoft, rasterization; a GPU finishes
+// later. GL calls are counted in one more frame after the timed ones, so
+// counting costs nothing in the timings. Results go to stdout as JSON, or
+// to -o; frame_hash is of the last image, equal across runs and commits as
+// long as the output is.
+//
+// bench_render runs on GLSoft, bench_render_gl on the HEADLESS backend.
+//
+//   bench_render [-s widthxheight] [-n objects] [-m textures] [-k pipelines]
+//           [-d] [-f frames] [-w warmup] [-r seed] [-t texture_size]
+//           [-j workers] [-o results.json] [-i last_frame.ppm]
+
+struct render_options {
+    int width = 800;
+
+    int height = 600;
+
+    int objects = 100;
+
+    int textures = 4;
+
+    int pipelines = 2;
+
+    bool dynamic = false;
+
+    int frames = 200;
+
+    int warmup = 10;
+
+    uint32_t seed = 1;
+
+    int texture_size = 256;
+
+    int workers = -1;
+
+    std::string output;
+
+    std::string image;
+};
+
+static const char* vertex_src =
+    "#version 330 core\n"
+    "layout (location = 0) in vec3 aPos;\n"
+    "layout (location = 1) in vec3 aColor;\n"
+    "layout (location = 2) in vec2 aTexCoord;\n"
+    "out vec3 ourColor;\n"
+    "out vec2 TexCoord;\n"
+    "void main() {\n"
+    "    gl_Position = vec4(aPos, 1.0);\n"
+    "    ourColor = aColor;\n"
+    "    TexCoord = aTexCoord;\n"
+    "}\n";
+
+// The demo's, with the mix amount a uniform set per pipeline.
+static const char* fragment_src =
+    "#version 330 core\n"
+    "out vec4 FragColor;\n"
+    "in vec3 ourColor;\n"
+    "in vec2 TexCoord;\n"
+    "uniform sampler2D texture1;\n"
+    "uniform sampler2D texture2;\n"
+    "uniform float mix_amount;\n"
+    "void main() {\n"
+    "    FragColor = mix(texture(texture1, TexCoord), texture(texture2, TexCoord), mix_amount);\n"
+    "}\n";
+
+#if defined(GOFRAN_HEADLESS_SOFT)
+static soft_program_t soft_program() {
+    soft_program_t program;
+    program.varyings = 5;
+    program.uniforms = { "texture1", "texture2", "mix_amount" };
+    program.vertex = [](const soft_vertex_in_t& in, float position[4], float* varyings) {
+        memcpy(position, in.attribs[0], 3 * sizeof(float));
+        position[3] = 1.0f;
+        memcpy(varyings, in.attribs[1], 3 * sizeof(float));
+        memcpy(varyings + 3, in.attribs[2], 2 * sizeof(float));
+    };
+    program.fragment = [](const soft_fragment_in_t& in, float rgba[4]) {
+        float texel1[4];
+        float texel2[4];
+        in.sample(in.uniforms->i[0], in.varyings[3], in.varyings[4], texel1);
+        in.sample(in.uniforms->i[1], in.varyings[3], in.varyings[4], texel2);
+        float amount = in.uniforms->f[2];
+        for (int i = 0; i < 4; ++i) {
+            rgba[i] = texel1[i] + (texel2[i] - texel1[i]) * amount;
+        }
+    };
+    return program;
+}
+#endif
+
+// mt19937 output is the same everywhere, the std distributions are not.
+class scene_random {
+public:
+    explicit scene_random(uint32_t seed) : _engine(seed) {
+    }
+
+    // [low, high)
+    float uniform(float low, float high) {
+        return low + (high - low) * (float)(_engine() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // [0, n)
+    int index(int n) {
+        return (int)(_engine() % (uint32_t)n);
+    }
+
+private:
+    std::mt19937 _engine;
+};
+
+struct object_t {
+    std::unique_ptr<GLBuffer> vbo;
+
+    std::unique_ptr<GLVertexArray> vao;
+
+    int texture1;
+
+    int texture2;
+
+    int pipeline;
+
+    float x;
+
+    float y;
+
+    float size;
+
+    float color[3];
+
+    float phase;
+};
+
+struct scene_t {
+    GLBuffer ebo;
+
+    std::vector<std::unique_ptr<GLTextures>> textures;
+
+    std::vector<std::unique_ptr<GLPipeline>> pipelines;
+
+    std::vector<object_t> objects;
+
+    scene_t() : ebo(gli_buffertype::GLI_ELEMENT_ARRAY_BUFFER) {
+    }
+};
+
+// Like the demo's vertices: position, color, texture coordinates.
+static void quad_vertices(const object_t& object, float dx, float dy, float vertices[32]) {
+    static const float corners[4][4] = {
+        { 1.0f, 1.0f, 1.0f, 1.0f },
+        { 1.0f, -1.0f, 1.0f, 0.0f },
+        { -1.0f, -1.0f, 0.0f, 0.0f },
+        { -1.0f, 1.0f, 0.0f, 1.0f },
+    };
+    for (int i = 0; i < 4; ++i) {
+        float* vertex = vertices + 8 * i;
+        vertex[0] = object.x + dx + corners[i][0] * object.size;
+        vertex[1] = object.y + dy + corners[i][1] * object.size;
+        vertex[2] = 0.0f;
+        memcpy(vertex + 3, object.color, 3 * sizeof(float));
+        vertex[6] = corners[i][2];
+        vertex[7] = corners[i][3];
+    }
+}
+
+// Where a dynamic object is in frame.
+static void animate(const object_t& object, int frame, float vertices[32]) {
+    float angle = frame * 0.05f + object.phase;
+    quad_vertices(object, 0.1f * std::cos(angle), 0.1f * std::sin(angle), vertices);
+}
+
+static bool build_scene(const render_options& options, scene_t& scene
+#if defined(GOFRAN_HEADLESS_SOFT)
+        , GLSoft& soft
+#endif
+        ) {
+    scene_random random(options.seed);
+
+    int size = options.texture_size;
+    std::vector<unsigned char> pixels((size_t)size * size * 4);
+    for (int i = 0; i < options.textures; ++i) {
+        unsigned char dark[3];
+        unsigned char light[3];
+        for (int c = 0; c < 3; ++c) {
+            dark[c] = (unsigned char)random.index(128);
+            light[c] = (unsigned char)(128 + random.index(128));
+        }
+        int cell = 4 << random.index(4);
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                const unsigned char* value = ((x / cell) + (y / cell)) % 2 ? light : dark;
+                unsigned char* pixel = &pixels[((size_t)y * size + x) * 4];
+                memcpy(pixel, value, 3);
+                pixel[3] = 255;
+            }
+        }
+
+        auto texture = std::make_unique<GLTextures>(gli_texturetype::GLI_TEXTURE_2D);
+        texture->generate();
+        texture->bind();
+        texture->set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_WRAP_S, gli_textureparams::GLI_REPEAT);
+        texture->set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_WRAP_T, gli_textureparams::GLI_REPEAT);
+        texture->set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_MIN_FILTER, gli_textureparams::GLI_LINEAR_MIPMAP_LINEAR);
+        texture->set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_MAG_FILTER, gli_textureparams::GLI_LINEAR);
+        texture->load_texture(size, size, pixels.data(), gli_pixelformat::GLI_RGBA);
+        scene.textures.push_back(std::move(texture));
+    }
+
+    for (int i = 0; i < options.pipelines; ++i) {
+        auto pipeline = std::make_unique<GLPipeline>();
+        // A different source per pipeline, so no driver shares the programs.
+        std::string vertex = vertex_src + std::string("// pipeline ") + std::to_string(i) + "\n";
+        if (gli_success != pipeline->set_vertex_shader(vertex)
+                || gli_success != pipeline->set_fragment_shader(fragment_src)
+                || gli_success != pipeline->link()) {
+            return false;
+        }
+#if defined(GOFRAN_HEADLESS_SOFT)
+        soft.set_program(*pipeline, soft_program());
+#endif
+        pipeline->use();
+        pipeline->set_uniform1("texture1", 0);
+        pipeline->set_uniform1("texture2", 1);
+        pipeline->set_uniform1("mix_amount", options.pipelines > 1 ? 0.8f * i / (options.pipelines - 1) : 0.2f);
+        scene.pipelines.push_back(std::move(pipeline));
+    }
+
+    unsigned int indices[] = { 0, 1, 3, 1, 2, 3 };
+    scene.ebo.generate();
+    scene.ebo.upload_data(indices, sizeof(indices));
+
+    for (int i = 0; i < options.objects; ++i) {
+        object_t object;
+        object.texture1 = random.index(options.textures);
+        object.texture2 = random.index(options.textures);
+        object.pipeline = random.index(options.pipelines);
+        object.size = random.uniform(0.02f, 0.2f);
+        object.x = random.uniform(-0.8f, 0.8f);
+        object.y = random.uniform(-0.8f, 0.8f);
+        for (float& c : object.color) {
+            c = random.uniform(0.0f, 1.0f);
+        }
+        object.phase = random.uniform(0.0f, 6.2831853f);
+
+        float vertices[32];
+        quad_vertices(object, 0.0f, 0.0f, vertices);
+        object.vbo = std::make_unique<GLBuffer>(gli_buffertype::GLI_ARRAY_BUFFER);
+        object.vbo->generate();
+        object.vbo->upload_data(vertices, sizeof(vertices));
+
+        object.vao = std::make_unique<GLVertexArray>();
+        object.vao->generate();
+        object.vao->bind();
+        object.vbo->bind();
+        scene.ebo.bind();
+        object.vao->set_attribute(0, 3, gli_type::GLI_FLOAT, false, 8 * sizeof(float), 0);
+        object.vao->set_attribute(1, 3, gli_type::GLI_FLOAT, false, 8 * sizeof(float), 3 * sizeof(float));
+        object.vao->set_attribute(2, 2, gli_type::GLI_FLOAT, false, 8 * sizeof(float), 6 * sizeof(float));
+        object.vao->unbind();
+        object.vbo->unbind();
+        scene.ebo.unbind();
+        scene.objects.push_back(std::move(object));
+    }
+    return GL_NO_ERROR == glGetError();
+}
+
+// In generation order, so state changes are as random as the scene.
+static void draw_frame(scene_t& scene, bool dynamic, int frame) {
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    for (object_t& object : scene.objects) {
+        if (dynamic) {
+            float vertices[32];
+            animate(object, frame, vertices);
+            object.vbo->upload_data(vertices, sizeof(vertices));
+        }
+
+        // Straight to GL, GLTextures::active() skips textures it marked bound.
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, scene.textures[object.texture1]->id());
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, scene.textures[object.texture2]->id());
+        scene.pipelines[object.pipeline]->use();
+        object.vao->bind();
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        object.vao->unbind();
+    }
+}
+
+// Nearest rank, of sorted values.
+static double percentile(const std::vector<double>& sorted, double p) {
+    size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+// Kilobytes, ru_maxrss is bytes on macOS.
+static long peak_rss_kb() {
+    struct rusage usage;
+    if (0 != getrusage(RUSAGE_SELF, &usage)) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+static bool parse_options(int argc, const char* argv[], render_options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool value = i + 1 < argc;
+        if ("-s" == arg && value) {
+            if (2 != sscanf(argv[++i], "%dx%d", &options.width, &options.height)) {
+                return false;
+            }
+        } else if ("-n" == arg && value) {
+            options.objects = std::atoi(argv[++i]);
+        } else if ("-m" == arg && value) {
+            options.textures = std::atoi(argv[++i]);
+        } else if ("-k" == arg && value) {
+            options.pipelines = std::atoi(argv[++i]);
+        } else if ("-d" == arg) {
+            options.dynamic = true;
+        } else if ("-f" == arg && value) {
+            options.frames = std::atoi(argv[++i]);
+        } else if ("-w" == arg && value) {
+            options.warmup = std::atoi(argv[++i]);
+        } else if ("-r" == arg && value) {
+            options.seed = (uint32_t)std::strtoul(argv[++i], NULL, 10);
+        } else if ("-t" == arg && value) {
+            options.texture_size = std::atoi(argv[++i]);
+        } else if ("-j" == arg && value) {
+            options.workers = std::atoi(argv[++i]);
+        } else if ("-o" == arg && value) {
+            options.output = argv[++i];
+        } else if ("-i" == arg && value) {
+            options.image = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return options.width > 0 && options.height > 0 && options.objects > 0 && options.textures > 0
+            && options.pipelines > 0 && options.frames > 0 && options.warmup >= 0 && options.texture_size > 0;
+}
+
+int main(int argc, const char* argv[]) {
+    render_options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cout << "usage: bench_render [-s widthxheight] [-n objects] [-m textures] [-k pipelines] [-d]"
+                << " [-f frames] [-w warmup] [-r seed] [-t texture_size] [-j workers]"
+                << " [-o results.json] [-i last_frame.ppm]" << std::endl;
+        return 1;
+    }
+
+#if defined(GOFRAN_HEADLESS_SOFT)
+    JobSystem jobs(options.workers);
+    GLSoft headless(jobs);
+#else
+    GLHeadless headless;
+#endif
+    // The backend reports itself on stdout, keep that for the JSON.
+    std::streambuf* stdout_buffer = std::cout.rdbuf(std::cerr.rdbuf());
+    gli_status created = headless.create(options.width, options.height);
+    std::cout.rdbuf(stdout_buffer);
+    if (gli_success != created) {
+        std::cerr << "Failed to create " << headless.backend_name() << " context" << std::endl;
+        return 1;
+    }
+
+    scene_t scene;
+    bool built =
+#if defined(GOFRAN_HEADLESS_SOFT)
+        build_scene(options, scene, headless);
+#else
+        build_scene(options, scene);
+#endif
+    if (!built) {
+        std::cerr << "Failed to build the scene" << std::endl;
+        return 1;
+    }
+
+    for (int frame = 0; frame < options.warmup; ++frame) {
+        draw_frame(scene, options.dynamic, frame);
+        headless.end_frame();
+    }
+    glFinish();
+
+    std::vector<double> frame_ms;
+    frame_ms.reserve(options.frames);
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < options.frames; ++frame) {
+        auto frame_start = std::chrono::steady_clock::now();
+        draw_frame(scene, options.dynamic, options.warmup + frame);
+        headless.end_frame();
+        frame_ms.push_back(std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - frame_start).count());
+    }
+    double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // The last timed frame again, counted.
+    GLStats stats(std::cerr, 0);
+    stats.install();
+    draw_frame(scene, options.dynamic, options.warmup + options.frames - 1);
+    headless.end_frame();
+    stats.end_frame();
+    stats.uninstall();
+    uint64_t calls = 0;
+    for (size_t i = 0; i < gl_call_count; ++i) {
+        calls += stats.frame_calls((gl_call)i);
+    }
+
+    GLenum error = glGetError();
+    if (GL_NO_ERROR != error) {
+        std::cerr << "GL error 0x" << std::hex << error << std::endl;
+        return 1;
+    }
+
+    std::vector<unsigned char> pixels;
+    if (!headless.read_pixels(pixels)) {
+        std::cerr << "Failed to read the frame" << std::endl;
+        return 1;
+    }
+    if (!options.image.empty() && gli_success != headless.write_ppm(options.image)) {
+        std::cerr << "Failed to write " << options.image << std::endl;
+        return 1;
+    }
+
+    std::vector<double> sorted = frame_ms;
+    std::sort(sorted.begin(), sorted.end());
+    double mean_ms = total_ms / options.frames;
+    char hash[32];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)gl_trace_hash(pixels.data(), pixels.size()));
+
+    std::ostringstream json;
+    json << "{\n"
+            << "  \"bench\": \"render\",\n"
+            << "  \"backend\": \"" << headless.backend_name() << "\",\n"
+            << "  \"renderer\": \"" << (const char*)glGetString(GL_RENDERER) << "\",\n"
+            << "  \"config\": {\n"
+            << "    \"width\": " << options.width << ",\n"
+            << "    \"height\": " << options.height << ",\n"
+            << "    \"objects\": " << options.objects << ",\n"
+            << "    \"textures\": " << options.textures << ",\n"
+            << "    \"pipelines\": " << options.pipelines << ",\n"
+            << "    \"dynamic\": " << (options.dynamic ? "true" : "false") << ",\n"
+            << "    \"frames\": " << options.frames << ",\n"
+            << "    \"warmup\": " << options.warmup << ",\n"
+            << "    \"seed\": " << options.seed << ",\n"
+            << "    \"texture_size\": " << options.texture_size << "\n"
+            << "  },\n"
+            << "  \"frame_ms\": {\n"
+            << "    \"min\": " << sorted.front() << ",\n"
+            << "    \"p50\": " << percentile(sorted, 50.0) << ",\n"
+            << "    \"p95\": " << percentile(sorted, 95.0) << ",\n"
+            << "    \"p99\": " << percentile(sorted, 99.0) << ",\n"
+            << "    \"max\": " << sorted.back() << ",\n"
+            << "    \"mean\": " << mean_ms << "\n"
+            << "  },\n"
+            << "  \"draws_per_frame\": " << options.objects << ",\n"
+            << "  \"draws_per_sec\": " << options.objects * 1000.0 / mean_ms << ",\n"
+            << "  \"gl_calls_per_frame\": " << calls << ",\n"
+            << "  \"peak_rss_kb\": " << peak_rss_kb() << ",\n"
+            << "  \"frame_hash\": \"" << hash << "\"\n"
+            << "}\n";
+
+    if (options.output.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream file(options.output);
+        file << json.str();
+        if (!file) {
+            std::cerr << "Failed to write " << options.output << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
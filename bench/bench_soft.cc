@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../src/gl_soft.h"
+
+using namespace gofran;
+
+// Fill rate and triangle throughput of GLSoft, on one thread and on all
+// cores: "fill" draws fullscreen quads with two bilinear textures, 8 deep;
+// "triangles" a grid of small interpolated color triangles over the whole
+// frame. Everything goes through the gl_impl.h wrappers and glad, like an
+// application would.
+//
+//   bench_soft [-s widthxheight] [-n frames] [-g grid] [-o last_frame.ppm]
+
+static double now_ms() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+static const char* vertex_src = "#version 330 core\nvoid main() {}\n";
+
+static const char* fragment_src = "#version 330 core\nvoid main() {}\n";
+
+static const int quad_layers = 8;
+
+// Position and texture coordinates.
+static soft_program_t textured_program() {
+    soft_program_t program;
+    program.varyings = 2;
+    program.uniforms = { "texture1", "texture2" };
+    program.vertex = [](const soft_vertex_in_t& in, float position[4], float* varyings) {
+        memcpy(position, in.attribs[0], 3 * sizeof(float));
+        position[3] = 1.0f;
+        memcpy(varyings, in.attribs[1], 2 * sizeof(float));
+    };
+    program.fragment = [](const soft_fragment_in_t& in, float rgba[4]) {
+        float texel1[4];
+        float texel2[4];
+        in.sample(in.uniforms->i[0], in.varyings[0], in.varyings[1], texel1);
+        in.sample(in.uniforms->i[1], in.varyings[0], in.varyings[1], texel2);
+        for (int i = 0; i < 4; ++i) {
+            rgba[i] = texel1[i] + (texel2[i] - texel1[i]) * 0.2f;
+        }
+    };
+    return program;
+}
+
+// Position and color.
+static soft_program_t color_program() {
+    soft_program_t program;
+    program.varyings = 3;
+    program.vertex = [](const soft_vertex_in_t& in, float position[4], float* varyings) {
+        memcpy(position, in.attribs[0], 3 * sizeof(float));
+        position[3] = 1.0f;
+        memcpy(varyings, in.attribs[1], 3 * sizeof(float));
+    };
+    program.fragment = [](const soft_fragment_in_t& in, float rgba[4]) {
+        memcpy(rgba, in.varyings, 3 * sizeof(float));
+        rgba[3] = 1.0f;
+    };
+    return program;
+}
+
+struct mesh_t {
+    GLBuffer vbo;
+
+    GLBuffer ebo;
+
+    GLVertexArray vao;
+
+    GLPipeline pipeline;
+
+    int indices = 0;
+
+    mesh_t() : vbo(gli_buffertype::GLI_ARRAY_BUFFER)
+            , ebo(gli_buffertype::GLI_ELEMENT_ARRAY_BUFFER) {
+    }
+};
+
+// floats per vertex: 3 position, then attribute 1.
+static bool build_mesh(GLSoft& soft, mesh_t& mesh, const std::vector<float>& vertices, int floats,
+        const std::vector<unsigned int>& indices, const soft_program_t& program) {
+    mesh.vbo.generate();
+    mesh.vbo.upload_data(vertices.data(), vertices.size() * sizeof(float));
+    mesh.ebo.generate();
+    mesh.ebo.upload_data(indices.data(), indices.size() * sizeof(unsigned int));
+    if (gli_success != mesh.pipeline.set_vertex_shader(vertex_src)
+            || gli_success != mesh.pipeline.set_fragment_shader(fragment_src)
+            || gli_success != mesh.pipeline.link()
+            || !soft.set_program(mesh.pipeline, program)) {
+        return false;
+    }
+
+    mesh.vao.generate();
+    mesh.vao.bind();
+    mesh.vbo.bind();
+    mesh.ebo.bind();
+    mesh.vao.set_attribute(0, 3, gli_type::GLI_FLOAT, false, floats * sizeof(float), 0);
+    mesh.vao.set_attribute(1, floats - 3, gli_type::GLI_FLOAT, false, floats * sizeof(float), 3 * sizeof(float));
+    mesh.vao.unbind();
+    mesh.indices = (int)indices.size();
+    return true;
+}
+
+// quad_layers fullscreen quads, each a little further into the textures.
+static bool build_quads(GLSoft& soft, mesh_t& mesh) {
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    for (int layer = 0; layer < quad_layers; ++layer) {
+        float shift = layer * 0.125f;
+        const float corners[4][5] = {
+            { 1.0f, 1.0f, 0.0f, 2.0f + shift, 2.0f },
+            { 1.0f, -1.0f, 0.0f, 2.0f + shift, 0.0f },
+            { -1.0f, -1.0f, 0.0f, shift, 0.0f },
+            { -1.0f, 1.0f, 0.0f, shift, 2.0f },
+        };
+        unsigned int base = (unsigned int)vertices.size() / 5;
+        for (const auto& corner : corners) {
+            vertices.insert(vertices.end(), corner, corner + 5);
+        }
+        for (unsigned int index : { 0, 1, 3, 1, 2, 3 }) {
+            indices.push_back(base + index);
+        }
+    }
+    return build_mesh(soft, mesh, vertices, 5, indices, textured_program());
+}
+
+// grid x grid cells of two triangles each.
+static bool build_grid(GLSoft& soft, mesh_t& mesh, int grid) {
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    for (int y = 0; y <= grid; ++y) {
+        for (int x = 0; x <= grid; ++x) {
+            float u = (float)x / grid;
+            float v = (float)y / grid;
+            float vertex[6] = { u * 2.0f - 1.0f, v * 2.0f - 1.0f, 0.0f, u, v, 1.0f - u };
+            vertices.insert(vertices.end(), vertex, vertex + 6);
+        }
+    }
+    for (int y = 0; y < grid; ++y) {
+        for (int x = 0; x < grid; ++x) {
+            unsigned int i = y * (grid + 1) + x;
+            unsigned int cell[6] = { i, i + 1, i + grid + 1, i + 1, i + grid + 2, i + grid + 1 };
+            indices.insert(indices.end(), cell, cell + 6);
+        }
+    }
+    return build_mesh(soft, mesh, vertices, 6, indices, color_program());
+}
+
+static std::vector<unsigned char> checker(int size, int cell, unsigned char dark, unsigned char light) {
+    std::vector<unsigned char> pixels((size_t)size * size * 4);
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            unsigned char value = ((x / cell) + (y / cell)) % 2 ? light : dark;
+            unsigned char* pixel = &pixels[((size_t)y * size + x) * 4];
+            pixel[0] = value;
+            pixel[1] = (unsigned char)(x * 255 / size);
+            pixel[2] = (unsigned char)(y * 255 / size);
+            pixel[3] = 255;
+        }
+    }
+    return pixels;
+}
+
+static void load_texture(GLTextures& texture, const std::vector<unsigned char>& pixels, int size) {
+    texture.generate();
+    texture.bind();
+    texture.set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_WRAP_S, gli_textureparams::GLI_REPEAT);
+    texture.set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_WRAP_T, gli_textureparams::GLI_REPEAT);
+    texture.set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_MIN_FILTER, gli_textureparams::GLI_LINEAR);
+    texture.set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_MAG_FILTER, gli_textureparams::GLI_LINEAR);
+    texture.load_texture(size, size, pixels.data(), gli_pixelformat::GLI_RGBA);
+}
+
+static void draw(mesh_t& mesh) {
+    mesh.pipeline.use();
+    mesh.vao.bind();
+    glDrawElements(GL_TRIANGLES, mesh.indices, GL_UNSIGNED_INT, 0);
+    mesh.vao.unbind();
+}
+
+static void report(const char* name, const GLSoft& soft, int frames, double ms) {
+    const GLSoft::stats_t& stats = soft.stats();
+    double work_ms = stats.setup_ms + stats.raster_ms;
+    printf("%-10s %9.3f ms/frame %9.1f Mpixels/s %9.3f Mtriangles/s  setup %6.1f%%\n",
+            name, ms / frames, stats.pixels / (ms * 1e3), stats.triangles / (ms * 1e3),
+            work_ms > 0.0 ? 100.0 * stats.setup_ms / work_ms : 0.0);
+}
+
+// workers as for JobSystem, -1 for all cores.
+static bool run(int workers, int width, int height, int frames, int grid, const std::string& output) {
+    JobSystem jobs(workers);
+    GLSoft soft(jobs);
+    if (gli_success != soft.create(width, height)) {
+        return false;
+    }
+
+    GLTextures texture1(gli_texturetype::GLI_TEXTURE_2D);
+    GLTextures texture2(gli_texturetype::GLI_TEXTURE_2D);
+    load_texture(texture1, checker(256, 32, 40, 220), 256);
+    load_texture(texture2, checker(256, 8, 0, 255), 256);
+
+    mesh_t quads;
+    mesh_t cells;
+    if (!build_quads(soft, quads) || !build_grid(soft, cells, grid)) {
+        std::cout << "Failed to build the scene" << std::endl;
+        return false;
+    }
+    quads.pipeline.use();
+    quads.pipeline.set_uniform1("texture1", 0);
+    quads.pipeline.set_uniform1("texture2", 1);
+
+    std::cout << jobs.thread_count() << " threads, " << width << "x" << height << ", " << frames
+            << " frames" << std::endl;
+
+    // A frame first, for allocations and caches.
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    texture1.active(0);
+    texture2.active(1);
+    glClear(GL_COLOR_BUFFER_BIT);
+    draw(quads);
+    soft.end_frame();
+
+    soft.clear_stats();
+    double start = now_ms();
+    for (int frame = 0; frame < frames; ++frame) {
+        glClear(GL_COLOR_BUFFER_BIT);
+        draw(quads);
+        soft.end_frame();
+    }
+    report("fill", soft, frames, now_ms() - start);
+
+    soft.clear_stats();
+    start = now_ms();
+    for (int frame = 0; frame < frames; ++frame) {
+        glClear(GL_COLOR_BUFFER_BIT);
+        draw(cells);
+        soft.end_frame();
+    }
+    report("triangles", soft, frames, now_ms() - start);
+
+    if (!soft.errors().empty()) {
+        std::cout << "GL errors: " << soft.errors().front() << std::endl;
+        return false;
+    }
+    if (!output.empty() && gli_success != soft.write_ppm(output)) {
+        std::cout << "Failed to write " << output << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, const char* argv[]) {
+    int width = 1280;
+    int height = 720;
+    int frames = 20;
+    int grid = 256;
+    std::string output;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ("-s" == arg && i + 1 < argc) {
+            if (2 != sscanf(argv[++i], "%dx%d", &width, &height)) {
+                width = 0;
+            }
+        } else if ("-n" == arg && i + 1 < argc) {
+            frames = std::atoi(argv[++i]);
+        } else if ("-g" == arg && i + 1 < argc) {
+            grid = std::atoi(argv[++i]);
+        } else if ("-o" == arg && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            width = 0;
+        }
+    }
+    if (width <= 0 || height <= 0 || frames <= 0 || grid <= 0) {
+        std::cout << "usage: bench_soft [-s widthxheight] [-n frames] [-g grid] [-o last_frame.ppm]" << std::endl;
+        return 1;
+    }
+
+    // The single threaded run first, its image is overwritten by the next.
+    if (!run(0, width, height, frames, grid, output) || !run(-1, width, height, frames, grid, output)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stddef.h>
+
+#include "gl_impl.h"
+#include "job_system.h"
+#include "../stb_image.h"
+
+namespace gofran {
+
+// Plays an animated GIF from a GLI_TEXTURE_2D_ARRAY. Frames are decoded
+// ahead on a pool thread with stbi_gif_stream, one at a time, into a ring of
+// window() buffers, and each one is uploaded into the array layer of its
+// slot. Only the window is ever resident, on either side of the bus, no
+// matter how many frames the file has; the animation loops.
+//
+// Everything but the decoding runs on the render thread: call update() once
+// per frame and sample layer() of texture().
+class GifPlayer {
+public:
+    GifPlayer(JobSystem& jobs, size_t window = 8) : _jobs(jobs)
+            , _stream(NULL)
+            , _width(0)
+            , _height(0)
+            , _slots(window < 2 ? 2 : window)
+            , _next_decode(0)
+            , _decoding(false)
+            , _failed(false)
+            , _current(-1)
+            , _shown_at(0.0) {
+    }
+
+    ~GifPlayer() {
+        // The decode job uses the stream and the slots.
+        _jobs.wait(&_decode_counter);
+        stbi_gif_stream_close(_stream);
+    }
+
+private:
+    GifPlayer(const GifPlayer&) = delete;
+
+    GifPlayer* operator=(const GifPlayer&) = delete;
+
+public:
+    // Render thread only. Allocates the ring and starts decoding.
+    gli_status open(const std::string& path) {
+        if (NULL != _stream) {
+            return gli_regenerate;
+        }
+
+        _stream = stbi_gif_stream_open(path.c_str(), &_width, &_height);
+        if (NULL == _stream) {
+            std::cout << "Failed to open gif " << path << ": " << stbi_failure_reason() << std::endl;
+            return gli_io_failed;
+        }
+
+        for (auto& slot : _slots) {
+            slot.pixels.reset(new unsigned char[(size_t)_width * _height * 4]);
+        }
+
+        _texture = std::make_shared<GLTextures>(gli_texturetype::GLI_TEXTURE_2D_ARRAY);
+        _texture->generate();
+        _texture->bind();
+        _texture->set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_MIN_FILTER, gli_textureparams::GLI_LINEAR);
+        _texture->set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_MAG_FILTER, gli_textureparams::GLI_LINEAR);
+        _texture->allocate_layers(_width, _height, (int)_slots.size(), gli_pixelformat::GLI_RGBA);
+        _texture->unbind();
+
+        kick_decode();
+        return gli_success;
+    }
+
+    // Render thread only. Uploads decoded frames and moves on to the next
+    // frame once the current one has been shown for its delay. Returns the
+    // layer to sample, -1 before the first frame is ready.
+    int update(double now_ms) {
+        if (NULL == _stream) {
+            return -1;
+        }
+
+        // The decoder never touches a decoded slot, so uploads run unlocked.
+        std::vector<size_t> decoded;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (size_t i = 0; i < _slots.size(); ++i) {
+                if (slot_t::SLOT_DECODED == _slots[i].state) {
+                    decoded.push_back(i);
+                }
+            }
+        }
+        if (!decoded.empty()) {
+            _texture->bind();
+            for (size_t i : decoded) {
+                _texture->load_layer((int)i, _width, _height, _slots[i].pixels.get(), gli_pixelformat::GLI_RGBA);
+            }
+            _texture->unbind();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (size_t i : decoded) {
+                _slots[i].state = slot_t::SLOT_UPLOADED;
+            }
+
+            int next = (_current + 1) % (int)_slots.size();
+            bool next_ready = slot_t::SLOT_UPLOADED == _slots[next].state;
+            if (_current < 0) {
+                if (next_ready) {
+                    _current = next;
+                    _shown_at = now_ms;
+                }
+            } else if (next_ready && now_ms - _shown_at >= delay_ms(_slots[_current])) {
+                // Catch up without drifting, unless far behind (a stall).
+                _shown_at += delay_ms(_slots[_current]);
+                if (now_ms - _shown_at > 1000.0) {
+                    _shown_at = now_ms;
+                }
+                _slots[_current].state = slot_t::SLOT_FREE;
+                _current = next;
+            }
+        }
+
+        kick_decode();
+        return _current;
+    }
+
+    inline const std::shared_ptr<GLTextures>& texture() const {
+        return _texture;
+    }
+
+    inline int layer() const {
+        return _current;
+    }
+
+    inline int width() const {
+        return _width;
+    }
+
+    inline int height() const {
+        return _height;
+    }
+
+    inline size_t window() const {
+        return _slots.size();
+    }
+
+    // Whether decoding stopped on a corrupt frame. Frames decoded before
+    // keep playing.
+    inline bool failed() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _failed;
+    }
+
+private:
+    struct slot_t {
+        enum state_t {
+            SLOT_FREE,
+            SLOT_DECODING,
+            SLOT_DECODED,
+            SLOT_UPLOADED,
+        };
+
+        std::unique_ptr<unsigned char[]> pixels;
+
+        // Milliseconds.
+        int delay = 0;
+
+        state_t state = SLOT_FREE;
+    };
+
+    // GIFs with no delay mean "as fast as possible", browsers use 100ms.
+    static double delay_ms(const slot_t& slot) {
+        return slot.delay > 10 ? slot.delay : 100.0;
+    }
+
+    void kick_decode() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_decoding || _failed || NULL == _stream || slot_t::SLOT_FREE != _slots[_next_decode].state) {
+                return;
+            }
+            _decoding = true;
+        }
+
+        _jobs.run([this]() { decode_frames(); }, &_decode_counter);
+    }
+
+    // Pool thread, at most one at a time. Fills free slots in order.
+    void decode_frames() {
+        for (;;) {
+            slot_t* slot = NULL;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (slot_t::SLOT_FREE != _slots[_next_decode].state) {
+                    _decoding = false;
+                    return;
+                }
+                slot = &_slots[_next_decode];
+                slot->state = slot_t::SLOT_DECODING;
+            }
+
+            int delay = 0;
+            int res = stbi_gif_stream_next(_stream, slot->pixels.get(), 0, &delay);
+            if (0 == res && stbi_gif_stream_rewind(_stream)) {
+                res = stbi_gif_stream_next(_stream, slot->pixels.get(), 0, &delay);
+            }
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (1 != res) {
+                slot->state = slot_t::SLOT_FREE;
+                _failed = true;
+                _decoding = false;
+                return;
+            }
+            slot->delay = delay;
+            slot->state = slot_t::SLOT_DECODED;
+            _next_decode = (_next_decode + 1) % _slots.size();
+        }
+    }
+
+private:
+    JobSystem& _jobs;
+
+    stbi_gif_stream* _stream;
+
+    int _width;
+
+    int _height;
+
+    std::vector<slot_t> _slots;
+
+    // Slot the decoder fills next; frames go round the ring in order.
+    size_t _next_decode;
+
+    bool _decoding;
+
+    bool _failed;
+
+    int _current;
+
+    double _shown_at;
+
+    std::shared_ptr<GLTextures> _texture;
+
+    JobCounter _decode_counter;
+
+    mutable std::mutex _mutex;
+};
+
+}
@@ -0,0 +1,469 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "gl_impl.h"
+#include "job_system.h"
+#include "pixel_convert.h"
+#include "startup_profiler.h"
+#include "../stb_image.h"
+
+namespace gofran {
+
+template<typename T>
+class Task;
+
+namespace detail {
+
+// Tasks start eagerly, so creating several before awaiting any of them lets
+// them run concurrently. _state is either empty, the address of the one
+// coroutine awaiting the task, or one of the two markers below.
+class task_promise_base {
+public:
+    struct final_awaiter {
+        bool await_ready() noexcept {
+            return false;
+        }
+
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+            task_promise_base& promise = h.promise();
+            void* prev = promise._state.exchange(done_marker(), std::memory_order_acq_rel);
+            if (prev == detached_marker()) {
+                h.destroy();
+                return std::noop_coroutine();
+            }
+
+            if (NULL != prev) {
+                return std::coroutine_handle<>::from_address(prev);
+            }
+
+            return std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {
+        }
+    };
+
+    std::suspend_never initial_suspend() noexcept {
+        return {};
+    }
+
+    final_awaiter final_suspend() noexcept {
+        return {};
+    }
+
+    void unhandled_exception() {
+        std::terminate();
+    }
+
+    inline bool is_done() const {
+        return _state.load(std::memory_order_acquire) == done_marker();
+    }
+
+    // False when the task already finished and the awaiter should not
+    // suspend at all.
+    bool set_continuation(std::coroutine_handle<> waiter) {
+        void* expected = NULL;
+        return _state.compare_exchange_strong(expected, waiter.address(),
+                std::memory_order_acq_rel, std::memory_order_acquire);
+    }
+
+    // True when the frame already finished and the caller has to destroy it,
+    // otherwise it destroys itself at the end.
+    bool detach() {
+        return _state.exchange(detached_marker(), std::memory_order_acq_rel) == done_marker();
+    }
+
+private:
+    static void* done_marker() {
+        static char marker;
+        return &marker;
+    }
+
+    static void* detached_marker() {
+        static char marker;
+        return &marker;
+    }
+
+private:
+    std::atomic<void*> _state { NULL };
+};
+
+template<typename T>
+class task_promise : public task_promise_base {
+public:
+    Task<T> get_return_object() noexcept;
+
+    template<typename U>
+    void return_value(U&& value) {
+        _value.emplace(std::forward<U>(value));
+    }
+
+    T& result() {
+        return *_value;
+    }
+
+private:
+    std::optional<T> _value;
+};
+
+template<>
+class task_promise<void> : public task_promise_base {
+public:
+    Task<void> get_return_object() noexcept;
+
+    void return_void() noexcept {
+    }
+
+    void result() {
+    }
+};
+
+}
+
+template<typename T>
+class Task {
+public:
+    typedef detail::task_promise<T> promise_type;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : _handle(handle) {
+    }
+
+    Task(Task&& other) noexcept : _handle(std::exchange(other._handle, nullptr)) {
+    }
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            release();
+            _handle = std::exchange(other._handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~Task() {
+        release();
+    }
+
+private:
+    Task(const Task&) = delete;
+
+    Task* operator=(const Task&) = delete;
+
+public:
+    inline bool is_ready() const {
+        return _handle && _handle.promise().is_done();
+    }
+
+    // Only valid once is_ready() returned true.
+    decltype(auto) get() {
+        return _handle.promise().result();
+    }
+
+    bool await_ready() const noexcept {
+        return is_ready();
+    }
+
+    bool await_suspend(std::coroutine_handle<> waiter) noexcept {
+        return _handle.promise().set_continuation(waiter);
+    }
+
+    // Moves the result out, a task is awaited once.
+    decltype(auto) await_resume() {
+        if constexpr (std::is_void_v<T>) {
+            return;
+        } else {
+            return std::move(_handle.promise().result());
+        }
+    }
+
+private:
+    void release() {
+        if (_handle && _handle.promise().detach()) {
+            _handle.destroy();
+        }
+        _handle = nullptr;
+    }
+
+private:
+    std::coroutine_handle<promise_type> _handle;
+};
+
+namespace detail {
+
+template<typename T>
+Task<T> task_promise<T>::get_return_object() noexcept {
+    return Task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this));
+}
+
+inline Task<void> task_promise<void>::get_return_object() noexcept {
+    return Task<void>(std::coroutine_handle<task_promise<void>>::from_promise(*this));
+}
+
+}
+
+// co_await resume_on_worker(jobs) continues the coroutine on a pool thread,
+// co_await resume_on_render(jobs) on the main thread the next time it runs
+// main-affine jobs.
+struct resume_on_worker {
+    JobSystem& jobs;
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> h) const {
+        jobs.run([h]() { h.resume(); });
+    }
+
+    void await_resume() const noexcept {
+    }
+};
+
+// Always suspends, even on the main thread, so code queued before the
+// context exists only runs once the render loop pumps main-affine jobs.
+struct resume_on_render {
+    JobSystem& jobs;
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> h) const {
+        jobs.run_on_main([h]() { h.resume(); });
+    }
+
+    void await_resume() const noexcept {
+    }
+};
+
+// Decoded pixels, owned until uploaded.
+struct DecodedImage {
+    struct deleter {
+        void operator()(unsigned char* data) const {
+            stbi_image_free(data);
+        }
+    };
+
+    std::string path;
+
+    int width = 0;
+
+    int height = 0;
+
+    int channels = 0;
+
+    gli_pixelformat format = gli_pixelformat::GLI_RGBA;
+
+    std::unique_ptr<unsigned char, deleter> data;
+};
+
+// Awaitable asset loading. Disk reads and decodes run on workers, every GL
+// call runs on the render thread, which must keep calling
+// JobSystem::run_main_jobs() (or wait on the task) for loads to finish.
+// Reads and decodes never touch GL, so they may start before the context
+// exists; GL steps simply queue until the render thread starts pumping.
+//
+// While a loader exists stb_image splits large decodes over the pool too.
+// The stb hook is process wide, so only one loader should be alive at a time.
+class AssetLoader {
+public:
+    explicit AssetLoader(JobSystem& jobs) : _jobs(jobs)
+            , _profiler(NULL) {
+        stbi_set_parallel_for(&AssetLoader::stbi_parallel_for, &_jobs);
+    }
+
+    ~AssetLoader() {
+        stbi_set_parallel_for(NULL, NULL);
+    }
+
+private:
+    AssetLoader(const AssetLoader&) = delete;
+
+    AssetLoader* operator=(const AssetLoader&) = delete;
+
+public:
+
+    inline void set_profiler(StartupProfiler* profiler) {
+        _profiler = profiler;
+    }
+
+    // A max_size above zero decodes JPEGs straight to a reduced size, by a
+    // factor of 2, 4 or 8, until the longer side fits (or the factor runs
+    // out). Other formats always decode at full size. Radiance HDR files
+    // become GLI_RGBA16F pixels.
+    Task<DecodedImage> decode_image(std::string path, int max_size = 0) {
+        co_await resume_on_worker{ _jobs };
+
+        DecodedImage image;
+        image.path = path;
+
+        std::vector<unsigned char> bytes;
+        {
+            StartupProfiler::Phase phase(_profiler, "read " + path);
+            read_file(path, bytes);
+        }
+
+        if (!bytes.empty() && stbi_is_hdr_from_memory(bytes.data(), (int)bytes.size())) {
+            // Halves take half the memory of stb's floats and cover the
+            // range of RGBE. The conversion runs in place, row after row:
+            // split over threads, later rows would overwrite floats earlier
+            // ones still have to read.
+            StartupProfiler::Phase phase(_profiler, "decode " + path);
+            int channels_in_file = 0;
+            float* pixels = stbi_loadf_from_memory(bytes.data(), (int)bytes.size(),
+                    &image.width, &image.height, &channels_in_file, STBI_rgb_alpha);
+            if (NULL != pixels) {
+                float_to_half(pixels, (uint16_t*)pixels, (size_t)image.width * image.height * 4);
+            }
+            image.data.reset((unsigned char*)pixels);
+            image.channels = image.data ? 4 : 0;
+            image.format = gli_pixelformat::GLI_RGBA16F;
+        } else if (!bytes.empty()) {
+            // Always RGBA: it uploads as GL_RGBA8 without row alignment
+            // concerns, and 4:2:0 JPEGs take stb's fused RGBA path.
+            StartupProfiler::Phase phase(_profiler, "decode " + path);
+            int channels_in_file = 0;
+            int scale = pick_scale(bytes, max_size);
+            image.data.reset(stbi_load_scaled_from_memory(bytes.data(), (int)bytes.size(), scale,
+                    &image.width, &image.height, &channels_in_file, STBI_rgb_alpha));
+            image.channels = image.data ? 4 : 0;
+        }
+
+        co_return image;
+    }
+
+    // Render thread only.
+    std::shared_ptr<GLTextures> upload_texture(const DecodedImage& image) {
+        StartupProfiler::Phase phase(_profiler, "upload " + image.path);
+
+        auto texture = std::make_shared<GLTextures>(gli_texturetype::GLI_TEXTURE_2D);
+        texture->generate();
+        texture->bind();
+        texture->set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_WRAP_S, gli_textureparams::GLI_REPEAT);
+        texture->set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_WRAP_T, gli_textureparams::GLI_REPEAT);
+        texture->set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_MIN_FILTER, gli_textureparams::GLI_LINEAR);
+        texture->set_tex_parameteri(gli_texturesymbol::GLI_TEXTURE_MAG_FILTER, gli_textureparams::GLI_LINEAR);
+        if (image.data) {
+            texture->load_texture(image.width, image.height, image.data.get(), image.format);
+        } else {
+            std::cout << "Failed to load texture " << image.path << std::endl;
+        }
+        texture->unbind();
+
+        return texture;
+    }
+
+    Task<std::shared_ptr<GLTextures>> load_texture(std::string path, int max_size = 0) {
+        DecodedImage image = co_await decode_image(path, max_size);
+
+        co_await resume_on_render{ _jobs };
+
+        co_return upload_texture(image);
+    }
+
+    // Render thread only.
+    std::shared_ptr<GLPipeline> build_pipeline(const std::string& vs, const std::string& fs) {
+        StartupProfiler::Phase phase(_profiler, "compile pipeline");
+
+        auto pipeline = std::make_shared<GLPipeline>();
+        pipeline->set_vertex_shader(vs);
+        pipeline->set_fragment_shader(fs);
+        pipeline->link();
+
+        return pipeline;
+    }
+
+    Task<std::shared_ptr<GLPipeline>> compile_pipeline(std::string vs_path, std::string fs_path) {
+        Task<std::string> vs_src = read_text(vs_path);
+        Task<std::string> fs_src = read_text(fs_path);
+
+        std::string vs = co_await vs_src;
+        std::string fs = co_await fs_src;
+
+        co_await resume_on_render{ _jobs };
+
+        co_return build_pipeline(vs, fs);
+    }
+
+    Task<std::string> read_text(std::string path) {
+        co_await resume_on_worker{ _jobs };
+
+        StartupProfiler::Phase phase(_profiler, "read " + path);
+        std::string src;
+        if (gli_success != GLShader::read_file(path, src)) {
+            std::cout << "Failed to read " << path << std::endl;
+        }
+        co_return src;
+    }
+
+    // Blocks the calling thread, running main-affine jobs and helping the
+    // workers, until the task finishes.
+    template<typename T>
+    decltype(auto) wait(Task<T>& task) {
+        _jobs.wait_until([&task]() { return task.is_ready(); });
+        return task.get();
+    }
+
+    inline JobSystem& jobs() {
+        return _jobs;
+    }
+
+private:
+    static void stbi_parallel_for(void* user, int count, stbi_parallel_task* task, void* task_data) {
+        JobSystem* jobs = (JobSystem*)user;
+        jobs->parallel_for(0, (size_t)count, [task, task_data](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                task(task_data, (int)i);
+            }
+        }, 1);
+    }
+
+    static int pick_scale(const std::vector<unsigned char>& bytes, int max_size) {
+        int w = 0, h = 0, comp = 0;
+        if (max_size <= 0 || !stbi_info_from_memory(bytes.data(), (int)bytes.size(), &w, &h, &comp)) {
+            return 1;
+        }
+
+        int scale = 1;
+        while (scale < 8 && std::max(w, h) > max_size * scale) {
+            scale *= 2;
+        }
+        return scale;
+    }
+
+    static void read_file(const std::string& path, std::vector<unsigned char>& bytes) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            return;
+        }
+
+        file.seekg(0, std::ios::end);
+        std::streamoff size = file.tellg();
+        file.seekg(0, std::ios::beg);
+        if (size <= 0) {
+            return;
+        }
+
+        bytes.resize((size_t)size);
+        file.read((char*)bytes.data(), size);
+        bytes.resize((size_t)file.gcount());
+    }
+
+private:
+    JobSystem& _jobs;
+
+    StartupProfiler* _profiler;
+};
+
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace gofran {
+
+// One value per entry point of gl_entrypoints.h, for tools that count or
+// record GL calls.
+enum class gl_call : uint16_t {
+#define GOFRAN_GL_ENTRYPOINT(ret, name, params, args) name,
+#include "gl_entrypoints.h"
+    COUNT
+};
+
+static const size_t gl_call_count = (size_t)gl_call::COUNT;
+
+// "glBindBuffer" for gl_call::BindBuffer.
+inline const char* gl_call_name(gl_call call) {
+    static const char* const names[] = {
+#define GOFRAN_GL_ENTRYPOINT(ret, name, params, args) "gl" #name,
+#include "gl_entrypoints.h"
+    };
+
+    return (size_t)call < gl_call_count ? names[(size_t)call] : "gl?";
+}
+
+}
@@ -0,0 +1,394 @@
+#pragma once
+
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+#include <string.h>
+
+#include "gl_trace.h"
+
+namespace gofran {
+
+// Records the GL calls of a range of frames into a trace file, for
+// GLReplay. install() swaps the glad function pointers of every entry point
+// in gl_entrypoints.h for stubs that forward to the ones loaded before, so
+// it goes after gladLoadGLLoader (or GLMock::install()) and before the
+// code to capture.
+//
+// Calls are recorded from open() until the last frame of the range has
+// ended, including the frames before the range: a trace has to create the
+// objects its frames use, and GLReplay runs everything before the range as
+// setup. Calls from other threads, like GLLoader uploads, are recorded in
+// the order they ran and are replayed on one context; while open, GL calls
+// are serialized on a mutex. Client memory is only known for the calls that
+// gl_trace.h documents, e.g. glDrawElements with client side indices is not
+// supported.
+class GLCapture {
+public:
+    GLCapture() : _installed(false)
+            , _capturing(false)
+            , _first_frame(0)
+            , _end_frame(0)
+            , _frame(0)
+            , _calls(0)
+            , _payloads(0)
+            , _payload_bytes(0)
+            , _reused_bytes(0)
+            , _file_bytes(0) {
+    }
+
+    ~GLCapture() {
+        close();
+        uninstall();
+    }
+
+private:
+    GLCapture(const GLCapture&) = delete;
+
+    GLCapture* operator=(const GLCapture&) = delete;
+
+public:
+    void install() {
+        if (_installed) {
+            return;
+        }
+
+        current() = this;
+#define GOFRAN_GL_ENTRYPOINT(ret, name, params, args) \
+        _real.name = glad_gl##name; \
+        glad_gl##name = &GLCapture::stub_##name;
+#include "gl_entrypoints.h"
+        _installed = true;
+    }
+
+    // Puts back the pointers install() found.
+    void uninstall() {
+        if (!_installed) {
+            return;
+        }
+
+        close();
+#define GOFRAN_GL_ENTRYPOINT(ret, name, params, args) glad_gl##name = _real.name;
+#include "gl_entrypoints.h"
+        _installed = false;
+        if (this == current()) {
+            current() = NULL;
+        }
+    }
+
+    // Starts recording into path. Frames count from 0 at open(), the range
+    // is frames [first_frame, first_frame + frames).
+    gli_status open(const std::string& path, uint32_t first_frame = 0, uint32_t frames = UINT32_MAX) {
+        if (!_installed) {
+            return gli_uninitialize;
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_capturing) {
+            return gli_regenerate;
+        }
+
+        _file.open(path, std::ios::binary | std::ios::trunc);
+        if (!_file) {
+            return gli_io_failed;
+        }
+
+        _first_frame = first_frame;
+        _end_frame = frames > UINT32_MAX - first_frame ? UINT32_MAX : first_frame + frames;
+        _frame = 0;
+        _calls = _payloads = _payload_bytes = _reused_bytes = _file_bytes = 0;
+        _payload_ids.clear();
+
+        _out.clear();
+        _out.write_bytes("GTRC", 4);
+        _out.write_varint(gl_trace_version);
+        _out.write_varint(first_frame);
+        _out.write_varint(gl_call_count);
+        for (size_t i = 0; i < gl_call_count; ++i) {
+            _out.write_string(gl_call_name((gl_call)i));
+        }
+        _capturing.store(true);
+        return gli_success;
+    }
+
+    // Call where the frame is presented. Closes the trace after the last
+    // frame of the range.
+    void end_frame() {
+        if (!_capturing.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        bool last = false;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _out.write_varint(TRACE_FRAME);
+            _out.write_varint(_frame);
+            last = ++_frame >= _end_frame;
+        }
+        if (last) {
+            close();
+        }
+    }
+
+    gli_status close() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_capturing) {
+            return gli_notgenerate;
+        }
+
+        _capturing.store(false);
+        _out.write_varint(TRACE_END);
+        flush();
+        _file.close();
+        return _file ? gli_success : gli_io_failed;
+    }
+
+    inline bool is_capturing() const {
+        return _capturing.load(std::memory_order_relaxed);
+    }
+
+    inline uint32_t frame() const {
+        return _frame;
+    }
+
+    inline uint64_t calls() const {
+        return _calls;
+    }
+
+    // Distinct payloads written, and their bytes.
+    inline uint64_t payloads() const {
+        return _payloads;
+    }
+
+    inline uint64_t payload_bytes() const {
+        return _payload_bytes;
+    }
+
+    // Payload bytes that were already in the trace and cost only an id.
+    inline uint64_t reused_bytes() const {
+        return _reused_bytes;
+    }
+
+    inline uint64_t file_bytes() const {
+        return _file_bytes + _out.size();
+    }
+
+private:
+    template<gl_call C>
+    using call_tag = std::integral_constant<gl_call, C>;
+
+    struct procs_t {
+#define GOFRAN_GL_ENTRYPOINT(ret, name, params, args) decltype(glad_gl##name) name;
+#include "gl_entrypoints.h"
+    };
+
+    static GLCapture*& current() {
+        static GLCapture* capture = NULL;
+        return capture;
+    }
+
+    // The stubs take the arguments through a callable so the X-macro can
+    // pass them as written in gl_entrypoints.h.
+    template<gl_call C, typename R, typename... P>
+    struct call_t {
+        GLCapture* capture;
+
+        R (APIENTRYP fn)(P...);
+
+        inline R operator()(P... args) const {
+            return capture->call<C>(fn, args...);
+        }
+    };
+
+    template<gl_call C, typename R, typename... P>
+    static call_t<C, R, P...> bind_call(GLCapture* capture, R (APIENTRYP fn)(P...)) {
+        return call_t<C, R, P...>{ capture, fn };
+    }
+
+#define GOFRAN_GL_ENTRYPOINT(ret, name, params, args) \
+    static ret APIENTRY stub_##name params { \
+        GLCapture* capture = current(); \
+        return bind_call<gl_call::name>(capture, capture->_real.name) args; \
+    }
+#include "gl_entrypoints.h"
+
+    template<gl_call C, typename R, typename... P>
+    R call(R (APIENTRYP fn)(P...), P... args) {
+        if (!_capturing.load(std::memory_order_relaxed)) {
+            return fn(args...);
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_capturing.load(std::memory_order_relaxed)) {
+            return fn(args...);
+        }
+
+        _record.clear();
+        _record.write_varint((uint32_t)C);
+        (_record.write(args), ...);
+        ++_calls;
+        if constexpr (std::is_void_v<R>) {
+            fn(args...);
+            payload(call_tag<C>(), args...);
+            commit();
+        } else {
+            R result = fn(args...);
+            _record.write(result);
+            payload(call_tag<C>(), args...);
+            commit();
+            return result;
+        }
+    }
+
+    // What a call reads from or writes to client memory, after its result.
+    // Most calls have nothing.
+    template<gl_call C, typename... P>
+    void payload(call_tag<C>, P...) {
+    }
+
+    void payload(call_tag<gl_call::BufferData>, GLenum, GLsizeiptr size, const void* data, GLenum) {
+        write_payload(data, size);
+    }
+
+    void payload(call_tag<gl_call::DeleteBuffers>, GLsizei n, const GLuint* buffers) {
+        write_names(n, buffers);
+    }
+
+    void payload(call_tag<gl_call::DeleteTextures>, GLsizei n, const GLuint* textures) {
+        write_names(n, textures);
+    }
+
+    void payload(call_tag<gl_call::DeleteVertexArrays>, GLsizei n, const GLuint* arrays) {
+        write_names(n, arrays);
+    }
+
+    void payload(call_tag<gl_call::GenBuffers>, GLsizei n, GLuint* buffers) {
+        write_names(n, buffers);
+    }
+
+    void payload(call_tag<gl_call::GenTextures>, GLsizei n, GLuint* textures) {
+        write_names(n, textures);
+    }
+
+    void payload(call_tag<gl_call::GenVertexArrays>, GLsizei n, GLuint* arrays) {
+        write_names(n, arrays);
+    }
+
+    void payload(call_tag<gl_call::GetUniformLocation>, GLuint, const GLchar* name) {
+        write_payload(name, strlen(name));
+    }
+
+    // All strings as one source.
+    void payload(call_tag<gl_call::ShaderSource>, GLuint, GLsizei count, const GLchar* const* string,
+            const GLint* length) {
+        std::string src;
+        for (GLsizei i = 0; i < count; ++i) {
+            if (NULL == length || length[i] < 0) {
+                src += string[i];
+            } else {
+                src.append(string[i], length[i]);
+            }
+        }
+        write_payload(src.data(), src.size());
+    }
+
+    void payload(call_tag<gl_call::TexImage2D>, GLenum, GLint, GLint, GLsizei width, GLsizei height,
+            GLint, GLenum format, GLenum type, const void* pixels) {
+        write_payload(pixels, gl_image_bytes(width, height, 1, format, type));
+    }
+
+    void payload(call_tag<gl_call::TexImage3D>, GLenum, GLint, GLint, GLsizei width, GLsizei height,
+            GLsizei depth, GLint, GLenum format, GLenum type, const void* pixels) {
+        write_payload(pixels, gl_image_bytes(width, height, depth, format, type));
+    }
+
+    void payload(call_tag<gl_call::TexSubImage3D>, GLenum, GLint, GLint, GLint, GLint, GLsizei width,
+            GLsizei height, GLsizei depth, GLenum format, GLenum type, const void* pixels) {
+        write_payload(pixels, gl_image_bytes(width, height, depth, format, type));
+    }
+
+    void write_names(GLsizei n, const GLuint* names) {
+        for (GLsizei i = 0; i < n; ++i) {
+            _record.write(names[i]);
+        }
+    }
+
+    // Writes new payloads straight to the output, ahead of the call record
+    // that refers to them.
+    void write_payload(const void* data, uint64_t size) {
+        if (NULL == data) {
+            _record.write_varint(0);
+            return;
+        }
+
+        // Same hash and size is taken as same bytes.
+        uint64_t key = gl_trace_hash(data, size) ^ (size * 0xc2b2ae3d27d4eb4full);
+        auto it = _payload_ids.find(key);
+        if (_payload_ids.end() != it) {
+            _reused_bytes += size;
+            _record.write_varint(it->second);
+            return;
+        }
+
+        uint64_t id = ++_payloads;
+        _payload_ids.emplace(key, id);
+        _payload_bytes += size;
+        _out.write_varint(TRACE_PAYLOAD);
+        _out.write_varint(size);
+        _out.write_bytes(data, size);
+        _record.write_varint(id);
+    }
+
+    void commit() {
+        _out.append(_record);
+        if (_out.size() >= (1 << 20)) {
+            flush();
+        }
+    }
+
+    void flush() {
+        _file.write((const char*)_out.bytes().data(), _out.size());
+        _file_bytes += _out.size();
+        _out.clear();
+    }
+
+private:
+    procs_t _real;
+
+    bool _installed;
+
+    std::atomic<bool> _capturing;
+
+    std::mutex _mutex;
+
+    std::ofstream _file;
+
+    uint32_t _first_frame;
+
+    uint32_t _end_frame;
+
+    uint32_t _frame;
+
+    // Buffered output, flushed to _file every MiB.
+    GLTraceWriter _out;
+
+    // The call being recorded.
+    GLTraceWriter _record;
+
+    std::unordered_map<uint64_t, uint64_t> _payload_ids;
+
+    uint64_t _calls;
+
+    uint64_t _payloads;
+
+    uint64_t _payload_bytes;
+
+    uint64_t _reused_bytes;
+
+    uint64_t _file_bytes;
+};
+
+}
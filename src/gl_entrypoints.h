@@ -0,0 +1,59 @@
+// Every GL entry point the gl_impl.h wrappers, the loaders and the demo call,
+// plus what gladLoadGLLoader needs to find the version. One line per entry
+// point, for code generated with an X-macro:
+//
+//   GOFRAN_GL_ENTRYPOINT(return type, name without "gl", (parameters), (arguments))
+//
+// Define GOFRAN_GL_ENTRYPOINT, then include this file; it is undefined again
+// at the end. No include guard, every expansion includes it again. Keep the
+// list sorted, and add entry points here when the wrappers start using them.
+
+GOFRAN_GL_ENTRYPOINT(void, ActiveTexture, (GLenum texture), (texture))
+GOFRAN_GL_ENTRYPOINT(void, AttachShader, (GLuint program, GLuint shader), (program, shader))
+GOFRAN_GL_ENTRYPOINT(void, BindBuffer, (GLenum target, GLuint buffer), (target, buffer))
+GOFRAN_GL_ENTRYPOINT(void, BindTexture, (GLenum target, GLuint texture), (target, texture))
+GOFRAN_GL_ENTRYPOINT(void, BindVertexArray, (GLuint array), (array))
+GOFRAN_GL_ENTRYPOINT(void, BufferData, (GLenum target, GLsizeiptr size, const void* data, GLenum usage), (target, size, data, usage))
+GOFRAN_GL_ENTRYPOINT(void, Clear, (GLbitfield mask), (mask))
+GOFRAN_GL_ENTRYPOINT(void, ClearColor, (GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha), (red, green, blue, alpha))
+GOFRAN_GL_ENTRYPOINT(GLenum, ClientWaitSync, (GLsync sync, GLbitfield flags, GLuint64 timeout), (sync, flags, timeout))
+GOFRAN_GL_ENTRYPOINT(void, CompileShader, (GLuint shader), (shader))
+GOFRAN_GL_ENTRYPOINT(GLuint, CreateProgram, (void), ())
+GOFRAN_GL_ENTRYPOINT(GLuint, CreateShader, (GLenum type), (type))
+GOFRAN_GL_ENTRYPOINT(void, DeleteBuffers, (GLsizei n, const GLuint* buffers), (n, buffers))
+GOFRAN_GL_ENTRYPOINT(void, DeleteProgram, (GLuint program), (program))
+GOFRAN_GL_ENTRYPOINT(void, DeleteShader, (GLuint shader), (shader))
+GOFRAN_GL_ENTRYPOINT(void, DeleteSync, (GLsync sync), (sync))
+GOFRAN_GL_ENTRYPOINT(void, DeleteTextures, (GLsizei n, const GLuint* textures), (n, textures))
+GOFRAN_GL_ENTRYPOINT(void, DeleteVertexArrays, (GLsizei n, const GLuint* arrays), (n, arrays))
+GOFRAN_GL_ENTRYPOINT(void, DrawElements, (GLenum mode, GLsizei count, GLenum type, const void* indices), (mode, count, type, indices))
+GOFRAN_GL_ENTRYPOINT(void, EnableVertexAttribArray, (GLuint index), (index))
+GOFRAN_GL_ENTRYPOINT(GLsync, FenceSync, (GLenum condition, GLbitfield flags), (condition, flags))
+GOFRAN_GL_ENTRYPOINT(void, Finish, (void), ())
+GOFRAN_GL_ENTRYPOINT(void, Flush, (void), ())
+GOFRAN_GL_ENTRYPOINT(void, GenBuffers, (GLsizei n, GLuint* buffers), (n, buffers))
+GOFRAN_GL_ENTRYPOINT(void, GenTextures, (GLsizei n, GLuint* textures), (n, textures))
+GOFRAN_GL_ENTRYPOINT(void, GenVertexArrays, (GLsizei n, GLuint* arrays), (n, arrays))
+GOFRAN_GL_ENTRYPOINT(void, GenerateMipmap, (GLenum target), (target))
+GOFRAN_GL_ENTRYPOINT(GLenum, GetError, (void), ())
+GOFRAN_GL_ENTRYPOINT(void, GetIntegerv, (GLenum pname, GLint* data), (pname, data))
+GOFRAN_GL_ENTRYPOINT(void, GetProgramInfoLog, (GLuint program, GLsizei buf_size, GLsizei* length, GLchar* log), (program, buf_size, length, log))
+GOFRAN_GL_ENTRYPOINT(void, GetProgramiv, (GLuint program, GLenum pname, GLint* params), (program, pname, params))
+GOFRAN_GL_ENTRYPOINT(void, GetShaderInfoLog, (GLuint shader, GLsizei buf_size, GLsizei* length, GLchar* log), (shader, buf_size, length, log))
+GOFRAN_GL_ENTRYPOINT(void, GetShaderiv, (GLuint shader, GLenum pname, GLint* params), (shader, pname, params))
+GOFRAN_GL_ENTRYPOINT(const GLubyte*, GetString, (GLenum name), (name))
+GOFRAN_GL_ENTRYPOINT(const GLubyte*, GetStringi, (GLenum name, GLuint index), (name, index))
+GOFRAN_GL_ENTRYPOINT(GLint, GetUniformLocation, (GLuint program, const GLchar* name), (program, name))
+GOFRAN_GL_ENTRYPOINT(void, LinkProgram, (GLuint program), (program))
+GOFRAN_GL_ENTRYPOINT(void, ShaderSource, (GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length), (shader, count, string, length))
+GOFRAN_GL_ENTRYPOINT(void, TexImage2D, (GLenum target, GLint level, GLint internal_format, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels), (target, level, internal_format, width, height, border, format, type, pixels))
+GOFRAN_GL_ENTRYPOINT(void, TexImage3D, (GLenum target, GLint level, GLint internal_format, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const void* pixels), (target, level, internal_format, width, height, depth, border, format, type, pixels))
+GOFRAN_GL_ENTRYPOINT(void, TexParameteri, (GLenum target, GLenum pname, GLint param), (target, pname, param))
+GOFRAN_GL_ENTRYPOINT(void, TexSubImage3D, (GLenum target, GLint level, GLint x, GLint y, GLint z, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void* pixels), (target, level, x, y, z, width, height, depth, format, type, pixels))
+GOFRAN_GL_ENTRYPOINT(void, Uniform1f, (GLint location, GLfloat v0), (location, v0))
+GOFRAN_GL_ENTRYPOINT(void, Uniform1i, (GLint location, GLint v0), (location, v0))
+GOFRAN_GL_ENTRYPOINT(void, UseProgram, (GLuint program), (program))
+GOFRAN_GL_ENTRYPOINT(void, VertexAttribPointer, (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer), (index, size, type, normalized, stride, pointer))
+GOFRAN_GL_ENTRYPOINT(void, Viewport, (GLint x, GLint y, GLsizei width, GLsizei height), (x, y, width, height))
+
+#undef GOFRAN_GL_ENTRYPOINT
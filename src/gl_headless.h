@@ -0,0 +1,318 @@
+#pragma once
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <string.h>
+
+#include "gl_impl.h"
+
+#if defined(GOFRAN_HEADLESS_EGL)
+// Surfaceless needs no window system, keep X11 out of eglplatform.h.
+#ifndef EGL_NO_X11
+#define EGL_NO_X11
+#endif
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#elif defined(GOFRAN_HEADLESS_OSMESA)
+#include <GL/osmesa.h>
+#else
+#error "gl_headless.h needs GOFRAN_HEADLESS_EGL or GOFRAN_HEADLESS_OSMESA"
+#endif
+
+namespace gofran {
+
+// GL 3.3 core context without a window, for build and CI hosts with no
+// display or GPU: EGL on the Mesa surfaceless platform (llvmpipe when there
+// is no GPU), or OSMesa. The backend is picked at build time with the
+// HEADLESS CMake option. Rendering goes to an RGBA8 + depth/stencil FBO of
+// the requested size, which stays bound as the draw framebuffer, so code
+// written for the default framebuffer of a window works unchanged.
+class GLHeadless {
+public:
+    GLHeadless() : _width(0)
+            , _height(0)
+            , _fbo(0)
+            , _color(0)
+            , _depth(0)
+#if defined(GOFRAN_HEADLESS_EGL)
+            , _display(EGL_NO_DISPLAY)
+            , _context(EGL_NO_CONTEXT)
+#else
+            , _context(NULL)
+#endif
+    {
+    }
+
+    ~GLHeadless() {
+        destroy();
+    }
+
+private:
+    GLHeadless(const GLHeadless&) = delete;
+
+    GLHeadless* operator=(const GLHeadless&) = delete;
+
+public:
+    static const char* backend_name() {
+#if defined(GOFRAN_HEADLESS_EGL)
+        return "egl surfaceless";
+#else
+        return "osmesa";
+#endif
+    }
+
+    // Creates the context, makes it current on the calling thread, loads the
+    // GL entry points through glad with the backend's proc address function
+    // and binds the FBO.
+    gli_status create(int width, int height) {
+        if (is_created()) {
+            return gli_regenerate;
+        }
+
+        if (!create_context()) {
+            destroy();
+            return gli_uninitialize;
+        }
+
+        if (!gladLoadGLLoader(proc_address_loader())) {
+            std::cout << "GLHeadless: failed to load GL with " << backend_name() << std::endl;
+            destroy();
+            return gli_uninitialize;
+        }
+
+        _width = width;
+        _height = height;
+
+        glGenRenderbuffers(1, &_color);
+        glBindRenderbuffer(GL_RENDERBUFFER, _color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glGenRenderbuffers(1, &_depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, _depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &_fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _color);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, _depth);
+        if (GL_FRAMEBUFFER_COMPLETE != glCheckFramebufferStatus(GL_FRAMEBUFFER)) {
+            std::cout << "GLHeadless: incomplete framebuffer" << std::endl;
+            destroy();
+            return gli_notgenerate;
+        }
+        glViewport(0, 0, width, height);
+
+        std::cout << "GLHeadless: " << backend_name() << ", " << glGetString(GL_RENDERER)
+                << ", GL " << glGetString(GL_VERSION) << std::endl;
+        return gli_success;
+    }
+
+    void destroy() {
+        if (0 != _fbo) {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glDeleteFramebuffers(1, &_fbo);
+            glDeleteRenderbuffers(1, &_color);
+            glDeleteRenderbuffers(1, &_depth);
+            _fbo = _color = _depth = 0;
+        }
+
+#if defined(GOFRAN_HEADLESS_EGL)
+        if (EGL_NO_DISPLAY != _display) {
+            eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (EGL_NO_CONTEXT != _context) {
+                eglDestroyContext(_display, _context);
+            }
+            eglTerminate(_display);
+        }
+        _display = EGL_NO_DISPLAY;
+        _context = EGL_NO_CONTEXT;
+#else
+        if (NULL != _context) {
+            OSMesaDestroyContext(_context);
+            _context = NULL;
+        }
+#endif
+        _width = _height = 0;
+    }
+
+    inline bool is_created() const {
+        return 0 != _fbo;
+    }
+
+    inline int width() const {
+        return _width;
+    }
+
+    inline int height() const {
+        return _height;
+    }
+
+    inline unsigned int fbo() const {
+        return _fbo;
+    }
+
+    // Rebinds the FBO, for code that bound another framebuffer.
+    void bind() {
+        glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+        glViewport(0, 0, _width, _height);
+    }
+
+    // Where a window would swap buffers: nobody presents the frame, so this
+    // only flushes to bound the amount of queued work.
+    void end_frame() {
+        glFlush();
+    }
+
+    // RGBA8, top row first. Waits for rendering to finish.
+    bool read_pixels(std::vector<unsigned char>& pixels) {
+        if (!is_created()) {
+            return false;
+        }
+
+        size_t row = (size_t)_width * 4;
+        pixels.resize(row * _height);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, _fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+        std::vector<unsigned char> temp(row);
+        for (int y = 0; y < _height / 2; ++y) {
+            unsigned char* top = pixels.data() + y * row;
+            unsigned char* bottom = pixels.data() + (_height - 1 - y) * row;
+            memcpy(temp.data(), top, row);
+            memcpy(top, bottom, row);
+            memcpy(bottom, temp.data(), row);
+        }
+        return true;
+    }
+
+    // The current frame as a binary PPM, to look at what CI rendered.
+    gli_status write_ppm(const std::string& path) {
+        std::vector<unsigned char> pixels;
+        if (!read_pixels(pixels)) {
+            return gli_notgenerate;
+        }
+
+        std::ofstream file(path, std::ios::binary);
+        file << "P6\n" << _width << " " << _height << "\n255\n";
+        for (size_t i = 0; i < pixels.size(); i += 4) {
+            file.write((const char*)&pixels[i], 3);
+        }
+        return file ? gli_success : gli_io_failed;
+    }
+
+private:
+#if defined(GOFRAN_HEADLESS_EGL)
+    bool create_context() {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+                (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (NULL != get_platform_display) {
+            _display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        }
+        if (EGL_NO_DISPLAY == _display) {
+            std::cout << "GLHeadless: no EGL surfaceless platform" << std::endl;
+            return false;
+        }
+
+        EGLint major = 0;
+        EGLint minor = 0;
+        if (!eglInitialize(_display, &major, &minor)) {
+            std::cout << "GLHeadless: eglInitialize failed, 0x" << std::hex << eglGetError() << std::dec << std::endl;
+            eglTerminate(_display);
+            _display = EGL_NO_DISPLAY;
+            return false;
+        }
+
+        // No surface is ever created; the default would ask for windows.
+        const EGLint config_attribs[] = {
+            EGL_SURFACE_TYPE, 0,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLConfig config = NULL;
+        EGLint configs = 0;
+        if (!eglChooseConfig(_display, config_attribs, &config, 1, &configs) || 0 == configs) {
+            std::cout << "GLHeadless: no desktop GL config" << std::endl;
+            return false;
+        }
+
+        const EGLint context_attribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        eglBindAPI(EGL_OPENGL_API);
+        _context = eglCreateContext(_display, config, EGL_NO_CONTEXT, context_attribs);
+        if (EGL_NO_CONTEXT == _context) {
+            std::cout << "GLHeadless: no GL 3.3 core context, 0x" << std::hex << eglGetError() << std::dec << std::endl;
+            return false;
+        }
+
+        // EGL_KHR_surfaceless_context: current without any surface, all
+        // drawing goes to the FBO.
+        if (!eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, _context)) {
+            std::cout << "GLHeadless: eglMakeCurrent failed, 0x" << std::hex << eglGetError() << std::dec << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    static GLADloadproc proc_address_loader() {
+        return (GLADloadproc)eglGetProcAddress;
+    }
+#else
+    bool create_context() {
+        const int attribs[] = {
+            OSMESA_FORMAT, OSMESA_RGBA,
+            OSMESA_DEPTH_BITS, 0,
+            OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+            OSMESA_CONTEXT_MAJOR_VERSION, 3,
+            OSMESA_CONTEXT_MINOR_VERSION, 3,
+            0
+        };
+        _context = OSMesaCreateContextAttribs(attribs, NULL);
+        if (NULL == _context) {
+            std::cout << "GLHeadless: no OSMesa GL 3.3 core context" << std::endl;
+            return false;
+        }
+
+        // OSMesa always wants a client buffer; a single pixel is enough as
+        // nothing draws to it.
+        if (!OSMesaMakeCurrent(_context, _client_pixel, GL_UNSIGNED_BYTE, 1, 1)) {
+            std::cout << "GLHeadless: OSMesaMakeCurrent failed" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    static GLADloadproc proc_address_loader() {
+        return (GLADloadproc)OSMesaGetProcAddress;
+    }
+#endif
+
+private:
+    int _width;
+
+    int _height;
+
+    unsigned int _fbo;
+
+    unsigned int _color;
+
+    unsigned int _depth;
+
+#if defined(GOFRAN_HEADLESS_EGL)
+    EGLDisplay _display;
+
+    EGLContext _context;
+#else
+    OSMesaContext _context;
+
+    unsigned char _client_pixel[4];
+#endif
+};
+
+}
@@ -5,6 +5,10 @@
 #include <fstream>
 #include <sstream>
 #include <typeinfo>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <stdint.h>
 
 #include <glad/glad.h>
 #include "GLFW/glfw3.h"
@@ -51,6 +55,7 @@ enum class gli_buffertype {
 
 enum class gli_texturetype {
     GLI_TEXTURE_2D,
+    GLI_TEXTURE_2D_ARRAY,
     GLI_UNKNOWN_TEXTURETYPE
 };
 
@@ -73,6 +78,10 @@ enum class gli_textureparams {
 enum class gli_pixelformat {
     GLI_RGB,
     GLI_RGBA,
+    // Half float RGBA, pixels from float_to_half().
+    GLI_RGBA16F,
+    // Packed unsigned floats, pixels from float_to_r11g11b10().
+    GLI_R11F_G11F_B10F,
 };
 
 class GLShader {
@@ -95,6 +104,19 @@ public:
     gli_status set_file(const gli_shadertype& type,
             const std::string& path) {
         _type = type;
+        gli_status res = read_file(path, _src);
+        if (gli_success != res) {
+            return res;
+        }
+
+        std::cout << _src << std::endl;
+
+        return gli_success;
+    }
+
+    // Touches no GL state, so sources can be read on any thread and handed
+    // to set_src() on the render thread.
+    static gli_status read_file(const std::string& path, std::string& src) {
         std::ifstream shader_file;
         shader_file.open(path);
         if (!shader_file) {
@@ -105,9 +127,7 @@ public:
         shader_stream << shader_file.rdbuf();
         shader_file.close();
 
-        _src = shader_stream.str();
-        std::cout << _src << std::endl;
-
+        src = shader_stream.str();
         return gli_success;
     }
 
@@ -217,7 +237,14 @@ public:
         glGetProgramiv(_id, GL_LINK_STATUS, &success);
         if (!success) {
             glGetProgramInfoLog(_id, 1024, NULL, infoLog);
+            return gli_compile_shader;
         }
+
+        return gli_success;
+    }
+
+    inline unsigned int id() const {
+        return _id;
     }
 
     inline int use() {
@@ -232,11 +259,13 @@ public:
     inline gli_status set_uniform1(const std::string &name, int value) {
         // TODO: Set
         glUniform1i(glGetUniformLocation(_id, name.c_str()), value);
+        return gli_success;
     }
 
     inline gli_status set_uniform1(const std::string &name, float value) {
         // TODO: Set
         glUniform1f(glGetUniformLocation(_id, name.c_str()), value);
+        return gli_success;
     }
 
 private:
@@ -247,10 +276,198 @@ private:
     unsigned int _id;
 };
 
+// glfence
+class GLFence {
+public:
+    GLFence() : _sync(NULL) {
+    }
+
+    ~GLFence() {
+        reset();
+    }
+
+    GLFence(GLFence&& other) : _sync(other._sync) {
+        other._sync = NULL;
+    }
+
+    GLFence& operator=(GLFence&& other) {
+        if (this != &other) {
+            reset();
+            _sync = other._sync;
+            other._sync = NULL;
+        }
+        return *this;
+    }
+
+private:
+    GLFence(const GLFence&) = delete;
+
+    GLFence* operator=(const GLFence&) = delete;
+
+public:
+    gli_status insert() {
+        reset();
+        _sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        if (NULL == _sync) {
+            return gli_notgenerate;
+        }
+
+        return gli_success;
+    }
+
+    // Never blocks. A fence that was never inserted counts as signaled, and
+    // so does a failed wait, otherwise callers would poll it forever.
+    bool is_signaled() const {
+        if (NULL == _sync) {
+            return true;
+        }
+
+        GLenum res = glClientWaitSync(_sync, 0, 0);
+        return GL_TIMEOUT_EXPIRED != res;
+    }
+
+    bool wait(uint64_t timeout_ns) const {
+        if (NULL == _sync) {
+            return true;
+        }
+
+        GLenum res = glClientWaitSync(_sync, GL_SYNC_FLUSH_COMMANDS_BIT, timeout_ns);
+        return GL_TIMEOUT_EXPIRED != res;
+    }
+
+    void reset() {
+        if (NULL != _sync) {
+            glDeleteSync(_sync);
+            _sync = NULL;
+        }
+    }
+
+    inline bool is_valid() const {
+        return NULL != _sync;
+    }
+
+private:
+    GLsync _sync;
+};
+
+// gltimeline
+// Records a fence at the end of every frame. Frame numbers start at 1, a
+// frame is retired once the GPU has passed its fence, and frames retire in
+// order. Objects deleted while a frame that used them is still in flight are
+// kept alive until that frame retires.
+class GLTimeline {
+public:
+    typedef std::function<void()> deleter_fn;
+
+    GLTimeline() : _frame(1)
+            , _retired(0) {
+    }
+
+    ~GLTimeline() {
+        finish();
+    }
+
+private:
+    GLTimeline(const GLTimeline&) = delete;
+
+    GLTimeline* operator=(const GLTimeline&) = delete;
+
+public:
+    inline uint64_t current_frame() const {
+        return _frame;
+    }
+
+    inline uint64_t retired_frame() const {
+        return _retired;
+    }
+
+    void end_frame() {
+        in_flight f;
+        f.frame = _frame;
+        f.fence.insert();
+        _in_flight.push_back(std::move(f));
+        ++_frame;
+
+        retire();
+    }
+
+    bool is_retired(uint64_t frame) {
+        if (frame > _retired) {
+            retire();
+        }
+
+        return frame <= _retired;
+    }
+
+    void defer_delete(uint64_t frame, const deleter_fn& fn) {
+        if (is_retired(frame)) {
+            fn();
+            return;
+        }
+
+        _deletions.push_back(deletion{ frame, fn });
+    }
+
+    // Blocks until every recorded frame retired, then runs the pending
+    // deletions. Only meant for shutdown or context loss.
+    void finish() {
+        while (!_in_flight.empty()) {
+            _in_flight.front().fence.wait(UINT64_MAX);
+            _retired = _in_flight.front().frame;
+            _in_flight.pop_front();
+        }
+        _retired = _frame;
+
+        collect();
+    }
+
+private:
+    struct in_flight {
+        uint64_t frame;
+
+        GLFence fence;
+    };
+
+    struct deletion {
+        uint64_t frame;
+
+        deleter_fn fn;
+    };
+
+    void retire() {
+        while (!_in_flight.empty() && _in_flight.front().fence.is_signaled()) {
+            _retired = _in_flight.front().frame;
+            _in_flight.pop_front();
+        }
+
+        collect();
+    }
+
+    void collect() {
+        while (!_deletions.empty() && _deletions.front().frame <= _retired) {
+            _deletions.front().fn();
+            _deletions.pop_front();
+        }
+    }
+
+private:
+    uint64_t _frame;
+
+    uint64_t _retired;
+
+    std::deque<in_flight> _in_flight;
+
+    // Sorted by frame, deletions are always queued for a frame that is not
+    // older than the ones before it.
+    std::deque<deletion> _deletions;
+};
+
 class GLTypeImpl {
 public:
     GLTypeImpl() : _id(0)
             , _nums(0)
+            , _timeline(NULL)
+            , _last_frame(0)
             , _is_binded(false) {
     }
 
@@ -275,6 +492,7 @@ public:
 
     inline void set_isbinded() {
         _is_binded = true;
+        mark_used();
     }
 
     inline void set_notbinded() {
@@ -285,7 +503,40 @@ public:
         return _id;
     }
 
+    // Objects attached to a timeline remember the last frame they were bound
+    // in and release their GL names only once that frame has retired.
+    inline void set_timeline(GLTimeline* timeline) {
+        _timeline = timeline;
+        mark_used();
+    }
+
+    // For objects used without being bound, e.g. buffers drawn through a
+    // vertex array.
+    inline void mark_used() {
+        if (NULL != _timeline) {
+            _last_frame = _timeline->current_frame();
+        }
+    }
+
+    inline uint64_t last_frame() const {
+        return _last_frame;
+    }
+
+    inline bool is_idle() const {
+        return NULL == _timeline || _timeline->is_retired(_last_frame);
+    }
+
 protected:
+    void release(const GLTimeline::deleter_fn& fn) {
+        if (NULL != _timeline) {
+            _timeline->defer_delete(_last_frame, fn);
+        } else {
+            fn();
+        }
+        _id = 0;
+    }
+
+
     static unsigned int type_2_gltype(const gli_type& type) {
         GLI_CONVERT(type, FLOAT)
 
@@ -305,6 +556,10 @@ protected:
 
     size_t _nums;
 
+    GLTimeline* _timeline;
+
+    uint64_t _last_frame;
+
 private:
     bool _is_binded;
 };
@@ -325,6 +580,12 @@ public:
     }
 
 public:
+    // Buffers the vertex array reads from, marked used each time it is
+    // bound. They must outlive it.
+    inline void attach(GLTypeImpl& buffer) {
+        _buffers.push_back(&buffer);
+    }
+
     virtual gli_status generate(size_t n = 1) override {
         if (is_generated()) {
             // TODO: print log
@@ -352,6 +613,10 @@ public:
             return gli_notgenerate;
         }
 
+        for (GLTypeImpl* buffer : _buffers) {
+            buffer->mark_used();
+        }
+
         if (is_binded()) {
             // TODO: print log
             return gli_rebind;
@@ -394,6 +659,9 @@ public:
 
         return gli_success;
     }
+
+private:
+    std::vector<GLTypeImpl*> _buffers;
 };
 
 // glbuffer
@@ -402,7 +670,11 @@ public:
     GLBuffer(const gli_buffertype& type) : _type(type) {
     }
 
-    ~GLBuffer() = default;
+    ~GLBuffer() {
+        if (is_generated()) {
+            this->remove();
+        }
+    }
 
 public:
     virtual gli_status generate(size_t n = 1) override {
@@ -422,7 +694,11 @@ public:
             return gli_notgenerate;
         }
 
-        glDeleteBuffers(_nums, &_id);
+        unsigned int id = _id;
+        size_t nums = _nums;
+        release([id, nums]() {
+            glDeleteBuffers(nums, &id);
+        });
         return gli_success;
     }
 
@@ -455,7 +731,8 @@ public:
             return gli_notbind;
         }
 
-        glBindBuffer(0, 0);
+        auto buffer_type = buffertype_2_glbuffertype(_type);
+        glBindBuffer(buffer_type, 0);
 
         set_notbinded();
         return gli_success;
@@ -473,6 +750,21 @@ public:
         return gli_success;
     }
 
+    // Fill the buffer through GL_COPY_WRITE_BUFFER, which is not vertex array
+    // state, so it also works on a loader context with no VAO bound.
+    template<typename T>
+    int upload_data(const T* data, size_t size) const {
+        if (!is_generated()) {
+            return gli_uninited;
+        }
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, _id);
+        glBufferData(GL_COPY_WRITE_BUFFER, size, data, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        return gli_success;
+    }
+
 private:
     static unsigned int buffertype_2_glbuffertype(const gli_buffertype& type) {
         GLI_CONVERT(buffertype, ARRAY_BUFFER)
@@ -491,7 +783,11 @@ public:
     GLTextures(const gli_texturetype& type) : _type(type) {
     }
 
-    ~GLTextures() = default;
+    ~GLTextures() {
+        if (is_generated()) {
+            this->remove();
+        }
+    }
     
 #define GLI_TEXTURE_LOCATION(n) GL_TEXTURE##n
 
@@ -513,7 +809,11 @@ public:
             return gli_notgenerate;
         }
 
-        glDeleteTextures(_nums, &_id);
+        unsigned int id = _id;
+        size_t nums = _nums;
+        release([id, nums]() {
+            glDeleteTextures(nums, &id);
+        });
         return gli_success;
     }
     
@@ -563,26 +863,59 @@ public:
             return gli_notbind;
         }
 
-        glBindTexture(0, 0);
+        auto type = texturetype_2_gltexturetype(_type);
+        glBindTexture(type, 0);
         set_notbinded();
         return gli_success;
     }
 
     gli_status load_texture(int width, int height,
-            const unsigned char* data, const gli_pixelformat& type) {
+            const void* data, const gli_pixelformat& type) {
         if (!is_generated() || !is_binded()) {
             return gli_uninited;
         }
 
         auto texture_type = texturetype_2_gltexturetype(_type);
         // TODO: Modify params later
-        auto pixel_type = pixelformat_2_glpixelformat(type);
-        glTexImage2D(texture_type, 0, pixel_type, width, height, 0, pixel_type, GL_UNSIGNED_BYTE, data);
+        auto internal_format = pixelformat_2_glpixelformat(type);
+        auto pixel_format = pixelformat_2_gldataformat(type);
+        auto data_type = pixelformat_2_gldatatype(type);
+        glTexImage2D(texture_type, 0, internal_format, width, height, 0, pixel_format, data_type, data);
         glGenerateMipmap(texture_type);
 
         return gli_success;
     }
 
+    // GLI_TEXTURE_2D_ARRAY: storage for layers images of one size, filled
+    // with load_layer(). No mipmaps, layers usually change every frame.
+    gli_status allocate_layers(int width, int height, int layers, const gli_pixelformat& type) {
+        if (!is_generated() || !is_binded()) {
+            return gli_uninited;
+        }
+
+        auto texture_type = texturetype_2_gltexturetype(_type);
+        auto internal_format = pixelformat_2_glpixelformat(type);
+        auto pixel_format = pixelformat_2_gldataformat(type);
+        auto data_type = pixelformat_2_gldatatype(type);
+        glTexImage3D(texture_type, 0, internal_format, width, height, layers, 0, pixel_format, data_type, NULL);
+
+        return gli_success;
+    }
+
+    gli_status load_layer(int layer, int width, int height,
+            const void* data, const gli_pixelformat& type) {
+        if (!is_generated() || !is_binded()) {
+            return gli_uninited;
+        }
+
+        auto texture_type = texturetype_2_gltexturetype(_type);
+        auto pixel_format = pixelformat_2_gldataformat(type);
+        auto data_type = pixelformat_2_gldatatype(type);
+        glTexSubImage3D(texture_type, 0, 0, 0, layer, width, height, 1, pixel_format, data_type, data);
+
+        return gli_success;
+    }
+
     gli_status set_tex_parameteri(const gli_texturesymbol& symbol,
             const gli_textureparams& param) {
         if (!is_generated() || !is_binded()) {
@@ -600,6 +933,7 @@ public:
 private:
     static unsigned int texturetype_2_gltexturetype(const gli_texturetype& type) {
         GLI_CONVERT(texturetype, TEXTURE_2D)
+        GLI_CONVERT(texturetype, TEXTURE_2D_ARRAY)
 
         return 0;
     }
@@ -625,10 +959,35 @@ private:
     static unsigned int pixelformat_2_glpixelformat(const gli_pixelformat& type) {
         GLI_CONVERT(pixelformat, RGB)
         GLI_CONVERT(pixelformat, RGBA)
+        GLI_CONVERT(pixelformat, RGBA16F)
+        GLI_CONVERT(pixelformat, R11F_G11F_B10F)
 
         return 0;
     }
 
+    // Layout of the pixels handed to load_texture().
+    static unsigned int pixelformat_2_gldataformat(const gli_pixelformat& type) {
+        if (type == gli_pixelformat::GLI_RGBA16F) {
+            return GL_RGBA;
+        }
+        if (type == gli_pixelformat::GLI_R11F_G11F_B10F) {
+            return GL_RGB;
+        }
+
+        return pixelformat_2_glpixelformat(type);
+    }
+
+    static unsigned int pixelformat_2_gldatatype(const gli_pixelformat& type) {
+        if (type == gli_pixelformat::GLI_RGBA16F) {
+            return GL_HALF_FLOAT;
+        }
+        if (type == gli_pixelformat::GLI_R11F_G11F_B10F) {
+            return GL_UNSIGNED_INT_10F_11F_11F_REV;
+        }
+
+        return GL_UNSIGNED_BYTE;
+    }
+
 private:
     gli_texturetype _type;
 };
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gl_impl.h"
+
+namespace gofran {
+
+// One unit of work handed to GLLoader. The render thread may only touch the
+// objects filled by the task once is_ready() returns true.
+class GLUpload {
+public:
+    GLUpload() : _ready(false)
+            , _status(gli_success) {
+    }
+
+    inline bool is_ready() const {
+        return _ready.load(std::memory_order_acquire);
+    }
+
+    inline gli_status status() const {
+        return _status;
+    }
+
+private:
+    friend class GLLoader;
+
+    std::atomic<bool> _ready;
+
+    gli_status _status;
+};
+
+// Background upload thread owning a second GLFW context that shares objects
+// with the render context. Tasks run on the loader thread, publish their
+// result with a fence, and poll() on the render thread checks those fences
+// with a zero timeout, so the render thread never blocks on an upload.
+//
+// When no shared context can be created (e.g. a software GL without a
+// display, or start() called without a window) the loader runs inline:
+// tasks execute on the render thread from poll(), one per call. Headless
+// builds (GOFRAN_HEADLESS) don't link GLFW and always run inline.
+class GLLoader {
+public:
+    typedef std::function<gli_status()> upload_fn;
+
+    GLLoader() : _context(NULL)
+            , _running(false) {
+    }
+
+    ~GLLoader() {
+        stop();
+    }
+
+private:
+    GLLoader(const GLLoader&) = delete;
+
+    GLLoader* operator=(const GLLoader&) = delete;
+
+public:
+    // Must be called on the main thread, GLFW only creates windows there.
+    gli_status start(GLFWwindow* share) {
+        if (_running) {
+            return gli_regenerate;
+        }
+
+#ifndef GOFRAN_HEADLESS
+        if (NULL != share) {
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+            _context = glfwCreateWindow(1, 1, "loader", NULL, share);
+            glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+        }
+#else
+        (void)share;
+#endif
+
+        if (NULL == _context) {
+            std::cout << "GLLoader: no shared context, uploading inline" << std::endl;
+            return gli_success;
+        }
+
+        _running = true;
+        _thread = std::thread(&GLLoader::thread_main, this);
+        return gli_success;
+    }
+
+    void stop() {
+        if (_running) {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _running = false;
+            }
+            _cond.notify_one();
+            _thread.join();
+        }
+
+        _signaled.clear();
+        _published.clear();
+
+#ifndef GOFRAN_HEADLESS
+        if (NULL != _context) {
+            glfwDestroyWindow(_context);
+            _context = NULL;
+        }
+#endif
+    }
+
+    inline bool is_threaded() const {
+        return NULL != _context;
+    }
+
+    std::shared_ptr<GLUpload> submit(const upload_fn& fn) {
+        std::shared_ptr<GLUpload> upload = std::make_shared<GLUpload>();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _tasks.push_back(task{ fn, upload });
+        }
+        _cond.notify_one();
+        return upload;
+    }
+
+    // Render thread only. Marks every upload whose fence has signaled as
+    // ready; never waits on the GPU.
+    void poll() {
+        if (!is_threaded()) {
+            run_inline();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            while (!_signaled.empty()) {
+                _published.push_back(std::move(_signaled.front()));
+                _signaled.pop_front();
+            }
+        }
+
+        auto it = _published.begin();
+        while (it != _published.end()) {
+            if (it->fence.is_signaled()) {
+                it->upload->_ready.store(true, std::memory_order_release);
+                it = _published.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+private:
+    struct task {
+        upload_fn fn;
+
+        std::shared_ptr<GLUpload> upload;
+    };
+
+    struct published {
+        GLFence fence;
+
+        std::shared_ptr<GLUpload> upload;
+    };
+
+    void thread_main() {
+#ifndef GOFRAN_HEADLESS
+        glfwMakeContextCurrent(_context);
+#endif
+
+        for (;;) {
+            task t;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cond.wait(lock, [this] { return !_running || !_tasks.empty(); });
+                if (_tasks.empty()) {
+                    break;
+                }
+                t = _tasks.front();
+                _tasks.pop_front();
+            }
+
+            published p = execute(t);
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            _signaled.push_back(std::move(p));
+        }
+
+#ifndef GOFRAN_HEADLESS
+        glfwMakeContextCurrent(NULL);
+#endif
+    }
+
+    void run_inline() {
+        task t;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_tasks.empty()) {
+                return;
+            }
+            t = _tasks.front();
+            _tasks.pop_front();
+        }
+
+        _published.push_back(execute(t));
+    }
+
+    static published execute(const task& t) {
+        t.upload->_status = t.fn();
+
+        published p;
+        p.fence.insert();
+        p.upload = t.upload;
+        // Make sure the fence reaches the GPU, otherwise the render thread
+        // could poll it forever.
+        glFlush();
+        return p;
+    }
+
+private:
+    GLFWwindow* _context;
+
+    std::thread _thread;
+
+    std::mutex _mutex;
+
+    std::condition_variable _cond;
+
+    bool _running;
+
+    std::deque<task> _tasks;
+
+    std::deque<published> _signaled;
+
+    std::vector<published> _published;
+};
+
+}
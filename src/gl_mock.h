@@ -0,0 +1,779 @@
+#pragma once
+
+#include <array>
+#include <initializer_list>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+#include "gl_trace.h"
+
+namespace gofran {
+
+// A GL "implementation" for code that has no context: install() feeds
+// gladLoadGLLoader stubs for every entry point in gl_entrypoints.h. Each
+// call is counted, appended to calls() while recording, and applied to a
+// minimal object model: generated names, bindings, buffer sizes, texture
+// sizes, shader and program status, uniform locations and fences. That
+// is enough for GLBuffer, GLTextures, GLVertexArray and GLPipeline to run
+// unchanged, so tests can assert the exact calls a frame makes and
+// benchmarks can measure the wrappers without any driver underneath.
+//
+// Misuse that real GL reports with glGetError (a bad target, a draw
+// without a program or a VAO, uploading to nothing bound) sets the GL
+// error and is logged in errors(). Only one mock is current at a time, and
+// it is not thread safe, like a GL context.
+class GLMock {
+public:
+    struct buffer_t {
+        GLsizeiptr size = 0;
+
+        GLenum usage = 0;
+    };
+
+    struct texture_t {
+        // Set by the first bind, like in GL.
+        GLenum target = 0;
+
+        GLint internal_format = 0;
+
+        GLsizei width = 0;
+
+        GLsizei height = 0;
+
+        GLsizei depth = 0;
+
+        bool mipmaps = false;
+    };
+
+    GLMock() : _recording(true)
+            , _next_name(1)
+            , _next_sync(1)
+            , _error(GL_NO_ERROR)
+            , _active_texture(0)
+            , _vertex_array(0)
+            , _program(0)
+            , _bytes(0) {
+        _counts.fill(0);
+    }
+
+    ~GLMock() {
+        if (this == current()) {
+            current() = NULL;
+        }
+    }
+
+private:
+    GLMock(const GLMock&) = delete;
+
+    GLMock* operator=(const GLMock&) = delete;
+
+public:
+    // Points the glad function pointers at the stubs and makes this mock the
+    // one they act on. The calls glad makes while loading are not kept.
+    bool install() {
+        current() = this;
+        bool loaded = 0 != gladLoadGLLoader(&GLMock::proc_address);
+        clear();
+        return loaded;
+    }
+
+    // Stubs called while no mock is current do nothing and return 0.
+    static GLMock*& current() {
+        static GLMock* mock = NULL;
+        return mock;
+    }
+
+    // With recording off calls are only counted, for benchmarks.
+    inline void set_recording(bool recording) {
+        _recording = recording;
+    }
+
+    inline bool is_recording() const {
+        return _recording;
+    }
+
+    // Forgets recorded calls, counts, uploaded bytes and errors. Objects
+    // and bindings stay.
+    void clear() {
+        _calls.clear();
+        _counts.fill(0);
+        _bytes = 0;
+        _errors.clear();
+        _error = GL_NO_ERROR;
+    }
+
+    inline const std::vector<gl_call>& calls() const {
+        return _calls;
+    }
+
+    inline uint64_t count(gl_call call) const {
+        return _counts[(size_t)call];
+    }
+
+    uint64_t total_calls() const {
+        uint64_t total = 0;
+        for (uint64_t n : _counts) {
+            total += n;
+        }
+        return total;
+    }
+
+    // Bytes handed to glBufferData and the glTex*Image calls.
+    inline uint64_t bytes_uploaded() const {
+        return _bytes;
+    }
+
+    inline const std::vector<std::string>& errors() const {
+        return _errors;
+    }
+
+    // The recorded calls, one name per line.
+    std::string trace() const {
+        std::ostringstream out;
+        for (gl_call call : _calls) {
+            out << gl_call_name(call) << "\n";
+        }
+        return out.str();
+    }
+
+    // Whether the recorded calls are exactly expected; prints both when not.
+    bool expect_calls(std::initializer_list<gl_call> expected, std::ostream& out = std::cout) const {
+        if (expected.size() == _calls.size() && std::equal(expected.begin(), expected.end(), _calls.begin())) {
+            return true;
+        }
+
+        out << "GLMock: expected " << expected.size() << " calls, got " << _calls.size() << std::endl;
+        size_t n = std::max(expected.size(), _calls.size());
+        for (size_t i = 0; i < n; ++i) {
+            const char* want = i < expected.size() ? gl_call_name(expected.begin()[i]) : "-";
+            const char* got = i < _calls.size() ? gl_call_name(_calls[i]) : "-";
+            out << (strcmp(want, got) ? "  ! " : "    ") << want << "\t" << got << std::endl;
+        }
+        return false;
+    }
+
+    // NULL for names that are not buffers (or textures) right now.
+    const buffer_t* buffer(GLuint name) const {
+        auto it = _buffers.find(name);
+        return _buffers.end() != it ? &it->second : NULL;
+    }
+
+    const texture_t* texture(GLuint name) const {
+        auto it = _textures.find(name);
+        return _textures.end() != it ? &it->second : NULL;
+    }
+
+    GLuint bound_buffer(GLenum target) const {
+        auto it = _bound_buffers.find(target);
+        return _bound_buffers.end() != it ? it->second : 0;
+    }
+
+    // On the active texture unit.
+    GLuint bound_texture(GLenum target) const {
+        auto it = _bound_textures.find(texture_key(_active_texture, target));
+        return _bound_textures.end() != it ? it->second : 0;
+    }
+
+    inline GLuint bound_vertex_array() const {
+        return _vertex_array;
+    }
+
+    inline GLuint current_program() const {
+        return _program;
+    }
+
+    // Buffers, textures, vertex arrays, shaders, programs and fences.
+    size_t live_objects() const {
+        return _buffers.size() + _textures.size() + _vertex_arrays.size()
+                + _shaders.size() + _programs.size() + _syncs.size();
+    }
+
+private:
+    struct shader_t {
+        GLenum type = 0;
+
+        bool compiled = false;
+    };
+
+    struct program_t {
+        std::vector<GLuint> shaders;
+
+        bool linked = false;
+
+        std::unordered_map<std::string, GLint> uniforms;
+    };
+
+    inline void record(gl_call call) {
+        ++_counts[(size_t)call];
+        if (_recording) {
+            _calls.push_back(call);
+        }
+    }
+
+    // Like GL only the first error sticks until glGetError.
+    void error(GLenum code, gl_call call, const char* what) {
+        if (GL_NO_ERROR == _error) {
+            _error = code;
+        }
+
+        std::string message = gl_call_name(call);
+        message += ": ";
+        message += what;
+        _errors.push_back(message);
+    }
+
+    static uint64_t texture_key(GLuint unit, GLenum target) {
+        return ((uint64_t)unit << 32) | target;
+    }
+
+    static bool is_buffer_target(GLenum target) {
+        switch (target) {
+        case GL_ARRAY_BUFFER:
+        case GL_ELEMENT_ARRAY_BUFFER:
+        case GL_COPY_READ_BUFFER:
+        case GL_COPY_WRITE_BUFFER:
+        case GL_PIXEL_PACK_BUFFER:
+        case GL_PIXEL_UNPACK_BUFFER:
+        case GL_TEXTURE_BUFFER:
+        case GL_TRANSFORM_FEEDBACK_BUFFER:
+        case GL_UNIFORM_BUFFER:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static bool is_texture_target(GLenum target) {
+        switch (target) {
+        case GL_TEXTURE_2D:
+        case GL_TEXTURE_2D_ARRAY:
+        case GL_TEXTURE_3D:
+        case GL_TEXTURE_CUBE_MAP:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    texture_t* bound_texture_object(GLenum target, gl_call call) {
+        if (!is_texture_target(target)) {
+            error(GL_INVALID_ENUM, call, "invalid texture target");
+            return NULL;
+        }
+
+        auto it = _textures.find(bound_texture(target));
+        if (_textures.end() == it) {
+            error(GL_INVALID_OPERATION, call, "no texture bound");
+            return NULL;
+        }
+        return &it->second;
+    }
+
+    template<typename T>
+    void generate(GLsizei n, GLuint* names, std::unordered_map<GLuint, T>& objects, gl_call call) {
+        if (n < 0) {
+            error(GL_INVALID_VALUE, call, "negative count");
+            return;
+        }
+
+        for (GLsizei i = 0; i < n; ++i) {
+            names[i] = _next_name++;
+            objects[names[i]];
+        }
+    }
+
+    // The stubs glad calls, one per entry point, forwarding to the members
+    // of the same name below.
+#define GOFRAN_GL_ENTRYPOINT(ret, name, params, args) \
+    static ret APIENTRY stub_##name params { \
+        GLMock* mock = current(); \
+        if (NULL == mock) { \
+            return (ret)0; \
+        } \
+        mock->record(gl_call::name); \
+        return mock->name args; \
+    }
+#include "gl_entrypoints.h"
+
+    static void* proc_address(const char* name) {
+        struct proc_t {
+            const char* name;
+
+            void* proc;
+        };
+        static const proc_t procs[] = {
+#define GOFRAN_GL_ENTRYPOINT(ret, name, params, args) { "gl" #name, (void*)&GLMock::stub_##name },
+#include "gl_entrypoints.h"
+        };
+
+        for (const auto& proc : procs) {
+            if (0 == strcmp(name, proc.name)) {
+                return proc.proc;
+            }
+        }
+        return NULL;
+    }
+
+    void ActiveTexture(GLenum texture) {
+        if (texture < GL_TEXTURE0 || texture > GL_TEXTURE31) {
+            error(GL_INVALID_ENUM, gl_call::ActiveTexture, "invalid texture unit");
+            return;
+        }
+        _active_texture = texture - GL_TEXTURE0;
+    }
+
+    void AttachShader(GLuint program, GLuint shader) {
+        auto it = _programs.find(program);
+        if (_programs.end() == it || 0 == _shaders.count(shader)) {
+            error(GL_INVALID_VALUE, gl_call::AttachShader, "unknown program or shader");
+            return;
+        }
+        it->second.shaders.push_back(shader);
+    }
+
+    void BindBuffer(GLenum target, GLuint buffer) {
+        if (!is_buffer_target(target)) {
+            error(GL_INVALID_ENUM, gl_call::BindBuffer, "invalid buffer target");
+            return;
+        }
+        if (0 != buffer && 0 == _buffers.count(buffer)) {
+            error(GL_INVALID_OPERATION, gl_call::BindBuffer, "unknown buffer");
+            return;
+        }
+        _bound_buffers[target] = buffer;
+    }
+
+    void BindTexture(GLenum target, GLuint texture) {
+        if (!is_texture_target(target)) {
+            error(GL_INVALID_ENUM, gl_call::BindTexture, "invalid texture target");
+            return;
+        }
+        if (0 != texture) {
+            auto it = _textures.find(texture);
+            if (_textures.end() == it) {
+                error(GL_INVALID_OPERATION, gl_call::BindTexture, "unknown texture");
+                return;
+            }
+            if (0 != it->second.target && target != it->second.target) {
+                error(GL_INVALID_OPERATION, gl_call::BindTexture, "texture bound to another target before");
+                return;
+            }
+            it->second.target = target;
+        }
+        _bound_textures[texture_key(_active_texture, target)] = texture;
+    }
+
+    void BindVertexArray(GLuint array) {
+        if (0 != array && 0 == _vertex_arrays.count(array)) {
+            error(GL_INVALID_OPERATION, gl_call::BindVertexArray, "unknown vertex array");
+            return;
+        }
+        _vertex_array = array;
+    }
+
+    void BufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+        if (!is_buffer_target(target)) {
+            error(GL_INVALID_ENUM, gl_call::BufferData, "invalid buffer target");
+            return;
+        }
+        if (size < 0) {
+            error(GL_INVALID_VALUE, gl_call::BufferData, "negative size");
+            return;
+        }
+        auto it = _buffers.find(bound_buffer(target));
+        if (_buffers.end() == it) {
+            error(GL_INVALID_OPERATION, gl_call::BufferData, "no buffer bound");
+            return;
+        }
+        it->second.size = size;
+        it->second.usage = usage;
+        _bytes += NULL != data ? (uint64_t)size : 0;
+    }
+
+    void Clear(GLbitfield) {
+    }
+
+    void ClearColor(GLfloat, GLfloat, GLfloat, GLfloat) {
+    }
+
+    GLenum ClientWaitSync(GLsync sync, GLbitfield, GLuint64) {
+        if (0 == _syncs.count(sync)) {
+            error(GL_INVALID_VALUE, gl_call::ClientWaitSync, "unknown sync");
+            return GL_WAIT_FAILED;
+        }
+        // Nothing is ever queued, fences signal at once.
+        return GL_ALREADY_SIGNALED;
+    }
+
+    void CompileShader(GLuint shader) {
+        auto it = _shaders.find(shader);
+        if (_shaders.end() == it) {
+            error(GL_INVALID_VALUE, gl_call::CompileShader, "unknown shader");
+            return;
+        }
+        it->second.compiled = true;
+    }
+
+    GLuint CreateProgram() {
+        GLuint name = _next_name++;
+        _programs[name];
+        return name;
+    }
+
+    GLuint CreateShader(GLenum type) {
+        if (GL_VERTEX_SHADER != type && GL_FRAGMENT_SHADER != type && GL_GEOMETRY_SHADER != type) {
+            error(GL_INVALID_ENUM, gl_call::CreateShader, "invalid shader type");
+            return 0;
+        }
+        GLuint name = _next_name++;
+        _shaders[name].type = type;
+        return name;
+    }
+
+    void DeleteBuffers(GLsizei n, const GLuint* buffers) {
+        for (GLsizei i = 0; i < n; ++i) {
+            if (0 != _buffers.erase(buffers[i])) {
+                for (auto& bound : _bound_buffers) {
+                    bound.second = buffers[i] == bound.second ? 0 : bound.second;
+                }
+            }
+        }
+    }
+
+    void DeleteProgram(GLuint program) {
+        _programs.erase(program);
+    }
+
+    void DeleteShader(GLuint shader) {
+        _shaders.erase(shader);
+    }
+
+    void DeleteSync(GLsync sync) {
+        if (NULL != sync && 0 == _syncs.erase(sync)) {
+            error(GL_INVALID_VALUE, gl_call::DeleteSync, "unknown sync");
+        }
+    }
+
+    void DeleteTextures(GLsizei n, const GLuint* textures) {
+        for (GLsizei i = 0; i < n; ++i) {
+            if (0 != _textures.erase(textures[i])) {
+                for (auto& bound : _bound_textures) {
+                    bound.second = textures[i] == bound.second ? 0 : bound.second;
+                }
+            }
+        }
+    }
+
+    void DeleteVertexArrays(GLsizei n, const GLuint* arrays) {
+        for (GLsizei i = 0; i < n; ++i) {
+            if (0 != _vertex_arrays.erase(arrays[i]) && arrays[i] == _vertex_array) {
+                _vertex_array = 0;
+            }
+        }
+    }
+
+    void DrawElements(GLenum, GLsizei count, GLenum, const void*) {
+        if (count < 0) {
+            error(GL_INVALID_VALUE, gl_call::DrawElements, "negative count");
+        } else if (0 == _program || 0 == _vertex_array) {
+            error(GL_INVALID_OPERATION, gl_call::DrawElements, "no program or vertex array");
+        }
+    }
+
+    void EnableVertexAttribArray(GLuint) {
+        if (0 == _vertex_array) {
+            error(GL_INVALID_OPERATION, gl_call::EnableVertexAttribArray, "no vertex array bound");
+        }
+    }
+
+    GLsync FenceSync(GLenum, GLbitfield) {
+        GLsync sync = (GLsync)(uintptr_t)_next_sync++;
+        _syncs.insert(sync);
+        return sync;
+    }
+
+    void Finish() {
+    }
+
+    void Flush() {
+    }
+
+    void GenBuffers(GLsizei n, GLuint* buffers) {
+        generate(n, buffers, _buffers, gl_call::GenBuffers);
+    }
+
+    void GenTextures(GLsizei n, GLuint* textures) {
+        generate(n, textures, _textures, gl_call::GenTextures);
+    }
+
+    void GenVertexArrays(GLsizei n, GLuint* arrays) {
+        if (n < 0) {
+            error(GL_INVALID_VALUE, gl_call::GenVertexArrays, "negative count");
+            return;
+        }
+        for (GLsizei i = 0; i < n; ++i) {
+            arrays[i] = _next_name++;
+            _vertex_arrays.insert(arrays[i]);
+        }
+    }
+
+    void GenerateMipmap(GLenum target) {
+        texture_t* texture = bound_texture_object(target, gl_call::GenerateMipmap);
+        if (NULL != texture) {
+            texture->mipmaps = true;
+        }
+    }
+
+    GLenum GetError() {
+        GLenum code = _error;
+        _error = GL_NO_ERROR;
+        return code;
+    }
+
+    // glad needs at least one extension from a 3.x context.
+    void GetIntegerv(GLenum pname, GLint* data) {
+        switch (pname) {
+        case GL_NUM_EXTENSIONS:
+            *data = 1;
+            break;
+        case GL_MAJOR_VERSION:
+        case GL_MINOR_VERSION:
+            *data = 3;
+            break;
+        default:
+            *data = 0;
+            break;
+        }
+    }
+
+    void GetProgramInfoLog(GLuint, GLsizei buf_size, GLsizei* length, GLchar* log) {
+        empty_log(buf_size, length, log);
+    }
+
+    void GetProgramiv(GLuint program, GLenum pname, GLint* params) {
+        auto it = _programs.find(program);
+        if (_programs.end() == it) {
+            error(GL_INVALID_VALUE, gl_call::GetProgramiv, "unknown program");
+            return;
+        }
+        *params = GL_LINK_STATUS == pname ? it->second.linked : 0;
+    }
+
+    void GetShaderInfoLog(GLuint, GLsizei buf_size, GLsizei* length, GLchar* log) {
+        empty_log(buf_size, length, log);
+    }
+
+    void GetShaderiv(GLuint shader, GLenum pname, GLint* params) {
+        auto it = _shaders.find(shader);
+        if (_shaders.end() == it) {
+            error(GL_INVALID_VALUE, gl_call::GetShaderiv, "unknown shader");
+            return;
+        }
+        if (GL_COMPILE_STATUS == pname) {
+            *params = it->second.compiled;
+        } else if (GL_SHADER_TYPE == pname) {
+            *params = (GLint)it->second.type;
+        } else {
+            *params = 0;
+        }
+    }
+
+    const GLubyte* GetString(GLenum name) {
+        switch (name) {
+        case GL_VENDOR:
+            return (const GLubyte*)"gofran";
+        case GL_RENDERER:
+            return (const GLubyte*)"GLMock";
+        case GL_VERSION:
+            return (const GLubyte*)"3.3 GLMock";
+        case GL_SHADING_LANGUAGE_VERSION:
+            return (const GLubyte*)"3.30";
+        default:
+            error(GL_INVALID_ENUM, gl_call::GetString, "invalid name");
+            return NULL;
+        }
+    }
+
+    const GLubyte* GetStringi(GLenum name, GLuint index) {
+        if (GL_EXTENSIONS != name || 0 != index) {
+            error(GL_INVALID_VALUE, gl_call::GetStringi, "invalid name or index");
+            return NULL;
+        }
+        return (const GLubyte*)"GL_GOFRAN_mock";
+    }
+
+    // Locations are handed out in order of first use, per program.
+    GLint GetUniformLocation(GLuint program, const GLchar* name) {
+        auto it = _programs.find(program);
+        if (_programs.end() == it || !it->second.linked) {
+            error(GL_INVALID_OPERATION, gl_call::GetUniformLocation, "program not linked");
+            return -1;
+        }
+        auto& uniforms = it->second.uniforms;
+        return uniforms.emplace(name, (GLint)uniforms.size()).first->second;
+    }
+
+    void LinkProgram(GLuint program) {
+        auto it = _programs.find(program);
+        if (_programs.end() == it) {
+            error(GL_INVALID_VALUE, gl_call::LinkProgram, "unknown program");
+            return;
+        }
+        bool linked = !it->second.shaders.empty();
+        for (GLuint shader : it->second.shaders) {
+            auto s = _shaders.find(shader);
+            linked = linked && _shaders.end() != s && s->second.compiled;
+        }
+        it->second.linked = linked;
+    }
+
+    void ShaderSource(GLuint shader, GLsizei, const GLchar* const*, const GLint*) {
+        if (0 == _shaders.count(shader)) {
+            error(GL_INVALID_VALUE, gl_call::ShaderSource, "unknown shader");
+        }
+    }
+
+    void TexImage2D(GLenum target, GLint level, GLint internal_format, GLsizei width, GLsizei height,
+            GLint, GLenum format, GLenum type, const void* pixels) {
+        tex_image(gl_call::TexImage2D, target, level, internal_format, width, height, 1, format, type, pixels);
+    }
+
+    void TexImage3D(GLenum target, GLint level, GLint internal_format, GLsizei width, GLsizei height,
+            GLsizei depth, GLint, GLenum format, GLenum type, const void* pixels) {
+        tex_image(gl_call::TexImage3D, target, level, internal_format, width, height, depth, format, type, pixels);
+    }
+
+    void TexParameteri(GLenum target, GLenum, GLint) {
+        bound_texture_object(target, gl_call::TexParameteri);
+    }
+
+    void TexSubImage3D(GLenum target, GLint, GLint x, GLint y, GLint z, GLsizei width, GLsizei height,
+            GLsizei depth, GLenum format, GLenum type, const void* pixels) {
+        texture_t* texture = bound_texture_object(target, gl_call::TexSubImage3D);
+        if (NULL == texture) {
+            return;
+        }
+        if (x < 0 || y < 0 || z < 0 || x + width > texture->width || y + height > texture->height
+                || z + depth > texture->depth) {
+            error(GL_INVALID_VALUE, gl_call::TexSubImage3D, "region outside the texture");
+            return;
+        }
+        _bytes += NULL != pixels ? gl_image_bytes(width, height, depth, format, type) : 0;
+    }
+
+    void Uniform1f(GLint location, GLfloat) {
+        uniform(location, gl_call::Uniform1f);
+    }
+
+    void Uniform1i(GLint location, GLint) {
+        uniform(location, gl_call::Uniform1i);
+    }
+
+    void UseProgram(GLuint program) {
+        if (0 != program) {
+            auto it = _programs.find(program);
+            if (_programs.end() == it || !it->second.linked) {
+                error(GL_INVALID_OPERATION, gl_call::UseProgram, "program not linked");
+                return;
+            }
+        }
+        _program = program;
+    }
+
+    void VertexAttribPointer(GLuint, GLint, GLenum, GLboolean, GLsizei, const void*) {
+        if (0 == _vertex_array || 0 == bound_buffer(GL_ARRAY_BUFFER)) {
+            error(GL_INVALID_OPERATION, gl_call::VertexAttribPointer, "no vertex array or array buffer bound");
+        }
+    }
+
+    void Viewport(GLint, GLint, GLsizei width, GLsizei height) {
+        if (width < 0 || height < 0) {
+            error(GL_INVALID_VALUE, gl_call::Viewport, "negative size");
+        }
+    }
+
+    void tex_image(gl_call call, GLenum target, GLint level, GLint internal_format, GLsizei width,
+            GLsizei height, GLsizei depth, GLenum format, GLenum type, const void* pixels) {
+        texture_t* texture = bound_texture_object(target, call);
+        if (NULL == texture) {
+            return;
+        }
+        if (width < 0 || height < 0 || depth < 0) {
+            error(GL_INVALID_VALUE, call, "negative size");
+            return;
+        }
+        if (0 == level) {
+            texture->internal_format = internal_format;
+            texture->width = width;
+            texture->height = height;
+            texture->depth = depth;
+        }
+        _bytes += NULL != pixels ? gl_image_bytes(width, height, depth, format, type) : 0;
+    }
+
+    void uniform(GLint location, gl_call call) {
+        // -1 is silently ignored, like in GL.
+        if (0 == _program) {
+            error(GL_INVALID_OPERATION, call, "no program in use");
+        } else if (location < -1) {
+            error(GL_INVALID_OPERATION, call, "invalid location");
+        }
+    }
+
+    static void empty_log(GLsizei buf_size, GLsizei* length, GLchar* log) {
+        if (NULL != length) {
+            *length = 0;
+        }
+        if (buf_size > 0 && NULL != log) {
+            log[0] = 0;
+        }
+    }
+
+private:
+    bool _recording;
+
+    std::vector<gl_call> _calls;
+
+    std::array<uint64_t, gl_call_count> _counts;
+
+    GLuint _next_name;
+
+    uintptr_t _next_sync;
+
+    GLenum _error;
+
+    std::vector<std::string> _errors;
+
+    std::unordered_map<GLuint, buffer_t> _buffers;
+
+    std::unordered_map<GLuint, texture_t> _textures;
+
+    std::unordered_set<GLuint> _vertex_arrays;
+
+    std::unordered_map<GLuint, shader_t> _shaders;
+
+    std::unordered_map<GLuint, program_t> _programs;
+
+    std::unordered_set<GLsync> _syncs;
+
+    std::unordered_map<GLenum, GLuint> _bound_buffers;
+
+    // Per texture unit and target, see texture_key().
+    std::unordered_map<uint64_t, GLuint> _bound_textures;
+
+    GLuint _active_texture;
+
+    GLuint _vertex_array;
+
+    GLuint _program;
+
+    uint64_t _bytes;
+};
+
+}
@@ -0,0 +1,592 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+#include "gl_trace.h"
+
+namespace gofran {
+
+// Plays a GLCapture trace on the current context through the glad function
+// pointers, as fast as it reads. Object names, fences and uniform
+// locations are mapped from the ones in the trace to the ones this context
+// hands out. Every call is timed on its own, only the GL call, not the
+// decoding around it; timings include the cost of reading the clock, tens
+// of nanoseconds.
+class GLReplay {
+public:
+    struct call_stats_t {
+        uint64_t count = 0;
+
+        double ns = 0.0;
+    };
+
+    GLReplay() : _first_frame(0)
+            , _records_start(0)
+            , _range_start(0)
+            , _range_payloads(0)
+            , _program(0)
+            , _frame(0) {
+        _scratch.resize(64 * 1024);
+        clear_stats();
+    }
+
+private:
+    GLReplay(const GLReplay&) = delete;
+
+    GLReplay* operator=(const GLReplay&) = delete;
+
+public:
+    // Reads the whole trace into memory and checks its header. Fails on calls
+    // this build does not know.
+    gli_status load(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            return gli_io_failed;
+        }
+        _trace.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+        _reader = GLTraceReader(_trace.data(), _trace.size());
+        const unsigned char* magic = _reader.read_bytes(4);
+        if (NULL == magic || 0 != memcmp(magic, "GTRC", 4) || gl_trace_version != _reader.read_varint()) {
+            return gli_uninitialize;
+        }
+        _first_frame = (uint32_t)_reader.read_varint();
+
+        // Traces keep the names of their calls, index them by ours.
+        size_t count = _reader.read_varint();
+        _calls.clear();
+        for (size_t i = 0; i < count && !_reader.failed(); ++i) {
+            std::string name = _reader.read_string();
+            size_t call = 0;
+            while (call < gl_call_count && name != gl_call_name((gl_call)call)) {
+                ++call;
+            }
+            if (gl_call_count == call) {
+                std::cout << "GLReplay: " << name << " is not supported" << std::endl;
+                return gli_uninitialize;
+            }
+            _calls.push_back((gl_call)call);
+        }
+        _records_start = _reader.position();
+        return _reader.failed() ? gli_uninitialize : gli_success;
+    }
+
+    inline uint32_t first_frame() const {
+        return _first_frame;
+    }
+
+    // Plays everything before the captured range: objects, uploads and the
+    // frames before it. Not part of the stats.
+    gli_status setup() {
+        _reader.seek(_records_start);
+        _payloads.clear();
+        _range_start = _records_start;
+        _range_payloads = 0;
+        bool more = true;
+        while (more && _frame < _first_frame) {
+            more = play_frame();
+        }
+        if (_reader.failed()) {
+            return gli_io_failed;
+        }
+
+        _range_start = _reader.position();
+        _range_payloads = _payloads.size();
+        clear_stats();
+        return gli_success;
+    }
+
+    // Plays the next frame of the range; false once the trace has ended,
+    // then the next call starts the range over.
+    bool play_frame() {
+        auto start = clock::now();
+        bool played = false;
+        while (!_reader.failed()) {
+            uint64_t record = _reader.read_varint();
+            if (TRACE_FRAME == record) {
+                _frame = (uint32_t)_reader.read_varint() + 1;
+                _frame_times.push_back(ms_since(start));
+                return true;
+            } else if (TRACE_PAYLOAD == record) {
+                size_t size = _reader.read_varint();
+                _payloads.push_back({ _reader.read_bytes(size), size });
+            } else if (TRACE_END == record) {
+                break;
+            } else if (record < _calls.size()) {
+                (this->*dispatch_table()[(size_t)_calls[record]])();
+                played = true;
+            } else {
+                _reader.read_bytes(SIZE_MAX);
+            }
+        }
+
+        // Calls after the last end_frame().
+        if (played && !_reader.failed()) {
+            _frame_times.push_back(ms_since(start));
+        }
+
+        // Payloads of the range are read again and get the same ids.
+        _reader.seek(_range_start);
+        _payloads.resize(_range_payloads);
+        return false;
+    }
+
+    inline bool failed() const {
+        return _reader.failed();
+    }
+
+    inline const std::array<call_stats_t, gl_call_count>& stats() const {
+        return _stats;
+    }
+
+    // Per frame played since setup(), in milliseconds.
+    inline const std::vector<double>& frame_times() const {
+        return _frame_times;
+    }
+
+    void clear_stats() {
+        _stats.fill(call_stats_t());
+        _frame_times.clear();
+    }
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    typedef void (GLReplay::*dispatch_fn)();
+
+    struct payload_t {
+        const unsigned char* data;
+
+        size_t size;
+    };
+
+    template<gl_call C>
+    using call_tag = std::integral_constant<gl_call, C>;
+
+    static double ms_since(clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    }
+
+    template<typename F>
+    inline void time(gl_call call, F fn) {
+        auto start = clock::now();
+        fn();
+        call_stats_t& stats = _stats[(size_t)call];
+        stats.ns += std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        ++stats.count;
+    }
+
+#define GOFRAN_GL_ENTRYPOINT(ret, name, params, args) \
+    void dispatch_##name() { \
+        replay(call_tag<gl_call::name>(), glad_gl##name); \
+    }
+#include "gl_entrypoints.h"
+
+    static const dispatch_fn* dispatch_table() {
+        static const dispatch_fn table[] = {
+#define GOFRAN_GL_ENTRYPOINT(ret, name, params, args) &GLReplay::dispatch_##name,
+#include "gl_entrypoints.h"
+        };
+        return table;
+    }
+
+    // Outputs go to scratch memory.
+    template<typename T>
+    T read_arg() {
+        if constexpr (gl_trace_by_value<T>) {
+            return _reader.read<T>();
+        } else {
+            return (T)_scratch.data();
+        }
+    }
+
+    // Calls that only pass values.
+    template<gl_call C, typename R, typename... P>
+    void replay(call_tag<C>, R (APIENTRYP fn)(P...)) {
+        // Braces read the arguments in order.
+        std::tuple<P...> args{ read_arg<P>()... };
+        time(C, [&]() {
+            std::apply(fn, args);
+        });
+        if constexpr (!std::is_void_v<R>) {
+            _reader.read<R>();
+        }
+    }
+
+    // Calls on objects, with names mapped to this context's.
+    void replay(call_tag<gl_call::AttachShader>, PFNGLATTACHSHADERPROC fn) {
+        GLuint program = name(_programs, _reader.read<GLuint>());
+        GLuint shader = name(_shaders, _reader.read<GLuint>());
+        time(gl_call::AttachShader, [&]() {
+            fn(program, shader);
+        });
+    }
+
+    void replay(call_tag<gl_call::BindBuffer>, PFNGLBINDBUFFERPROC fn) {
+        GLenum target = _reader.read<GLenum>();
+        GLuint buffer = name(_buffers, _reader.read<GLuint>());
+        time(gl_call::BindBuffer, [&]() {
+            fn(target, buffer);
+        });
+    }
+
+    void replay(call_tag<gl_call::BindTexture>, PFNGLBINDTEXTUREPROC fn) {
+        GLenum target = _reader.read<GLenum>();
+        GLuint texture = name(_textures, _reader.read<GLuint>());
+        time(gl_call::BindTexture, [&]() {
+            fn(target, texture);
+        });
+    }
+
+    void replay(call_tag<gl_call::BindVertexArray>, PFNGLBINDVERTEXARRAYPROC fn) {
+        GLuint array = name(_vertex_arrays, _reader.read<GLuint>());
+        time(gl_call::BindVertexArray, [&]() {
+            fn(array);
+        });
+    }
+
+    void replay(call_tag<gl_call::BufferData>, PFNGLBUFFERDATAPROC fn) {
+        GLenum target = _reader.read<GLenum>();
+        GLsizeiptr size = _reader.read<GLsizeiptr>();
+        _reader.read<const void*>();
+        GLenum usage = _reader.read<GLenum>();
+        const void* data = payload();
+        time(gl_call::BufferData, [&]() {
+            fn(target, size, data, usage);
+        });
+    }
+
+    void replay(call_tag<gl_call::ClientWaitSync>, PFNGLCLIENTWAITSYNCPROC fn) {
+        GLsync sync = sync_name(_reader.read<GLsync>());
+        GLbitfield flags = _reader.read<GLbitfield>();
+        GLuint64 timeout = _reader.read<GLuint64>();
+        _reader.read<GLenum>();
+        time(gl_call::ClientWaitSync, [&]() {
+            fn(sync, flags, timeout);
+        });
+    }
+
+    void replay(call_tag<gl_call::CompileShader>, PFNGLCOMPILESHADERPROC fn) {
+        GLuint shader = name(_shaders, _reader.read<GLuint>());
+        time(gl_call::CompileShader, [&]() {
+            fn(shader);
+        });
+    }
+
+    void replay(call_tag<gl_call::CreateProgram>, PFNGLCREATEPROGRAMPROC fn) {
+        GLuint program = 0;
+        time(gl_call::CreateProgram, [&]() {
+            program = fn();
+        });
+        _programs[_reader.read<GLuint>()] = program;
+    }
+
+    void replay(call_tag<gl_call::CreateShader>, PFNGLCREATESHADERPROC fn) {
+        GLenum type = _reader.read<GLenum>();
+        GLuint shader = 0;
+        time(gl_call::CreateShader, [&]() {
+            shader = fn(type);
+        });
+        _shaders[_reader.read<GLuint>()] = shader;
+    }
+
+    void replay(call_tag<gl_call::DeleteBuffers>, PFNGLDELETEBUFFERSPROC fn) {
+        delete_names(gl_call::DeleteBuffers, fn, _buffers);
+    }
+
+    void replay(call_tag<gl_call::DeleteProgram>, PFNGLDELETEPROGRAMPROC fn) {
+        GLuint program = take_name(_programs, _reader.read<GLuint>());
+        time(gl_call::DeleteProgram, [&]() {
+            fn(program);
+        });
+    }
+
+    void replay(call_tag<gl_call::DeleteShader>, PFNGLDELETESHADERPROC fn) {
+        GLuint shader = take_name(_shaders, _reader.read<GLuint>());
+        time(gl_call::DeleteShader, [&]() {
+            fn(shader);
+        });
+    }
+
+    void replay(call_tag<gl_call::DeleteSync>, PFNGLDELETESYNCPROC fn) {
+        GLsync captured = _reader.read<GLsync>();
+        GLsync sync = sync_name(captured);
+        _syncs.erase(captured);
+        time(gl_call::DeleteSync, [&]() {
+            fn(sync);
+        });
+    }
+
+    void replay(call_tag<gl_call::DeleteTextures>, PFNGLDELETETEXTURESPROC fn) {
+        delete_names(gl_call::DeleteTextures, fn, _textures);
+    }
+
+    void replay(call_tag<gl_call::DeleteVertexArrays>, PFNGLDELETEVERTEXARRAYSPROC fn) {
+        delete_names(gl_call::DeleteVertexArrays, fn, _vertex_arrays);
+    }
+
+    void replay(call_tag<gl_call::FenceSync>, PFNGLFENCESYNCPROC fn) {
+        GLenum condition = _reader.read<GLenum>();
+        GLbitfield flags = _reader.read<GLbitfield>();
+        GLsync sync = NULL;
+        time(gl_call::FenceSync, [&]() {
+            sync = fn(condition, flags);
+        });
+        _syncs[_reader.read<GLsync>()] = sync;
+    }
+
+    void replay(call_tag<gl_call::GenBuffers>, PFNGLGENBUFFERSPROC fn) {
+        gen_names(gl_call::GenBuffers, fn, _buffers);
+    }
+
+    void replay(call_tag<gl_call::GenTextures>, PFNGLGENTEXTURESPROC fn) {
+        gen_names(gl_call::GenTextures, fn, _textures);
+    }
+
+    void replay(call_tag<gl_call::GenVertexArrays>, PFNGLGENVERTEXARRAYSPROC fn) {
+        gen_names(gl_call::GenVertexArrays, fn, _vertex_arrays);
+    }
+
+    void replay(call_tag<gl_call::GetProgramInfoLog>, PFNGLGETPROGRAMINFOLOGPROC fn) {
+        GLuint program = name(_programs, _reader.read<GLuint>());
+        GLsizei buf_size = std::min<GLsizei>(_reader.read<GLsizei>(), (GLsizei)_scratch.size());
+        time(gl_call::GetProgramInfoLog, [&]() {
+            fn(program, buf_size, NULL, (GLchar*)_scratch.data());
+        });
+    }
+
+    void replay(call_tag<gl_call::GetProgramiv>, PFNGLGETPROGRAMIVPROC fn) {
+        GLuint program = name(_programs, _reader.read<GLuint>());
+        GLenum pname = _reader.read<GLenum>();
+        time(gl_call::GetProgramiv, [&]() {
+            fn(program, pname, (GLint*)_scratch.data());
+        });
+    }
+
+    void replay(call_tag<gl_call::GetShaderInfoLog>, PFNGLGETSHADERINFOLOGPROC fn) {
+        GLuint shader = name(_shaders, _reader.read<GLuint>());
+        GLsizei buf_size = std::min<GLsizei>(_reader.read<GLsizei>(), (GLsizei)_scratch.size());
+        time(gl_call::GetShaderInfoLog, [&]() {
+            fn(shader, buf_size, NULL, (GLchar*)_scratch.data());
+        });
+    }
+
+    void replay(call_tag<gl_call::GetShaderiv>, PFNGLGETSHADERIVPROC fn) {
+        GLuint shader = name(_shaders, _reader.read<GLuint>());
+        GLenum pname = _reader.read<GLenum>();
+        time(gl_call::GetShaderiv, [&]() {
+            fn(shader, pname, (GLint*)_scratch.data());
+        });
+    }
+
+    void replay(call_tag<gl_call::GetUniformLocation>, PFNGLGETUNIFORMLOCATIONPROC fn) {
+        GLuint captured_program = _reader.read<GLuint>();
+        GLuint program = name(_programs, captured_program);
+        GLint captured = _reader.read<GLint>();
+        size_t size = 0;
+        const void* data = payload(&size);
+        _uniform_name.assign((const char*)data, NULL != data ? size : 0);
+
+        GLint location = -1;
+        time(gl_call::GetUniformLocation, [&]() {
+            location = fn(program, _uniform_name.c_str());
+        });
+        _uniforms[uniform_key(captured_program, captured)] = location;
+    }
+
+    void replay(call_tag<gl_call::LinkProgram>, PFNGLLINKPROGRAMPROC fn) {
+        GLuint program = name(_programs, _reader.read<GLuint>());
+        time(gl_call::LinkProgram, [&]() {
+            fn(program);
+        });
+    }
+
+    void replay(call_tag<gl_call::ShaderSource>, PFNGLSHADERSOURCEPROC fn) {
+        GLuint shader = name(_shaders, _reader.read<GLuint>());
+        _reader.read<GLsizei>();
+        size_t size = 0;
+        const GLchar* src = (const GLchar*)payload(&size);
+        GLint length = (GLint)size;
+        time(gl_call::ShaderSource, [&]() {
+            fn(shader, 1, &src, &length);
+        });
+    }
+
+    void replay(call_tag<gl_call::TexImage2D>, PFNGLTEXIMAGE2DPROC fn) {
+        std::tuple<GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const void*> args{
+            _reader.read<GLenum>(), _reader.read<GLint>(), _reader.read<GLint>(),
+            _reader.read<GLsizei>(), _reader.read<GLsizei>(), _reader.read<GLint>(),
+            _reader.read<GLenum>(), _reader.read<GLenum>(), _reader.read<const void*>() };
+        std::get<8>(args) = payload();
+        time(gl_call::TexImage2D, [&]() {
+            std::apply(fn, args);
+        });
+    }
+
+    void replay(call_tag<gl_call::TexImage3D>, PFNGLTEXIMAGE3DPROC fn) {
+        std::tuple<GLenum, GLint, GLint, GLsizei, GLsizei, GLsizei, GLint, GLenum, GLenum, const void*> args{
+            _reader.read<GLenum>(), _reader.read<GLint>(), _reader.read<GLint>(),
+            _reader.read<GLsizei>(), _reader.read<GLsizei>(), _reader.read<GLsizei>(),
+            _reader.read<GLint>(), _reader.read<GLenum>(), _reader.read<GLenum>(),
+            _reader.read<const void*>() };
+        std::get<9>(args) = payload();
+        time(gl_call::TexImage3D, [&]() {
+            std::apply(fn, args);
+        });
+    }
+
+    void replay(call_tag<gl_call::TexSubImage3D>, PFNGLTEXSUBIMAGE3DPROC fn) {
+        std::tuple<GLenum, GLint, GLint, GLint, GLint, GLsizei, GLsizei, GLsizei, GLenum, GLenum, const void*> args{
+            _reader.read<GLenum>(), _reader.read<GLint>(), _reader.read<GLint>(),
+            _reader.read<GLint>(), _reader.read<GLint>(), _reader.read<GLsizei>(),
+            _reader.read<GLsizei>(), _reader.read<GLsizei>(), _reader.read<GLenum>(),
+            _reader.read<GLenum>(), _reader.read<const void*>() };
+        std::get<10>(args) = payload();
+        time(gl_call::TexSubImage3D, [&]() {
+            std::apply(fn, args);
+        });
+    }
+
+    void replay(call_tag<gl_call::Uniform1f>, PFNGLUNIFORM1FPROC fn) {
+        GLint location = uniform(_reader.read<GLint>());
+        GLfloat v0 = _reader.read<GLfloat>();
+        time(gl_call::Uniform1f, [&]() {
+            fn(location, v0);
+        });
+    }
+
+    void replay(call_tag<gl_call::Uniform1i>, PFNGLUNIFORM1IPROC fn) {
+        GLint location = uniform(_reader.read<GLint>());
+        GLint v0 = _reader.read<GLint>();
+        time(gl_call::Uniform1i, [&]() {
+            fn(location, v0);
+        });
+    }
+
+    void replay(call_tag<gl_call::UseProgram>, PFNGLUSEPROGRAMPROC fn) {
+        _program = _reader.read<GLuint>();
+        GLuint program = name(_programs, _program);
+        time(gl_call::UseProgram, [&]() {
+            fn(program);
+        });
+    }
+
+    template<typename F>
+    void gen_names(gl_call call, F fn, std::unordered_map<GLuint, GLuint>& names) {
+        GLsizei n = std::max<GLsizei>(0, _reader.read<GLsizei>());
+        _names.resize(n);
+        time(call, [&]() {
+            fn(n, _names.data());
+        });
+        for (GLsizei i = 0; i < n; ++i) {
+            names[_reader.read<GLuint>()] = _names[i];
+        }
+    }
+
+    template<typename F>
+    void delete_names(gl_call call, F fn, std::unordered_map<GLuint, GLuint>& names) {
+        GLsizei n = std::max<GLsizei>(0, _reader.read<GLsizei>());
+        _names.resize(n);
+        for (GLsizei i = 0; i < n; ++i) {
+            _names[i] = take_name(names, _reader.read<GLuint>());
+        }
+        time(call, [&]() {
+            fn(n, _names.data());
+        });
+    }
+
+    // Names this context never handed out pass through unchanged.
+    static GLuint name(const std::unordered_map<GLuint, GLuint>& names, GLuint captured) {
+        auto it = names.find(captured);
+        return names.end() != it ? it->second : captured;
+    }
+
+    static GLuint take_name(std::unordered_map<GLuint, GLuint>& names, GLuint captured) {
+        GLuint replayed = name(names, captured);
+        names.erase(captured);
+        return replayed;
+    }
+
+    GLsync sync_name(GLsync captured) const {
+        auto it = _syncs.find(captured);
+        return _syncs.end() != it ? it->second : NULL;
+    }
+
+    static uint64_t uniform_key(GLuint program, GLint location) {
+        return ((uint64_t)program << 32) | (uint32_t)location;
+    }
+
+    // Locations are per program, the one in use when the trace set it.
+    GLint uniform(GLint captured) const {
+        auto it = _uniforms.find(uniform_key(_program, captured));
+        return _uniforms.end() != it ? it->second : captured;
+    }
+
+    // Reads a payload id, NULL for 0.
+    const void* payload(size_t* size = NULL) {
+        uint64_t id = _reader.read_varint();
+        const payload_t* p = 0 != id && id <= _payloads.size() ? &_payloads[id - 1] : NULL;
+        if (NULL != size) {
+            *size = NULL != p ? p->size : 0;
+        }
+        return NULL != p ? p->data : NULL;
+    }
+
+private:
+    std::vector<unsigned char> _trace;
+
+    GLTraceReader _reader;
+
+    // Index into gl_call for each call index in the trace.
+    std::vector<gl_call> _calls;
+
+    uint32_t _first_frame;
+
+    size_t _records_start;
+
+    size_t _range_start;
+
+    size_t _range_payloads;
+
+    // By payload id - 1, pointing into _trace.
+    std::vector<payload_t> _payloads;
+
+    std::unordered_map<GLuint, GLuint> _buffers;
+
+    std::unordered_map<GLuint, GLuint> _textures;
+
+    std::unordered_map<GLuint, GLuint> _vertex_arrays;
+
+    std::unordered_map<GLuint, GLuint> _shaders;
+
+    std::unordered_map<GLuint, GLuint> _programs;
+
+    std::unordered_map<GLsync, GLsync> _syncs;
+
+    std::unordered_map<uint64_t, GLint> _uniforms;
+
+    // The program in use, as named in the trace.
+    GLuint _program;
+
+    uint32_t _frame;
+
+    std::vector<GLuint> _names;
+
+    std::string _uniform_name;
+
+    std::vector<unsigned char> _scratch;
+
+    std::array<call_stats_t, gl_call_count> _stats;
+
+    std::vector<double> _frame_times;
+};
+
+}
@@ -0,0 +1,1693 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+#include "gl_calls.h"
+#include "gl_impl.h"
+#include "job_system.h"
+#include "pixel_convert.h"
+
+namespace gofran {
+
+static const int soft_max_attributes = 8;
+
+static const int soft_max_varyings = 8;
+
+static const int soft_max_uniforms = 16;
+
+static const int soft_max_units = 4;
+
+// std::floor is a libm call on x86-64 without SSE4.1. x must fit an int.
+inline int soft_floor(float x) {
+    int i = (int)x;
+    return (float)i > x ? i - 1 : i;
+}
+
+// Level 0 of a 2D texture, converted to RGBA8 on upload. Row 0 is t = 0.
+struct soft_texture_t {
+    GLenum target = 0;
+
+    GLsizei width = 0;
+
+    GLsizei height = 0;
+
+    std::vector<unsigned char> texels;
+
+    GLenum wrap_s = GL_REPEAT;
+
+    GLenum wrap_t = GL_REPEAT;
+
+    // Without mipmaps only the magnification filter is used, NEAREST or
+    // anything else for bilinear.
+    GLenum mag_filter = GL_LINEAR;
+};
+
+// Uniform values by location, a glUniform1i sets both.
+struct soft_uniforms_t {
+    GLint i[soft_max_uniforms] = {};
+
+    GLfloat f[soft_max_uniforms] = {};
+};
+
+// What a native vertex shader reads: every attribute location as a vec4,
+// missing components and disabled arrays filled with (0, 0, 0, 1) like GL.
+struct soft_vertex_in_t {
+    float attribs[soft_max_attributes][4];
+
+    const soft_uniforms_t* uniforms;
+};
+
+// What a native fragment shader reads: the perspective correct varyings
+// of the pixel, the uniforms and the textures bound to the units.
+struct soft_fragment_in_t {
+    const float* varyings;
+
+    const soft_uniforms_t* uniforms;
+
+    const soft_texture_t* const* units;
+
+    // RGBA in [0, 1], (0, 0, 0, 1) from an empty unit like an incomplete
+    // texture in GL.
+    void sample(int unit, float u, float v, float rgba[4]) const {
+        const soft_texture_t* texture = unit >= 0 && unit < soft_max_units ? units[unit] : NULL;
+        if (NULL == texture || texture->texels.empty()) {
+            rgba[0] = rgba[1] = rgba[2] = 0.0f;
+            rgba[3] = 1.0f;
+            return;
+        }
+
+        int width = texture->width;
+        int height = texture->height;
+        float x = std::clamp(u, -65536.0f, 65536.0f) * width;
+        float y = std::clamp(v, -65536.0f, 65536.0f) * height;
+        if (GL_NEAREST == texture->mag_filter) {
+            const unsigned char* texel = texel_at(*texture,
+                    wrap(soft_floor(x), width, texture->wrap_s),
+                    wrap(soft_floor(y), height, texture->wrap_t));
+            for (int c = 0; c < 4; ++c) {
+                rgba[c] = texel[c] * (1.0f / 255.0f);
+            }
+            return;
+        }
+
+        x -= 0.5f;
+        y -= 0.5f;
+        int s0 = soft_floor(x);
+        int t0 = soft_floor(y);
+        float fx = x - s0;
+        float fy = y - t0;
+        int s1 = s0 + 1;
+        int t1 = t0 + 1;
+        // Most taps are inside, wrapping needs a division.
+        if (s0 < 0 || s1 >= width) {
+            s0 = wrap(s0, width, texture->wrap_s);
+            s1 = wrap(s1, width, texture->wrap_s);
+        }
+        if (t0 < 0 || t1 >= height) {
+            t0 = wrap(t0, height, texture->wrap_t);
+            t1 = wrap(t1, height, texture->wrap_t);
+        }
+        const unsigned char* a = texel_at(*texture, s0, t0);
+        const unsigned char* b = texel_at(*texture, s1, t0);
+        const unsigned char* c = texel_at(*texture, s0, t1);
+        const unsigned char* d = texel_at(*texture, s1, t1);
+#if defined(GOFRAN_PIXEL_SSE2)
+        __m128 va = load_texel(a);
+        __m128 vb = load_texel(b);
+        __m128 vc = load_texel(c);
+        __m128 vd = load_texel(d);
+        __m128 vfx = _mm_set1_ps(fx);
+        __m128 bottom = _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), vfx));
+        __m128 top = _mm_add_ps(vc, _mm_mul_ps(_mm_sub_ps(vd, vc), vfx));
+        __m128 texel = _mm_add_ps(bottom, _mm_mul_ps(_mm_sub_ps(top, bottom), _mm_set1_ps(fy)));
+        _mm_storeu_ps(rgba, _mm_mul_ps(texel, _mm_set1_ps(1.0f / 255.0f)));
+#else
+        for (int i = 0; i < 4; ++i) {
+            float bottom = a[i] + (b[i] - a[i]) * fx;
+            float top = c[i] + (d[i] - c[i]) * fx;
+            rgba[i] = (bottom + (top - bottom) * fy) * (1.0f / 255.0f);
+        }
+#endif
+    }
+
+private:
+    static inline int wrap(int i, int size, GLenum mode) {
+        switch (mode) {
+        case GL_REPEAT:
+            i %= size;
+            return i < 0 ? i + size : i;
+        case GL_MIRRORED_REPEAT: {
+            int period = 2 * size;
+            i %= period;
+            if (i < 0) {
+                i += period;
+            }
+            return i < size ? i : period - 1 - i;
+        }
+        default:
+            return std::clamp(i, 0, size - 1);
+        }
+    }
+
+    static inline const unsigned char* texel_at(const soft_texture_t& texture, int s, int t) {
+        return &texture.texels[((size_t)t * texture.width + s) * 4];
+    }
+
+#if defined(GOFRAN_PIXEL_SSE2)
+    static inline __m128 load_texel(const unsigned char* texel) {
+        int32_t bytes;
+        memcpy(&bytes, texel, 4);
+        __m128i zero = _mm_setzero_si128();
+        __m128i words = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+    }
+#endif
+};
+
+// Native C++ stand-ins for the GLSL of a program, see GLSoft::set_program().
+// vertex writes the clip space position and varyings floats, fragment the
+// RGBA color written to the framebuffer.
+struct soft_program_t {
+    void (*vertex)(const soft_vertex_in_t& in, float position[4], float* varyings) = NULL;
+
+    void (*fragment)(const soft_fragment_in_t& in, float rgba[4]) = NULL;
+
+    int varyings = 0;
+
+    // glGetUniformLocation returns the index of the name in this list, -1
+    // for other names.
+    std::vector<std::string> uniforms;
+};
+
+// A CPU GL implementation behind the glad function pointers, for rendering
+// benchmarks and image tests on hosts without a GPU, independent of Mesa.
+// It implements what gl_impl.h and the demo use: buffers, vertex arrays
+// with float attributes, 2D RGBA8 textures with nearest or bilinear
+// sampling, indexed triangles, clear and an RGBA8 framebuffer of the size
+// given to create(). No depth, blending or mipmaps. GLSL is not compiled;
+// set_program() registers native shaders per program, drawing with a
+// program that has none is an error.
+//
+// Draws shade their vertices and set up triangles right away, in parallel
+// on the job system, and bin the triangles into 64x64 pixel tiles. Tiles
+// are rasterized when the frame is flushed (glFlush, glFinish, a fence,
+// reading pixels, or a texture change under queued draws): a job per
+// worker takes tiles from a shared counter until none are left, so a
+// thread owns a tile and needs no locks. Coverage is tested 4 pixels at a
+// time with edge functions, SSE2 when available.
+//
+// Like GLMock only one is current, calls must come from one thread, and
+// misuse sets the GL error and is logged in errors().
+class GLSoft {
+public:
+    static const int tile_size = 64;
+
+    struct stats_t {
+        uint64_t frames = 0;
+
+        uint64_t draws = 0;
+
+        // Submitted, and left after clipping and dropping degenerate ones.
+        uint64_t triangles = 0;
+
+        uint64_t binned = 0;
+
+        // Fragments shaded.
+        uint64_t pixels = 0;
+
+        // Vertex shading, triangle setup and binning in the draw calls.
+        double setup_ms = 0.0;
+
+        double raster_ms = 0.0;
+    };
+
+    explicit GLSoft(JobSystem& jobs) : _jobs(jobs)
+            , _width(0)
+            , _height(0)
+            , _tiles_x(0)
+            , _tiles_y(0)
+            , _next_name(1)
+            , _next_sync(1)
+            , _error(GL_NO_ERROR)
+            , _active_texture(0)
+            , _vertex_array(0)
+            , _program(0)
+            , _clear_pending(false)
+            , _triangle_count(0)
+            , _plane_count(0) {
+        _clear_color[0] = _clear_color[1] = _clear_color[2] = _clear_color[3] = 0.0f;
+        memset(_viewport, 0, sizeof(_viewport));
+    }
+
+    ~GLSoft() {
+        if (this == current()) {
+            current() = NULL;
+        }
+    }
+
+private:
+    GLSoft(const GLSoft&) = delete;
+
+    GLSoft* operator=(const GLSoft&) = delete;
+
+public:
+    static const char* backend_name() {
+        return "soft";
+    }
+
+    // Allocates the framebuffer, points the glad function pointers at this
+    // implementation and sets the viewport, like GLHeadless::create().
+    gli_status create(int width, int height) {
+        if (is_created()) {
+            return gli_regenerate;
+        }
+        if (width <= 0 || height <= 0) {
+            return gli_uninitialize;
+        }
+
+        _width = width;
+        _height = height;
+        _color.assign((size_t)width * height * 4, 0);
+        _tiles_x = (width + tile_size - 1) / tile_size;
+        _tiles_y = (height + tile_size - 1) / tile_size;
+        _bins.assign((size_t)_tiles_x * _tiles_y, std::vector<uint32_t>());
+
+        current() = this;
+        if (!gladLoadGLLoader(&GLSoft::proc_address)) {
+            std::cout << "GLSoft: failed to load GL" << std::endl;
+            current() = NULL;
+            _width = _height = 0;
+            return gli_uninitialize;
+        }
+        _viewport[2] = width;
+        _viewport[3] = height;
+
+        std::cout << "GLSoft: " << _jobs.thread_count() << " threads, " << tile_size << "x" << tile_size
+                << " tiles" << std::endl;
+        return gli_success;
+    }
+
+    inline bool is_created() const {
+        return 0 != _width;
+    }
+
+    inline int width() const {
+        return _width;
+    }
+
+    inline int height() const {
+        return _height;
+    }
+
+    // Stubs called while no GLSoft is current do nothing and return 0.
+    static GLSoft*& current() {
+        static GLSoft* soft = NULL;
+        return soft;
+    }
+
+    // The shaders for program, usually a GLPipeline after build_pipeline().
+    // Set them before looking up uniforms, the locations come from the list.
+    bool set_program(GLuint program, const soft_program_t& native) {
+        auto it = _programs.find(program);
+        if (_programs.end() == it || NULL == native.vertex || NULL == native.fragment
+                || native.varyings < 0 || native.varyings > soft_max_varyings
+                || native.uniforms.size() > (size_t)soft_max_uniforms) {
+            return false;
+        }
+        it->second.native = native;
+        return true;
+    }
+
+    inline bool set_program(const GLPipeline& pipeline, const soft_program_t& native) {
+        return set_program(pipeline.id(), native);
+    }
+
+    // Where a window would swap buffers; rasterizes the frame.
+    void end_frame() {
+        ++_stats.frames;
+        glFlush();
+    }
+
+    // RGBA8, top row first.
+    bool read_pixels(std::vector<unsigned char>& pixels) {
+        if (!is_created()) {
+            return false;
+        }
+
+        flush();
+        size_t row = (size_t)_width * 4;
+        pixels.resize(row * _height);
+        for (int y = 0; y < _height; ++y) {
+            memcpy(pixels.data() + y * row, _color.data() + (_height - 1 - y) * row, row);
+        }
+        return true;
+    }
+
+    gli_status write_ppm(const std::string& path) {
+        std::vector<unsigned char> pixels;
+        if (!read_pixels(pixels)) {
+            return gli_notgenerate;
+        }
+
+        std::ofstream file(path, std::ios::binary);
+        file << "P6\n" << _width << " " << _height << "\n255\n";
+        for (size_t i = 0; i < pixels.size(); i += 4) {
+            file.write((const char*)&pixels[i], 3);
+        }
+        return file ? gli_success : gli_io_failed;
+    }
+
+    inline const stats_t& stats() const {
+        return _stats;
+    }
+
+    inline void clear_stats() {
+        _stats = stats_t();
+    }
+
+    // Fill rate and triangle throughput over the stats so far.
+    void report(std::ostream& out) const {
+        double ms = _stats.setup_ms + _stats.raster_ms;
+        out << "GLSoft: " << _stats.frames << " frames, " << _stats.draws << " draws, " << _stats.triangles
+                << " triangles (" << _stats.binned << " binned), " << _stats.pixels << " pixels; setup "
+                << _stats.setup_ms << " ms, raster " << _stats.raster_ms << " ms: "
+                << (_stats.raster_ms > 0.0 ? _stats.pixels / (_stats.raster_ms * 1e3) : 0.0) << " Mpixels/s, "
+                << (ms > 0.0 ? _stats.triangles / (ms * 1e3) : 0.0) << " Mtriangles/s" << std::endl;
+    }
+
+    inline const std::vector<std::string>& errors() const {
+        return _errors;
+    }
+
+    inline void clear_errors() {
+        _errors.clear();
+        _error = GL_NO_ERROR;
+    }
+
+private:
+    struct buffer_t {
+        std::vector<unsigned char> data;
+    };
+
+    struct attrib_t {
+        bool enabled = false;
+
+        GLint size = 4;
+
+        GLsizei stride = 0;
+
+        uintptr_t offset = 0;
+
+        GLuint buffer = 0;
+    };
+
+    struct vertex_array_t {
+        GLuint element_buffer = 0;
+
+        attrib_t attribs[soft_max_attributes];
+    };
+
+    struct shader_t {
+        GLenum type = 0;
+
+        bool compiled = false;
+    };
+
+    struct program_t {
+        std::vector<GLuint> shaders;
+
+        bool linked = false;
+
+        soft_program_t native;
+
+        soft_uniforms_t uniforms;
+    };
+
+    // What the tiles need of a draw, copied so later state changes don't
+    // reach queued triangles. Textures are flushed before they change.
+    struct draw_t {
+        void (*fragment)(const soft_fragment_in_t& in, float rgba[4]);
+
+        int varyings;
+
+        soft_uniforms_t uniforms;
+
+        const soft_texture_t* units[soft_max_units];
+
+        // Where the planes of the draw's first triangle slot start.
+        size_t planes;
+
+        uint32_t first_slot;
+    };
+
+    // Screen space, y up, counter-clockwise after setup. Edge i is opposite
+    // vertex i: e(x, y) = a * x + b * y + c, inside where positive.
+    struct triangle_t {
+        uint32_t draw;
+
+        bool valid;
+
+        float a[3];
+
+        float b[3];
+
+        float c[3];
+
+        // Pixels on an edge belong to the top or left one.
+        bool top_left[3];
+
+        int min_x;
+
+        int min_y;
+
+        int max_x;
+
+        int max_y;
+    };
+
+    // Work shared by the jobs of parallel(); late jobs find nothing left.
+    struct parallel_t {
+        std::atomic<size_t> next;
+
+        std::atomic<size_t> done;
+
+        size_t count;
+
+        size_t grain;
+
+        std::function<void(size_t, size_t)> fn;
+
+        void work() {
+            for (;;) {
+                size_t first = next.fetch_add(grain, std::memory_order_relaxed);
+                if (first >= count) {
+                    return;
+                }
+                size_t last = std::min(count, first + grain);
+                fn(first, last);
+                done.fetch_add(last - first, std::memory_order_release);
+            }
+        }
+    };
+
+    // Calls fn(first, last) over [0, count) on the calling thread and a job
+    // per worker. The caller never runs other jobs while it waits: on the
+    // main thread those can be GL calls, which must not reenter.
+    void parallel(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn) {
+        if (count <= grain || _jobs.thread_count() < 2) {
+            fn(0, count);
+            return;
+        }
+
+        auto shared = std::make_shared<parallel_t>();
+        shared->next = 0;
+        shared->done = 0;
+        shared->count = count;
+        shared->grain = grain;
+        shared->fn = fn;
+        size_t helpers = std::min(_jobs.thread_count() - 1, (count + grain - 1) / grain - 1);
+        for (size_t i = 0; i < helpers; ++i) {
+            _jobs.run([shared]() { shared->work(); }, NULL);
+        }
+
+        shared->work();
+        while (shared->done.load(std::memory_order_acquire) < count) {
+            std::this_thread::yield();
+        }
+    }
+
+    // Like GL only the first error sticks until glGetError.
+    void error(GLenum code, gl_call call, const char* what) {
+        if (GL_NO_ERROR == _error) {
+            _error = code;
+        }
+
+        std::string message = gl_call_name(call);
+        message += ": ";
+        message += what;
+        _errors.push_back(message);
+    }
+
+    static uint64_t texture_key(GLuint unit, GLenum target) {
+        return ((uint64_t)unit << 32) | target;
+    }
+
+    static bool is_buffer_target(GLenum target) {
+        switch (target) {
+        case GL_ARRAY_BUFFER:
+        case GL_ELEMENT_ARRAY_BUFFER:
+        case GL_COPY_READ_BUFFER:
+        case GL_COPY_WRITE_BUFFER:
+        case GL_PIXEL_PACK_BUFFER:
+        case GL_PIXEL_UNPACK_BUFFER:
+        case GL_UNIFORM_BUFFER:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static bool is_texture_target(GLenum target) {
+        switch (target) {
+        case GL_TEXTURE_2D:
+        case GL_TEXTURE_2D_ARRAY:
+        case GL_TEXTURE_3D:
+        case GL_TEXTURE_CUBE_MAP:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // The element array binding belongs to the vertex array.
+    GLuint& buffer_binding(GLenum target) {
+        if (GL_ELEMENT_ARRAY_BUFFER == target && 0 != _vertex_array) {
+            return _vertex_arrays[_vertex_array].element_buffer;
+        }
+        return _bound_buffers[target];
+    }
+
+    GLuint bound_texture(GLuint unit, GLenum target) const {
+        auto it = _bound_textures.find(texture_key(unit, target));
+        return _bound_textures.end() != it ? it->second : 0;
+    }
+
+    soft_texture_t* bound_texture_object(GLenum target, gl_call call) {
+        if (!is_texture_target(target)) {
+            error(GL_INVALID_ENUM, call, "invalid texture target");
+            return NULL;
+        }
+
+        auto it = _textures.find(bound_texture(_active_texture, target));
+        if (_textures.end() == it) {
+            error(GL_INVALID_OPERATION, call, "no texture bound");
+            return NULL;
+        }
+        return &it->second;
+    }
+
+    template<typename T>
+    void generate(GLsizei n, GLuint* names, std::unordered_map<GLuint, T>& objects, gl_call call) {
+        if (n < 0) {
+            error(GL_INVALID_VALUE, call, "negative count");
+            return;
+        }
+
+        for (GLsizei i = 0; i < n; ++i) {
+            names[i] = _next_name++;
+            objects[names[i]];
+        }
+    }
+
+    static inline uint32_t pack_color(const float rgba[4]) {
+#if defined(GOFRAN_PIXEL_SSE2)
+        // max() first turns NaN into 0, like unorm_to_u8().
+        __m128 unorm = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(rgba), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        __m128i words = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(unorm, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+        words = _mm_packs_epi32(words, words);
+        return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+#else
+        unsigned char bytes[4] = { detail::unorm_to_u8(rgba[0]), detail::unorm_to_u8(rgba[1]),
+                detail::unorm_to_u8(rgba[2]), detail::unorm_to_u8(rgba[3]) };
+        uint32_t color;
+        memcpy(&color, bytes, 4);
+        return color;
+#endif
+    }
+
+    // Rasterizes the queued triangles and clears.
+    void flush() {
+        if (!_clear_pending && 0 == _triangle_count) {
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::atomic<uint64_t> pixels(0);
+        parallel(_bins.size(), 1, [&](size_t first, size_t last) {
+            uint64_t shaded = 0;
+            for (size_t tile = first; tile < last; ++tile) {
+                shaded += raster_tile(tile);
+            }
+            pixels.fetch_add(shaded, std::memory_order_relaxed);
+        });
+        _stats.pixels += pixels.load();
+        _stats.raster_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        for (auto& bin : _bins) {
+            bin.clear();
+        }
+        _triangle_count = 0;
+        _plane_count = 0;
+        _draws.clear();
+        _clear_pending = false;
+    }
+
+    uint64_t raster_tile(size_t tile) {
+        int tile_x = (int)(tile % _tiles_x) * tile_size;
+        int tile_y = (int)(tile / _tiles_x) * tile_size;
+        int tile_right = std::min(tile_x + tile_size, _width) - 1;
+        int tile_top = std::min(tile_y + tile_size, _height) - 1;
+        size_t row = (size_t)_width * 4;
+
+        if (_clear_pending) {
+            for (int y = tile_y; y <= tile_top; ++y) {
+                unsigned char* pixel = _color.data() + y * row + tile_x * 4;
+                for (int x = tile_x; x <= tile_right; ++x, pixel += 4) {
+                    memcpy(pixel, &_clear_value, 4);
+                }
+            }
+        }
+
+        uint64_t shaded = 0;
+        for (uint32_t index : _bins[tile]) {
+            const triangle_t& tri = _triangles[index];
+            const draw_t& draw = _draws[tri.draw];
+            const float* planes = triangle_planes(draw, index);
+            int x0 = std::max(tri.min_x, tile_x);
+            int x1 = std::min(tri.max_x, tile_right);
+            int y0 = std::max(tri.min_y, tile_y);
+            int y1 = std::min(tri.max_y, tile_top);
+
+            // Varyings of the 4 pixels of a coverage test, pixel major.
+            float varyings[4][soft_max_varyings];
+            soft_fragment_in_t in;
+            in.uniforms = &draw.uniforms;
+            in.units = draw.units;
+            int planes_count = draw.varyings + 1;
+
+            for (int y = y0; y <= y1; ++y) {
+                float py = (float)y + 0.5f;
+                float rows[3];
+                for (int i = 0; i < 3; ++i) {
+                    rows[i] = tri.b[i] * py + tri.c[i];
+                }
+                float plane_rows[soft_max_varyings + 1];
+                for (int k = 0; k < planes_count; ++k) {
+                    plane_rows[k] = planes[3 * k + 1] * py + planes[3 * k + 2];
+                }
+                unsigned char* line = _color.data() + y * row;
+
+                for (int x = x0; x <= x1; x += 4) {
+                    unsigned int mask = coverage(tri, rows, x) & lane_mask(x1 - x);
+                    if (0 == mask) {
+                        continue;
+                    }
+
+                    // All 4 lanes, which vectorizes, then shade the covered.
+                    float px[4];
+                    float w[4];
+                    for (int lane = 0; lane < 4; ++lane) {
+                        px[lane] = (float)(x + lane) + 0.5f;
+                        w[lane] = 1.0f / (planes[0] * px[lane] + plane_rows[0]);
+                    }
+                    for (int k = 1; k < planes_count; ++k) {
+                        for (int lane = 0; lane < 4; ++lane) {
+                            varyings[lane][k - 1] = (planes[3 * k] * px[lane] + plane_rows[k]) * w[lane];
+                        }
+                    }
+
+                    for (int lane = 0; mask; ++lane, mask >>= 1) {
+                        if (0 == (mask & 1)) {
+                            continue;
+                        }
+
+                        in.varyings = varyings[lane];
+                        float rgba[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+                        draw.fragment(in, rgba);
+                        uint32_t color = pack_color(rgba);
+                        memcpy(line + (x + lane) * 4, &color, 4);
+                        ++shaded;
+                    }
+                }
+            }
+        }
+        return shaded;
+    }
+
+    // Lanes x .. x + 3 that are at most last - x away.
+    static inline unsigned int lane_mask(int left) {
+        return left >= 3 ? 0xf : (1u << (left + 1)) - 1;
+    }
+
+    // Bit per pixel x .. x + 3 of the row whose b * y + c are rows. Both
+    // paths compute a * x + row in the same order, so a pixel on an edge
+    // shared by two triangles is exactly zero in both.
+    static inline unsigned int coverage(const triangle_t& tri, const float rows[3], int x) {
+#if defined(GOFRAN_PIXEL_SSE2)
+        __m128 px = _mm_add_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(x), _mm_setr_epi32(0, 1, 2, 3))),
+                _mm_set1_ps(0.5f));
+        __m128 zero = _mm_setzero_ps();
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int i = 0; i < 3; ++i) {
+            __m128 e = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.a[i]), px), _mm_set1_ps(rows[i]));
+            __m128 on_edge = tri.top_left[i] ? _mm_cmpeq_ps(e, zero) : zero;
+            inside = _mm_and_ps(inside, _mm_or_ps(_mm_cmpgt_ps(e, zero), on_edge));
+        }
+        return (unsigned int)_mm_movemask_ps(inside);
+#else
+        unsigned int mask = 0;
+        for (int lane = 0; lane < 4; ++lane) {
+            float px = (float)(x + lane) + 0.5f;
+            bool inside = true;
+            for (int i = 0; i < 3; ++i) {
+                float e = tri.a[i] * px + rows[i];
+                inside = inside && (e > 0.0f || (0.0f == e && tri.top_left[i]));
+            }
+            mask |= (inside ? 1u : 0u) << lane;
+        }
+        return mask;
+#endif
+    }
+
+    // 1 / w and varying / w, a plane of 3 floats each.
+    static inline size_t plane_floats(int varyings) {
+        return 3 * (size_t)(varyings + 1);
+    }
+
+    inline float* triangle_planes(const draw_t& draw, uint32_t slot) {
+        return &_planes[draw.planes + (slot - draw.first_slot) * plane_floats(draw.varyings)];
+    }
+
+    // A triangle cut by the near plane, its second half goes to another slot.
+    struct quad_t {
+        float vertices[4][4 + soft_max_varyings];
+    };
+
+    // Clip space vertices with their varyings, to the triangle at slot: w is
+    // clipped at the near plane, the rest is left to the viewport bounds.
+    // True when that left a quad, the caller emits its second half.
+    bool setup_triangle(const float* v0, const float* v1, const float* v2, const draw_t& draw, uint32_t slot,
+            quad_t& quad) {
+        _triangles[slot].valid = false;
+
+        const float* in[3] = { v0, v1, v2 };
+        for (int axis = 0; axis < 3; ++axis) {
+            if ((v0[axis] > v0[3] && v1[axis] > v1[3] && v2[axis] > v2[3])
+                    || (v0[axis] < -v0[3] && v1[axis] < -v1[3] && v2[axis] < -v2[3])) {
+                return false;
+            }
+        }
+
+        const float near_w = 1e-5f;
+        if (v0[3] >= near_w && v1[3] >= near_w && v2[3] >= near_w) {
+            emit_triangle(in, draw, slot);
+            return false;
+        }
+
+        // Sutherland-Hodgman against w >= near_w.
+        size_t stride = 4 + draw.varyings;
+        float (*clipped)[4 + soft_max_varyings] = quad.vertices;
+        int n = 0;
+        for (int i = 0; i < 3; ++i) {
+            const float* a = in[i];
+            const float* b = in[(i + 1) % 3];
+            if (a[3] >= near_w) {
+                memcpy(clipped[n++], a, stride * sizeof(float));
+            }
+            if ((a[3] >= near_w) != (b[3] >= near_w)) {
+                float t = (near_w - a[3]) / (b[3] - a[3]);
+                for (size_t k = 0; k < stride; ++k) {
+                    clipped[n][k] = a[k] + (b[k] - a[k]) * t;
+                }
+                ++n;
+            }
+        }
+        if (n >= 3) {
+            const float* first[3] = { clipped[0], clipped[1], clipped[2] };
+            emit_triangle(first, draw, slot);
+        }
+        return 4 == n;
+    }
+
+    // Frame storage only grows, resizing would clear it every draw.
+    void grow_frame(size_t triangles, size_t planes) {
+        if (_triangles.size() < triangles) {
+            _triangles.resize(std::max(triangles, 2 * _triangles.size()));
+        }
+        if (_planes.size() < planes) {
+            _planes.resize(std::max(planes, 2 * _planes.size()));
+        }
+    }
+
+    void emit_triangle(const float* const in[3], const draw_t& draw, uint32_t slot) {
+        float x[3];
+        float y[3];
+        float inv_w[3];
+        for (int i = 0; i < 3; ++i) {
+            inv_w[i] = 1.0f / in[i][3];
+            x[i] = _viewport[0] + (in[i][0] * inv_w[i] * 0.5f + 0.5f) * _viewport[2];
+            y[i] = _viewport[1] + (in[i][1] * inv_w[i] * 0.5f + 0.5f) * _viewport[3];
+        }
+
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+        if (!(std::fabs(area) > 0.0f) || !std::isfinite(area)) {
+            return;
+        }
+
+        // No culling in GL by default, clockwise triangles are turned around.
+        int order[3] = { 0, 1, 2 };
+        if (area < 0.0f) {
+            std::swap(order[1], order[2]);
+            area = -area;
+        }
+
+        triangle_t& tri = _triangles[slot];
+        float min_x = std::max((float)std::max(_viewport[0], 0), std::min({ x[0], x[1], x[2] }));
+        float max_x = std::min((float)std::min(_viewport[0] + _viewport[2], _width), std::max({ x[0], x[1], x[2] }));
+        float min_y = std::max((float)std::max(_viewport[1], 0), std::min({ y[0], y[1], y[2] }));
+        float max_y = std::min((float)std::min(_viewport[1] + _viewport[3], _height), std::max({ y[0], y[1], y[2] }));
+        // Pixels whose centers are in the bounds.
+        tri.min_x = -soft_floor(0.5f - min_x);
+        tri.max_x = std::min(soft_floor(max_x - 0.5f), _width - 1);
+        tri.min_y = -soft_floor(0.5f - min_y);
+        tri.max_y = std::min(soft_floor(max_y - 0.5f), _height - 1);
+        if (tri.min_x > tri.max_x || tri.min_y > tri.max_y) {
+            return;
+        }
+
+        for (int i = 0; i < 3; ++i) {
+            int from = order[(i + 1) % 3];
+            int to = order[(i + 2) % 3];
+            // From the lower vertex of the two, so the triangle on the other
+            // side of the edge gets exactly the negated function.
+            bool flip = y[from] > y[to] || (y[from] == y[to] && x[from] > x[to]);
+            int p = flip ? to : from;
+            int q = flip ? from : to;
+            float a = y[p] - y[q];
+            float b = x[q] - x[p];
+            float c = -(a * x[p] + b * y[p]);
+            float dx = x[to] - x[from];
+            float dy = y[to] - y[from];
+            tri.a[i] = flip ? -a : a;
+            tri.b[i] = flip ? -b : b;
+            tri.c[i] = flip ? -c : c;
+            tri.top_left[i] = dy < 0.0f || (0.0f == dy && dx < 0.0f);
+        }
+
+        // value(x, y) = sum of e_i(x, y) * value_i / area.
+        float* planes = triangle_planes(draw, slot);
+        float inv_area = 1.0f / area;
+        for (int k = 0; k <= draw.varyings; ++k) {
+            float values[3];
+            for (int i = 0; i < 3; ++i) {
+                int v = order[i];
+                values[i] = 0 == k ? inv_w[v] : in[v][4 + k - 1] * inv_w[v];
+            }
+            float* plane = planes + 3 * k;
+            plane[0] = (tri.a[0] * values[0] + tri.a[1] * values[1] + tri.a[2] * values[2]) * inv_area;
+            plane[1] = (tri.b[0] * values[0] + tri.b[1] * values[1] + tri.b[2] * values[2]) * inv_area;
+            plane[2] = (tri.c[0] * values[0] + tri.c[1] * values[1] + tri.c[2] * values[2]) * inv_area;
+        }
+        tri.draw = (uint32_t)_draws.size() - 1;
+        tri.valid = true;
+    }
+
+    // The stubs glad calls, one per entry point, forwarding to the members
+    // of the same name below.
+#define GOFRAN_GL_ENTRYPOINT(ret, name, params, args) \
+    static ret APIENTRY stub_##name params { \
+        GLSoft* soft = current(); \
+        if (NULL == soft) { \
+            return (ret)0; \
+        } \
+        return soft->name args; \
+    }
+#include "gl_entrypoints.h"
+
+    static void* proc_address(const char* name) {
+        struct proc_t {
+            const char* name;
+
+            void* proc;
+        };
+        static const proc_t procs[] = {
+#define GOFRAN_GL_ENTRYPOINT(ret, name, params, args) { "gl" #name, (void*)&GLSoft::stub_##name },
+#include "gl_entrypoints.h"
+        };
+
+        for (const auto& proc : procs) {
+            if (0 == strcmp(name, proc.name)) {
+                return proc.proc;
+            }
+        }
+        return NULL;
+    }
+
+    void ActiveTexture(GLenum texture) {
+        if (texture < GL_TEXTURE0 || texture > GL_TEXTURE31) {
+            error(GL_INVALID_ENUM, gl_call::ActiveTexture, "invalid texture unit");
+            return;
+        }
+        _active_texture = texture - GL_TEXTURE0;
+    }
+
+    void AttachShader(GLuint program, GLuint shader) {
+        auto it = _programs.find(program);
+        if (_programs.end() == it || 0 == _shaders.count(shader)) {
+            error(GL_INVALID_VALUE, gl_call::AttachShader, "unknown program or shader");
+            return;
+        }
+        it->second.shaders.push_back(shader);
+    }
+
+    void BindBuffer(GLenum target, GLuint buffer) {
+        if (!is_buffer_target(target)) {
+            error(GL_INVALID_ENUM, gl_call::BindBuffer, "invalid buffer target");
+            return;
+        }
+        if (0 != buffer && 0 == _buffers.count(buffer)) {
+            error(GL_INVALID_OPERATION, gl_call::BindBuffer, "unknown buffer");
+            return;
+        }
+        buffer_binding(target) = buffer;
+    }
+
+    void BindTexture(GLenum target, GLuint texture) {
+        if (!is_texture_target(target)) {
+            error(GL_INVALID_ENUM, gl_call::BindTexture, "invalid texture target");
+            return;
+        }
+        if (0 != texture) {
+            auto it = _textures.find(texture);
+            if (_textures.end() == it) {
+                error(GL_INVALID_OPERATION, gl_call::BindTexture, "unknown texture");
+                return;
+            }
+            if (0 == it->second.target) {
+                it->second.target = target;
+            } else if (target != it->second.target) {
+                error(GL_INVALID_OPERATION, gl_call::BindTexture, "texture bound to another target before");
+                return;
+            }
+        }
+        _bound_textures[texture_key(_active_texture, target)] = texture;
+    }
+
+    void BindVertexArray(GLuint array) {
+        if (0 != array && 0 == _vertex_arrays.count(array)) {
+            error(GL_INVALID_OPERATION, gl_call::BindVertexArray, "unknown vertex array");
+            return;
+        }
+        _vertex_array = array;
+    }
+
+    // Vertices are shaded when drawn, so buffers change without a flush.
+    void BufferData(GLenum target, GLsizeiptr size, const void* data, GLenum) {
+        if (!is_buffer_target(target)) {
+            error(GL_INVALID_ENUM, gl_call::BufferData, "invalid buffer target");
+            return;
+        }
+        if (size < 0) {
+            error(GL_INVALID_VALUE, gl_call::BufferData, "negative size");
+            return;
+        }
+        auto it = _buffers.find(buffer_binding(target));
+        if (_buffers.end() == it) {
+            error(GL_INVALID_OPERATION, gl_call::BufferData, "no buffer bound");
+            return;
+        }
+        if (NULL != data) {
+            it->second.data.assign((const unsigned char*)data, (const unsigned char*)data + size);
+        } else {
+            it->second.data.assign((size_t)size, 0);
+        }
+    }
+
+    // Only the color buffer, which is all there is.
+    void Clear(GLbitfield mask) {
+        if (0 == (mask & GL_COLOR_BUFFER_BIT) || !is_created()) {
+            return;
+        }
+        if (0 != _triangle_count) {
+            flush();
+        }
+        _clear_pending = true;
+        _clear_value = pack_color(_clear_color);
+    }
+
+    void ClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {
+        _clear_color[0] = red;
+        _clear_color[1] = green;
+        _clear_color[2] = blue;
+        _clear_color[3] = alpha;
+    }
+
+    // Fences are created after the flush, so they are always signaled.
+    GLenum ClientWaitSync(GLsync sync, GLbitfield, GLuint64) {
+        if (0 == _syncs.count(sync)) {
+            error(GL_INVALID_VALUE, gl_call::ClientWaitSync, "unknown sync");
+            return GL_WAIT_FAILED;
+        }
+        return GL_ALREADY_SIGNALED;
+    }
+
+    void CompileShader(GLuint shader) {
+        auto it = _shaders.find(shader);
+        if (_shaders.end() == it) {
+            error(GL_INVALID_VALUE, gl_call::CompileShader, "unknown shader");
+            return;
+        }
+        it->second.compiled = true;
+    }
+
+    GLuint CreateProgram() {
+        GLuint name = _next_name++;
+        _programs[name];
+        return name;
+    }
+
+    GLuint CreateShader(GLenum type) {
+        if (GL_VERTEX_SHADER != type && GL_FRAGMENT_SHADER != type) {
+            error(GL_INVALID_ENUM, gl_call::CreateShader, "invalid shader type");
+            return 0;
+        }
+        GLuint name = _next_name++;
+        _shaders[name].type = type;
+        return name;
+    }
+
+    void DeleteBuffers(GLsizei n, const GLuint* buffers) {
+        for (GLsizei i = 0; i < n; ++i) {
+            _buffers.erase(buffers[i]);
+            for (auto& binding : _bound_buffers) {
+                if (buffers[i] == binding.second) {
+                    binding.second = 0;
+                }
+            }
+        }
+    }
+
+    void DeleteProgram(GLuint program) {
+        _programs.erase(program);
+        if (program == _program) {
+            _program = 0;
+        }
+    }
+
+    void DeleteShader(GLuint shader) {
+        _shaders.erase(shader);
+    }
+
+    void DeleteSync(GLsync sync) {
+        if (NULL != sync && 0 == _syncs.erase(sync)) {
+            error(GL_INVALID_VALUE, gl_call::DeleteSync, "unknown sync");
+        }
+    }
+
+    void DeleteTextures(GLsizei n, const GLuint* textures) {
+        flush();
+        for (GLsizei i = 0; i < n; ++i) {
+            _textures.erase(textures[i]);
+            for (auto& binding : _bound_textures) {
+                if (textures[i] == binding.second) {
+                    binding.second = 0;
+                }
+            }
+        }
+    }
+
+    void DeleteVertexArrays(GLsizei n, const GLuint* arrays) {
+        for (GLsizei i = 0; i < n; ++i) {
+            _vertex_arrays.erase(arrays[i]);
+            if (arrays[i] == _vertex_array) {
+                _vertex_array = 0;
+            }
+        }
+    }
+
+    void DrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices) {
+        if (count < 0) {
+            error(GL_INVALID_VALUE, gl_call::DrawElements, "negative count");
+            return;
+        }
+        if (GL_TRIANGLES != mode) {
+            error(GL_INVALID_ENUM, gl_call::DrawElements, "only GL_TRIANGLES is rasterized");
+            return;
+        }
+        size_t index_size = GL_UNSIGNED_INT == type ? 4 : GL_UNSIGNED_SHORT == type ? 2 : GL_UNSIGNED_BYTE == type ? 1 : 0;
+        if (0 == index_size) {
+            error(GL_INVALID_ENUM, gl_call::DrawElements, "invalid index type");
+            return;
+        }
+        auto program = _programs.find(_program);
+        auto vertex_array = _vertex_arrays.find(_vertex_array);
+        if (_programs.end() == program || !program->second.linked || _vertex_arrays.end() == vertex_array) {
+            error(GL_INVALID_OPERATION, gl_call::DrawElements, "no program or vertex array");
+            return;
+        }
+        const soft_program_t& native = program->second.native;
+        if (NULL == native.vertex) {
+            error(GL_INVALID_OPERATION, gl_call::DrawElements, "no native shaders set for the program");
+            return;
+        }
+        auto elements = _buffers.find(vertex_array->second.element_buffer);
+        uintptr_t offset = (uintptr_t)indices;
+        if (_buffers.end() == elements || offset + count * index_size > elements->second.data.size()) {
+            error(GL_INVALID_OPERATION, gl_call::DrawElements, "indices outside the element buffer");
+            return;
+        }
+        if (count < 3 || !is_created()) {
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        size_t triangles = count / 3;
+        _indices.resize(triangles * 3);
+        const unsigned char* source = elements->second.data.data() + offset;
+        uint32_t lowest = UINT32_MAX;
+        uint32_t highest = 0;
+        for (size_t i = 0; i < _indices.size(); ++i) {
+            uint32_t index;
+            if (4 == index_size) {
+                memcpy(&index, source + i * 4, 4);
+            } else if (2 == index_size) {
+                uint16_t short_index;
+                memcpy(&short_index, source + i * 2, 2);
+                index = short_index;
+            } else {
+                index = source[i];
+            }
+            _indices[i] = index;
+            lowest = std::min(lowest, index);
+            highest = std::max(highest, index);
+        }
+
+        draw_t draw;
+        draw.fragment = native.fragment;
+        draw.varyings = native.varyings;
+        draw.uniforms = program->second.uniforms;
+        for (int unit = 0; unit < soft_max_units; ++unit) {
+            auto texture = _textures.find(bound_texture(unit, GL_TEXTURE_2D));
+            draw.units[unit] = _textures.end() != texture ? &texture->second : NULL;
+        }
+        // A slot per triangle, then the second halves of clipped ones.
+        // Culled triangles stay in their slot and are skipped when binning.
+        uint32_t base = _triangle_count;
+        draw.planes = _plane_count;
+        draw.first_slot = base;
+        _draws.push_back(draw);
+        grow_frame(base + triangles, draw.planes + triangles * plane_floats(draw.varyings));
+
+        shade_vertices(vertex_array->second, native, draw.uniforms, lowest, highest);
+
+        size_t stride = 4 + draw.varyings;
+        std::vector<quad_t> quads;
+        std::mutex quads_mutex;
+        parallel(triangles, 1024, [&](size_t first, size_t last) {
+            quad_t quad;
+            for (size_t i = first; i < last; ++i) {
+                const float* v0 = &_vertices[(_indices[3 * i] - lowest) * stride];
+                const float* v1 = &_vertices[(_indices[3 * i + 1] - lowest) * stride];
+                const float* v2 = &_vertices[(_indices[3 * i + 2] - lowest) * stride];
+                if (setup_triangle(v0, v1, v2, draw, base + (uint32_t)i, quad)) {
+                    std::lock_guard<std::mutex> lock(quads_mutex);
+                    quads.push_back(quad);
+                }
+            }
+        });
+        _triangle_count = base + (uint32_t)triangles;
+        for (const quad_t& quad : quads) {
+            grow_frame(_triangle_count + 1, draw.planes + (_triangle_count + 1 - base) * plane_floats(draw.varyings));
+            const float* second[3] = { quad.vertices[0], quad.vertices[2], quad.vertices[3] };
+            _triangles[_triangle_count].valid = false;
+            emit_triangle(second, draw, _triangle_count++);
+        }
+        _plane_count = draw.planes + (_triangle_count - base) * plane_floats(draw.varyings);
+
+        for (uint32_t slot = base; slot < _triangle_count; ++slot) {
+            const triangle_t& tri = _triangles[slot];
+            if (!tri.valid) {
+                continue;
+            }
+            ++_stats.binned;
+            for (int ty = tri.min_y / tile_size; ty <= tri.max_y / tile_size; ++ty) {
+                for (int tx = tri.min_x / tile_size; tx <= tri.max_x / tile_size; ++tx) {
+                    _bins[(size_t)ty * _tiles_x + tx].push_back(slot);
+                }
+            }
+        }
+
+        ++_stats.draws;
+        _stats.triangles += triangles;
+        _stats.setup_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Runs the vertex shader once for each of lowest .. highest into
+    // _vertices: clip position then varyings.
+    void shade_vertices(const vertex_array_t& vertex_array, const soft_program_t& native,
+            const soft_uniforms_t& uniforms, uint32_t lowest, uint32_t highest) {
+        struct fetch_t {
+            const unsigned char* data = NULL;
+
+            size_t size = 0;
+
+            size_t stride = 0;
+
+            size_t offset = 0;
+
+            int components = 0;
+        };
+
+        // Only the enabled arrays, by location.
+        fetch_t fetches[soft_max_attributes];
+        int locations[soft_max_attributes];
+        int enabled = 0;
+        for (int i = 0; i < soft_max_attributes; ++i) {
+            const attrib_t& attrib = vertex_array.attribs[i];
+            auto buffer = _buffers.find(attrib.buffer);
+            if (!attrib.enabled || _buffers.end() == buffer) {
+                continue;
+            }
+            fetch_t& fetch = fetches[enabled];
+            fetch.data = buffer->second.data.data();
+            fetch.size = buffer->second.data.size();
+            fetch.stride = attrib.stride ? attrib.stride : attrib.size * sizeof(float);
+            fetch.offset = attrib.offset;
+            fetch.components = attrib.size;
+            locations[enabled++] = i;
+        }
+
+        size_t stride = 4 + native.varyings;
+        size_t vertices = (size_t)highest - lowest + 1;
+        _vertices.resize(vertices * stride);
+        parallel(vertices, 1024, [&](size_t first, size_t last) {
+            // Components an array doesn't have keep the default.
+            static const float defaults[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+            soft_vertex_in_t in;
+            in.uniforms = &uniforms;
+            for (int i = 0; i < soft_max_attributes; ++i) {
+                memcpy(in.attribs[i], defaults, sizeof(defaults));
+            }
+            for (size_t v = first; v < last; ++v) {
+                for (int i = 0; i < enabled; ++i) {
+                    float* attrib = in.attribs[locations[i]];
+                    const fetch_t& fetch = fetches[i];
+                    size_t at = fetch.offset + (lowest + v) * fetch.stride;
+                    // Reads past the end of the buffer leave the whole
+                    // attribute at the default, like Mesa does.
+                    if (at + fetch.components * sizeof(float) <= fetch.size) {
+                        memcpy(attrib, fetch.data + at, fetch.components * sizeof(float));
+                    } else {
+                        memcpy(attrib, defaults, sizeof(defaults));
+                    }
+                }
+                float* out = &_vertices[v * stride];
+                native.vertex(in, out, out + 4);
+            }
+        });
+    }
+
+    void EnableVertexAttribArray(GLuint index) {
+        auto it = _vertex_arrays.find(_vertex_array);
+        if (_vertex_arrays.end() == it || index >= (GLuint)soft_max_attributes) {
+            error(GL_INVALID_OPERATION, gl_call::EnableVertexAttribArray, "no vertex array bound or index too large");
+            return;
+        }
+        it->second.attribs[index].enabled = true;
+    }
+
+    GLsync FenceSync(GLenum, GLbitfield) {
+        flush();
+        GLsync sync = (GLsync)(uintptr_t)_next_sync++;
+        _syncs.insert(sync);
+        return sync;
+    }
+
+    void Finish() {
+        flush();
+    }
+
+    void Flush() {
+        flush();
+    }
+
+    void GenBuffers(GLsizei n, GLuint* buffers) {
+        generate(n, buffers, _buffers, gl_call::GenBuffers);
+    }
+
+    void GenTextures(GLsizei n, GLuint* textures) {
+        generate(n, textures, _textures, gl_call::GenTextures);
+    }
+
+    void GenVertexArrays(GLsizei n, GLuint* arrays) {
+        generate(n, arrays, _vertex_arrays, gl_call::GenVertexArrays);
+    }
+
+    // Only level 0 is sampled.
+    void GenerateMipmap(GLenum target) {
+        bound_texture_object(target, gl_call::GenerateMipmap);
+    }
+
+    GLenum GetError() {
+        GLenum code = _error;
+        _error = GL_NO_ERROR;
+        return code;
+    }
+
+    // glad needs at least one extension from a 3.x context.
+    void GetIntegerv(GLenum pname, GLint* data) {
+        switch (pname) {
+        case GL_NUM_EXTENSIONS:
+            *data = 1;
+            break;
+        case GL_MAJOR_VERSION:
+        case GL_MINOR_VERSION:
+            *data = 3;
+            break;
+        case GL_VIEWPORT:
+            memcpy(data, _viewport, sizeof(_viewport));
+            break;
+        case GL_MAX_TEXTURE_IMAGE_UNITS:
+            *data = soft_max_units;
+            break;
+        default:
+            *data = 0;
+            break;
+        }
+    }
+
+    static void empty_log(GLsizei buf_size, GLsizei* length, GLchar* log) {
+        if (NULL != length) {
+            *length = 0;
+        }
+        if (buf_size > 0 && NULL != log) {
+            log[0] = '\0';
+        }
+    }
+
+    void GetProgramInfoLog(GLuint, GLsizei buf_size, GLsizei* length, GLchar* log) {
+        empty_log(buf_size, length, log);
+    }
+
+    void GetProgramiv(GLuint program, GLenum pname, GLint* params) {
+        auto it = _programs.find(program);
+        if (_programs.end() == it) {
+            error(GL_INVALID_VALUE, gl_call::GetProgramiv, "unknown program");
+            return;
+        }
+        *params = GL_LINK_STATUS == pname ? it->second.linked : 0;
+    }
+
+    void GetShaderInfoLog(GLuint, GLsizei buf_size, GLsizei* length, GLchar* log) {
+        empty_log(buf_size, length, log);
+    }
+
+    void GetShaderiv(GLuint shader, GLenum pname, GLint* params) {
+        auto it = _shaders.find(shader);
+        if (_shaders.end() == it) {
+            error(GL_INVALID_VALUE, gl_call::GetShaderiv, "unknown shader");
+            return;
+        }
+        if (GL_COMPILE_STATUS == pname) {
+            *params = it->second.compiled;
+        } else if (GL_SHADER_TYPE == pname) {
+            *params = (GLint)it->second.type;
+        } else {
+            *params = 0;
+        }
+    }
+
+    const GLubyte* GetString(GLenum name) {
+        switch (name) {
+        case GL_VENDOR:
+            return (const GLubyte*)"gofran";
+        case GL_RENDERER:
+            return (const GLubyte*)"GLSoft";
+        case GL_VERSION:
+            return (const GLubyte*)"3.3 GLSoft";
+        case GL_SHADING_LANGUAGE_VERSION:
+            return (const GLubyte*)"3.30";
+        default:
+            error(GL_INVALID_ENUM, gl_call::GetString, "invalid name");
+            return NULL;
+        }
+    }
+
+    const GLubyte* GetStringi(GLenum name, GLuint index) {
+        if (GL_EXTENSIONS != name || 0 != index) {
+            error(GL_INVALID_VALUE, gl_call::GetStringi, "invalid name or index");
+            return NULL;
+        }
+        return (const GLubyte*)"GL_GOFRAN_soft";
+    }
+
+    GLint GetUniformLocation(GLuint program, const GLchar* name) {
+        auto it = _programs.find(program);
+        if (_programs.end() == it || !it->second.linked) {
+            error(GL_INVALID_OPERATION, gl_call::GetUniformLocation, "program not linked");
+            return -1;
+        }
+        const auto& uniforms = it->second.native.uniforms;
+        auto found = std::find(uniforms.begin(), uniforms.end(), name);
+        return uniforms.end() != found ? (GLint)(found - uniforms.begin()) : -1;
+    }
+
+    void LinkProgram(GLuint program) {
+        auto it = _programs.find(program);
+        if (_programs.end() == it) {
+            error(GL_INVALID_VALUE, gl_call::LinkProgram, "unknown program");
+            return;
+        }
+        it->second.linked = !it->second.shaders.empty();
+    }
+
+    void ShaderSource(GLuint shader, GLsizei, const GLchar* const*, const GLint*) {
+        if (0 == _shaders.count(shader)) {
+            error(GL_INVALID_VALUE, gl_call::ShaderSource, "unknown shader");
+        }
+    }
+
+    // 8 bit RED, RG, RGB or RGBA rows, 4 byte aligned like the default
+    // GL_UNPACK_ALIGNMENT.
+    void TexImage2D(GLenum target, GLint level, GLint, GLsizei width, GLsizei height, GLint,
+            GLenum format, GLenum type, const void* pixels) {
+        soft_texture_t* texture = bound_texture_object(target, gl_call::TexImage2D);
+        if (NULL == texture) {
+            return;
+        }
+        if (GL_TEXTURE_2D != target || GL_UNSIGNED_BYTE != type) {
+            error(GL_INVALID_ENUM, gl_call::TexImage2D, "only 8 bit 2D textures are sampled");
+            return;
+        }
+        int components = GL_RED == format ? 1 : GL_RG == format ? 2 : GL_RGB == format ? 3 : GL_RGBA == format ? 4 : 0;
+        if (0 == components) {
+            error(GL_INVALID_ENUM, gl_call::TexImage2D, "invalid format");
+            return;
+        }
+        if (width < 0 || height < 0) {
+            error(GL_INVALID_VALUE, gl_call::TexImage2D, "negative size");
+            return;
+        }
+        if (0 != level) {
+            return;
+        }
+
+        flush();
+        texture->width = width;
+        texture->height = height;
+        texture->texels.assign((size_t)width * height * 4, 0);
+        size_t row = ((size_t)width * components + 3) & ~(size_t)3;
+        for (GLsizei y = 0; y < height && NULL != pixels; ++y) {
+            const unsigned char* source = (const unsigned char*)pixels + y * row;
+            unsigned char* texel = &texture->texels[(size_t)y * width * 4];
+            for (GLsizei x = 0; x < width; ++x, source += components, texel += 4) {
+                texel[0] = source[0];
+                texel[1] = components > 1 ? source[1] : 0;
+                texel[2] = components > 2 ? source[2] : 0;
+                texel[3] = components > 3 ? source[3] : 255;
+            }
+        }
+    }
+
+    void TexImage3D(GLenum target, GLint, GLint, GLsizei, GLsizei, GLsizei, GLint, GLenum, GLenum, const void*) {
+        if (NULL != bound_texture_object(target, gl_call::TexImage3D)) {
+            error(GL_INVALID_ENUM, gl_call::TexImage3D, "only 2D textures are sampled");
+        }
+    }
+
+    void TexParameteri(GLenum target, GLenum pname, GLint param) {
+        soft_texture_t* texture = bound_texture_object(target, gl_call::TexParameteri);
+        if (NULL == texture) {
+            return;
+        }
+
+        flush();
+        switch (pname) {
+        case GL_TEXTURE_WRAP_S:
+            texture->wrap_s = (GLenum)param;
+            break;
+        case GL_TEXTURE_WRAP_T:
+            texture->wrap_t = (GLenum)param;
+            break;
+        case GL_TEXTURE_MAG_FILTER:
+            texture->mag_filter = (GLenum)param;
+            break;
+        default:
+            break;
+        }
+    }
+
+    void TexSubImage3D(GLenum target, GLint, GLint, GLint, GLint, GLsizei, GLsizei, GLsizei, GLenum, GLenum, const void*) {
+        if (NULL != bound_texture_object(target, gl_call::TexSubImage3D)) {
+            error(GL_INVALID_ENUM, gl_call::TexSubImage3D, "only 2D textures are sampled");
+        }
+    }
+
+    // Values are copied into each draw, so uniforms change without a flush.
+    soft_uniforms_t* current_uniforms(GLint location, gl_call call) {
+        auto it = _programs.find(_program);
+        if (_programs.end() == it) {
+            error(GL_INVALID_OPERATION, call, "no program in use");
+            return NULL;
+        }
+        if (location < -1 || location >= (GLint)it->second.native.uniforms.size()) {
+            error(GL_INVALID_OPERATION, call, "invalid location");
+            return NULL;
+        }
+        return -1 == location ? NULL : &it->second.uniforms;
+    }
+
+    void Uniform1f(GLint location, GLfloat v0) {
+        if (soft_uniforms_t* uniforms = current_uniforms(location, gl_call::Uniform1f)) {
+            uniforms->f[location] = v0;
+            uniforms->i[location] = (GLint)v0;
+        }
+    }
+
+    void Uniform1i(GLint location, GLint v0) {
+        if (soft_uniforms_t* uniforms = current_uniforms(location, gl_call::Uniform1i)) {
+            uniforms->i[location] = v0;
+            uniforms->f[location] = (GLfloat)v0;
+        }
+    }
+
+    void UseProgram(GLuint program) {
+        if (0 != program && 0 == _programs.count(program)) {
+            error(GL_INVALID_VALUE, gl_call::UseProgram, "unknown program");
+            return;
+        }
+        _program = program;
+    }
+
+    void VertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean, GLsizei stride, const void* pointer) {
+        auto it = _vertex_arrays.find(_vertex_array);
+        if (_vertex_arrays.end() == it) {
+            error(GL_INVALID_OPERATION, gl_call::VertexAttribPointer, "no vertex array bound");
+            return;
+        }
+        if (index >= (GLuint)soft_max_attributes || size < 1 || size > 4 || stride < 0) {
+            error(GL_INVALID_VALUE, gl_call::VertexAttribPointer, "invalid index, size or stride");
+            return;
+        }
+        if (GL_FLOAT != type) {
+            error(GL_INVALID_ENUM, gl_call::VertexAttribPointer, "only GL_FLOAT attributes are fetched");
+            return;
+        }
+        attrib_t& attrib = it->second.attribs[index];
+        attrib.size = size;
+        attrib.stride = stride;
+        attrib.offset = (uintptr_t)pointer;
+        attrib.buffer = _bound_buffers[GL_ARRAY_BUFFER];
+    }
+
+    // Triangles are in screen space once set up, later viewports don't
+    // move them.
+    void Viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+        if (width < 0 || height < 0) {
+            error(GL_INVALID_VALUE, gl_call::Viewport, "negative size");
+            return;
+        }
+        _viewport[0] = x;
+        _viewport[1] = y;
+        _viewport[2] = width;
+        _viewport[3] = height;
+    }
+
+    JobSystem& _jobs;
+
+    int _width;
+
+    int _height;
+
+    int _tiles_x;
+
+    int _tiles_y;
+
+    GLuint _next_name;
+
+    uintptr_t _next_sync;
+
+    GLenum _error;
+
+    std::vector<std::string> _errors;
+
+    std::unordered_map<GLuint, buffer_t> _buffers;
+
+    std::unordered_map<GLuint, soft_texture_t> _textures;
+
+    std::unordered_map<GLuint, vertex_array_t> _vertex_arrays;
+
+    std::unordered_map<GLuint, shader_t> _shaders;
+
+    std::unordered_map<GLuint, program_t> _programs;
+
+    std::unordered_set<GLsync> _syncs;
+
+    std::unordered_map<GLenum, GLuint> _bound_buffers;
+
+    std::unordered_map<uint64_t, GLuint> _bound_textures;
+
+    GLuint _active_texture;
+
+    GLuint _vertex_array;
+
+    GLuint _program;
+
+    GLfloat _clear_color[4];
+
+    GLint _viewport[4];
+
+    // The frame: RGBA8 rows, bottom first, and what is queued for it.
+    std::vector<unsigned char> _color;
+
+    bool _clear_pending;
+
+    uint32_t _clear_value;
+
+    std::vector<draw_t> _draws;
+
+    std::vector<triangle_t> _triangles;
+
+    uint32_t _triangle_count;
+
+    std::vector<float> _planes;
+
+    size_t _plane_count;
+
+    // Triangle slots per tile, in draw order.
+    std::vector<std::vector<uint32_t>> _bins;
+
+    // Scratch of the current draw.
+    std::vector<uint32_t> _indices;
+
+    std::vector<float> _vertices;
+
+    stats_t _stats;
+};
+
+}
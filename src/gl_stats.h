@@ -0,0 +1,514 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+#include "gl_calls.h"
+#include "gl_impl.h"
+#include "tsc_timer.h"
+
+namespace gofran {
+
+// Counts the GL calls of every frame per entry point and the CPU time spent
+// inside them, by swapping the glad pointers of gl_entrypoints.h for timing
+// stubs. Built into the demos with the GL_STATS CMake option.
+//
+// The thread that calls install() is the render thread: its calls are
+// counted per frame and checked for anti-patterns. Calls from other
+// threads, e.g. GLLoader uploads, are only counted, as a total per frame.
+// Checked, once the first frame has ended:
+//   - glGetUniformLocation, glGetError and other glGet* queries
+//   - glFinish
+// and always:
+//   - binding what is already bound
+//   - binding to target 0, which GL rejects
+//
+// end_frame() prints a one-line summary every interval frames, report()
+// the totals since install().
+class GLStats {
+public:
+    enum antipattern {
+        STATS_UNIFORM_LOOKUP,
+        STATS_GET_ERROR,
+        STATS_QUERY,
+        STATS_FINISH,
+        STATS_REDUNDANT_BIND,
+        STATS_INVALID_BIND,
+        STATS_ANTIPATTERN_COUNT
+    };
+
+    GLStats(std::ostream& out, uint32_t interval = 1) : _out(out)
+            , _interval(interval)
+            , _installed(false)
+            , _frames(0)
+            , _other_calls(0)
+            , _other_ticks(0)
+            , _frame_other_calls(0)
+            , _active_texture(0)
+            , _vertex_array(-1)
+            , _program(-1) {
+        _frame.fill(counter_t());
+        _total.fill(counter_t());
+        _frame_antipatterns.fill(0);
+        _antipatterns.fill(antipattern_t());
+    }
+
+    ~GLStats() {
+        uninstall();
+    }
+
+private:
+    GLStats(const GLStats&) = delete;
+
+    GLStats* operator=(const GLStats&) = delete;
+
+public:
+    void install() {
+        if (_installed) {
+            return;
+        }
+
+        // Calibrates now rather than in the first frame.
+        TscTimer::ns_per_tick();
+        _thread = std::this_thread::get_id();
+        current() = this;
+#define GOFRAN_GL_ENTRYPOINT(ret, name, params, args) \
+        _real.name = glad_gl##name; \
+        glad_gl##name = &GLStats::stub_##name;
+#include "gl_entrypoints.h"
+        _installed = true;
+    }
+
+    void uninstall() {
+        if (!_installed) {
+            return;
+        }
+
+#define GOFRAN_GL_ENTRYPOINT(ret, name, params, args) glad_gl##name = _real.name;
+#include "gl_entrypoints.h"
+        _installed = false;
+        if (this == current()) {
+            current() = NULL;
+        }
+    }
+
+    // Call on the render thread where the frame is presented.
+    void end_frame() {
+        uint64_t other_calls = 0;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            other_calls = _frame_other_calls;
+            _frame_other_calls = 0;
+        }
+
+        if (0 != _interval && 0 == _frames % _interval) {
+            summary(other_calls);
+        }
+
+        for (size_t i = 0; i < gl_call_count; ++i) {
+            _total[i].calls += _frame[i].calls;
+            _total[i].ticks += _frame[i].ticks;
+            _total[i].max_frame_calls = std::max(_total[i].max_frame_calls, _frame[i].calls);
+        }
+        _last = _frame;
+        _frame.fill(counter_t());
+        for (size_t i = 0; i < STATS_ANTIPATTERN_COUNT; ++i) {
+            antipattern_t& a = _antipatterns[i];
+            if (0 != _frame_antipatterns[i]) {
+                a.first_frame = 0 == a.frames ? _frames : a.first_frame;
+                a.count += _frame_antipatterns[i];
+                ++a.frames;
+            }
+        }
+        _frame_antipatterns.fill(0);
+        ++_frames;
+    }
+
+    inline uint64_t frames() const {
+        return _frames;
+    }
+
+    // Of the last frame that ended, on the render thread.
+    inline uint64_t frame_calls(gl_call call) const {
+        return _last[(size_t)call].calls;
+    }
+
+    inline double frame_ns(gl_call call) const {
+        return TscTimer::to_ns(_last[(size_t)call].ticks);
+    }
+
+    inline uint64_t total_calls(gl_call call) const {
+        return _total[(size_t)call].calls;
+    }
+
+    inline double total_ns(gl_call call) const {
+        return TscTimer::to_ns(_total[(size_t)call].ticks);
+    }
+
+    // Times seen in ended frames.
+    inline uint64_t antipatterns(antipattern a) const {
+        return _antipatterns[a].count;
+    }
+
+    static const char* antipattern_name(antipattern a) {
+        switch (a) {
+        case STATS_UNIFORM_LOOKUP:
+            return "glGetUniformLocation in the frame loop";
+        case STATS_GET_ERROR:
+            return "glGetError in the frame loop";
+        case STATS_QUERY:
+            return "glGet* query in the frame loop";
+        case STATS_FINISH:
+            return "glFinish in the frame loop";
+        case STATS_REDUNDANT_BIND:
+            return "redundant bind";
+        case STATS_INVALID_BIND:
+            return "bind to target 0";
+        default:
+            return "?";
+        }
+    }
+
+    // Totals over the ended frames, most expensive calls first.
+    void report(std::ostream& out) const {
+        std::vector<size_t> calls;
+        uint64_t ticks = 0;
+        for (size_t i = 0; i < gl_call_count; ++i) {
+            if (0 != _total[i].calls) {
+                calls.push_back(i);
+                ticks += _total[i].ticks;
+            }
+        }
+        std::sort(calls.begin(), calls.end(), [&](size_t a, size_t b) {
+            return _total[a].ticks > _total[b].ticks;
+        });
+
+        uint64_t frames = std::max<uint64_t>(1, _frames);
+        std::streamsize precision = out.precision();
+        out << "GL calls over " << _frames << " frames, render thread" << std::endl;
+        out << std::left << std::setw(28) << "call"
+                << std::right << std::setw(10) << "calls"
+                << std::setw(10) << "/frame"
+                << std::setw(10) << "max"
+                << std::setw(12) << "ms"
+                << std::setw(14) << "ns/call"
+                << std::setw(8) << "%" << std::endl;
+        out << std::fixed << std::setprecision(2);
+        for (size_t i : calls) {
+            const counter_t& c = _total[i];
+            double ns = TscTimer::to_ns(c.ticks);
+            out << std::left << std::setw(28) << gl_call_name((gl_call)i)
+                    << std::right << std::setw(10) << c.calls
+                    << std::setw(10) << (double)c.calls / frames
+                    << std::setw(10) << c.max_frame_calls
+                    << std::setw(12) << ns / 1e6
+                    << std::setw(14) << ns / c.calls
+                    << std::setw(8) << 100.0 * c.ticks / std::max<uint64_t>(1, ticks) << std::endl;
+        }
+        out << "total " << TscTimer::to_ns(ticks) / 1e6 << " ms in GL, "
+                << TscTimer::to_ns(ticks) / 1e3 / frames << " us per frame" << std::endl;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            out << "other threads: " << _other_calls << " calls, " << TscTimer::to_ns(_other_ticks) / 1e6
+                    << " ms in GL" << std::endl;
+        }
+
+        bool any = false;
+        for (size_t i = 0; i < STATS_ANTIPATTERN_COUNT; ++i) {
+            const antipattern_t& a = _antipatterns[i];
+            if (0 == a.count) {
+                continue;
+            }
+            if (!any) {
+                out << "anti-patterns" << std::endl;
+                any = true;
+            }
+            out << "  " << antipattern_name((antipattern)i) << ": " << a.count << " times in " << a.frames
+                    << " frames, first in frame " << a.first_frame << std::endl;
+        }
+        out.unsetf(std::ios::floatfield);
+        out.precision(precision);
+    }
+
+private:
+    template<gl_call C>
+    using call_tag = std::integral_constant<gl_call, C>;
+
+    struct procs_t {
+#define GOFRAN_GL_ENTRYPOINT(ret, name, params, args) decltype(glad_gl##name) name;
+#include "gl_entrypoints.h"
+    };
+
+    struct counter_t {
+        uint64_t calls = 0;
+
+        uint64_t ticks = 0;
+
+        // Most calls in a single frame, in the totals.
+        uint64_t max_frame_calls = 0;
+    };
+
+    struct antipattern_t {
+        uint64_t count = 0;
+
+        uint64_t frames = 0;
+
+        uint64_t first_frame = 0;
+    };
+
+    static GLStats*& current() {
+        static GLStats* stats = NULL;
+        return stats;
+    }
+
+    // See GLCapture, the stubs pass their arguments through a callable.
+    template<gl_call C, typename R, typename... P>
+    struct call_t {
+        GLStats* stats;
+
+        R (APIENTRYP fn)(P...);
+
+        inline R operator()(P... args) const {
+            return stats->call<C>(fn, args...);
+        }
+    };
+
+    template<gl_call C, typename R, typename... P>
+    static call_t<C, R, P...> bind_call(GLStats* stats, R (APIENTRYP fn)(P...)) {
+        return call_t<C, R, P...>{ stats, fn };
+    }
+
+#define GOFRAN_GL_ENTRYPOINT(ret, name, params, args) \
+    static ret APIENTRY stub_##name params { \
+        GLStats* stats = current(); \
+        return bind_call<gl_call::name>(stats, stats->_real.name) args; \
+    }
+#include "gl_entrypoints.h"
+
+    template<gl_call C, typename R, typename... P>
+    R call(R (APIENTRYP fn)(P...), P... args) {
+        bool render = std::this_thread::get_id() == _thread;
+        if (render) {
+            check(call_tag<C>(), args...);
+        }
+
+        uint64_t start = TscTimer::now();
+        if constexpr (std::is_void_v<R>) {
+            fn(args...);
+            record(C, render, TscTimer::now() - start);
+        } else {
+            R result = fn(args...);
+            record(C, render, TscTimer::now() - start);
+            return result;
+        }
+    }
+
+    inline void record(gl_call call, bool render, uint64_t ticks) {
+        if (render) {
+            counter_t& c = _frame[(size_t)call];
+            ++c.calls;
+            c.ticks += ticks;
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_other_calls;
+        ++_frame_other_calls;
+        _other_ticks += ticks;
+    }
+
+    inline void flag(antipattern a) {
+        ++_frame_antipatterns[a];
+    }
+
+    inline void flag_in_loop(antipattern a) {
+        if (0 != _frames) {
+            flag(a);
+        }
+    }
+
+    // Most calls are not checked.
+    template<gl_call C, typename... P>
+    void check(call_tag<C>, P...) {
+        if constexpr (C == gl_call::GetIntegerv || C == gl_call::GetProgramInfoLog || C == gl_call::GetProgramiv
+                || C == gl_call::GetShaderInfoLog || C == gl_call::GetShaderiv || C == gl_call::GetString
+                || C == gl_call::GetStringi) {
+            flag_in_loop(STATS_QUERY);
+        }
+    }
+
+    void check(call_tag<gl_call::GetUniformLocation>, GLuint, const GLchar*) {
+        flag_in_loop(STATS_UNIFORM_LOOKUP);
+    }
+
+    void check(call_tag<gl_call::GetError>) {
+        flag_in_loop(STATS_GET_ERROR);
+    }
+
+    void check(call_tag<gl_call::Finish>) {
+        flag_in_loop(STATS_FINISH);
+    }
+
+    void check(call_tag<gl_call::ActiveTexture>, GLenum texture) {
+        GLuint unit = texture - GL_TEXTURE0;
+        bind(unit == _active_texture);
+        _active_texture = unit;
+    }
+
+    void check(call_tag<gl_call::BindBuffer>, GLenum target, GLuint buffer) {
+        if (0 == target) {
+            flag(STATS_INVALID_BIND);
+            return;
+        }
+        auto it = _buffers.find(target);
+        bind(_buffers.end() != it && buffer == it->second);
+        _buffers[target] = buffer;
+    }
+
+    void check(call_tag<gl_call::BindTexture>, GLenum target, GLuint texture) {
+        if (0 == target) {
+            flag(STATS_INVALID_BIND);
+            return;
+        }
+        uint64_t key = ((uint64_t)_active_texture << 32) | target;
+        auto it = _textures.find(key);
+        bind(_textures.end() != it && texture == it->second);
+        _textures[key] = texture;
+    }
+
+    void check(call_tag<gl_call::BindVertexArray>, GLuint array) {
+        bind(array == _vertex_array);
+        // The element array buffer binding is vertex array state.
+        if (array != _vertex_array) {
+            _buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+        }
+        _vertex_array = array;
+    }
+
+    void check(call_tag<gl_call::UseProgram>, GLuint program) {
+        bind(program == _program);
+        _program = program;
+    }
+
+    // Deleting bound objects unbinds them.
+    void check(call_tag<gl_call::DeleteBuffers>, GLsizei n, const GLuint* buffers) {
+        forget(_buffers, n, buffers);
+    }
+
+    void check(call_tag<gl_call::DeleteTextures>, GLsizei n, const GLuint* textures) {
+        forget(_textures, n, textures);
+    }
+
+    void check(call_tag<gl_call::DeleteVertexArrays>, GLsizei n, const GLuint* arrays) {
+        for (GLsizei i = 0; i < n; ++i) {
+            _vertex_array = arrays[i] == _vertex_array ? 0 : _vertex_array;
+        }
+    }
+
+    void check(call_tag<gl_call::DeleteProgram>, GLuint program) {
+        _program = program == _program ? -1 : _program;
+    }
+
+    inline void bind(bool redundant) {
+        if (redundant) {
+            flag(STATS_REDUNDANT_BIND);
+        }
+    }
+
+    template<typename K>
+    static void forget(std::unordered_map<K, GLuint>& bindings, GLsizei n, const GLuint* names) {
+        for (auto& binding : bindings) {
+            for (GLsizei i = 0; i < n; ++i) {
+                binding.second = names[i] == binding.second ? 0 : binding.second;
+            }
+        }
+    }
+
+    // One line per frame: calls, time in GL, the most expensive call and
+    // what was flagged.
+    void summary(uint64_t other_calls) {
+        uint64_t calls = 0;
+        uint64_t ticks = 0;
+        size_t top = 0;
+        for (size_t i = 0; i < gl_call_count; ++i) {
+            calls += _frame[i].calls;
+            ticks += _frame[i].ticks;
+            top = _frame[i].ticks > _frame[top].ticks ? i : top;
+        }
+
+        std::streamsize precision = _out.precision();
+        _out << std::fixed << std::setprecision(1);
+        _out << "frame " << _frames << ": " << calls << " GL calls, " << TscTimer::to_ns(ticks) / 1e3 << " us";
+        if (0 != calls) {
+            _out << ", top " << gl_call_name((gl_call)top) << " " << _frame[top].calls << "x "
+                    << TscTimer::to_ns(_frame[top].ticks) / 1e3 << " us";
+        }
+        if (0 != other_calls) {
+            _out << ", " << other_calls << " on other threads";
+        }
+        for (size_t i = 0; i < STATS_ANTIPATTERN_COUNT; ++i) {
+            if (0 != _frame_antipatterns[i]) {
+                _out << "; " << _frame_antipatterns[i] << "x " << antipattern_name((antipattern)i);
+            }
+        }
+        _out << std::endl;
+        _out.unsetf(std::ios::floatfield);
+        _out.precision(precision);
+    }
+
+private:
+    std::ostream& _out;
+
+    uint32_t _interval;
+
+    procs_t _real;
+
+    bool _installed;
+
+    std::thread::id _thread;
+
+    uint64_t _frames;
+
+    // Render thread only, indexed by gl_call.
+    std::array<counter_t, gl_call_count> _frame;
+
+    std::array<counter_t, gl_call_count> _last;
+
+    std::array<counter_t, gl_call_count> _total;
+
+    std::array<uint64_t, STATS_ANTIPATTERN_COUNT> _frame_antipatterns;
+
+    std::array<antipattern_t, STATS_ANTIPATTERN_COUNT> _antipatterns;
+
+    // Calls from other threads.
+    mutable std::mutex _mutex;
+
+    uint64_t _other_calls;
+
+    uint64_t _other_ticks;
+
+    uint64_t _frame_other_calls;
+
+    // What the render thread has bound, as far as its calls tell; missing
+    // and -1 are unknown.
+    GLuint _active_texture;
+
+    std::unordered_map<GLenum, GLuint> _buffers;
+
+    // Per texture unit and target.
+    std::unordered_map<uint64_t, GLuint> _textures;
+
+    int64_t _vertex_array;
+
+    int64_t _program;
+};
+
+}
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+#include "gl_calls.h"
+#include "gl_impl.h"
+
+namespace gofran {
+
+// GL call traces, written by GLCapture and read by GLReplay:
+//
+//   header   "GTRC", then as varints the version, the first frame of the
+//            captured range, the number of calls and the name of each call
+//            ("glBindBuffer"), so a trace still replays after
+//            gl_entrypoints.h changed
+//   records  a varint that is either the index of a call in the header,
+//            followed by its arguments, its result and its payloads, or one
+//            of trace_record
+//
+// Integers and pointers are LEB128 varints, signed ones zigzag encoded,
+// floats are raw little endian. Pointers to client memory are not written
+// (outputs), except const void*, which GL also uses for offsets into bound
+// buffers. What such pointers point to is written by the call, data as the
+// id of a TRACE_PAYLOAD record (0 for NULL): payloads are written once, the
+// first time their bytes are seen, so re-uploading the same data costs a
+// varint.
+static const uint32_t gl_trace_version = 1;
+
+enum trace_record : uint32_t {
+    // Varint size and the bytes. Ids count from 1 in file order.
+    TRACE_PAYLOAD = 0x100000,
+    // Varint number of the frame that just ended, from 0.
+    TRACE_FRAME,
+    TRACE_END,
+};
+
+// Whether GLCapture writes an argument of type T; see above.
+template<typename T>
+constexpr bool gl_trace_by_value = !std::is_pointer_v<T>
+        || std::is_same_v<T, const void*> || std::is_same_v<T, GLsync>;
+
+// Bytes GL reads for an image of the given size, with the default unpack
+// alignment of 4 bytes per row.
+inline uint64_t gl_image_bytes(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type) {
+    if (width <= 0 || height <= 0 || depth <= 0) {
+        return 0;
+    }
+
+    uint64_t pixel = 4;
+    if (GL_UNSIGNED_INT_10F_11F_11F_REV != type) {
+        uint64_t components = 4;
+        switch (format) {
+        case GL_RED:
+            components = 1;
+            break;
+        case GL_RG:
+            components = 2;
+            break;
+        case GL_RGB:
+        case GL_BGR:
+            components = 3;
+            break;
+        default:
+            break;
+        }
+
+        uint64_t size = 1;
+        switch (type) {
+        case GL_HALF_FLOAT:
+        case GL_UNSIGNED_SHORT:
+            size = 2;
+            break;
+        case GL_FLOAT:
+        case GL_UNSIGNED_INT:
+            size = 4;
+            break;
+        default:
+            break;
+        }
+        pixel = components * size;
+    }
+
+    uint64_t row = (pixel * width + 3) & ~(uint64_t)3;
+    return row * height * depth;
+}
+
+// 64 bits, 8 bytes a step; only for spotting repeated payloads.
+inline uint64_t gl_trace_hash(const void* data, size_t size) {
+    const uint64_t k = 0x9e3779b97f4a7c15ull;
+    const unsigned char* p = (const unsigned char*)data;
+    uint64_t hash = size * k;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t v;
+        memcpy(&v, p + i, 8);
+        hash = (hash ^ (v * k)) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ p[i]) * 0x100000001b3ull;
+    }
+    hash ^= hash >> 32;
+    return hash * k;
+}
+
+class GLTraceWriter {
+public:
+    inline void clear() {
+        _bytes.clear();
+    }
+
+    inline const std::vector<unsigned char>& bytes() const {
+        return _bytes;
+    }
+
+    inline size_t size() const {
+        return _bytes.size();
+    }
+
+    void write_varint(uint64_t value) {
+        while (value >= 0x80) {
+            _bytes.push_back((unsigned char)(value | 0x80));
+            value >>= 7;
+        }
+        _bytes.push_back((unsigned char)value);
+    }
+
+    void write_bytes(const void* data, size_t size) {
+        const unsigned char* p = (const unsigned char*)data;
+        _bytes.insert(_bytes.end(), p, p + size);
+    }
+
+    void write_string(const std::string& str) {
+        write_varint(str.size());
+        write_bytes(str.data(), str.size());
+    }
+
+    template<typename T>
+    void write(T value) {
+        if constexpr (!gl_trace_by_value<T>) {
+            return;
+        } else if constexpr (std::is_pointer_v<T>) {
+            write_varint((uint64_t)(uintptr_t)value);
+        } else if constexpr (std::is_floating_point_v<T>) {
+            write_bytes(&value, sizeof(value));
+        } else if constexpr (std::is_signed_v<T>) {
+            int64_t v = (int64_t)value;
+            write_varint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+        } else {
+            write_varint((uint64_t)value);
+        }
+    }
+
+    void append(const GLTraceWriter& other) {
+        write_bytes(other._bytes.data(), other._bytes.size());
+    }
+
+private:
+    std::vector<unsigned char> _bytes;
+};
+
+// Reads a trace in memory. Reading past the end returns zeros and marks the
+// reader failed instead of throwing, callers check failed() once per record.
+class GLTraceReader {
+public:
+    GLTraceReader() : _data(NULL)
+            , _size(0)
+            , _pos(0)
+            , _failed(false) {
+    }
+
+    GLTraceReader(const unsigned char* data, size_t size) : _data(data)
+            , _size(size)
+            , _pos(0)
+            , _failed(false) {
+    }
+
+    inline size_t position() const {
+        return _pos;
+    }
+
+    inline void seek(size_t pos) {
+        _pos = pos;
+    }
+
+    inline bool at_end() const {
+        return _pos >= _size;
+    }
+
+    inline bool failed() const {
+        return _failed;
+    }
+
+    uint64_t read_varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (_pos >= _size) {
+                _failed = true;
+                return 0;
+            }
+            unsigned char b = _data[_pos++];
+            value |= (uint64_t)(b & 0x7f) << shift;
+            if (0 == (b & 0x80)) {
+                return value;
+            }
+        }
+        _failed = true;
+        return 0;
+    }
+
+    // Points into the trace, NULL when it is too short.
+    const unsigned char* read_bytes(size_t size) {
+        if (size > _size - _pos) {
+            _failed = true;
+            _pos = _size;
+            return NULL;
+        }
+        const unsigned char* p = _data + _pos;
+        _pos += size;
+        return p;
+    }
+
+    std::string read_string() {
+        size_t size = read_varint();
+        const unsigned char* p = read_bytes(size);
+        return NULL != p ? std::string((const char*)p, size) : std::string();
+    }
+
+    // Mirrors GLTraceWriter::write(). Pointers that are not written come
+    // back as NULL.
+    template<typename T>
+    T read() {
+        if constexpr (!gl_trace_by_value<T>) {
+            return NULL;
+        } else if constexpr (std::is_pointer_v<T>) {
+            return (T)(uintptr_t)read_varint();
+        } else if constexpr (std::is_floating_point_v<T>) {
+            T value = 0;
+            const unsigned char* p = read_bytes(sizeof(value));
+            if (NULL != p) {
+                memcpy(&value, p, sizeof(value));
+            }
+            return value;
+        } else if constexpr (std::is_signed_v<T>) {
+            uint64_t v = read_varint();
+            return (T)(int64_t)((v >> 1) ^ (~(v & 1) + 1));
+        } else {
+            return (T)read_varint();
+        }
+    }
+
+private:
+    const unsigned char* _data;
+
+    size_t _size;
+
+    size_t _pos;
+
+    bool _failed;
+};
+
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include <stddef.h>
+
+#include "image_index.h"
+#include "job_system.h"
+#include "stbi_arena.h"
+#include "../stb_image.h"
+
+namespace gofran {
+
+// One image of a batch: a file, or a blob the caller keeps alive until the
+// batch returns. Options apply to this image only, whatever the global stb
+// settings are.
+struct ImageBatchItem {
+    std::string path;
+
+    const unsigned char* data = NULL;
+
+    size_t size = 0;
+
+    // 0 keeps the channel count of the file.
+    int channels = 0;
+
+    // STBI_DEST_FLIP_VERTICALLY and STBI_DEST_BGR.
+    int flags = 0;
+
+    bool unpremultiply = false;
+
+    bool convert_iphone_png = false;
+};
+
+struct ImageBatchResult {
+    int width = 0;
+
+    int height = 0;
+
+    int channels = 0;
+
+    // Tightly packed rows, NULL when the image failed.
+    std::unique_ptr<unsigned char[]> pixels;
+
+    // stbi_failure_reason() of a failed image.
+    std::string error;
+
+    inline bool ok() const {
+        return NULL != pixels;
+    }
+};
+
+// Decodes many images at once, each on one pool thread. Pixels go straight
+// into the result with stbi_load_into, so everything stb_image allocates
+// along the way is scratch: it comes from an arena per thread that is reset
+// after every image. Images are not split over threads themselves, the batch
+// already keeps the pool busy.
+//
+// With an ImageIndex, files it knows are sized from their entry instead of
+// being probed with stbi_info first, which saves opening every file twice.
+class ImageBatch {
+public:
+    explicit ImageBatch(JobSystem& jobs, const ImageIndex* index = NULL) : _jobs(jobs)
+            , _index(index) {
+    }
+
+private:
+    ImageBatch(const ImageBatch&) = delete;
+
+    ImageBatch* operator=(const ImageBatch&) = delete;
+
+public:
+    std::vector<ImageBatchResult> decode(const std::vector<ImageBatchItem>& items) {
+        std::vector<ImageBatchResult> results(items.size());
+        const ImageIndex* index = _index;
+        _jobs.parallel_for(0, items.size(), [&items, &results, index](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                decode_one(items[i], results[i], index);
+            }
+        });
+        return results;
+    }
+
+private:
+    static void decode_one(const ImageBatchItem& item, ImageBatchResult& result, const ImageIndex* index) {
+        StbiArena::Scope scratch(StbiArena::this_thread());
+        stbi_set_parallel_for_thread(NULL, NULL);
+        stbi_set_flip_vertically_on_load_thread(0);
+        stbi_set_unpremultiply_on_load_thread(item.unpremultiply);
+        stbi_convert_iphone_png_to_rgb_thread(item.convert_iphone_png);
+
+        int channels_in_file = 0;
+        const ImageIndexEntry* known = NULL != index && NULL == item.data ? index->find(item.path) : NULL;
+        if (NULL != known && !known->is_image()) {
+            known = NULL;
+        }
+        bool ok = true;
+        if (NULL != known) {
+            result.width = (int)known->width;
+            result.height = (int)known->height;
+            channels_in_file = known->channels;
+        } else {
+            ok = NULL != item.data
+                    ? stbi_info_from_memory(item.data, (int)item.size, &result.width, &result.height, &channels_in_file)
+                    : stbi_info(item.path.c_str(), &result.width, &result.height, &channels_in_file);
+        }
+        const char* error = NULL;
+        if (ok) {
+            result.channels = item.channels ? item.channels : channels_in_file;
+            size_t size = (size_t)result.width * result.height * result.channels;
+            result.pixels.reset(new (std::nothrow) unsigned char[size]);
+            if (NULL == result.pixels) {
+                error = "outofmem";
+            } else {
+                stbi_dest dest = { result.pixels.get(), size, 0, result.channels, item.flags };
+                ok = NULL != item.data
+                        ? stbi_load_into_from_memory(item.data, (int)item.size, &dest,
+                                &result.width, &result.height, &channels_in_file)
+                        : stbi_load_into(item.path.c_str(), &dest,
+                                &result.width, &result.height, &channels_in_file);
+            }
+        }
+        // The file changed since the index was scanned: probe it after all.
+        if (NULL != known && (!ok || (0 == item.channels && channels_in_file != known->channels))) {
+            result = ImageBatchResult();
+            decode_one(item, result, NULL);
+            return;
+        }
+
+        if (!ok && NULL == error) {
+            error = stbi_failure_reason();
+            if (NULL == error) {
+                error = "decode failed";
+            }
+        }
+
+        if (NULL != error) {
+            result.pixels.reset();
+            result.error = error;
+        }
+
+        stbi_reset_thread_settings();
+    }
+
+private:
+    JobSystem& _jobs;
+
+    const ImageIndex* _index;
+};
+
+}
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <stddef.h>
+
+#include "job_system.h"
+#include "../stb_image.h"
+
+namespace gofran {
+
+// What the index knows about one file, without decoding it. Written to disk
+// as is, so the layout is fixed.
+struct ImageIndexEntry {
+    enum flag_t : uint8_t {
+        IMAGE_16_BIT = 1,
+        IMAGE_HDR = 2,
+    };
+
+    uint64_t path_hash;
+
+    uint64_t file_size;
+
+    // last_write_time() in ticks of the filesystem clock.
+    int64_t mtime;
+
+    uint32_t width;
+
+    uint32_t height;
+
+    uint8_t channels;
+
+    // STBI_FORMAT_*, STBI_FORMAT_UNKNOWN for files stb_image can't read;
+    // those are kept too so rescans skip them.
+    uint8_t format;
+
+    uint8_t flags;
+
+    uint8_t reserved[5];
+
+    inline bool is_image() const {
+        return STBI_FORMAT_UNKNOWN != format;
+    }
+
+    // Bytes of the image decoded with 8-bit components, 0 channels meaning
+    // the channels of the file.
+    inline size_t decoded_size(int desired_channels = 0) const {
+        return (size_t)width * height * (desired_channels ? desired_channels : channels);
+    }
+};
+
+static_assert(sizeof(ImageIndexEntry) == 40, "ImageIndexEntry is stored on disk");
+
+// Dimensions, channels and format of every file under an asset directory,
+// so memory budgets and atlases can be planned, and buffers sized, before
+// anything is loaded. scan() probes the files with stbi_info on the job
+// system; files whose size and modification time match the entry from the
+// last scan are not opened again, so rescanning a large tree mostly costs
+// the directory walk. The index saves to a small binary file, entries
+// sorted by the hash of their path.
+//
+// Paths are keyed the way the scan saw them: the directory given to scan()
+// joined with the path below it, with '/' separators. find() normalizes the
+// separators, so loaders can use the same paths they open files with.
+class ImageIndex {
+public:
+    struct scan_stats_t {
+        size_t files = 0;
+
+        size_t images = 0;
+
+        // Files opened with stbi_info, the others came from the last scan.
+        size_t probed = 0;
+
+        size_t reused = 0;
+
+        // Entries of files that are gone.
+        size_t removed = 0;
+    };
+
+    ImageIndex() = default;
+
+private:
+    ImageIndex(const ImageIndex&) = delete;
+
+    ImageIndex* operator=(const ImageIndex&) = delete;
+
+public:
+    // FNV-1a of the '/'-separated path.
+    static uint64_t hash_path(const std::string& path) {
+        std::string generic = std::filesystem::path(path).generic_string();
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : generic) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // Replaces the entries with those of an index file. A missing, truncated
+    // or foreign file leaves the index empty, the next scan probes all.
+    bool load(const std::string& path) {
+        _entries.clear();
+
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) {
+            return false;
+        }
+        std::streamoff size = file.tellg();
+        file.seekg(0, std::ios::beg);
+
+        header_t header;
+        if (!file.read((char*)&header, sizeof(header))
+                || header_t().magic != header.magic || header_t().version != header.version
+                || (uint64_t)size != sizeof(header) + (uint64_t)header.count * sizeof(ImageIndexEntry)) {
+            return false;
+        }
+
+        _entries.resize(header.count);
+        if (!file.read((char*)_entries.data(), (std::streamsize)(header.count * sizeof(ImageIndexEntry)))) {
+            _entries.clear();
+            return false;
+        }
+        return true;
+    }
+
+    // Writes next to the target and renames over it, so a crash never leaves
+    // half an index behind.
+    bool save(const std::string& path) const {
+        std::string temp = path + ".tmp";
+        {
+            std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+            header_t header;
+            header.count = (uint32_t)_entries.size();
+            if (!file.write((const char*)&header, sizeof(header))
+                    || !file.write((const char*)_entries.data(),
+                            (std::streamsize)(_entries.size() * sizeof(ImageIndexEntry)))) {
+                return false;
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(temp, path, ec);
+        return !ec;
+    }
+
+    // Brings the index up to date with every regular file under dir,
+    // dropping entries of files that are gone.
+    scan_stats_t scan(JobSystem& jobs, const std::string& dir) {
+        namespace fs = std::filesystem;
+
+        std::vector<std::string> paths;
+        std::error_code ec;
+        for (fs::recursive_directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec), end;
+                !ec && it != end; it.increment(ec)) {
+            std::error_code type_ec;
+            if (it->is_regular_file(type_ec)) {
+                paths.push_back(it->path().generic_string());
+            }
+        }
+
+        std::vector<ImageIndexEntry> entries(paths.size());
+        std::atomic<size_t> probed(0);
+        std::atomic<size_t> known(0);
+        // A probe is an open and one small read, so files go in groups of 16.
+        jobs.parallel_for(0, paths.size(), [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                ImageIndexEntry& entry = entries[i];
+                entry = ImageIndexEntry();
+                entry.path_hash = hash_path(paths[i]);
+
+                std::error_code size_ec;
+                std::error_code time_ec;
+                entry.file_size = fs::file_size(paths[i], size_ec);
+                entry.mtime = (int64_t)fs::last_write_time(paths[i], time_ec).time_since_epoch().count();
+
+                const ImageIndexEntry* old = find_hash(entry.path_hash);
+                if (NULL != old) {
+                    known.fetch_add(1, std::memory_order_relaxed);
+                    if (!size_ec && !time_ec && old->file_size == entry.file_size && old->mtime == entry.mtime) {
+                        entry = *old;
+                        continue;
+                    }
+                }
+
+                probe(paths[i], entry);
+                probed.fetch_add(1, std::memory_order_relaxed);
+            }
+        }, 16);
+
+        scan_stats_t stats;
+        stats.files = paths.size();
+        stats.probed = probed.load();
+        stats.reused = stats.files - stats.probed;
+        stats.removed = _entries.size() - known.load();
+
+        std::sort(entries.begin(), entries.end(), [](const ImageIndexEntry& a, const ImageIndexEntry& b) {
+            return a.path_hash < b.path_hash;
+        });
+        entries.erase(std::unique(entries.begin(), entries.end(),
+                [](const ImageIndexEntry& a, const ImageIndexEntry& b) {
+                    return a.path_hash == b.path_hash;
+                }), entries.end());
+        _entries.swap(entries);
+
+        for (const auto& entry : _entries) {
+            stats.images += entry.is_image() ? 1 : 0;
+        }
+        return stats;
+    }
+
+    // NULL for paths the last scan didn't see.
+    const ImageIndexEntry* find(const std::string& path) const {
+        return find_hash(hash_path(path));
+    }
+
+    inline const std::vector<ImageIndexEntry>& entries() const {
+        return _entries;
+    }
+
+    inline size_t size() const {
+        return _entries.size();
+    }
+
+    inline void clear() {
+        _entries.clear();
+    }
+
+private:
+    struct header_t {
+        uint32_t magic = 0x58444947; // "GIDX"
+
+        uint32_t version = 1;
+
+        uint32_t count = 0;
+
+        uint32_t reserved = 0;
+    };
+
+    const ImageIndexEntry* find_hash(uint64_t hash) const {
+        auto it = std::lower_bound(_entries.begin(), _entries.end(), hash,
+                [](const ImageIndexEntry& entry, uint64_t h) { return entry.path_hash < h; });
+        return _entries.end() != it && hash == it->path_hash ? &*it : NULL;
+    }
+
+    static void probe(const std::string& path, ImageIndexEntry& entry) {
+        stbi_image_info info;
+        if (!stbi_info_ex(path.c_str(), &info)) {
+            return;
+        }
+
+        entry.width = (uint32_t)info.x;
+        entry.height = (uint32_t)info.y;
+        entry.channels = (uint8_t)info.comp;
+        entry.format = (uint8_t)info.format;
+        entry.flags = (info.is_16_bit ? ImageIndexEntry::IMAGE_16_BIT : 0)
+                | (info.is_hdr ? ImageIndexEntry::IMAGE_HDR : 0);
+    }
+
+private:
+    std::vector<ImageIndexEntry> _entries;
+};
+
+}
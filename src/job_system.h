@@ -0,0 +1,427 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+namespace gofran {
+
+// Jobs signal completion by decrementing a counter, waiting on a counter
+// means waiting for every job that was started with it.
+class JobCounter {
+public:
+    JobCounter() : _value(0) {
+    }
+
+    inline bool is_done() const {
+        return 0 == _value.load(std::memory_order_acquire);
+    }
+
+private:
+    JobCounter(const JobCounter&) = delete;
+
+    JobCounter* operator=(const JobCounter&) = delete;
+
+private:
+    friend class JobSystem;
+
+    std::atomic<int> _value;
+};
+
+struct Job {
+    std::function<void()> fn;
+
+    JobCounter* counter;
+};
+
+// Chase-Lev work-stealing deque (Le, Pop, Cohen, Zappa Nardelli, PPoPP'13).
+// The owner pushes and pops at the bottom, thieves steal from the top. The
+// ring has a fixed capacity; push() fails when it is full and the caller runs
+// the job inline instead.
+class JobDeque {
+public:
+    static const int64_t capacity = 4096;
+
+    JobDeque() : _top(0)
+            , _bottom(0) {
+        for (int64_t i = 0; i < capacity; ++i) {
+            _ring[i].store(NULL, std::memory_order_relaxed);
+        }
+    }
+
+    bool push(Job* job) {
+        int64_t b = _bottom.load(std::memory_order_relaxed);
+        int64_t t = _top.load(std::memory_order_acquire);
+        if (b - t >= capacity) {
+            return false;
+        }
+
+        _ring[b & (capacity - 1)].store(job, std::memory_order_relaxed);
+        _bottom.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    Job* pop() {
+        int64_t b = _bottom.load(std::memory_order_relaxed) - 1;
+        _bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = _top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            _bottom.store(b + 1, std::memory_order_relaxed);
+            return NULL;
+        }
+
+        Job* job = _ring[b & (capacity - 1)].load(std::memory_order_relaxed);
+        if (t == b) {
+            // Last element, race against thieves for it.
+            if (!_top.compare_exchange_strong(t, t + 1,
+                    std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                job = NULL;
+            }
+            _bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    Job* steal() {
+        int64_t t = _top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = _bottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return NULL;
+        }
+
+        Job* job = _ring[t & (capacity - 1)].load(std::memory_order_relaxed);
+        if (!_top.compare_exchange_strong(t, t + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return NULL;
+        }
+        return job;
+    }
+
+    inline bool is_empty() const {
+        return _bottom.load(std::memory_order_relaxed)
+                <= _top.load(std::memory_order_relaxed);
+    }
+
+private:
+    // Keep owner and thief indices on separate cache lines.
+    std::atomic<int64_t> _top;
+
+    char _pad_top[64 - sizeof(std::atomic<int64_t>)];
+
+    std::atomic<int64_t> _bottom;
+
+    char _pad_bottom[64 - sizeof(std::atomic<int64_t>)];
+
+    std::atomic<Job*> _ring[capacity];
+};
+
+// Work-stealing scheduler. The constructing thread is the main thread: it
+// owns deque 0 and is the only one that runs main-thread-affine jobs (GL
+// calls), either from run_main_jobs() or while it waits on a counter.
+// Threads that are not part of the pool submit through a shared queue.
+class JobSystem {
+public:
+    // workers is the number of threads besides the main one, a negative
+    // count uses one per remaining core but at least one, so work queued
+    // from the main thread progresses while it renders.
+    explicit JobSystem(int workers = -1) : _running(true)
+            , _sleepers(0) {
+        if (workers < 0) {
+            unsigned int cores = std::thread::hardware_concurrency();
+            workers = cores > 1 ? (int)cores - 1 : 1;
+        }
+
+        _deques.resize(workers + 1);
+        for (auto& deque : _deques) {
+            deque = new JobDeque();
+        }
+
+        this_worker() = worker_slot{ this, 0 };
+        for (size_t i = 1; i < _deques.size(); ++i) {
+            _threads.push_back(std::thread(&JobSystem::worker_main, this, i));
+        }
+    }
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _running = false;
+        }
+        _cond.notify_all();
+        for (auto& thread : _threads) {
+            thread.join();
+        }
+
+        this_worker() = worker_slot{ NULL, 0 };
+        for (auto& deque : _deques) {
+            delete deque;
+        }
+    }
+
+private:
+    JobSystem(const JobSystem&) = delete;
+
+    JobSystem* operator=(const JobSystem&) = delete;
+
+public:
+    inline size_t thread_count() const {
+        return _deques.size();
+    }
+
+    inline bool is_main_thread() const {
+        return this_worker().owner == this && 0 == this_worker().index;
+    }
+
+    void run(const std::function<void()>& fn, JobCounter* counter = NULL) {
+        Job* job = make_job(fn, counter);
+
+        worker_slot& self = this_worker();
+        if (self.owner == this) {
+            if (!_deques[self.index]->push(job)) {
+                execute(job);
+                return;
+            }
+        } else {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _injected.push_back(job);
+        }
+
+        wake_one();
+    }
+
+    // The job runs on the main thread only, from run_main_jobs() or wait().
+    void run_on_main(const std::function<void()>& fn, JobCounter* counter = NULL) {
+        Job* job = make_job(fn, counter);
+
+        std::lock_guard<std::mutex> lock(_main_mutex);
+        _main_jobs.push_back(job);
+    }
+
+    // Main thread only. Returns the number of jobs that ran.
+    size_t run_main_jobs() {
+        size_t ran = 0;
+        while (Job* job = pop_main()) {
+            execute(job);
+            ++ran;
+        }
+        return ran;
+    }
+
+    // Helps with other work until the counter drops to zero, so waiting from
+    // inside a job never deadlocks the pool.
+    void wait(JobCounter* counter) {
+        wait_until([counter]() { return counter->is_done(); });
+    }
+
+    void wait_until(const std::function<bool()>& done) {
+        size_t idle = 0;
+        while (!done()) {
+            Job* job = find_job();
+            if (NULL != job) {
+                execute(job);
+                idle = 0;
+            } else if (++idle < 64) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    }
+
+    // Calls fn(first, last) over [begin, end). Ranges are split lazily: a
+    // worker only hands off the back half of its range while its own deque is
+    // empty, i.e. when other workers might be starving. grain is the smallest
+    // range worth scheduling; 0 picks one from the range and the pool size.
+    void parallel_for(size_t begin, size_t end,
+            const std::function<void(size_t, size_t)>& fn, size_t grain = 0) {
+        if (begin >= end) {
+            return;
+        }
+
+        if (0 == grain) {
+            grain = std::max<size_t>(1, (end - begin) / (thread_count() * 16));
+        }
+
+        JobCounter counter;
+        run_range(begin, end, grain, fn, &counter);
+        wait(&counter);
+    }
+
+private:
+    struct worker_slot {
+        JobSystem* owner;
+
+        size_t index;
+    };
+
+    static worker_slot& this_worker() {
+        static thread_local worker_slot slot = { NULL, 0 };
+        return slot;
+    }
+
+    Job* make_job(const std::function<void()>& fn, JobCounter* counter) {
+        if (NULL != counter) {
+            counter->_value.fetch_add(1, std::memory_order_relaxed);
+        }
+        return new Job{ fn, counter };
+    }
+
+    static void execute(Job* job) {
+        job->fn();
+        if (NULL != job->counter) {
+            job->counter->_value.fetch_sub(1, std::memory_order_release);
+        }
+        delete job;
+    }
+
+    void run_range(size_t begin, size_t end, size_t grain,
+            const std::function<void(size_t, size_t)>& fn, JobCounter* counter) {
+        worker_slot& self = this_worker();
+        while (begin < end) {
+            size_t count = end - begin;
+            bool starving = self.owner != this || _deques[self.index]->is_empty();
+            if (count > 2 * grain && starving) {
+                size_t mid = begin + count / 2;
+                size_t last = end;
+                run([this, mid, last, grain, &fn, counter]() {
+                    run_range(mid, last, grain, fn, counter);
+                }, counter);
+                end = mid;
+                continue;
+            }
+
+            size_t last = std::min(end, begin + grain);
+            fn(begin, last);
+            begin = last;
+        }
+    }
+
+    Job* pop_main() {
+        std::lock_guard<std::mutex> lock(_main_mutex);
+        if (_main_jobs.empty()) {
+            return NULL;
+        }
+
+        Job* job = _main_jobs.front();
+        _main_jobs.pop_front();
+        return job;
+    }
+
+    Job* find_job() {
+        worker_slot& self = this_worker();
+        size_t index = self.owner == this ? self.index : 0;
+
+        if (self.owner == this) {
+            if (0 == index) {
+                if (Job* job = pop_main()) {
+                    return job;
+                }
+            }
+
+            if (Job* job = _deques[index]->pop()) {
+                return job;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_injected.empty()) {
+                Job* job = _injected.front();
+                _injected.pop_front();
+                return job;
+            }
+        }
+
+        size_t n = _deques.size();
+        for (size_t i = 1; i < n; ++i) {
+            size_t victim = (index + i) % n;
+            if (Job* job = _deques[victim]->steal()) {
+                return job;
+            }
+        }
+        return NULL;
+    }
+
+    void wake_one() {
+        if (_sleepers.load(std::memory_order_acquire) > 0) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _cond.notify_one();
+        }
+    }
+
+    bool has_stealable_work() {
+        for (auto& deque : _deques) {
+            if (!deque->is_empty()) {
+                return true;
+            }
+        }
+        return !_injected.empty();
+    }
+
+    void worker_main(size_t index) {
+        this_worker() = worker_slot{ this, index };
+
+        size_t idle = 0;
+        for (;;) {
+            Job* job = find_job();
+            if (NULL != job) {
+                execute(job);
+                idle = 0;
+                continue;
+            }
+
+            if (++idle < 64) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (!_running) {
+                break;
+            }
+
+            _sleepers.fetch_add(1, std::memory_order_acq_rel);
+            // The timeout bounds the cost of a wake-up lost to a push that
+            // raced with the check above.
+            _cond.wait_for(lock, std::chrono::milliseconds(1), [this] {
+                return !_running || has_stealable_work();
+            });
+            _sleepers.fetch_sub(1, std::memory_order_acq_rel);
+            idle = 0;
+        }
+
+        this_worker() = worker_slot{ NULL, 0 };
+    }
+
+private:
+    std::vector<JobDeque*> _deques;
+
+    std::vector<std::thread> _threads;
+
+    std::mutex _mutex;
+
+    std::condition_variable _cond;
+
+    bool _running;
+
+    std::atomic<int> _sleepers;
+
+    // Jobs submitted by threads outside the pool.
+    std::deque<Job*> _injected;
+
+    std::mutex _main_mutex;
+
+    std::deque<Job*> _main_jobs;
+};
+
+}
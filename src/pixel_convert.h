@@ -0,0 +1,928 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "job_system.h"
+
+// SSE2 is the x64 baseline and always used there; AVX2 kernels (with F16C for
+// halves) are compiled per function and picked at run time. On AArch64 the
+// NEON kernels are used. Define GOFRAN_NO_SIMD to get the scalar code only.
+#if !defined(GOFRAN_NO_SIMD)
+#if defined(__SSE2__) || defined(_M_X64)
+#define GOFRAN_PIXEL_SSE2
+#include <emmintrin.h>
+#if defined(__clang__) || defined(__GNUC__)
+#define GOFRAN_PIXEL_AVX2
+#define GOFRAN_AVX2_TARGET __attribute__((target("avx2,f16c")))
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define GOFRAN_PIXEL_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+namespace gofran {
+
+// Conversions between stb_image output and what textures want uploaded.
+// Every kernel works on a span of pixels (or of components, where it says
+// so), so it can run per row and rows can be split over threads with
+// convert_rows_parallel(). Source and destination must not overlap unless a
+// kernel says otherwise.
+//
+// The sRGB kernels are table lookups. SIMD doesn't help those except for
+// float to sRGB, where AVX2 gathers from the table.
+enum class pixel_isa {
+    PIXEL_SCALAR,
+    PIXEL_SSE2,
+    PIXEL_AVX2,
+    PIXEL_NEON,
+    // The best the CPU supports.
+    PIXEL_BEST,
+};
+
+namespace detail {
+
+inline bool cpu_has_avx2() {
+#if defined(GOFRAN_PIXEL_AVX2)
+    static const bool has = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c");
+    return has;
+#else
+    return false;
+#endif
+}
+
+// Lowers a requested ISA to one this build and CPU can run.
+inline pixel_isa resolve_isa(pixel_isa isa) {
+#if defined(GOFRAN_PIXEL_NEON)
+    return pixel_isa::PIXEL_SCALAR == isa ? isa : pixel_isa::PIXEL_NEON;
+#elif defined(GOFRAN_PIXEL_SSE2)
+    if (pixel_isa::PIXEL_SCALAR == isa) {
+        return isa;
+    }
+    if ((pixel_isa::PIXEL_AVX2 == isa || pixel_isa::PIXEL_BEST == isa) && cpu_has_avx2()) {
+        return pixel_isa::PIXEL_AVX2;
+    }
+    return pixel_isa::PIXEL_SSE2;
+#else
+    (void)isa;
+    return pixel_isa::PIXEL_SCALAR;
+#endif
+}
+
+// Linear float to sRGB8 with correct rounding. Floats from 2^-13 up to 1 are
+// bucketed by exponent and the top 9 mantissa bits; no bucket holds more than
+// one rounding threshold, so a bucket's value at its start plus one compare
+// gives the result. Everything below 2^-13 rounds to 0.
+struct srgb_tables {
+    static const int mantissa_bits = 9;
+
+    static const int buckets = 13 << mantissa_bits;
+
+    static const uint32_t min_bits = (127 - 13) << 23;
+
+    float to_linear[256];
+
+    uint8_t to_srgb8[256];
+
+    uint8_t to_linear8[256];
+
+    int32_t bucket_base[buckets];
+
+    float bucket_threshold[buckets];
+
+    static double srgb_to_linear(double s) {
+        return s <= 0.04045 ? s / 12.92 : std::pow((s + 0.055) / 1.055, 2.4);
+    }
+
+    static double linear_to_srgb(double l) {
+        return l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+    }
+
+    srgb_tables() {
+        for (int i = 0; i < 256; ++i) {
+            double l = srgb_to_linear(i / 255.0);
+            to_linear[i] = (float)l;
+            to_linear8[i] = (uint8_t)std::lround(l * 255.0);
+            to_srgb8[i] = (uint8_t)std::lround(linear_to_srgb(i / 255.0) * 255.0);
+        }
+
+        for (int b = 0; b < buckets; ++b) {
+            uint32_t lo_bits = min_bits + ((uint32_t)b << (23 - mantissa_bits));
+            uint32_t hi_bits = lo_bits + (1u << (23 - mantissa_bits));
+            float lo, hi;
+            memcpy(&lo, &lo_bits, 4);
+            memcpy(&hi, &hi_bits, 4);
+
+            long k = std::lround(linear_to_srgb(lo) * 255.0);
+            bucket_base[b] = (int32_t)k;
+            bucket_threshold[b] = std::numeric_limits<float>::infinity();
+            if (k < 255) {
+                // First float of the bucket that rounds to k + 1.
+                float t = (float)srgb_to_linear((k + 0.5) / 255.0);
+                while (t > lo && std::lround(linear_to_srgb(std::nextafter(t, 0.0f)) * 255.0) > k) {
+                    t = std::nextafter(t, 0.0f);
+                }
+                while (std::lround(linear_to_srgb(t) * 255.0) <= k) {
+                    t = std::nextafter(t, 2.0f);
+                }
+                if (t < hi) {
+                    bucket_threshold[b] = t;
+                }
+            }
+        }
+    }
+
+    static const srgb_tables& get() {
+        static const srgb_tables tables;
+        return tables;
+    }
+};
+
+inline uint8_t linear_to_srgb8(const srgb_tables& t, float x) {
+    const float almost_one = 0.99999994f;
+    // Also catches NaN and -0.
+    if (!(x > 0.0f)) {
+        return 0;
+    }
+    if (x > almost_one) {
+        return 255;
+    }
+
+    uint32_t bits;
+    memcpy(&bits, &x, 4);
+    if (bits < srgb_tables::min_bits) {
+        return 0;
+    }
+    uint32_t b = (bits - srgb_tables::min_bits) >> (23 - srgb_tables::mantissa_bits);
+    return (uint8_t)(t.bucket_base[b] + (x >= t.bucket_threshold[b] ? 1 : 0));
+}
+
+inline uint8_t unorm_to_u8(float x) {
+    return x >= 1.0f ? 255 : x > 0.0f ? (uint8_t)(x * 255.0f + 0.5f) : 0;
+}
+
+// Round to nearest even, overflow to infinity, NaNs stay (quiet) NaNs.
+// After F. Giesen's float_to_half_fast3_rtne.
+inline uint16_t float_to_half(float value) {
+    const uint32_t f32_infinity = 255u << 23;
+    const uint32_t f16_max = (127u + 16u) << 23;
+    const uint32_t denorm_magic_bits = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+    uint32_t f;
+    memcpy(&f, &value, 4);
+    uint32_t sign = f & 0x80000000u;
+    f ^= sign;
+
+    uint16_t h;
+    if (f >= f16_max) {
+        h = f > f32_infinity ? 0x7e00 : 0x7c00;
+    } else if (f < (113u << 23)) {
+        // Subnormal (or zero): let the FPU round by adding a magic number.
+        float magic, sum;
+        memcpy(&magic, &denorm_magic_bits, 4);
+        memcpy(&sum, &f, 4);
+        sum += magic;
+        uint32_t bits;
+        memcpy(&bits, &sum, 4);
+        h = (uint16_t)(bits - denorm_magic_bits);
+    } else {
+        uint32_t mant_odd = (f >> 13) & 1;
+        f += ((uint32_t)(15 - 127) << 23) + 0xfff;
+        f += mant_odd;
+        h = (uint16_t)(f >> 13);
+    }
+    return (uint16_t)(h | (sign >> 16));
+}
+
+// The unsigned floats of GL_R11F_G11F_B10F: a 5-bit exponent biased by 15
+// like halves, no sign and mantissa_bits (6 or 5) of mantissa. Rounds to
+// nearest even; negatives become 0 and finite values too large become the
+// largest finite one, infinity and NaN stay what they are.
+template<int mantissa_bits>
+struct ufloat_t {
+    static const int shift = 23 - mantissa_bits;
+
+    // Float bits of the largest finite value.
+    static const uint32_t max_bits = ((127u + 15u) << 23) | (((1u << mantissa_bits) - 1) << shift);
+
+    // Below the smallest normal, 2^-14, the result is subnormal.
+    static const uint32_t min_normal_bits = (127u - 14u) << 23;
+
+    static const uint32_t subnormal_magic_bits = ((127u - 15u) + shift + 1) << 23;
+
+    static const uint32_t normal_bias = ((1u << (shift - 1)) - 1) - ((127u - 15u) << 23);
+
+    static const uint32_t max_finite = (30u << mantissa_bits) | ((1u << mantissa_bits) - 1);
+
+    static const uint32_t infinity = 31u << mantissa_bits;
+
+    static const uint32_t nan = infinity | ((1u << mantissa_bits) - 1);
+};
+
+template<int mantissa_bits>
+inline uint32_t float_to_ufloat(float value) {
+    typedef ufloat_t<mantissa_bits> uf;
+
+    uint32_t f;
+    memcpy(&f, &value, 4);
+    if ((f & 0x7fffffffu) > 0x7f800000u) {
+        return uf::nan;
+    }
+    if (f & 0x80000000u) {
+        return 0;
+    }
+    if (0x7f800000u == f) {
+        return uf::infinity;
+    }
+    if (f >= uf::max_bits) {
+        return uf::max_finite;
+    }
+    if (f < uf::min_normal_bits) {
+        const uint32_t magic_bits = uf::subnormal_magic_bits;
+        float magic, sum;
+        memcpy(&magic, &magic_bits, 4);
+        sum = value + magic;
+        uint32_t bits;
+        memcpy(&bits, &sum, 4);
+        return bits - uf::subnormal_magic_bits;
+    }
+    return (f + uf::normal_bias + ((f >> uf::shift) & 1)) >> uf::shift;
+}
+
+inline uint32_t float_to_r11g11b10(float r, float g, float b) {
+    return float_to_ufloat<6>(r) | (float_to_ufloat<6>(g) << 11) | (float_to_ufloat<5>(b) << 22);
+}
+
+#if defined(GOFRAN_PIXEL_SSE2)
+// Four packed RGB pixels in the low 12 bytes to RGBA. No byte shuffle in
+// SSE2: shift the whole register left by k bytes so pixel k lands at the
+// start of lane k, keep its 3 bytes there, and merge the four.
+inline __m128i expand_rgb4_sse2(__m128i v) {
+    const __m128i rgb0 = _mm_setr_epi32(0x00ffffff, 0, 0, 0);
+    const __m128i rgb1 = _mm_setr_epi32(0, 0x00ffffff, 0, 0);
+    const __m128i rgb2 = _mm_setr_epi32(0, 0, 0x00ffffff, 0);
+    const __m128i rgb3 = _mm_setr_epi32(0, 0, 0, 0x00ffffff);
+    __m128i x = _mm_or_si128(_mm_and_si128(v, rgb0), _mm_and_si128(_mm_slli_si128(v, 1), rgb1));
+    __m128i y = _mm_or_si128(_mm_and_si128(_mm_slli_si128(v, 2), rgb2), _mm_and_si128(_mm_slli_si128(v, 3), rgb3));
+    return _mm_or_si128(_mm_or_si128(x, y), _mm_set1_epi32((int)0xff000000u));
+}
+
+inline void rgb8_to_rgba8_sse2(const uint8_t* src, uint8_t* dst, size_t pixels) {
+    size_t i = 0;
+    // 16 pixels from three loads, realigned to 4 pixels per register.
+    for (; i + 16 <= pixels; i += 16) {
+        const uint8_t* s = src + 3 * i;
+        __m128i a = _mm_loadu_si128((const __m128i*)s);
+        __m128i b = _mm_loadu_si128((const __m128i*)(s + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(s + 32));
+        __m128i* d = (__m128i*)(dst + 4 * i);
+        _mm_storeu_si128(d + 0, expand_rgb4_sse2(a));
+        _mm_storeu_si128(d + 1, expand_rgb4_sse2(_mm_or_si128(_mm_srli_si128(a, 12), _mm_slli_si128(b, 4))));
+        _mm_storeu_si128(d + 2, expand_rgb4_sse2(_mm_or_si128(_mm_srli_si128(b, 8), _mm_slli_si128(c, 8))));
+        _mm_storeu_si128(d + 3, expand_rgb4_sse2(_mm_srli_si128(c, 4)));
+    }
+    // The rest a 32-bit word at a time, except the last pixel: its word
+    // would read past the span.
+    for (; i + 1 < pixels; ++i) {
+        uint32_t v;
+        memcpy(&v, src + 3 * i, 4);
+        v |= 0xff000000u;
+        memcpy(dst + 4 * i, &v, 4);
+    }
+    for (; i < pixels; ++i) {
+        dst[4 * i + 0] = src[3 * i + 0];
+        dst[4 * i + 1] = src[3 * i + 1];
+        dst[4 * i + 2] = src[3 * i + 2];
+        dst[4 * i + 3] = 255;
+    }
+}
+
+// round(c * a / 255) for 8 16-bit products, exact over 0..255*255.
+inline __m128i div255_sse2(__m128i t) {
+    t = _mm_add_epi16(t, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+inline __m128i premultiply2_sse2(__m128i px) {
+    // Alpha of each pixel in all four lanes, but 255 in the alpha lane so
+    // alpha itself comes out unchanged.
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(px, 0xff), 0xff);
+    const __m128i alpha_lane = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    a = _mm_or_si128(_mm_andnot_si128(alpha_lane, a), _mm_and_si128(alpha_lane, _mm_set1_epi16(255)));
+    return div255_sse2(_mm_mullo_epi16(px, a));
+}
+
+inline void premultiply_rgba8_sse2(const uint8_t* src, uint8_t* dst, size_t pixels) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= pixels; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+        __m128i lo = premultiply2_sse2(_mm_unpacklo_epi8(v, zero));
+        __m128i hi = premultiply2_sse2(_mm_unpackhi_epi8(v, zero));
+        _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_packus_epi16(lo, hi));
+    }
+    for (; i < pixels; ++i) {
+        uint32_t a = src[4 * i + 3];
+        for (int c = 0; c < 3; ++c) {
+            uint32_t t = src[4 * i + c] * a + 128;
+            dst[4 * i + c] = (uint8_t)((t + (t >> 8)) >> 8);
+        }
+        dst[4 * i + 3] = (uint8_t)a;
+    }
+}
+
+// round(x * 255 / 65535) = (x * 255 + 32895) >> 16, in 32-bit lanes.
+inline __m128i narrow4_sse2(__m128i x) {
+    __m128i t = _mm_sub_epi32(_mm_slli_epi32(x, 8), x);
+    return _mm_srli_epi32(_mm_add_epi32(t, _mm_set1_epi32(32895)), 16);
+}
+
+inline void narrow_u16_to_u8_sse2(const uint16_t* src, uint8_t* dst, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + i + 8));
+        __m128i a16 = _mm_packs_epi32(narrow4_sse2(_mm_unpacklo_epi16(a, zero)), narrow4_sse2(_mm_unpackhi_epi16(a, zero)));
+        __m128i b16 = _mm_packs_epi32(narrow4_sse2(_mm_unpacklo_epi16(b, zero)), narrow4_sse2(_mm_unpackhi_epi16(b, zero)));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(a16, b16));
+    }
+    for (; i < count; ++i) {
+        dst[i] = (uint8_t)((src[i] * 255u + 32895u) >> 16);
+    }
+}
+
+// float_to_half() on four lanes; the results are sign extended 32-bit
+// values, so _mm_packs_epi32 keeps their bit patterns.
+inline __m128i float_to_half4_sse2(__m128 f) {
+    const __m128i c_f16_max = _mm_set1_epi32((127 + 16) << 23);
+    const __m128i c_nan_bit = _mm_set1_epi32(0x200);
+    const __m128i c_infinity = _mm_set1_epi32(0x7c00);
+    const __m128i c_min_normal = _mm_set1_epi32((127 - 14) << 23);
+    const __m128i c_subnorm_magic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+    const __m128i c_normal_bias = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+
+    __m128 sign = _mm_and_ps(f, _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000u)));
+    __m128 absf = _mm_xor_ps(f, sign);
+    __m128i absi = _mm_castps_si128(absf);
+    __m128i is_nan = _mm_castps_si128(_mm_cmpunord_ps(absf, absf));
+    __m128i is_regular = _mm_cmpgt_epi32(c_f16_max, absi);
+    __m128i special = _mm_or_si128(_mm_and_si128(is_nan, c_nan_bit), c_infinity);
+
+    __m128i is_subnormal = _mm_cmpgt_epi32(c_min_normal, absi);
+    __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absf, _mm_castsi128_ps(c_subnorm_magic))), c_subnorm_magic);
+
+    __m128i mant_odd = _mm_srai_epi32(_mm_slli_epi32(absi, 31 - 13), 31);
+    __m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(absi, c_normal_bias), mant_odd), 13);
+
+    __m128i finite = _mm_or_si128(_mm_and_si128(is_subnormal, subnormal), _mm_andnot_si128(is_subnormal, normal));
+    __m128i h = _mm_or_si128(_mm_and_si128(is_regular, finite), _mm_andnot_si128(is_regular, special));
+    return _mm_or_si128(h, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+}
+
+inline void float_to_half_sse2(const float* src, uint16_t* dst, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i lo = float_to_half4_sse2(_mm_loadu_ps(src + i));
+        __m128i hi = float_to_half4_sse2(_mm_loadu_ps(src + i + 4));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(lo, hi));
+    }
+    for (; i < count; ++i) {
+        dst[i] = float_to_half(src[i]);
+    }
+}
+inline __m128i select_sse2(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// float_to_ufloat() on four lanes.
+template<int mantissa_bits>
+inline __m128i float_to_ufloat4_sse2(__m128 x) {
+    typedef ufloat_t<mantissa_bits> uf;
+
+    __m128i xi = _mm_castps_si128(x);
+    __m128i is_nan = _mm_castps_si128(_mm_cmpunord_ps(x, x));
+    __m128i is_negative = _mm_srai_epi32(xi, 31);
+    __m128i is_infinity = _mm_cmpeq_epi32(xi, _mm_set1_epi32(0x7f800000));
+    // Signed compares: negative lanes are neither, and are cleared anyway.
+    __m128i is_large = _mm_cmpgt_epi32(xi, _mm_set1_epi32((int)uf::max_bits - 1));
+    __m128i is_subnormal = _mm_cmpgt_epi32(_mm_set1_epi32((int)uf::min_normal_bits), xi);
+
+    const __m128i magic = _mm_set1_epi32((int)uf::subnormal_magic_bits);
+    __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(x, _mm_castsi128_ps(magic))), magic);
+    __m128i odd = _mm_and_si128(_mm_srli_epi32(xi, uf::shift), _mm_set1_epi32(1));
+    __m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(xi, _mm_set1_epi32((int)uf::normal_bias)), odd), uf::shift);
+
+    __m128i v = select_sse2(is_subnormal, subnormal, normal);
+    v = select_sse2(is_large, _mm_set1_epi32((int)uf::max_finite), v);
+    v = _mm_andnot_si128(is_negative, v);
+    v = select_sse2(is_infinity, _mm_set1_epi32((int)uf::infinity), v);
+    return select_sse2(is_nan, _mm_set1_epi32((int)uf::nan), v);
+}
+
+inline void float_to_r11g11b10_sse2(const float* src, uint32_t* dst, size_t pixels, int channels) {
+    size_t i = 0;
+    for (; i + 4 <= pixels; i += 4) {
+        // Four pixels to one register per channel.
+        __m128 r, g, b;
+        const float* s = src + i * channels;
+        if (4 == channels) {
+            __m128 p0 = _mm_loadu_ps(s), p1 = _mm_loadu_ps(s + 4), p2 = _mm_loadu_ps(s + 8), p3 = _mm_loadu_ps(s + 12);
+            _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+            r = p0;
+            g = p1;
+            b = p2;
+        } else {
+            // r0 g0 b0 r1 | g1 b1 r2 g2 | b2 r3 g3 b3
+            __m128 a = _mm_loadu_ps(s), m = _mm_loadu_ps(s + 4), c = _mm_loadu_ps(s + 8);
+            __m128 r23 = _mm_shuffle_ps(m, c, _MM_SHUFFLE(0, 1, 0, 2));
+            r = _mm_shuffle_ps(a, r23, _MM_SHUFFLE(2, 0, 3, 0));
+            g = _mm_shuffle_ps(_mm_shuffle_ps(a, m, _MM_SHUFFLE(0, 0, 0, 1)),
+                    _mm_shuffle_ps(m, c, _MM_SHUFFLE(0, 2, 0, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+            b = _mm_shuffle_ps(_mm_shuffle_ps(a, m, _MM_SHUFFLE(0, 1, 0, 2)),
+                    _mm_shuffle_ps(c, c, _MM_SHUFFLE(0, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+        }
+        __m128i v = _mm_or_si128(float_to_ufloat4_sse2<6>(r), _mm_slli_epi32(float_to_ufloat4_sse2<6>(g), 11));
+        v = _mm_or_si128(v, _mm_slli_epi32(float_to_ufloat4_sse2<5>(b), 22));
+        _mm_storeu_si128((__m128i*)(dst + i), v);
+    }
+    for (; i < pixels; ++i) {
+        const float* s = src + i * channels;
+        dst[i] = float_to_r11g11b10(s[0], s[1], s[2]);
+    }
+}
+#endif // GOFRAN_PIXEL_SSE2
+
+#if defined(GOFRAN_PIXEL_AVX2)
+GOFRAN_AVX2_TARGET inline void rgb8_to_rgba8_avx2(const uint8_t* src, uint8_t* dst, size_t pixels) {
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32((int)0xff000000u);
+    size_t i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        const uint8_t* s = src + 3 * i;
+        __m128i a = _mm_loadu_si128((const __m128i*)s);
+        __m128i b = _mm_loadu_si128((const __m128i*)(s + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(s + 32));
+        __m128i* d = (__m128i*)(dst + 4 * i);
+        _mm_storeu_si128(d + 0, _mm_or_si128(_mm_shuffle_epi8(a, shuffle), alpha));
+        _mm_storeu_si128(d + 1, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), shuffle), alpha));
+        _mm_storeu_si128(d + 2, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), shuffle), alpha));
+        _mm_storeu_si128(d + 3, _mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(c, 4), shuffle), alpha));
+    }
+    rgb8_to_rgba8_sse2(src + 3 * i, dst + 4 * i, pixels - i);
+}
+
+GOFRAN_AVX2_TARGET inline void premultiply_rgba8_avx2(const uint8_t* src, uint8_t* dst, size_t pixels) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha_lane = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+    const __m256i c255 = _mm256_set1_epi16(255);
+    const __m256i c128 = _mm256_set1_epi16(128);
+    size_t i = 0;
+    for (; i + 8 <= pixels; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + 4 * i));
+        __m256i halves[2] = { _mm256_unpacklo_epi8(v, zero), _mm256_unpackhi_epi8(v, zero) };
+        for (auto& px : halves) {
+            __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(px, 0xff), 0xff);
+            a = _mm256_blendv_epi8(a, c255, alpha_lane);
+            __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(px, a), c128);
+            px = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+        }
+        // Unpack and pack both work within 128-bit lanes, so pixels come
+        // back in their original order.
+        _mm256_storeu_si256((__m256i*)(dst + 4 * i), _mm256_packus_epi16(halves[0], halves[1]));
+    }
+    premultiply_rgba8_sse2(src + 4 * i, dst + 4 * i, pixels - i);
+}
+
+GOFRAN_AVX2_TARGET inline void narrow_u16_to_u8_avx2(const uint16_t* src, uint8_t* dst, size_t count) {
+    const __m256i bias = _mm256_set1_epi32(32895);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i lo = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+        __m256i hi = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i + 8)));
+        lo = _mm256_srli_epi32(_mm256_add_epi32(_mm256_sub_epi32(_mm256_slli_epi32(lo, 8), lo), bias), 16);
+        hi = _mm256_srli_epi32(_mm256_add_epi32(_mm256_sub_epi32(_mm256_slli_epi32(hi, 8), hi), bias), 16);
+        __m256i w = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xd8);
+        __m128i b = _mm_packus_epi16(_mm256_castsi256_si128(w), _mm256_extracti128_si256(w, 1));
+        _mm_storeu_si128((__m128i*)(dst + i), b);
+    }
+    narrow_u16_to_u8_sse2(src + i, dst + i, count - i);
+}
+
+GOFRAN_AVX2_TARGET inline void float_to_half_avx2(const float* src, uint16_t* dst, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        __m128i b = _mm256_cvtps_ph(_mm256_loadu_ps(src + i + 8), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i*)(dst + i), a);
+        _mm_storeu_si128((__m128i*)(dst + i + 8), b);
+    }
+    float_to_half_sse2(src + i, dst + i, count - i);
+}
+
+// Eight linear floats to sRGB8, as linear_to_srgb8() with gathers. NaN and
+// negative clamp to 0.
+GOFRAN_AVX2_TARGET inline __m256i linear_to_srgb8_avx2(const srgb_tables& t, __m256 x) {
+    const __m256 almost_one = _mm256_set1_ps(0.99999994f);
+    const __m256i min_bits = _mm256_set1_epi32((int)srgb_tables::min_bits);
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_setzero_ps()), almost_one);
+    __m256i bits = _mm256_castps_si256(x);
+    __m256i small = _mm256_cmpgt_epi32(min_bits, bits);
+    __m256i b = _mm256_srli_epi32(_mm256_max_epi32(_mm256_sub_epi32(bits, min_bits), _mm256_setzero_si256()),
+            23 - srgb_tables::mantissa_bits);
+    __m256i base = _mm256_i32gather_epi32((const int*)t.bucket_base, b, 4);
+    __m256 threshold = _mm256_i32gather_ps(t.bucket_threshold, b, 4);
+    // The compare is all ones (-1) when x reached the threshold.
+    __m256i v = _mm256_sub_epi32(base, _mm256_castps_si256(_mm256_cmp_ps(x, threshold, _CMP_GE_OQ)));
+    __m256i one = _mm256_cmpeq_epi32(bits, _mm256_castps_si256(almost_one));
+    v = _mm256_blendv_epi8(v, _mm256_set1_epi32(255), one);
+    return _mm256_andnot_si256(small, v);
+}
+
+GOFRAN_AVX2_TARGET inline void linear_f32_to_srgb8_avx2(const float* src, uint8_t* dst, size_t pixels, int channels) {
+    const srgb_tables& t = srgb_tables::get();
+    size_t count = pixels * channels;
+    size_t i = 0;
+    if (1 == channels || 3 == channels) {
+        for (; i + 8 <= count; i += 8) {
+            __m256i v = linear_to_srgb8_avx2(t, _mm256_loadu_ps(src + i));
+            __m128i w = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+            _mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(w, w));
+        }
+    } else {
+        // Every other (2) or every fourth (4) component is alpha.
+        const __m256i alpha_lane = 2 == channels
+                ? _mm256_set_epi32(-1, 0, -1, 0, -1, 0, -1, 0)
+                : _mm256_set_epi32(-1, 0, 0, 0, -1, 0, 0, 0);
+        const __m256 c255 = _mm256_set1_ps(255.0f);
+        const __m256 half = _mm256_set1_ps(0.5f);
+        for (; i + 8 <= count; i += 8) {
+            __m256 x = _mm256_loadu_ps(src + i);
+            __m256i color = linear_to_srgb8_avx2(t, x);
+            __m256 clamped = _mm256_min_ps(_mm256_max_ps(x, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+            __m256i alpha = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(clamped, c255), half));
+            __m256i v = _mm256_blendv_epi8(color, alpha, alpha_lane);
+            __m128i w = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+            _mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(w, w));
+        }
+    }
+    for (; i < count; ++i) {
+        bool is_alpha = (2 == channels || 4 == channels) && (int)(i % channels) == channels - 1;
+        dst[i] = is_alpha ? unorm_to_u8(src[i]) : linear_to_srgb8(t, src[i]);
+    }
+}
+#endif // GOFRAN_PIXEL_AVX2
+
+#if defined(GOFRAN_PIXEL_NEON)
+inline void rgb8_to_rgba8_neon(const uint8_t* src, uint8_t* dst, size_t pixels) {
+    size_t i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        uint8x16x3_t rgb = vld3q_u8(src + 3 * i);
+        uint8x16x4_t rgba = { { rgb.val[0], rgb.val[1], rgb.val[2], vdupq_n_u8(255) } };
+        vst4q_u8(dst + 4 * i, rgba);
+    }
+    for (; i < pixels; ++i) {
+        dst[4 * i + 0] = src[3 * i + 0];
+        dst[4 * i + 1] = src[3 * i + 1];
+        dst[4 * i + 2] = src[3 * i + 2];
+        dst[4 * i + 3] = 255;
+    }
+}
+
+inline uint8x8_t div255_neon(uint16x8_t t) {
+    return vraddhn_u16(t, vrshrq_n_u16(t, 8));
+}
+
+inline void premultiply_rgba8_neon(const uint8_t* src, uint8_t* dst, size_t pixels) {
+    size_t i = 0;
+    for (; i + 8 <= pixels; i += 8) {
+        uint8x8x4_t px = vld4_u8(src + 4 * i);
+        px.val[0] = div255_neon(vmull_u8(px.val[0], px.val[3]));
+        px.val[1] = div255_neon(vmull_u8(px.val[1], px.val[3]));
+        px.val[2] = div255_neon(vmull_u8(px.val[2], px.val[3]));
+        vst4_u8(dst + 4 * i, px);
+    }
+    for (; i < pixels; ++i) {
+        uint32_t a = src[4 * i + 3];
+        for (int c = 0; c < 3; ++c) {
+            uint32_t t = src[4 * i + c] * a + 128;
+            dst[4 * i + c] = (uint8_t)((t + (t >> 8)) >> 8);
+        }
+        dst[4 * i + 3] = (uint8_t)a;
+    }
+}
+
+inline void narrow_u16_to_u8_neon(const uint16_t* src, uint8_t* dst, size_t count) {
+    const uint32x4_t bias = vdupq_n_u32(32895);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t x = vld1q_u16(src + i);
+        uint16x4_t lo = vaddhn_u32(vmull_n_u16(vget_low_u16(x), 255), bias);
+        uint16x4_t hi = vaddhn_u32(vmull_n_u16(vget_high_u16(x), 255), bias);
+        vst1_u8(dst + i, vmovn_u16(vcombine_u16(lo, hi)));
+    }
+    for (; i < count; ++i) {
+        dst[i] = (uint8_t)((src[i] * 255u + 32895u) >> 16);
+    }
+}
+
+inline void float_to_half_neon(const float* src, uint16_t* dst, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        float16x4_t lo = vcvt_f16_f32(vld1q_f32(src + i));
+        float16x4_t hi = vcvt_f16_f32(vld1q_f32(src + i + 4));
+        vst1q_u16(dst + i, vcombine_u16(vreinterpret_u16_f16(lo), vreinterpret_u16_f16(hi)));
+    }
+    for (; i < count; ++i) {
+        dst[i] = float_to_half(src[i]);
+    }
+}
+template<int mantissa_bits>
+inline uint32x4_t float_to_ufloat4_neon(float32x4_t x) {
+    typedef ufloat_t<mantissa_bits> uf;
+
+    uint32x4_t xi = vreinterpretq_u32_f32(x);
+    uint32x4_t is_nan = vmvnq_u32(vceqq_f32(x, x));
+    uint32x4_t is_negative = vcltq_s32(vreinterpretq_s32_u32(xi), vdupq_n_s32(0));
+    uint32x4_t is_infinity = vceqq_u32(xi, vdupq_n_u32(0x7f800000u));
+    uint32x4_t is_large = vcgeq_u32(xi, vdupq_n_u32(uf::max_bits));
+    uint32x4_t is_subnormal = vcltq_u32(xi, vdupq_n_u32(uf::min_normal_bits));
+
+    const uint32x4_t magic = vdupq_n_u32(uf::subnormal_magic_bits);
+    uint32x4_t subnormal = vsubq_u32(vreinterpretq_u32_f32(vaddq_f32(x, vreinterpretq_f32_u32(magic))), magic);
+    uint32x4_t odd = vandq_u32(vshrq_n_u32(xi, uf::shift), vdupq_n_u32(1));
+    uint32x4_t normal = vshrq_n_u32(vaddq_u32(vaddq_u32(xi, vdupq_n_u32(uf::normal_bias)), odd), uf::shift);
+
+    uint32x4_t v = vbslq_u32(is_subnormal, subnormal, normal);
+    v = vbslq_u32(is_large, vdupq_n_u32(uf::max_finite), v);
+    v = vbicq_u32(v, is_negative);
+    v = vbslq_u32(is_infinity, vdupq_n_u32(uf::infinity), v);
+    return vbslq_u32(is_nan, vdupq_n_u32(uf::nan), v);
+}
+
+inline void float_to_r11g11b10_neon(const float* src, uint32_t* dst, size_t pixels, int channels) {
+    size_t i = 0;
+    for (; i + 4 <= pixels; i += 4) {
+        float32x4_t r, g, b;
+        if (4 == channels) {
+            float32x4x4_t px = vld4q_f32(src + i * 4);
+            r = px.val[0];
+            g = px.val[1];
+            b = px.val[2];
+        } else {
+            float32x4x3_t px = vld3q_f32(src + i * 3);
+            r = px.val[0];
+            g = px.val[1];
+            b = px.val[2];
+        }
+        uint32x4_t v = vorrq_u32(float_to_ufloat4_neon<6>(r), vshlq_n_u32(float_to_ufloat4_neon<6>(g), 11));
+        vst1q_u32(dst + i, vorrq_u32(v, vshlq_n_u32(float_to_ufloat4_neon<5>(b), 22)));
+    }
+    for (; i < pixels; ++i) {
+        const float* s = src + i * channels;
+        dst[i] = float_to_r11g11b10(s[0], s[1], s[2]);
+    }
+}
+#endif // GOFRAN_PIXEL_NEON
+
+}
+
+// RGB8 to RGBA8 with opaque alpha. Drivers convert RGB uploads on the CPU,
+// often slowly, and 3-byte rows break the default unpack alignment.
+inline void rgb8_to_rgba8(const uint8_t* src, uint8_t* dst, size_t pixels,
+        pixel_isa isa = pixel_isa::PIXEL_BEST) {
+    switch (detail::resolve_isa(isa)) {
+#if defined(GOFRAN_PIXEL_AVX2)
+    case pixel_isa::PIXEL_AVX2:
+        detail::rgb8_to_rgba8_avx2(src, dst, pixels);
+        return;
+#endif
+#if defined(GOFRAN_PIXEL_SSE2)
+    case pixel_isa::PIXEL_SSE2:
+        detail::rgb8_to_rgba8_sse2(src, dst, pixels);
+        return;
+#endif
+#if defined(GOFRAN_PIXEL_NEON)
+    case pixel_isa::PIXEL_NEON:
+        detail::rgb8_to_rgba8_neon(src, dst, pixels);
+        return;
+#endif
+    default:
+        break;
+    }
+
+    for (size_t i = 0; i < pixels; ++i) {
+        dst[4 * i + 0] = src[3 * i + 0];
+        dst[4 * i + 1] = src[3 * i + 1];
+        dst[4 * i + 2] = src[3 * i + 2];
+        dst[4 * i + 3] = 255;
+    }
+}
+
+// Straight to premultiplied alpha, round(c * a / 255). In place is fine.
+inline void premultiply_rgba8(const uint8_t* src, uint8_t* dst, size_t pixels,
+        pixel_isa isa = pixel_isa::PIXEL_BEST) {
+    switch (detail::resolve_isa(isa)) {
+#if defined(GOFRAN_PIXEL_AVX2)
+    case pixel_isa::PIXEL_AVX2:
+        detail::premultiply_rgba8_avx2(src, dst, pixels);
+        return;
+#endif
+#if defined(GOFRAN_PIXEL_SSE2)
+    case pixel_isa::PIXEL_SSE2:
+        detail::premultiply_rgba8_sse2(src, dst, pixels);
+        return;
+#endif
+#if defined(GOFRAN_PIXEL_NEON)
+    case pixel_isa::PIXEL_NEON:
+        detail::premultiply_rgba8_neon(src, dst, pixels);
+        return;
+#endif
+    default:
+        break;
+    }
+
+    for (size_t i = 0; i < pixels; ++i) {
+        uint32_t a = src[4 * i + 3];
+        for (int c = 0; c < 3; ++c) {
+            uint32_t t = src[4 * i + c] * a + 128;
+            dst[4 * i + c] = (uint8_t)((t + (t >> 8)) >> 8);
+        }
+        dst[4 * i + 3] = (uint8_t)a;
+    }
+}
+
+// 16-bit components (stbi_load_16) to 8-bit, round(x * 255 / 65535).
+inline void narrow_u16_to_u8(const uint16_t* src, uint8_t* dst, size_t components,
+        pixel_isa isa = pixel_isa::PIXEL_BEST) {
+    switch (detail::resolve_isa(isa)) {
+#if defined(GOFRAN_PIXEL_AVX2)
+    case pixel_isa::PIXEL_AVX2:
+        detail::narrow_u16_to_u8_avx2(src, dst, components);
+        return;
+#endif
+#if defined(GOFRAN_PIXEL_SSE2)
+    case pixel_isa::PIXEL_SSE2:
+        detail::narrow_u16_to_u8_sse2(src, dst, components);
+        return;
+#endif
+#if defined(GOFRAN_PIXEL_NEON)
+    case pixel_isa::PIXEL_NEON:
+        detail::narrow_u16_to_u8_neon(src, dst, components);
+        return;
+#endif
+    default:
+        break;
+    }
+
+    for (size_t i = 0; i < components; ++i) {
+        dst[i] = (uint8_t)((src[i] * 255u + 32895u) >> 16);
+    }
+}
+
+// IEEE half floats for GL_HALF_FLOAT uploads, rounded to nearest even. In
+// place is fine.
+inline void float_to_half(const float* src, uint16_t* dst, size_t components,
+        pixel_isa isa = pixel_isa::PIXEL_BEST) {
+    switch (detail::resolve_isa(isa)) {
+#if defined(GOFRAN_PIXEL_AVX2)
+    case pixel_isa::PIXEL_AVX2:
+        detail::float_to_half_avx2(src, dst, components);
+        return;
+#endif
+#if defined(GOFRAN_PIXEL_SSE2)
+    case pixel_isa::PIXEL_SSE2:
+        detail::float_to_half_sse2(src, dst, components);
+        return;
+#endif
+#if defined(GOFRAN_PIXEL_NEON)
+    case pixel_isa::PIXEL_NEON:
+        detail::float_to_half_neon(src, dst, components);
+        return;
+#endif
+    default:
+        break;
+    }
+
+    for (size_t i = 0; i < components; ++i) {
+        dst[i] = detail::float_to_half(src[i]);
+    }
+}
+
+// RGB or RGBA floats (stbi_loadf) to GL_UNSIGNED_INT_10F_11F_11F_REV pixels,
+// a quarter of the memory of RGBA32F. Alpha is dropped, as are negative
+// values and the sign of NaNs. In place is fine.
+inline void float_to_r11g11b10(const float* src, uint32_t* dst, size_t pixels, int channels,
+        pixel_isa isa = pixel_isa::PIXEL_BEST) {
+    switch (detail::resolve_isa(isa)) {
+#if defined(GOFRAN_PIXEL_SSE2)
+    // Shuffles and compares only, AVX2 has nothing to add.
+    case pixel_isa::PIXEL_AVX2:
+    case pixel_isa::PIXEL_SSE2:
+        detail::float_to_r11g11b10_sse2(src, dst, pixels, channels);
+        return;
+#endif
+#if defined(GOFRAN_PIXEL_NEON)
+    case pixel_isa::PIXEL_NEON:
+        detail::float_to_r11g11b10_neon(src, dst, pixels, channels);
+        return;
+#endif
+    default:
+        break;
+    }
+
+    for (size_t i = 0; i < pixels; ++i) {
+        const float* s = src + i * channels;
+        dst[i] = detail::float_to_r11g11b10(s[0], s[1], s[2]);
+    }
+}
+
+// sRGB encoded 8-bit pixels of 1 to 4 channels to linear floats. With 2 or 4
+// channels the last one is alpha, which is only scaled to 0..1.
+inline void srgb8_to_linear_f32(const uint8_t* src, float* dst, size_t pixels, int channels) {
+    const detail::srgb_tables& t = detail::srgb_tables::get();
+    size_t count = pixels * channels;
+    int alpha = (2 == channels || 4 == channels) ? channels - 1 : channels;
+    for (size_t i = 0; i < count; i += channels) {
+        for (int c = 0; c < channels; ++c) {
+            dst[i + c] = c == alpha ? src[i + c] * (1.0f / 255.0f) : t.to_linear[src[i + c]];
+        }
+    }
+}
+
+// Linear floats back to sRGB8, correctly rounded; alpha as above.
+inline void linear_f32_to_srgb8(const float* src, uint8_t* dst, size_t pixels, int channels,
+        pixel_isa isa = pixel_isa::PIXEL_BEST) {
+#if defined(GOFRAN_PIXEL_AVX2)
+    if (pixel_isa::PIXEL_AVX2 == detail::resolve_isa(isa)) {
+        detail::linear_f32_to_srgb8_avx2(src, dst, pixels, channels);
+        return;
+    }
+#else
+    (void)isa;
+#endif
+
+    const detail::srgb_tables& t = detail::srgb_tables::get();
+    size_t count = pixels * channels;
+    int alpha = (2 == channels || 4 == channels) ? channels - 1 : channels;
+    for (size_t i = 0; i < count; i += channels) {
+        for (int c = 0; c < channels; ++c) {
+            dst[i + c] = c == alpha ? detail::unorm_to_u8(src[i + c]) : detail::linear_to_srgb8(t, src[i + c]);
+        }
+    }
+}
+
+// 8-bit to 8-bit either way, through 256-entry tables; alpha as above.
+// Linear 8-bit loses shadow detail, keep floats where that matters.
+inline void srgb8_to_linear8(const uint8_t* src, uint8_t* dst, size_t pixels, int channels) {
+    const detail::srgb_tables& t = detail::srgb_tables::get();
+    size_t count = pixels * channels;
+    int alpha = (2 == channels || 4 == channels) ? channels - 1 : channels;
+    for (size_t i = 0; i < count; i += channels) {
+        for (int c = 0; c < channels; ++c) {
+            dst[i + c] = c == alpha ? src[i + c] : t.to_linear8[src[i + c]];
+        }
+    }
+}
+
+inline void linear8_to_srgb8(const uint8_t* src, uint8_t* dst, size_t pixels, int channels) {
+    const detail::srgb_tables& t = detail::srgb_tables::get();
+    size_t count = pixels * channels;
+    int alpha = (2 == channels || 4 == channels) ? channels - 1 : channels;
+    for (size_t i = 0; i < count; i += channels) {
+        for (int c = 0; c < channels; ++c) {
+            dst[i + c] = c == alpha ? src[i + c] : t.to_srgb8[src[i + c]];
+        }
+    }
+}
+
+// Calls row(src_row, dst_row) for rows [first, last) of two images whose rows
+// are src_stride and dst_stride bytes apart, e.g.
+//   convert_rows(rgb, w * 3, rgba, w * 4, 0, h, [w](const void* s, void* d) {
+//       rgb8_to_rgba8((const uint8_t*)s, (uint8_t*)d, w);
+//   });
+template<typename Row>
+inline void convert_rows(const void* src, size_t src_stride, void* dst, size_t dst_stride,
+        size_t first, size_t last, const Row& row) {
+    for (size_t y = first; y < last; ++y) {
+        row((const uint8_t*)src + y * src_stride, (uint8_t*)dst + y * dst_stride);
+    }
+}
+
+// The same over all rows, split into bands of at least 64 KiB of output.
+template<typename Row>
+inline void convert_rows_parallel(JobSystem& jobs, const void* src, size_t src_stride,
+        void* dst, size_t dst_stride, size_t rows, const Row& row) {
+    size_t grain = std::max<size_t>(1, (64 << 10) / std::max<size_t>(1, dst_stride));
+    jobs.parallel_for(0, rows, [&](size_t first, size_t last) {
+        convert_rows(src, src_stride, dst, dst_stride, first, last, row);
+    }, grain);
+}
+
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <time.h>
+
+namespace gofran {
+
+// Records named startup phases from any thread: wall time relative to the
+// profiler's creation and CPU time of the thread that ran the phase. The
+// report ends with time to first frame, the number we track across commits.
+class StartupProfiler {
+public:
+    StartupProfiler() : _origin(std::chrono::steady_clock::now())
+            , _first_frame_ms(-1.0) {
+    }
+
+private:
+    StartupProfiler(const StartupProfiler&) = delete;
+
+    StartupProfiler* operator=(const StartupProfiler&) = delete;
+
+public:
+    // RAII scope for one phase. Must not span a co_await, the CPU clock is
+    // per thread.
+    class Phase {
+    public:
+        Phase(StartupProfiler* profiler, const std::string& name) : _profiler(profiler) {
+            if (NULL != _profiler) {
+                _name = name;
+                _wall_start = _profiler->now_ms();
+                _cpu_start = thread_cpu_ms();
+            }
+        }
+
+        ~Phase() {
+            if (NULL != _profiler) {
+                _profiler->record(_name, _wall_start, _profiler->now_ms(),
+                        thread_cpu_ms() - _cpu_start);
+            }
+        }
+
+    private:
+        Phase(const Phase&) = delete;
+
+        Phase* operator=(const Phase&) = delete;
+
+    private:
+        StartupProfiler* _profiler;
+
+        std::string _name;
+
+        double _wall_start;
+
+        double _cpu_start;
+    };
+
+    inline double now_ms() const {
+        using namespace std::chrono;
+        return duration<double, std::milli>(steady_clock::now() - _origin).count();
+    }
+
+    void mark_first_frame() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_first_frame_ms < 0.0) {
+            _first_frame_ms = now_ms();
+        }
+    }
+
+    inline double first_frame_ms() const {
+        return _first_frame_ms;
+    }
+
+    void report(std::ostream& out) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<record_t> records = _records;
+        std::sort(records.begin(), records.end(), [](const record_t& a, const record_t& b) {
+            return a.wall_start < b.wall_start;
+        });
+
+        out << "startup phases (ms)" << std::endl;
+        out << std::left << std::setw(32) << "phase"
+                << std::right << std::setw(10) << "start"
+                << std::setw(10) << "end"
+                << std::setw(10) << "wall"
+                << std::setw(10) << "cpu"
+                << "  thread" << std::endl;
+        std::streamsize precision = out.precision();
+        out << std::fixed << std::setprecision(2);
+        for (const auto& r : records) {
+            out << std::left << std::setw(32) << r.name
+                    << std::right << std::setw(10) << r.wall_start
+                    << std::setw(10) << r.wall_end
+                    << std::setw(10) << r.wall_end - r.wall_start
+                    << std::setw(10) << r.cpu
+                    << "  " << r.thread << std::endl;
+        }
+        out << "time to first frame: " << _first_frame_ms << " ms" << std::endl;
+        out.unsetf(std::ios::floatfield);
+        out.precision(precision);
+    }
+
+private:
+    struct record_t {
+        std::string name;
+
+        std::string thread;
+
+        double wall_start;
+
+        double wall_end;
+
+        double cpu;
+    };
+
+    void record(const std::string& name, double wall_start, double wall_end, double cpu) {
+        std::ostringstream thread;
+        thread << std::this_thread::get_id();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _records.push_back(record_t{ name, thread.str(), wall_start, wall_end, cpu });
+    }
+
+    static double thread_cpu_ms() {
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+        timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+#else
+        return 0.0;
+#endif
+    }
+
+private:
+    std::chrono::steady_clock::time_point _origin;
+
+    std::mutex _mutex;
+
+    std::vector<record_t> _records;
+
+    double _first_frame_ms;
+};
+
+}
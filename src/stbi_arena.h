@@ -0,0 +1,266 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../stb_image.h"
+
+namespace gofran {
+
+// Bump allocator for stb_image's scratch memory, installed on one thread with
+// stbi_set_allocator_thread(), usually through a Scope. Frees only give memory
+// back when they hit the newest allocation, which covers the grow-and-shrink
+// pattern of zlib and most temporaries; everything else is dropped at once by
+// reset(). After a reset the arena keeps a single block as large as everything
+// it held, up to retain_limit(), so decoding images of similar size again
+// never touches malloc.
+class StbiArena {
+public:
+    static const size_t min_block_size = 1 << 20;
+
+    struct stats_t {
+        // Allocations and resizes stb_image asked for.
+        size_t allocs = 0;
+
+        size_t resizes = 0;
+
+        // Resizes of the newest allocation that needed no copy.
+        size_t resized_in_place = 0;
+
+        // Blocks taken from malloc, what the allocations above would have
+        // cost without the arena.
+        size_t blocks = 0;
+
+        // Most bytes handed out at once, rounded to 16 byte granules.
+        size_t peak_bytes = 0;
+
+        size_t resets = 0;
+    };
+
+    // Installs the arena on the calling thread and resets it when the
+    // outermost scope ends. Nothing allocated inside may be used after that,
+    // so results must be freed inside or decoded with stbi_load_into. A scope
+    // replaces any other allocator of the thread and leaves none behind.
+    class Scope {
+    public:
+        explicit Scope(StbiArena& arena) : _arena(arena) {
+            if (0 == _arena._scopes++) {
+                stbi_allocator allocator = _arena.allocator();
+                stbi_set_allocator_thread(&allocator);
+            }
+        }
+
+        ~Scope() {
+            if (0 == --_arena._scopes) {
+                stbi_set_allocator_thread(NULL);
+                _arena.reset();
+            }
+        }
+
+    private:
+        Scope(const Scope&) = delete;
+
+        Scope* operator=(const Scope&) = delete;
+
+    private:
+        StbiArena& _arena;
+    };
+
+    StbiArena() : _last(NULL)
+            , _last_size(0)
+            , _in_use(0)
+            , _retain_limit(64 << 20)
+            , _scopes(0) {
+    }
+
+    ~StbiArena() {
+        release_blocks();
+    }
+
+private:
+    StbiArena(const StbiArena&) = delete;
+
+    StbiArena* operator=(const StbiArena&) = delete;
+
+public:
+    // One arena per thread, kept for the thread's lifetime.
+    static StbiArena& this_thread() {
+        static thread_local StbiArena arena;
+        return arena;
+    }
+
+    inline const stats_t& stats() const {
+        return _stats;
+    }
+
+    inline void clear_stats() {
+        _stats = stats_t();
+    }
+
+    inline size_t retain_limit() const {
+        return _retain_limit;
+    }
+
+    // Memory the arena may keep across reset(), more is given back to malloc.
+    inline void set_retain_limit(size_t bytes) {
+        _retain_limit = bytes;
+    }
+
+    // Valid as long as the arena, for stbi_set_allocator_thread().
+    stbi_allocator allocator() {
+        stbi_allocator a;
+        a.alloc = &StbiArena::stbi_alloc;
+        a.resize = &StbiArena::stbi_resize;
+        a.release = &StbiArena::stbi_release;
+        a.user = this;
+        return a;
+    }
+
+    void* alloc(size_t size) {
+        ++_stats.allocs;
+        return bump(align(size));
+    }
+
+    void* resize(void* p, size_t old_size, size_t new_size) {
+        if (NULL == p) {
+            return alloc(new_size);
+        }
+
+        // The newest allocation grows in place while its block has room.
+        ++_stats.resizes;
+        if (p == _last) {
+            block_t& block = _blocks.back();
+            size_t size = align(new_size);
+            if (block.used - _last_size + size <= block.size) {
+                block.used = block.used - _last_size + size;
+                _in_use = _in_use - _last_size + size;
+                _last_size = size;
+                _stats.peak_bytes = std::max(_stats.peak_bytes, _in_use);
+                ++_stats.resized_in_place;
+                return p;
+            }
+        }
+
+        void* q = bump(align(new_size));
+        if (NULL != q) {
+            memcpy(q, p, std::min(old_size, new_size));
+            release(p);
+        }
+        return q;
+    }
+
+    void release(void* p) {
+        if (NULL != p && p == _last) {
+            _blocks.back().used -= _last_size;
+            _in_use -= _last_size;
+            _last = NULL;
+            _last_size = 0;
+        }
+    }
+
+    // Invalidates every allocation.
+    void reset() {
+        size_t total = 0;
+        for (const auto& block : _blocks) {
+            total += block.size;
+        }
+
+        if (total > _retain_limit) {
+            release_blocks();
+        } else if (_blocks.size() > 1) {
+            release_blocks();
+            add_block(total);
+        }
+        if (!_blocks.empty()) {
+            _blocks.back().used = 0;
+        }
+        _last = NULL;
+        _last_size = 0;
+        _in_use = 0;
+        ++_stats.resets;
+    }
+
+private:
+    struct block_t {
+        unsigned char* data;
+
+        size_t size;
+
+        size_t used;
+    };
+
+    // 16 byte granules, and never 0 so every allocation has its own address.
+    static inline size_t align(size_t size) {
+        return (std::max<size_t>(size, 1) + 15) & ~(size_t)15;
+    }
+
+    void* bump(size_t size) {
+        if (_blocks.empty() || _blocks.back().used + size > _blocks.back().size) {
+            if (!add_block(size)) {
+                return NULL;
+            }
+        }
+
+        block_t& block = _blocks.back();
+        _last = block.data + block.used;
+        _last_size = size;
+        block.used += size;
+        _in_use += size;
+        _stats.peak_bytes = std::max(_stats.peak_bytes, _in_use);
+        return _last;
+    }
+
+    bool add_block(size_t size) {
+        size_t block_size = size > min_block_size ? size : min_block_size;
+        if (!_blocks.empty()) {
+            block_size = std::max(block_size, _blocks.back().size * 2);
+        }
+
+        unsigned char* data = (unsigned char*)malloc(block_size);
+        if (NULL == data) {
+            return false;
+        }
+        _blocks.push_back(block_t{ data, block_size, 0 });
+        ++_stats.blocks;
+        return true;
+    }
+
+    void release_blocks() {
+        for (auto& block : _blocks) {
+            free(block.data);
+        }
+        _blocks.clear();
+    }
+
+    static void* stbi_alloc(void* user, size_t size) {
+        return ((StbiArena*)user)->alloc(size);
+    }
+
+    static void* stbi_resize(void* user, void* p, size_t old_size, size_t new_size) {
+        return ((StbiArena*)user)->resize(p, old_size, new_size);
+    }
+
+    static void stbi_release(void* user, void* p) {
+        ((StbiArena*)user)->release(p);
+    }
+
+private:
+    std::vector<block_t> _blocks;
+
+    unsigned char* _last;
+
+    size_t _last_size;
+
+    size_t _in_use;
+
+    size_t _retain_limit;
+
+    int _scopes;
+
+    stats_t _stats;
+};
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define GOFRAN_TSC_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+#define GOFRAN_TSC_ARM64
+#endif
+
+namespace gofran {
+
+// Timestamps cheap enough to wrap single GL calls: the x86 time stamp
+// counter or the AArch64 virtual counter, steady_clock nanoseconds
+// elsewhere. Not serializing, a few instructions around a call may be
+// counted on either side. Ticks convert with a rate measured against
+// steady_clock once; CPUs of the last decade have an invariant TSC, the
+// rate holds across cores and clock changes.
+class TscTimer {
+public:
+    static inline uint64_t now() {
+#if defined(GOFRAN_TSC_X86)
+        return __rdtsc();
+#elif defined(GOFRAN_TSC_ARM64)
+        uint64_t ticks;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+        return ticks;
+#else
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // The first call measures for 10 ms.
+    static double ns_per_tick() {
+        static const double rate = calibrate();
+        return rate;
+    }
+
+    static inline double to_ns(uint64_t ticks) {
+        return ticks * ns_per_tick();
+    }
+
+private:
+    static double calibrate() {
+#if defined(GOFRAN_TSC_X86) || defined(GOFRAN_TSC_ARM64)
+        using namespace std::chrono;
+        auto start = steady_clock::now();
+        uint64_t first = now();
+        while (steady_clock::now() - start < milliseconds(10)) {
+        }
+        uint64_t last = now();
+        auto end = steady_clock::now();
+        return last > first ? duration<double, std::nano>(end - start).count() / (last - first) : 1.0;
+#else
+        return 1.0;
+#endif
+    }
+};
+
+}
@@ -244,8 +244,15 @@ RECENT REVISION HISTORY:
 //
 // I/O callbacks allow you to read from arbitrary sources, like packaged
 // files or some other source. Data read from callbacks are processed
-// through a small internal buffer (currently 128 bytes) to try to reduce
-// overhead.
+// through an internal buffer (STBI_IO_BUFFER_SIZE, 64 KiB by default) to
+// reduce overhead, so every "read" asks for that much and the decoder
+// rarely waits on a call. The FILE * functions go through the same buffer.
+//
+// On Unix-like systems the filename functions (stbi_load, stbi_load_16,
+// stbi_loadf, stbi_load_into, stbi_load_scaled) map the file and decode it
+// like a memory buffer instead; #define STBI_NO_MMAP to always use stdio. A
+// mapped file that another process truncates during the load can kill the
+// process with SIGBUS.
 //
 // The three functions you must define are "read" (reads some bytes of data),
 // "skip" (skips some bytes of data), "eof" (reports if the stream is at the end).
@@ -271,6 +278,12 @@ RECENT REVISION HISTORY:
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
 //
+// On x86-64 with GCC, Clang or MSVC the JPEG decoder additionally has AVX2
+// kernels (two-block IDCT, 2x2 upsampling, color conversion and a fused
+// 4:2:0 to RGBA path) that are selected at run time when the CPU supports
+// them, without compiling the rest of the file for AVX2. Define STBI_NO_AVX2
+// to leave them out.
+//
 // ===========================================================================
 //
 // HDR image support   (disable by defining STBI_NO_HDR)
@@ -363,6 +376,10 @@ RECENT REVISION HISTORY:
 //    huge block of memory and spend disproportionate time decoding it. By
 //    default this is set to (1 << 24), which is 16777216, but that's still
 //    very big.
+//
+//  - #define STBI_IO_BUFFER_SIZE to change how many bytes are read from
+//    I/O callbacks and FILEs at a time (at least 128), and STBI_NO_MMAP to
+//    load files by name through stdio rather than a memory mapping.
 
 #ifndef STBI_NO_STDIO
 #include <stdio.h>
@@ -428,6 +445,69 @@ STBIDEF stbi_uc *stbi_load_from_file  (FILE *f, int *x, int *y, int *channels_in
 
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp);
+
+// animated gifs one frame at a time. stbi_load_gif_from_memory holds every
+// frame at once; a stream only keeps the canvas and two frames for
+// disposal, however long the animation is. the memory passed to
+// stbi_gif_stream_open_memory must stay valid until the stream is closed.
+// frames are always RGBA, x*4 bytes per row, and flipped if
+// stbi_set_flip_vertically_on_load asks for it.
+//
+// stbi_gif_stream_next returns 1 after writing a frame (and its delay in
+// milliseconds), 0 after the last frame and -1 on error.
+// stbi_gif_stream_rewind starts over at the first frame, for looping.
+typedef struct stbi_gif_stream stbi_gif_stream;
+STBIDEF stbi_gif_stream *stbi_gif_stream_open_memory(stbi_uc const *buffer, int len, int *x, int *y);
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_gif_stream *stbi_gif_stream_open(char const *filename, int *x, int *y);
+#endif
+STBIDEF int  stbi_gif_stream_next(stbi_gif_stream *g, stbi_uc *pixels, int stride_in_bytes, int *delay_ms);
+STBIDEF int  stbi_gif_stream_rewind(stbi_gif_stream *g);
+STBIDEF void stbi_gif_stream_close(stbi_gif_stream *g);
+#endif
+
+// decode into memory the caller owns, e.g. a mapped pixel unpack buffer,
+// instead of a new allocation. rows are stride_in_bytes apart (0 means
+// width*channels) and hold 'channels' 8-bit components, converted the same
+// way as desired_channels. the image must fit in 'size' bytes; call
+// stbi_info first to size the buffer. flipping happens if either the flag
+// or stbi_set_flip_vertically_on_load asks for it.
+//
+// JPEGs and 8-bit non-interlaced PNGs without palette or tRNS are written
+// row by row straight into the destination; other images are decoded as
+// usual and then converted, flipped and swizzled in a single copy.
+// returns 1 on success, 0 with stbi_failure_reason() set otherwise.
+#define STBI_DEST_FLIP_VERTICALLY  1  // the first row in memory is the bottom of the image
+#define STBI_DEST_BGR              2  // store 3 and 4 channel pixels as BGR / BGRA
+
+typedef struct
+{
+   stbi_uc *pixels;
+   size_t   size;             // bytes available at pixels
+   int      stride_in_bytes;  // 0 for tightly packed rows
+   int      channels;         // 1..4
+   int      flags;            // STBI_DEST_*
+} stbi_dest;
+
+STBIDEF int stbi_load_into_from_memory   (stbi_uc           const *buffer, int len   , stbi_dest const *dest, int *x, int *y, int *channels_in_file);
+STBIDEF int stbi_load_into_from_callbacks(stbi_io_callbacks const *clbk  , void *user, stbi_dest const *dest, int *x, int *y, int *channels_in_file);
+
+#ifndef STBI_NO_STDIO
+STBIDEF int stbi_load_into          (char const *filename, stbi_dest const *dest, int *x, int *y, int *channels_in_file);
+STBIDEF int stbi_load_into_from_file(FILE *f,              stbi_dest const *dest, int *x, int *y, int *channels_in_file);
+#endif
+
+// reduced-size loads: decode at 1/scale of the full size, scale being 1, 2,
+// 4 or 8 (anything else rounds down to one of those). JPEGs are reduced in
+// the IDCT, which skips most of the work of a full decode, e.g. for
+// thumbnails or lower mips. other formats ignore scale and load at full
+// size, so always look at *x and *y.
+STBIDEF stbi_uc *stbi_load_scaled_from_memory   (stbi_uc           const *buffer, int len   , int scale, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF stbi_uc *stbi_load_scaled_from_callbacks(stbi_io_callbacks const *clbk  , void *user, int scale, int *x, int *y, int *channels_in_file, int desired_channels);
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_uc *stbi_load_scaled          (char const *filename, int scale, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF stbi_uc *stbi_load_scaled_from_file(FILE *f,              int scale, int *x, int *y, int *channels_in_file, int desired_channels);
 #endif
 
 #ifdef STBI_WINDOWS_UTF8
@@ -500,6 +580,37 @@ STBIDEF int      stbi_is_16_bit          (char const *filename);
 STBIDEF int      stbi_is_16_bit_from_file(FILE *f);
 #endif
 
+// stbi_info plus what a loader needs to size its buffers without probing
+// again: which format the file is in and whether it decodes to 16-bit or
+// float components. returns 1 and fills info if the image is supported.
+enum
+{
+   STBI_FORMAT_UNKNOWN = 0,
+   STBI_FORMAT_JPEG,
+   STBI_FORMAT_PNG,
+   STBI_FORMAT_GIF,
+   STBI_FORMAT_BMP,
+   STBI_FORMAT_PSD,
+   STBI_FORMAT_PIC,
+   STBI_FORMAT_PNM,
+   STBI_FORMAT_HDR,
+   STBI_FORMAT_TGA
+};
+
+typedef struct
+{
+   int x, y, comp;
+   int format;      // STBI_FORMAT_*
+   int is_16_bit;
+   int is_hdr;
+} stbi_image_info;
+
+STBIDEF int      stbi_info_ex_from_memory(stbi_uc const *buffer, int len, stbi_image_info *info);
+#ifndef STBI_NO_STDIO
+STBIDEF int      stbi_info_ex            (char const *filename,           stbi_image_info *info);
+STBIDEF int      stbi_info_ex_from_file  (FILE *f,                        stbi_image_info *info);
+#endif
+
 
 
 // for image formats that explicitly notate that they have premultiplied alpha,
@@ -521,6 +632,44 @@ STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpre
 STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+// multithreaded decoding. stb_image creates no threads itself; instead the
+// application installs a parallel-for that runs task(task_data, i) for every
+// i in [0,count) on its own pool and returns once all of them finished.
+// it is used for baseline JPEGs with restart markers decoded from memory
+// (one task per group of restart intervals), for progressive JPEG finishing
+// and for color conversion, which are split into row bands, and for the
+// float conversion of run-length encoded Radiance HDR images. pass NULL to
+// go back to serial decoding.
+typedef void stbi_parallel_task(void *task_data, int index);
+typedef void stbi_parallel_for(void *user, int count, stbi_parallel_task *task, void *task_data);
+STBIDEF void stbi_set_parallel_for(stbi_parallel_for *parallel_for, void *user);
+
+// as above, but only for images loaded on the calling thread; NULL decodes
+// them serially, e.g. on pool threads that each decode a whole image already
+STBIDEF void stbi_set_parallel_for_thread(stbi_parallel_for *parallel_for, void *user);
+
+// forget every *_thread setting of the calling thread, so it follows the
+// global ones again (e.g. when a pool thread finishes a job)
+STBIDEF void stbi_reset_thread_settings(void);
+
+// per-thread allocator. while one is installed, every allocation stb_image
+// makes on the calling thread goes through it, e.g. into a scratch arena that
+// is reset between images. that includes the images it returns and
+// stbi_image_free, so either free results before switching allocators or
+// decode with stbi_load_into, which leaves only scratch memory. resize gets
+// the old size like STBI_REALLOC_SIZED. pass NULL to go back to malloc.
+// returns 0 and does nothing if STBI_MALLOC was defined by the application
+// or the compiler has no thread-local variables.
+typedef struct
+{
+   void *(*alloc)  (void *user, size_t size);
+   void *(*resize) (void *user, void *p, size_t old_size, size_t new_size);
+   void  (*release)(void *user, void *p);
+   void  *user;
+} stbi_allocator;
+
+STBIDEF int stbi_set_allocator_thread(stbi_allocator const *allocator);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -640,12 +789,14 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -675,6 +826,32 @@ typedef unsigned char validate_uint32[sizeof(stbi__uint32)==4 ? 1 : -1];
 #error "Must define all or none of STBI_MALLOC, STBI_FREE, and STBI_REALLOC (or STBI_REALLOC_SIZED)."
 #endif
 
+#if !defined(STBI_MALLOC) && defined(STBI_THREAD_LOCAL)
+#define STBI__ALLOCATOR_HOOK
+static STBI_THREAD_LOCAL stbi_allocator stbi__allocator;
+static STBI_THREAD_LOCAL int stbi__allocator_set;
+
+static void *stbi__hook_malloc(size_t size)
+{
+   return stbi__allocator_set ? stbi__allocator.alloc(stbi__allocator.user, size) : malloc(size);
+}
+
+static void *stbi__hook_realloc_sized(void *p, size_t old_size, size_t new_size)
+{
+   return stbi__allocator_set ? stbi__allocator.resize(stbi__allocator.user, p, old_size, new_size) : realloc(p, new_size);
+}
+
+static void stbi__hook_free(void *p)
+{
+   if (stbi__allocator_set) stbi__allocator.release(stbi__allocator.user, p);
+   else free(p);
+}
+
+#define STBI_MALLOC(sz)                   stbi__hook_malloc(sz)
+#define STBI_REALLOC_SIZED(p,oldsz,newsz) stbi__hook_realloc_sized(p,oldsz,newsz)
+#define STBI_FREE(p)                      stbi__hook_free(p)
+#endif
+
 #ifndef STBI_MALLOC
 #define STBI_MALLOC(sz)           malloc(sz)
 #define STBI_REALLOC(p,newsz)     realloc(p,newsz)
@@ -747,7 +924,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG) || !defined(STBI_NO_HDR)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    int info3 = stbi__cpuid3();
@@ -758,7 +935,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG) || !defined(STBI_NO_HDR)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    // If we're even attempting to compile this on GCC/Clang, that means
@@ -771,6 +948,38 @@ static int stbi__sse2_available(void)
 #endif
 #endif
 
+// AVX2 kernels are compiled per function and picked at run time, so only
+// compilers that can target a single function get them
+#if defined(STBI_SSE2) && defined(STBI__X64_TARGET) && !defined(STBI_NO_AVX2) && !defined(STBI_NO_JPEG)
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define STBI_AVX2
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+#define STBI__AVX2_INLINE __attribute__((target("avx2"), always_inline)) inline
+#include <immintrin.h>
+static int stbi__avx2_available(void)
+{
+   return __builtin_cpu_supports("avx2");
+}
+#elif defined(_MSC_VER) && _MSC_VER >= 1700
+#define STBI_AVX2
+#define STBI__AVX2_TARGET
+#define STBI__AVX2_INLINE __forceinline
+#include <immintrin.h>
+static int stbi__avx2_available(void)
+{
+   int info[4];
+   __cpuid(info, 0);
+   if (info[0] < 7) return 0;
+   __cpuid(info, 1);
+   // OSXSAVE and AVX, and the OS saves the ymm registers
+   if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) return 0;
+   if ((_xgetbv(0) & 6) != 6) return 0;
+   __cpuidex(info, 7, 0);
+   return (info[1] & (1 << 5)) != 0;
+}
+#endif
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -793,6 +1002,23 @@ static int stbi__sse2_available(void)
 #define STBI_MAX_DIMENSIONS (1 << 24)
 #endif
 
+// bytes requested from the io callbacks (and fread) per refill
+#ifndef STBI_IO_BUFFER_SIZE
+#define STBI_IO_BUFFER_SIZE (64 << 10)
+#endif
+#if STBI_IO_BUFFER_SIZE < 128
+#error "STBI_IO_BUFFER_SIZE must be at least 128 bytes"
+#endif
+
+// filename loads decode straight out of a read-only mapping of the file
+#if !defined(STBI_NO_STDIO) && !defined(STBI_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#define STBI__MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 ///////////////////////////////////////////////
 //
 //  stbi__context struct and start_xxx functions
@@ -809,11 +1035,15 @@ typedef struct
 
    int read_from_callbacks;
    int buflen;
-   stbi_uc buffer_start[128];
+   stbi_uc *buffer_start;
+   stbi_uc buffer_small[128]; // used if the big buffer can't be allocated
    int callback_already_read;
 
    stbi_uc *img_buffer, *img_buffer_end;
    stbi_uc *img_buffer_original, *img_buffer_original_end;
+
+   struct stbi__dest *dest; // set while loading through stbi_load_into
+   int scale;               // log2 of the reduction asked for by stbi_load_scaled
 } stbi__context;
 
 
@@ -825,8 +1055,11 @@ static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
    s->io.read = NULL;
    s->read_from_callbacks = 0;
    s->callback_already_read = 0;
+   s->buffer_start = NULL;
    s->img_buffer = s->img_buffer_original = (stbi_uc *) buffer;
    s->img_buffer_end = s->img_buffer_original_end = (stbi_uc *) buffer+len;
+   s->dest = NULL;
+   s->scale = 0;
 }
 
 // initialize a callback-based context
@@ -834,14 +1067,29 @@ static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *
 {
    s->io = *c;
    s->io_user_data = user;
-   s->buflen = sizeof(s->buffer_start);
+   s->buffer_start = (stbi_uc *) STBI_MALLOC(STBI_IO_BUFFER_SIZE);
+   s->buflen = STBI_IO_BUFFER_SIZE;
+   if (!s->buffer_start) {
+      s->buffer_start = s->buffer_small;
+      s->buflen = sizeof(s->buffer_small);
+   }
    s->read_from_callbacks = 1;
    s->callback_already_read = 0;
+   s->dest = NULL;
+   s->scale = 0;
    s->img_buffer = s->img_buffer_original = s->buffer_start;
    stbi__refill_buffer(s);
    s->img_buffer_original_end = s->img_buffer_end;
 }
 
+// release what start_callbacks allocated; a no-op for memory contexts
+static void stbi__stop_callbacks(stbi__context *s)
+{
+   if (s->buffer_start && s->buffer_start != s->buffer_small)
+      STBI_FREE(s->buffer_start);
+   s->buffer_start = NULL;
+}
+
 #ifndef STBI_NO_STDIO
 
 static int stbi__stdio_read(void *user, char *data, int size)
@@ -873,10 +1121,49 @@ static stbi_io_callbacks stbi__stdio_callbacks =
 
 static void stbi__start_file(stbi__context *s, FILE *f)
 {
+#ifdef POSIX_FADV_SEQUENTIAL
+   // let the kernel read ahead aggressively, the file is consumed front to back
+   posix_fadvise(fileno(f), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
    stbi__start_callbacks(s, &stbi__stdio_callbacks, (void *) f);
 }
 
-//static void stop_file(stbi__context *s) { }
+#ifdef STBI__MMAP
+typedef struct
+{
+   void *data;
+   size_t size;
+} stbi__mapping;
+
+// Sets up a memory context over the whole file. Returns 0 if the file can't
+// be mapped (missing, empty, not a regular file, too big), the caller then
+// goes through stdio, which also reports the error.
+static int stbi__map_file(stbi__context *s, char const *filename, stbi__mapping *m)
+{
+   struct stat st;
+   int fd = open(filename, O_RDONLY);
+   if (fd < 0) return 0;
+   if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || st.st_size > INT_MAX) {
+      close(fd);
+      return 0;
+   }
+   m->size = (size_t) st.st_size;
+   m->data = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (m->data == MAP_FAILED) return 0;
+#ifdef MADV_SEQUENTIAL
+   // decoders walk the file front to back, let faults read far ahead
+   madvise(m->data, m->size, MADV_SEQUENTIAL);
+#endif
+   stbi__start_mem(s, (stbi_uc *) m->data, (int) m->size);
+   return 1;
+}
+
+static void stbi__unmap_file(stbi__mapping *m)
+{
+   munmap(m->data, m->size);
+}
+#endif
 
 #endif // !STBI_NO_STDIO
 
@@ -900,8 +1187,18 @@ typedef struct
    int bits_per_channel;
    int num_channels;
    int channel_order;
+   int rows_in_dest; // the loader already wrote the pixels to s->dest
 } stbi__result_info;
 
+// a resolved stbi_dest: row y of the image starts at row0 + y*stride
+typedef struct stbi__dest
+{
+   stbi_dest const *req;
+   int flip;
+   stbi_uc *row0;
+   ptrdiff_t stride;
+} stbi__dest;
+
 #ifndef STBI_NO_JPEG
 static int      stbi__jpeg_test(stbi__context *s);
 static void    *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri);
@@ -1114,6 +1411,70 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
+STBIDEF int stbi_set_allocator_thread(stbi_allocator const *allocator)
+{
+#ifdef STBI__ALLOCATOR_HOOK
+   stbi__allocator_set = allocator != NULL;
+   if (allocator) stbi__allocator = *allocator;
+   return 1;
+#else
+   STBI_NOTUSED(allocator);
+   return 0;
+#endif
+}
+
+// images below this many pixels are always decoded on the calling thread,
+// splitting them costs more than it saves
+#ifndef STBI_PARALLEL_MIN_PIXELS
+#define STBI_PARALLEL_MIN_PIXELS  (1 << 18)
+#endif
+
+static stbi_parallel_for *stbi__parallel_for_global = NULL;
+static void *stbi__parallel_for_user_global = NULL;
+
+STBIDEF void stbi_set_parallel_for(stbi_parallel_for *parallel_for, void *user)
+{
+   stbi__parallel_for_global = parallel_for;
+   stbi__parallel_for_user_global = user;
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__parallel_for_fn    stbi__parallel_for_global
+#define stbi__parallel_for_user  stbi__parallel_for_user_global
+#else
+static STBI_THREAD_LOCAL stbi_parallel_for *stbi__parallel_for_local;
+static STBI_THREAD_LOCAL void *stbi__parallel_for_user_local;
+static STBI_THREAD_LOCAL int stbi__parallel_for_set;
+
+STBIDEF void stbi_set_parallel_for_thread(stbi_parallel_for *parallel_for, void *user)
+{
+   stbi__parallel_for_local = parallel_for;
+   stbi__parallel_for_user_local = user;
+   stbi__parallel_for_set = 1;
+}
+
+#define stbi__parallel_for_fn    (stbi__parallel_for_set ? stbi__parallel_for_local : stbi__parallel_for_global)
+#define stbi__parallel_for_user  (stbi__parallel_for_set ? stbi__parallel_for_user_local : stbi__parallel_for_user_global)
+#endif // STBI_THREAD_LOCAL
+
+#if !defined(STBI_NO_JPEG) || !defined(STBI_NO_HDR)
+static int stbi__parallel_enabled(stbi__uint32 x, stbi__uint32 y)
+{
+   return stbi__parallel_for_fn != NULL && (stbi__uint64) x * y >= STBI_PARALLEL_MIN_PIXELS;
+}
+
+static void stbi__parallel(int count, stbi_parallel_task *task, void *task_data)
+{
+   if (stbi__parallel_for_fn && count > 1) {
+      stbi__parallel_for_fn(stbi__parallel_for_user, count, task, task_data);
+   } else {
+      int i;
+      for (i=0; i < count; ++i)
+         task(task_data, i);
+   }
+}
+#endif
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1263,6 +1624,102 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
    return (unsigned char *) result;
 }
 
+// checks that a w*h image fits the caller's buffer and works out where its
+// rows go
+static int stbi__dest_setup(stbi__dest *d, stbi__uint32 w, stbi__uint32 h)
+{
+   size_t row = (size_t) w * d->req->channels;
+   size_t stride = d->req->stride_in_bytes ? (size_t) d->req->stride_in_bytes : row;
+   if (d->req->stride_in_bytes < 0 || stride < row)
+      return stbi__err("bad stride", "Destination stride shorter than a row");
+   if (row > d->req->size || (h > 1 && (d->req->size - row) / stride < h - 1))
+      return stbi__err("dest too small", "Image doesn't fit the destination buffer");
+   d->row0 = d->req->pixels;
+   d->stride = (ptrdiff_t) stride;
+   if (d->flip) {
+      d->row0 += (h - 1) * stride;
+      d->stride = -d->stride;
+   }
+   return 1;
+}
+
+// RGB(A) -> BGR(A) in place
+static void stbi__dest_swap_rb(stbi_uc *row, stbi__uint32 w, int n)
+{
+   stbi__uint32 i;
+   if (n < 3) return;
+   for (i=0; i < w; ++i, row += n) {
+      stbi_uc t = row[0];
+      row[0] = row[2];
+      row[2] = t;
+   }
+}
+
+// the one pass for loaders that don't write to the destination themselves.
+// 16-bit results keep the top byte, like stbi__convert_16_to_8
+static void stbi__dest_copy(stbi__dest *d, void *image, stbi__uint32 w, stbi__uint32 h, int bits_per_channel)
+{
+   int n = d->req->channels;
+   int bgr = (d->req->flags & STBI_DEST_BGR) != 0;
+   size_t row = (size_t) w * n;
+   stbi__uint32 j;
+   size_t i;
+   for (j=0; j < h; ++j) {
+      stbi_uc *out = d->row0 + d->stride * (ptrdiff_t) j;
+      if (bits_per_channel == 16) {
+         stbi__uint16 *in = (stbi__uint16 *) image + row * j;
+         for (i=0; i < row; ++i)
+            out[i] = (stbi_uc) (in[i] >> 8);
+      } else {
+         memcpy(out, (stbi_uc *) image + row * j, row);
+      }
+      if (bgr) stbi__dest_swap_rb(out, w, n);
+   }
+}
+
+static int stbi__load_into(stbi__context *s, stbi_dest const *dest, int *x, int *y, int *comp)
+{
+   stbi__result_info ri;
+   stbi__dest d;
+   void *result;
+   int w, h, c;
+
+   if (dest == NULL || dest->pixels == NULL || dest->channels < 1 || dest->channels > 4)
+      return stbi__err("bad dest", "Invalid destination");
+
+   d.req = dest;
+   d.flip = (dest->flags & STBI_DEST_FLIP_VERTICALLY) || stbi__vertically_flip_on_load;
+   d.row0 = NULL;
+   d.stride = 0;
+
+   s->dest = &d;
+   result = stbi__load_main(s, &w, &h, &c, dest->channels, &ri, 8);
+   s->dest = NULL;
+   if (result == NULL)
+      return 0;
+
+   if (!ri.rows_in_dest) {
+      STBI_ASSERT(ri.bits_per_channel == 8 || ri.bits_per_channel == 16);
+      if (!stbi__dest_setup(&d, w, h)) {
+         STBI_FREE(result);
+         return 0;
+      }
+      stbi__dest_copy(&d, result, w, h, ri.bits_per_channel);
+      STBI_FREE(result);
+   }
+
+   if (x) *x = w;
+   if (y) *y = h;
+   if (comp) *comp = c;
+   return 1;
+}
+
+static stbi_uc *stbi__load_scaled(stbi__context *s, int scale, int *x, int *y, int *comp, int req_comp)
+{
+   s->scale = scale >= 8 ? 3 : scale >= 4 ? 2 : scale >= 2 ? 1 : 0;
+   return stbi__load_and_postprocess_8bit(s,x,y,comp,req_comp);
+}
+
 static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
    stbi__result_info ri;
@@ -1345,8 +1802,18 @@ static FILE *stbi__fopen(char const *filename, char const *mode)
 
 STBIDEF stbi_uc *stbi_load(char const *filename, int *x, int *y, int *comp, int req_comp)
 {
-   FILE *f = stbi__fopen(filename, "rb");
+   FILE *f;
    unsigned char *result;
+#ifdef STBI__MMAP
+   stbi__context s;
+   stbi__mapping m;
+   if (stbi__map_file(&s, filename, &m)) {
+      result = stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+      stbi__unmap_file(&m);
+      return result;
+   }
+#endif
+   f = stbi__fopen(filename, "rb");
    if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
    result = stbi_load_from_file(f,x,y,comp,req_comp);
    fclose(f);
@@ -1363,6 +1830,75 @@ STBIDEF stbi_uc *stbi_load_from_file(FILE *f, int *x, int *y, int *comp, int req
       // need to 'unget' all the characters in the IO buffer
       fseek(f, - (int) (s.img_buffer_end - s.img_buffer), SEEK_CUR);
    }
+   stbi__stop_callbacks(&s);
+   return result;
+}
+
+STBIDEF int stbi_load_into(char const *filename, stbi_dest const *dest, int *x, int *y, int *comp)
+{
+   FILE *f;
+   int result;
+#ifdef STBI__MMAP
+   stbi__context s;
+   stbi__mapping m;
+   if (stbi__map_file(&s, filename, &m)) {
+      result = stbi__load_into(&s,dest,x,y,comp);
+      stbi__unmap_file(&m);
+      return result;
+   }
+#endif
+   f = stbi__fopen(filename, "rb");
+   if (!f) return stbi__err("can't fopen", "Unable to open file");
+   result = stbi_load_into_from_file(f,dest,x,y,comp);
+   fclose(f);
+   return result;
+}
+
+STBIDEF int stbi_load_into_from_file(FILE *f, stbi_dest const *dest, int *x, int *y, int *comp)
+{
+   int result;
+   stbi__context s;
+   stbi__start_file(&s,f);
+   result = stbi__load_into(&s,dest,x,y,comp);
+   if (result) {
+      // need to 'unget' all the characters in the IO buffer
+      fseek(f, - (int) (s.img_buffer_end - s.img_buffer), SEEK_CUR);
+   }
+   stbi__stop_callbacks(&s);
+   return result;
+}
+
+STBIDEF stbi_uc *stbi_load_scaled(char const *filename, int scale, int *x, int *y, int *comp, int req_comp)
+{
+   FILE *f;
+   unsigned char *result;
+#ifdef STBI__MMAP
+   stbi__context s;
+   stbi__mapping m;
+   if (stbi__map_file(&s, filename, &m)) {
+      result = stbi__load_scaled(&s,scale,x,y,comp,req_comp);
+      stbi__unmap_file(&m);
+      return result;
+   }
+#endif
+   f = stbi__fopen(filename, "rb");
+   if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+   result = stbi_load_scaled_from_file(f,scale,x,y,comp,req_comp);
+   fclose(f);
+   return result;
+}
+
+STBIDEF stbi_uc *stbi_load_scaled_from_file(FILE *f, int scale, int *x, int *y, int *comp, int req_comp)
+{
+   unsigned char *result;
+   stbi__context s;
+   stbi__start_file(&s,f);
+   result = stbi__load_scaled(&s,scale,x,y,comp,req_comp);
+   if (result) {
+      // need to 'unget' all the characters in the IO buffer
+      fseek(f, - (int) (s.img_buffer_end - s.img_buffer), SEEK_CUR);
+   }
+   stbi__stop_callbacks(&s);
    return result;
 }
 
@@ -1376,13 +1912,24 @@ STBIDEF stbi__uint16 *stbi_load_from_file_16(FILE *f, int *x, int *y, int *comp,
       // need to 'unget' all the characters in the IO buffer
       fseek(f, - (int) (s.img_buffer_end - s.img_buffer), SEEK_CUR);
    }
+   stbi__stop_callbacks(&s);
    return result;
 }
 
 STBIDEF stbi_us *stbi_load_16(char const *filename, int *x, int *y, int *comp, int req_comp)
 {
-   FILE *f = stbi__fopen(filename, "rb");
+   FILE *f;
    stbi__uint16 *result;
+#ifdef STBI__MMAP
+   stbi__context s;
+   stbi__mapping m;
+   if (stbi__map_file(&s, filename, &m)) {
+      result = stbi__load_and_postprocess_16bit(&s,x,y,comp,req_comp);
+      stbi__unmap_file(&m);
+      return result;
+   }
+#endif
+   f = stbi__fopen(filename, "rb");
    if (!f) return (stbi_us *) stbi__errpuc("can't fopen", "Unable to open file");
    result = stbi_load_from_file_16(f,x,y,comp,req_comp);
    fclose(f);
@@ -1401,9 +1948,12 @@ STBIDEF stbi_us *stbi_load_16_from_memory(stbi_uc const *buffer, int len, int *x
 
 STBIDEF stbi_us *stbi_load_16_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *channels_in_file, int desired_channels)
 {
+   stbi__uint16 *result;
    stbi__context s;
    stbi__start_callbacks(&s, (stbi_io_callbacks *)clbk, user);
-   return stbi__load_and_postprocess_16bit(&s,x,y,channels_in_file,desired_channels);
+   result = stbi__load_and_postprocess_16bit(&s,x,y,channels_in_file,desired_channels);
+   stbi__stop_callbacks(&s);
+   return result;
 }
 
 STBIDEF stbi_uc *stbi_load_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
@@ -1415,9 +1965,46 @@ STBIDEF stbi_uc *stbi_load_from_memory(stbi_uc const *buffer, int len, int *x, i
 
 STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
 {
+   stbi_uc *result;
    stbi__context s;
    stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
-   return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+   result = stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+   stbi__stop_callbacks(&s);
+   return result;
+}
+
+STBIDEF int stbi_load_into_from_memory(stbi_uc const *buffer, int len, stbi_dest const *dest, int *x, int *y, int *comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_into(&s,dest,x,y,comp);
+}
+
+STBIDEF int stbi_load_into_from_callbacks(stbi_io_callbacks const *clbk, void *user, stbi_dest const *dest, int *x, int *y, int *comp)
+{
+   int result;
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   result = stbi__load_into(&s,dest,x,y,comp);
+   stbi__stop_callbacks(&s);
+   return result;
+}
+
+STBIDEF stbi_uc *stbi_load_scaled_from_memory(stbi_uc const *buffer, int len, int scale, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_scaled(&s,scale,x,y,comp,req_comp);
+}
+
+STBIDEF stbi_uc *stbi_load_scaled_from_callbacks(stbi_io_callbacks const *clbk, void *user, int scale, int *x, int *y, int *comp, int req_comp)
+{
+   stbi_uc *result;
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   result = stbi__load_scaled(&s,scale,x,y,comp,req_comp);
+   stbi__stop_callbacks(&s);
+   return result;
 }
 
 #ifndef STBI_NO_GIF
@@ -1464,16 +2051,29 @@ STBIDEF float *stbi_loadf_from_memory(stbi_uc const *buffer, int len, int *x, in
 
 STBIDEF float *stbi_loadf_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
 {
+   float *result;
    stbi__context s;
    stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
-   return stbi__loadf_main(&s,x,y,comp,req_comp);
+   result = stbi__loadf_main(&s,x,y,comp,req_comp);
+   stbi__stop_callbacks(&s);
+   return result;
 }
 
 #ifndef STBI_NO_STDIO
 STBIDEF float *stbi_loadf(char const *filename, int *x, int *y, int *comp, int req_comp)
 {
    float *result;
-   FILE *f = stbi__fopen(filename, "rb");
+   FILE *f;
+#ifdef STBI__MMAP
+   stbi__context s;
+   stbi__mapping m;
+   if (stbi__map_file(&s, filename, &m)) {
+      result = stbi__loadf_main(&s,x,y,comp,req_comp);
+      stbi__unmap_file(&m);
+      return result;
+   }
+#endif
+   f = stbi__fopen(filename, "rb");
    if (!f) return stbi__errpf("can't fopen", "Unable to open file");
    result = stbi_loadf_from_file(f,x,y,comp,req_comp);
    fclose(f);
@@ -1482,9 +2082,12 @@ STBIDEF float *stbi_loadf(char const *filename, int *x, int *y, int *comp, int r
 
 STBIDEF float *stbi_loadf_from_file(FILE *f, int *x, int *y, int *comp, int req_comp)
 {
+   float *result;
    stbi__context s;
    stbi__start_file(&s,f);
-   return stbi__loadf_main(&s,x,y,comp,req_comp);
+   result = stbi__loadf_main(&s,x,y,comp,req_comp);
+   stbi__stop_callbacks(&s);
+   return result;
 }
 #endif // !STBI_NO_STDIO
 
@@ -1528,6 +2131,7 @@ STBIDEF int stbi_is_hdr_from_file(FILE *f)
    stbi__start_file(&s,f);
    res = stbi__hdr_test(&s);
    fseek(f, pos, SEEK_SET);
+   stbi__stop_callbacks(&s);
    return res;
    #else
    STBI_NOTUSED(f);
@@ -1539,9 +2143,12 @@ STBIDEF int stbi_is_hdr_from_file(FILE *f)
 STBIDEF int      stbi_is_hdr_from_callbacks(stbi_io_callbacks const *clbk, void *user)
 {
    #ifndef STBI_NO_HDR
+   int res;
    stbi__context s;
    stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
-   return stbi__hdr_test(&s);
+   res = stbi__hdr_test(&s);
+   stbi__stop_callbacks(&s);
+   return res;
    #else
    STBI_NOTUSED(clbk);
    STBI_NOTUSED(user);
@@ -1912,8 +2519,13 @@ static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
 
 #ifndef STBI_NO_JPEG
 
-// huffman decoding acceleration
-#define FAST_BITS   9  // larger handles more cases; smaller stomps less cache
+// huffman decoding acceleration. codes of up to FAST_BITS bits, and for
+// DC/AC also the magnitude bits that follow them, resolve in one lookup.
+// larger handles more cases; smaller stomps less cache. at most 12
+#ifndef STBI_JPEG_FAST_BITS
+#define STBI_JPEG_FAST_BITS  11
+#endif
+#define FAST_BITS   STBI_JPEG_FAST_BITS
 
 typedef struct
 {
@@ -1933,6 +2545,7 @@ typedef struct
    stbi__huffman huff_ac[4];
    stbi__uint16 dequant[4][64];
    stbi__int16 fast_ac[4][1 << FAST_BITS];
+   stbi__int16 fast_dc[4][1 << FAST_BITS];
 
 // sizes for components, interleaved MCUs
    int img_h_max, img_v_max;
@@ -1954,10 +2567,12 @@ typedef struct
       stbi_uc *linebuf;
       short   *coeff;   // progressive only
       int      coeff_w, coeff_h; // number of 8x8 coefficient blocks
+      int      scale; // log2 reduction, less than jpeg.scale for subsampled chroma
+      void   (*idct_kernel)(stbi_uc *out, int out_stride, short data[64]);
    } img_comp[4];
 
-   stbi__uint32   code_buffer; // jpeg entropy-coded buffer
-   int            code_bits;   // number of valid bits
+   stbi__uint64   code_buffer; // jpeg entropy-coded buffer, msb first
+   int            code_bits;   // number of valid bits, the rest are 0
    unsigned char  marker;      // marker seen while filling entropy buffer
    int            nomore;      // flag if we saw a marker so must stop
 
@@ -1973,11 +2588,15 @@ typedef struct
 
    int scan_n, order[4];
    int restart_interval, todo;
+   int scale; // log2 of the reduction, blocks decode to (8 >> scale) pixels square
 
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
    void (*YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
    stbi_uc *(*resample_row_hv_2_kernel)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
+   // optional, NULL when the CPU has no wide version
+   void (*idct_block2_kernel)(stbi_uc *out0, int out0_stride, short data0[64], stbi_uc *out1, int out1_stride, short data1[64]);
+   void (*YCbCr_420_to_RGBA_kernel)(stbi_uc *out, stbi_uc const *y, stbi_uc *cb_near, stbi_uc *cb_far, stbi_uc *cr_near, stbi_uc *cr_far, int w, int count);
 } stbi__jpeg;
 
 static int stbi__build_huffman(stbi__huffman *h, int *count)
@@ -2044,14 +2663,64 @@ static void stbi__build_fast_ac(stbi__int16 *fast_ac, stbi__huffman *h)
             // if the result is small enough, we can fit it in fast_ac table
             if (k >= -128 && k <= 127)
                fast_ac[i] = (stbi__int16) ((k * 256) + (run * 16) + (len + magbits));
+         } else if (rs == 0x00 || rs == 0xf0) {
+            // end of block is an entry with no value and no run; a run of
+            // 16 zeros is a run of 15 followed by an explicit 0
+            fast_ac[i] = (stbi__int16) ((run * 16) + len);
+         }
+      }
+   }
+}
+
+// same for DC: the difference category and its magnitude bits in one go.
+// entries are (diff * 16) + total length, 0 if not accelerated
+static void stbi__build_fast_dc(stbi__int16 *fast_dc, stbi__huffman *h)
+{
+   int i;
+   for (i=0; i < (1 << FAST_BITS); ++i) {
+      stbi_uc fast = h->fast[i];
+      fast_dc[i] = 0;
+      if (fast < 255) {
+         int t = h->values[fast];
+         int len = h->size[fast];
+         if (len + t <= FAST_BITS) {
+            int k = 0;
+            if (t) {
+               int m = 1 << (t - 1);
+               k = ((i << len) & ((1 << FAST_BITS) - 1)) >> (FAST_BITS - t);
+               if (k < m) k += (~0U << t) + 1;
+            }
+            fast_dc[i] = (stbi__int16) ((k * 16) + (len + t));
          }
       }
    }
 }
 
+// true if any byte of x is 0xff
+#define stbi__has_ff_byte(x)  ((((~(x)) - 0x0101010101010101ull) & (x) & 0x8080808080808080ull) != 0)
+
+// refill the bit buffer to more than 56 bits. called with fewer than 24
 static void stbi__grow_buffer_unsafe(stbi__jpeg *j)
 {
-   do {
+   // fast path: take whole bytes 8 at a time while none of them is 0xff,
+   // i.e. neither a stuffed 0xff00 nor a marker
+   if (!j->nomore && j->s->img_buffer_end - j->s->img_buffer >= 8) {
+      stbi_uc *p = j->s->img_buffer;
+      int n = (64 - j->code_bits) >> 3;
+      stbi__uint64 v = ((stbi__uint64) p[0] << 56) | ((stbi__uint64) p[1] << 48)
+                     | ((stbi__uint64) p[2] << 40) | ((stbi__uint64) p[3] << 32)
+                     | ((stbi__uint64) p[4] << 24) | ((stbi__uint64) p[5] << 16)
+                     | ((stbi__uint64) p[6] <<  8) |  (stbi__uint64) p[7];
+      v &= ~(stbi__uint64) 0 << (64 - n*8); // just the n bytes that fit
+      if (!stbi__has_ff_byte(v)) {
+         j->code_buffer |= v >> j->code_bits;
+         j->code_bits += n*8;
+         j->s->img_buffer += n;
+         return;
+      }
+   }
+
+   do {
       unsigned int b = j->nomore ? 0 : stbi__get8(j->s);
       if (b == 0xff) {
          int c = stbi__get8(j->s);
@@ -2062,14 +2731,11 @@ static void stbi__grow_buffer_unsafe(stbi__jpeg *j)
             return;
          }
       }
-      j->code_buffer |= b << (24 - j->code_bits);
+      j->code_buffer |= (stbi__uint64) b << (56 - j->code_bits);
       j->code_bits += 8;
-   } while (j->code_bits <= 24);
+   } while (j->code_bits <= 56);
 }
 
-// (1 << n) - 1
-static const stbi__uint32 stbi__bmask[17]={0,1,3,7,15,31,63,127,255,511,1023,2047,4095,8191,16383,32767,65535};
-
 // decode a jpeg huffman value from the bitstream
 stbi_inline static int stbi__jpeg_huff_decode(stbi__jpeg *j, stbi__huffman *h)
 {
@@ -2080,7 +2746,7 @@ stbi_inline static int stbi__jpeg_huff_decode(stbi__jpeg *j, stbi__huffman *h)
 
    // look at the top FAST_BITS and determine what symbol ID it is,
    // if the code is <= FAST_BITS
-   c = (j->code_buffer >> (32 - FAST_BITS)) & ((1 << FAST_BITS)-1);
+   c = (int) (j->code_buffer >> (64 - FAST_BITS));
    k = h->fast[c];
    if (k < 255) {
       int s = h->size[k];
@@ -2097,7 +2763,7 @@ stbi_inline static int stbi__jpeg_huff_decode(stbi__jpeg *j, stbi__huffman *h)
    // end; in other words, regardless of the number of bits, it
    // wants to be compared against something shifted to have 16;
    // that way we don't need to shift inside the loop.
-   temp = j->code_buffer >> 16;
+   temp = (unsigned int) (j->code_buffer >> 48);
    for (k=FAST_BITS+1 ; ; ++k)
       if (temp < h->maxcode[k])
          break;
@@ -2111,8 +2777,8 @@ stbi_inline static int stbi__jpeg_huff_decode(stbi__jpeg *j, stbi__huffman *h)
       return -1;
 
    // convert the huffman code to the symbol id
-   c = ((j->code_buffer >> (32 - k)) & stbi__bmask[k]) + h->delta[k];
-   STBI_ASSERT((((j->code_buffer) >> (32 - h->size[c])) & stbi__bmask[h->size[c]]) == h->code[c]);
+   c = (int) (j->code_buffer >> (64 - k)) + h->delta[k];
+   STBI_ASSERT((j->code_buffer >> (64 - h->size[c])) == h->code[c]);
 
    // convert the id to a symbol
    j->code_bits -= k;
@@ -2131,10 +2797,9 @@ stbi_inline static int stbi__extend_receive(stbi__jpeg *j, int n)
    int sgn;
    if (j->code_bits < n) stbi__grow_buffer_unsafe(j);
 
-   sgn = j->code_buffer >> 31; // sign bit always in MSB; 0 if MSB clear (positive), 1 if MSB set (negative)
-   k = stbi_lrot(j->code_buffer, n);
-   j->code_buffer = k & ~stbi__bmask[n];
-   k &= stbi__bmask[n];
+   sgn = (int) (j->code_buffer >> 63); // sign bit always in MSB; 0 if MSB clear (positive), 1 if MSB set (negative)
+   k = (unsigned int) (j->code_buffer >> (64 - n));
+   j->code_buffer <<= n;
    j->code_bits -= n;
    return k + (stbi__jbias[n] & (sgn - 1));
 }
@@ -2144,9 +2809,8 @@ stbi_inline static int stbi__jpeg_get_bits(stbi__jpeg *j, int n)
 {
    unsigned int k;
    if (j->code_bits < n) stbi__grow_buffer_unsafe(j);
-   k = stbi_lrot(j->code_buffer, n);
-   j->code_buffer = k & ~stbi__bmask[n];
-   k &= stbi__bmask[n];
+   k = (unsigned int) (j->code_buffer >> (64 - n));
+   j->code_buffer <<= n;
    j->code_bits -= n;
    return k;
 }
@@ -2155,10 +2819,10 @@ stbi_inline static int stbi__jpeg_get_bit(stbi__jpeg *j)
 {
    unsigned int k;
    if (j->code_bits < 1) stbi__grow_buffer_unsafe(j);
-   k = j->code_buffer;
+   k = (unsigned int) (j->code_buffer >> 63);
    j->code_buffer <<= 1;
    --j->code_bits;
-   return k & 0x80000000;
+   return k;
 }
 
 // given a value that's at position X in the zigzag stream,
@@ -2179,19 +2843,26 @@ static const stbi_uc stbi__jpeg_dezigzag[64+15] =
 };
 
 // decode one 64-entry block--
-static int stbi__jpeg_decode_block(stbi__jpeg *j, short data[64], stbi__huffman *hdc, stbi__huffman *hac, stbi__int16 *fac, int b, stbi__uint16 *dequant)
+static int stbi__jpeg_decode_block(stbi__jpeg *j, short data[64], stbi__huffman *hdc, stbi__int16 *fdc, stbi__huffman *hac, stbi__int16 *fac, int b, stbi__uint16 *dequant)
 {
    int diff,dc,k;
    int t;
 
    if (j->code_bits < 16) stbi__grow_buffer_unsafe(j);
-   t = stbi__jpeg_huff_decode(j, hdc);
-   if (t < 0 || t > 15) return stbi__err("bad huffman code","Corrupt JPEG");
+   t = fdc[j->code_buffer >> (64 - FAST_BITS)];
+   if (t) { // fast-DC path
+      j->code_buffer <<= t & 15;
+      j->code_bits -= t & 15;
+      diff = t >> 4;
+   } else {
+      t = stbi__jpeg_huff_decode(j, hdc);
+      if (t < 0 || t > 15) return stbi__err("bad huffman code","Corrupt JPEG");
+      diff = t ? stbi__extend_receive(j, t) : 0;
+   }
 
    // 0 all the ac values now so we can do it 32-bits at a time
    memset(data,0,64*sizeof(data[0]));
 
-   diff = t ? stbi__extend_receive(j, t) : 0;
    dc = j->img_comp[b].dc_pred + diff;
    j->img_comp[b].dc_pred = dc;
    data[0] = (short) (dc * dequant[0]);
@@ -2202,13 +2873,14 @@ static int stbi__jpeg_decode_block(stbi__jpeg *j, short data[64], stbi__huffman
       unsigned int zig;
       int c,r,s;
       if (j->code_bits < 16) stbi__grow_buffer_unsafe(j);
-      c = (j->code_buffer >> (32 - FAST_BITS)) & ((1 << FAST_BITS)-1);
+      c = (int) (j->code_buffer >> (64 - FAST_BITS));
       r = fac[c];
       if (r) { // fast-AC path
-         k += (r >> 4) & 15; // run
          s = r & 15; // combined length
          j->code_buffer <<= s;
          j->code_bits -= s;
+         if ((r >> 4) == 0) break; // end block
+         k += (r >> 4) & 15; // run
          // decode into unzigzag'd location
          zig = stbi__jpeg_dezigzag[k++];
          data[zig] = (short) ((r >> 8) * dequant[zig]);
@@ -2231,7 +2903,7 @@ static int stbi__jpeg_decode_block(stbi__jpeg *j, short data[64], stbi__huffman
    return 1;
 }
 
-static int stbi__jpeg_decode_block_prog_dc(stbi__jpeg *j, short data[64], stbi__huffman *hdc, int b)
+static int stbi__jpeg_decode_block_prog_dc(stbi__jpeg *j, short data[64], stbi__huffman *hdc, stbi__int16 *fdc, int b)
 {
    int diff,dc;
    int t;
@@ -2242,9 +2914,16 @@ static int stbi__jpeg_decode_block_prog_dc(stbi__jpeg *j, short data[64], stbi__
    if (j->succ_high == 0) {
       // first scan for DC coefficient, must be first
       memset(data,0,64*sizeof(data[0])); // 0 all the ac values now
-      t = stbi__jpeg_huff_decode(j, hdc);
-      if (t < 0 || t > 15) return stbi__err("can't merge dc and ac", "Corrupt JPEG");
-      diff = t ? stbi__extend_receive(j, t) : 0;
+      t = fdc[j->code_buffer >> (64 - FAST_BITS)];
+      if (t) {
+         j->code_buffer <<= t & 15;
+         j->code_bits -= t & 15;
+         diff = t >> 4;
+      } else {
+         t = stbi__jpeg_huff_decode(j, hdc);
+         if (t < 0 || t > 15) return stbi__err("can't merge dc and ac", "Corrupt JPEG");
+         diff = t ? stbi__extend_receive(j, t) : 0;
+      }
 
       dc = j->img_comp[b].dc_pred + diff;
       j->img_comp[b].dc_pred = dc;
@@ -2257,6 +2936,22 @@ static int stbi__jpeg_decode_block_prog_dc(stbi__jpeg *j, short data[64], stbi__
    return 1;
 }
 
+// AC refinement: a nonzero coefficient reads one correction bit, which moves
+// it away from zero unless it already has that bit. the bits are close to
+// random, so this is branch free apart from the refill
+stbi_inline static void stbi__jpeg_refine_coef(stbi__jpeg *j, short *p, short bit)
+{
+   int v = *p;
+   int nz = v != 0;
+   int set, step;
+   if (j->code_bits < 1) stbi__grow_buffer_unsafe(j);
+   set = (int) (j->code_buffer >> 63) & nz & ((v & bit) == 0);
+   j->code_buffer <<= nz;
+   j->code_bits -= nz;
+   step = v > 0 ? bit : -bit;
+   *p = (short) (v + (step & -set));
+}
+
 // @OPTIMIZE: store non-zigzagged during the decode passes,
 // and only de-zigzag when dequantizing
 static int stbi__jpeg_decode_block_prog_ac(stbi__jpeg *j, short data[64], stbi__huffman *hac, stbi__int16 *fac)
@@ -2277,13 +2972,14 @@ static int stbi__jpeg_decode_block_prog_ac(stbi__jpeg *j, short data[64], stbi__
          unsigned int zig;
          int c,r,s;
          if (j->code_bits < 16) stbi__grow_buffer_unsafe(j);
-         c = (j->code_buffer >> (32 - FAST_BITS)) & ((1 << FAST_BITS)-1);
+         c = (int) (j->code_buffer >> (64 - FAST_BITS));
          r = fac[c];
          if (r) { // fast-AC path
-            k += (r >> 4) & 15; // run
             s = r & 15; // combined length
             j->code_buffer <<= s;
             j->code_bits -= s;
+            if ((r >> 4) == 0) break; // end of band, an eob run of 1
+            k += (r >> 4) & 15; // run
             zig = stbi__jpeg_dezigzag[k++];
             data[zig] = (short) ((r >> 8) * (1 << shift));
          } else {
@@ -2314,17 +3010,8 @@ static int stbi__jpeg_decode_block_prog_ac(stbi__jpeg *j, short data[64], stbi__
 
       if (j->eob_run) {
          --j->eob_run;
-         for (k = j->spec_start; k <= j->spec_end; ++k) {
-            short *p = &data[stbi__jpeg_dezigzag[k]];
-            if (*p != 0)
-               if (stbi__jpeg_get_bit(j))
-                  if ((*p & bit)==0) {
-                     if (*p > 0)
-                        *p += bit;
-                     else
-                        *p -= bit;
-                  }
-         }
+         for (k = j->spec_start; k <= j->spec_end; ++k)
+            stbi__jpeg_refine_coef(j, &data[stbi__jpeg_dezigzag[k]], bit);
       } else {
          k = j->spec_start;
          do {
@@ -2357,13 +3044,7 @@ static int stbi__jpeg_decode_block_prog_ac(stbi__jpeg *j, short data[64], stbi__
             while (k <= j->spec_end) {
                short *p = &data[stbi__jpeg_dezigzag[k++]];
                if (*p != 0) {
-                  if (stbi__jpeg_get_bit(j))
-                     if ((*p & bit)==0) {
-                        if (*p > 0)
-                           *p += bit;
-                        else
-                           *p -= bit;
-                     }
+                  stbi__jpeg_refine_coef(j, p, bit);
                } else {
                   if (r == 0) {
                      *p = (short) s;
@@ -2489,6 +3170,91 @@ static void stbi__idct_block(stbi_uc *out, int out_stride, short data[64])
    }
 }
 
+// reduced IDCTs for scaled decodes, after jidctred.c from the IJG: a 4x4,
+// 2x2 or 1x1 block straight from the 8x8 coefficients, close to the full
+// IDCT averaged over 2x2, 4x4 or 8x8 pixels. 13 fraction bits, the column
+// pass keeps 2 extra bits for the row pass
+#define stbi__r2f(x)  ((int) (((x) * 8192 + 0.5)))
+
+static void stbi__idct_block_4x4(stbi_uc *out, int out_stride, short data[64])
+{
+   int i,t0,t2,t10,t12,z1,z2,z3,z4,val[32],*v;
+   short *d;
+
+   // columns, column 4 doesn't reach the 4-point rows
+   for (i=0, d=data, v=val; i < 8; ++i, ++d, ++v) {
+      if (i == 4) continue;
+      if (d[8]==0 && d[16]==0 && d[24]==0 && d[40]==0 && d[48]==0 && d[56]==0) {
+         v[0] = v[8] = v[16] = v[24] = d[0]*4;
+         continue;
+      }
+      t0  = d[0] * (1 << 14);
+      t2  = d[16]*stbi__r2f(1.847759065f) - d[48]*stbi__r2f(0.765366865f);
+      t10 = t0+t2;
+      t12 = t0-t2;
+      z1 = d[56]; z2 = d[40]; z3 = d[24]; z4 = d[8];
+      t0 = - z1*stbi__r2f(0.211164243f) + z2*stbi__r2f(1.451774981f)
+           - z3*stbi__r2f(2.172734803f) + z4*stbi__r2f(1.061594337f);
+      t2 = - z1*stbi__r2f(0.509795579f) - z2*stbi__r2f(0.601344887f)
+           + z3*stbi__r2f(0.899976223f) + z4*stbi__r2f(2.562915447f);
+      v[ 0] = (t10+t2 + 2048) >> 12;
+      v[24] = (t10-t2 + 2048) >> 12;
+      v[ 8] = (t12+t0 + 2048) >> 12;
+      v[16] = (t12-t0 + 2048) >> 12;
+   }
+
+   // rows, rounding and the +128 level shift folded into one bias
+   for (i=0, v=val; i < 4; ++i, v+=8, out+=out_stride) {
+      t0  = v[0] * (1 << 14) + (1 << 18) + (128 << 19);
+      t2  = v[2]*stbi__r2f(1.847759065f) - v[6]*stbi__r2f(0.765366865f);
+      t10 = t0+t2;
+      t12 = t0-t2;
+      z1 = v[7]; z2 = v[5]; z3 = v[3]; z4 = v[1];
+      t0 = - z1*stbi__r2f(0.211164243f) + z2*stbi__r2f(1.451774981f)
+           - z3*stbi__r2f(2.172734803f) + z4*stbi__r2f(1.061594337f);
+      t2 = - z1*stbi__r2f(0.509795579f) - z2*stbi__r2f(0.601344887f)
+           + z3*stbi__r2f(0.899976223f) + z4*stbi__r2f(2.562915447f);
+      out[0] = stbi__clamp((t10+t2) >> 19);
+      out[3] = stbi__clamp((t10-t2) >> 19);
+      out[1] = stbi__clamp((t12+t0) >> 19);
+      out[2] = stbi__clamp((t12-t0) >> 19);
+   }
+}
+
+static void stbi__idct_block_2x2(stbi_uc *out, int out_stride, short data[64])
+{
+   int i,t0,t10,val[16],*v;
+   short *d;
+
+   // columns, only the odd ones and 0 reach the 2-point rows
+   for (i=0, d=data, v=val; i < 8; ++i, ++d, ++v) {
+      if (i == 2 || i == 4 || i == 6) continue;
+      if (d[8]==0 && d[24]==0 && d[40]==0 && d[56]==0) {
+         v[0] = v[8] = d[0]*4;
+         continue;
+      }
+      t10 = d[0] * (1 << 15);
+      t0  = - d[56]*stbi__r2f(0.720959822f) + d[40]*stbi__r2f(0.850430095f)
+            - d[24]*stbi__r2f(1.272758580f) + d[ 8]*stbi__r2f(3.624509785f);
+      v[0] = (t10+t0 + 4096) >> 13;
+      v[8] = (t10-t0 + 4096) >> 13;
+   }
+
+   for (i=0, v=val; i < 2; ++i, v+=8, out+=out_stride) {
+      t10 = v[0] * (1 << 15) + (1 << 19) + (128 << 20);
+      t0  = - v[7]*stbi__r2f(0.720959822f) + v[5]*stbi__r2f(0.850430095f)
+            - v[3]*stbi__r2f(1.272758580f) + v[1]*stbi__r2f(3.624509785f);
+      out[0] = stbi__clamp((t10+t0) >> 20);
+      out[1] = stbi__clamp((t10-t0) >> 20);
+   }
+}
+
+static void stbi__idct_block_1x1(stbi_uc *out, int out_stride, short data[64])
+{
+   STBI_NOTUSED(out_stride);
+   out[0] = stbi__clamp(((data[0] + 4) >> 3) + 128);
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2670,6 +3436,185 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
+#ifdef STBI_AVX2
+// avx2 integer IDCT of two blocks at once, one per 128-bit lane. every
+// instruction is the lane-wise twin of the one in stbi__idct_simd, so the
+// output is bit-identical to the sse2 and generic versions.
+STBI__AVX2_TARGET
+static void stbi__idct2_avx2(stbi_uc *out0, int out0_stride, short data0[64], stbi_uc *out1, int out1_stride, short data1[64])
+{
+   __m256i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m256i tmp;
+
+   #define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
+
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##lo = _mm256_unpacklo_epi16((x),(y)); \
+      __m256i c0##hi = _mm256_unpackhi_epi16((x),(y)); \
+      __m256i out0##_l = _mm256_madd_epi16(c0##lo, c0); \
+      __m256i out0##_h = _mm256_madd_epi16(c0##hi, c0); \
+      __m256i out1##_l = _mm256_madd_epi16(c0##lo, c1); \
+      __m256i out1##_h = _mm256_madd_epi16(c0##hi, c1)
+
+   #define dct_widen(out, in) \
+      __m256i out##_l = _mm256_srai_epi32(_mm256_unpacklo_epi16(_mm256_setzero_si256(), (in)), 4); \
+      __m256i out##_h = _mm256_srai_epi32(_mm256_unpackhi_epi16(_mm256_setzero_si256(), (in)), 4)
+
+   #define dct_wadd(out, a, b) \
+      __m256i out##_l = _mm256_add_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_add_epi32(a##_h, b##_h)
+
+   #define dct_wsub(out, a, b) \
+      __m256i out##_l = _mm256_sub_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_sub_epi32(a##_h, b##_h)
+
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased_l = _mm256_add_epi32(a##_l, bias); \
+         __m256i abiased_h = _mm256_add_epi32(a##_h, bias); \
+         dct_wadd(sum, abiased, b); \
+         dct_wsub(dif, abiased, b); \
+         out0 = _mm256_packs_epi32(_mm256_srai_epi32(sum_l, s), _mm256_srai_epi32(sum_h, s)); \
+         out1 = _mm256_packs_epi32(_mm256_srai_epi32(dif_l, s), _mm256_srai_epi32(dif_h, s)); \
+      }
+
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi8(a, b); \
+      b = _mm256_unpackhi_epi8(tmp, b)
+
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi16(a, b); \
+      b = _mm256_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m256i sum04 = _mm256_add_epi16(row0, row4); \
+         __m256i dif04 = _mm256_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         dct_wadd(x0, t0e, t3e); \
+         dct_wsub(x3, t0e, t3e); \
+         dct_wadd(x1, t1e, t2e); \
+         dct_wsub(x2, t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m256i sum17 = _mm256_add_epi16(row1, row7); \
+         __m256i sum35 = _mm256_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         dct_wadd(x4, y0o, y4o); \
+         dct_wadd(x5, y1o, y5o); \
+         dct_wadd(x6, y2o, y5o); \
+         dct_wadd(x7, y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   // block 0 in the low lane, block 1 in the high lane
+   #define dct_load(r) \
+      _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (data0 + (r)*8))), \
+                              _mm_loadu_si128((const __m128i *) (data1 + (r)*8)), 1)
+
+   // store row pairs a (low 8 bytes) and b (high 8 bytes) of both lanes
+   #define dct_store(v) \
+      { \
+         __m128i lo = _mm256_castsi256_si128(v); \
+         __m128i hi = _mm256_extracti128_si256(v, 1); \
+         _mm_storel_epi64((__m128i *) out0, lo); out0 += out0_stride; \
+         _mm_storel_epi64((__m128i *) out0, _mm_shuffle_epi32(lo, 0x4e)); out0 += out0_stride; \
+         _mm_storel_epi64((__m128i *) out1, hi); out1 += out1_stride; \
+         _mm_storel_epi64((__m128i *) out1, _mm_shuffle_epi32(hi, 0x4e)); out1 += out1_stride; \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   row0 = dct_load(0);
+   row1 = dct_load(1);
+   row2 = dct_load(2);
+   row3 = dct_load(3);
+   row4 = dct_load(4);
+   row5 = dct_load(5);
+   row6 = dct_load(6);
+   row7 = dct_load(7);
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose, within each lane
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      // pack
+      __m256i p0 = _mm256_packus_epi16(row0, row1);
+      __m256i p1 = _mm256_packus_epi16(row2, row3);
+      __m256i p2 = _mm256_packus_epi16(row4, row5);
+      __m256i p3 = _mm256_packus_epi16(row6, row7);
+
+      // 8bit 8x8 transpose, within each lane
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      dct_interleave8(p0, p1);
+      dct_interleave8(p2, p3);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      // store
+      dct_store(p0);
+      dct_store(p2);
+      dct_store(p1);
+      dct_store(p3);
+   }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+#undef dct_load
+#undef dct_store
+}
+#endif // STBI_AVX2
+
 #ifdef STBI_NEON
 
 // NEON integer IDCT. should produce bit-identical
@@ -2912,67 +3857,232 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
-static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+// with a two-block IDCT kernel every other block is held back and
+// transformed together with the next one. blocks alternate between the two
+// coefficient buffers, the next block is always decoded into buf[held]
+typedef struct
 {
-   stbi__jpeg_reset(z);
-   if (!z->progressive) {
-      if (z->scan_n == 1) {
-         int i,j;
-         STBI_SIMD_ALIGN(short, data[64]);
-         int n = z->order[0];
-         // non-interleaved data, we just need to process one block at a time,
-         // in trivial scanline order
-         // number of blocks to do just depends on how many actual "pixels" this
-         // component has, independent of interleaved MCU blocking and such
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               int ha = z->img_comp[n].ha;
-               if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-               // every data block is an MCU, so countdown the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  // if it's NOT a restart, then just bail, so we get corrupt data
-                  // rather than no data
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
-            }
+   stbi_uc *out;
+   int out_stride;
+   int held;
+} stbi__idct_queue;
+
+static void stbi__idct_queue_push(stbi__jpeg *z, stbi__idct_queue *q, short buf[2][64], int n, stbi_uc *out, int out_stride)
+{
+   if (!z->idct_block2_kernel) {
+      z->img_comp[n].idct_kernel(out, out_stride, buf[0]);
+   } else if (q->held) {
+      z->idct_block2_kernel(q->out, q->out_stride, buf[0], out, out_stride, buf[1]);
+      q->held = 0;
+   } else {
+      q->out = out;
+      q->out_stride = out_stride;
+      q->held = 1;
+   }
+}
+
+static void stbi__idct_queue_flush(stbi__jpeg *z, stbi__idct_queue *q, short buf[2][64])
+{
+   if (q->held) {
+      z->idct_block_kernel(q->out, q->out_stride, buf[0]);
+      q->held = 0;
+   }
+}
+
+// decode the baseline MCUs [first,last) of the current scan, in raster order.
+// in a single component scan every 8x8 block is an MCU
+static int stbi__jpeg_decode_baseline_mcus(stbi__jpeg *z, int first, int last)
+{
+   int i,j,k,m,x,y;
+   STBI_SIMD_ALIGN(short, data[2][64]);
+   stbi__idct_queue q;
+   q.held = 0;
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      // number of blocks to do just depends on how many actual "pixels" this
+      // component has, independent of interleaved MCU blocking and such
+      int w = (z->img_comp[n].x+7) >> 3;
+      int ha = z->img_comp[n].ha;
+      int bs = 8 >> z->img_comp[n].scale;
+      i = first % w;
+      j = first / w;
+      for (m=first; m < last; ++m) {
+         if (!stbi__jpeg_decode_block(z, data[q.held], z->huff_dc+z->img_comp[n].hd, z->fast_dc[z->img_comp[n].hd], z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+         stbi__idct_queue_push(z, &q, data, n, z->img_comp[n].data+z->img_comp[n].w2*j*bs+i*bs, z->img_comp[n].w2);
+         if (++i == w) { i = 0; ++j; }
+         // every data block is an MCU, so countdown the restart interval
+         if (--z->todo <= 0) {
+            if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+            // if it's NOT a restart, then just bail, so we get corrupt data
+            // rather than no data
+            if (!STBI__RESTART(z->marker)) break;
+            stbi__jpeg_reset(z);
          }
-         return 1;
-      } else { // interleaved
-         int i,j,k,x,y;
-         STBI_SIMD_ALIGN(short, data[64]);
-         for (j=0; j < z->img_mcu_y; ++j) {
-            for (i=0; i < z->img_mcu_x; ++i) {
-               // scan an interleaved mcu... process scan_n components in order
-               for (k=0; k < z->scan_n; ++k) {
-                  int n = z->order[k];
-                  // scan out an mcu's worth of this component; that's just determined
-                  // by the basic H and V specified for the component
-                  for (y=0; y < z->img_comp[n].v; ++y) {
-                     for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
-                        int ha = z->img_comp[n].ha;
-                        if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
-                     }
-                  }
-               }
-               // after all interleaved components, that's an interleaved MCU,
-               // so now count down the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
+      }
+   } else { // interleaved
+      i = first % z->img_mcu_x;
+      j = first / z->img_mcu_x;
+      for (m=first; m < last; ++m) {
+         // scan an interleaved mcu... process scan_n components in order
+         for (k=0; k < z->scan_n; ++k) {
+            int n = z->order[k];
+            int bs = 8 >> z->img_comp[n].scale;
+            // scan out an mcu's worth of this component; that's just determined
+            // by the basic H and V specified for the component
+            for (y=0; y < z->img_comp[n].v; ++y) {
+               for (x=0; x < z->img_comp[n].h; ++x) {
+                  int x2 = (i*z->img_comp[n].h + x)*bs;
+                  int y2 = (j*z->img_comp[n].v + y)*bs;
+                  int ha = z->img_comp[n].ha;
+                  if (!stbi__jpeg_decode_block(z, data[q.held], z->huff_dc+z->img_comp[n].hd, z->fast_dc[z->img_comp[n].hd], z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                  stbi__idct_queue_push(z, &q, data, n, z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2);
                }
             }
          }
-         return 1;
+         if (++i == z->img_mcu_x) { i = 0; ++j; }
+         // after all interleaved components, that's an interleaved MCU,
+         // so now count down the restart interval
+         if (--z->todo <= 0) {
+            if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+            if (!STBI__RESTART(z->marker)) break;
+            stbi__jpeg_reset(z);
+         }
       }
+   }
+   stbi__idct_queue_flush(z, &q, data);
+   return 1;
+}
+
+static int stbi__jpeg_baseline_mcu_count(stbi__jpeg *z)
+{
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      return ((z->img_comp[n].x+7) >> 3) * ((z->img_comp[n].y+7) >> 3);
+   }
+   return z->img_mcu_x * z->img_mcu_y;
+}
+
+// restart intervals are independent: each one starts byte aligned after an
+// RSTn marker with the DC predictors reset, so they can be decoded in parallel
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi_uc const **starts; // first byte of each interval
+   stbi_uc const *end;
+   int segments, tasks, mcus;
+   stbi_uc *failed;        // per task
+} stbi__jpeg_restart_job;
+
+// find the start of every restart interval of the scan beginning at the
+// current position, and the marker that terminates the scan. returns the
+// number of intervals, or 0 if there are more than max
+static int stbi__jpeg_find_restarts(stbi__jpeg *z, stbi_uc const **starts, int max, stbi_uc const **after_end, unsigned char *end_marker)
+{
+   stbi_uc const *p = z->s->img_buffer, *end = z->s->img_buffer_end;
+   int count = 0;
+   starts[count++] = p;
+   for (;;) {
+      p = (stbi_uc const *) memchr(p, 0xff, end - p);
+      if (!p) return 0;
+      while (p < end && *p == 0xff) ++p; // fill bytes
+      if (p == end) return 0;
+      if (*p == 0) { ++p; continue; } // stuffed 0xff data byte
+      if (!STBI__RESTART(*p)) {
+         *end_marker = *p;
+         *after_end = p+1;
+         return count;
+      }
+      if (count == max) return 0;
+      starts[count++] = ++p;
+   }
+}
+
+static void stbi__jpeg_restart_task(void *task_data, int index)
+{
+   stbi__jpeg_restart_job *job = (stbi__jpeg_restart_job *) task_data;
+   int first = index * job->segments / job->tasks;
+   int last = (index+1) * job->segments / job->tasks;
+   int ri = job->z->restart_interval;
+   int seg;
+   stbi__context s;
+   stbi__jpeg *j = (stbi__jpeg *) stbi__malloc(sizeof(stbi__jpeg));
+   if (!j) { job->failed[index] = 1; return; }
+   memcpy(j, job->z, sizeof(*j));
+   stbi__start_mem(&s, job->starts[first], (int) (job->end - job->starts[first]));
+   j->s = &s;
+   stbi__jpeg_reset(j);
+   for (seg=first; seg < last; ++seg) {
+      int mcu_end = (seg+1)*ri < job->mcus ? (seg+1)*ri : job->mcus;
+      if (!stbi__jpeg_decode_baseline_mcus(j, seg*ri, mcu_end)) {
+         job->failed[index] = 1;
+         break;
+      }
+      // an interval that doesn't end exactly at its RSTn is out of sync; the
+      // serial decoder stops there, so fail and let it handle the scan
+      if (seg+1 < job->segments && j->todo != ri) {
+         job->failed[index] = 1;
+         break;
+      }
+   }
+   STBI_FREE(j);
+}
+
+// returns 1 if the scan was decoded in parallel and the context now sits
+// after the marker that ends it, 0 to decode it serially instead
+static int stbi__jpeg_parallel_baseline(stbi__jpeg *z)
+{
+   stbi__jpeg_restart_job job;
+   stbi_uc const *after_end = NULL;
+   unsigned char end_marker = STBI__MARKER_none;
+   int i, ok, expected;
+
+   if (z->restart_interval <= 0 || z->s->read_from_callbacks || !stbi__parallel_enabled(z->s->img_x, z->s->img_y))
+      return 0;
+
+   job.mcus = stbi__jpeg_baseline_mcu_count(z);
+   expected = (job.mcus + z->restart_interval - 1) / z->restart_interval;
+   if (expected < 2) return 0;
+
+   job.starts = (stbi_uc const **) stbi__malloc_mad2(expected, (int) sizeof(*job.starts), 0);
+   if (!job.starts) return 0;
+   // a scan that doesn't match its restart interval is decoded serially,
+   // which handles the damage the same way it always has
+   if (stbi__jpeg_find_restarts(z, job.starts, expected, &after_end, &end_marker) != expected) {
+      STBI_FREE((void *) job.starts);
+      return 0;
+   }
+
+   job.z = z;
+   job.end = z->s->img_buffer_end;
+   job.segments = expected;
+   job.tasks = expected < 256 ? expected : 256;
+   job.failed = (stbi_uc *) stbi__malloc(job.tasks);
+   if (!job.failed) { STBI_FREE((void *) job.starts); return 0; }
+   memset(job.failed, 0, job.tasks);
+
+   stbi__parallel(job.tasks, stbi__jpeg_restart_task, &job);
+
+   ok = 1;
+   for (i=0; i < job.tasks; ++i)
+      if (job.failed[i]) ok = 0;
+   STBI_FREE(job.failed);
+   STBI_FREE((void *) job.starts);
+   // on a decode error go again serially, so the error is reported on this
+   // thread exactly as before
+   if (!ok) return 0;
+
+   z->s->img_buffer = (stbi_uc *) after_end;
+   z->marker = end_marker;
+   return 1;
+}
+
+static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+{
+   stbi__jpeg_reset(z);
+   if (!z->progressive) {
+      if (stbi__jpeg_parallel_baseline(z))
+         return 1;
+      return stbi__jpeg_decode_baseline_mcus(z, 0, stbi__jpeg_baseline_mcu_count(z));
    } else {
       if (z->scan_n == 1) {
          int i,j;
@@ -2987,7 +4097,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
             for (i=0; i < w; ++i) {
                short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
                if (z->spec_start == 0) {
-                  if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], n))
+                  if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], z->fast_dc[z->img_comp[n].hd], n))
                      return 0;
                } else {
                   int ha = z->img_comp[n].ha;
@@ -3017,7 +4127,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                         int x2 = (i*z->img_comp[n].h + x);
                         int y2 = (j*z->img_comp[n].v + y);
                         short *data = z->img_comp[n].coeff + 64 * (x2 + y2 * z->img_comp[n].coeff_w);
-                        if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], n))
+                        if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], z->fast_dc[z->img_comp[n].hd], n))
                            return 0;
                      }
                   }
@@ -3043,21 +4153,58 @@ static void stbi__jpeg_dequantize(short *data, stbi__uint16 *dequant)
       data[i] *= dequant[i];
 }
 
+typedef struct
+{
+   stbi__jpeg *z;
+   int n, rows, bands;
+} stbi__jpeg_finish_job;
+
+// dequantize and idct one band of block rows of component n
+static void stbi__jpeg_finish_task(void *task_data, int index)
+{
+   stbi__jpeg_finish_job *job = (stbi__jpeg_finish_job *) task_data;
+   stbi__jpeg *z = job->z;
+   int n = job->n;
+   int w = (z->img_comp[n].x+7) >> 3;
+   int j0 = index * job->rows / job->bands;
+   int j1 = (index+1) * job->rows / job->bands;
+   int w2 = z->img_comp[n].w2;
+   int bs = 8 >> z->img_comp[n].scale;
+   int i,j;
+   for (j=j0; j < j1; ++j) {
+      stbi_uc *out = z->img_comp[n].data + w2*j*bs;
+      i = 0;
+      if (z->idct_block2_kernel) {
+         for (; i+1 < w; i += 2) {
+            short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+            stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
+            stbi__jpeg_dequantize(data + 64, z->dequant[z->img_comp[n].tq]);
+            z->idct_block2_kernel(out + i*bs, w2, data, out + i*bs + bs, w2, data + 64);
+         }
+      }
+      for (; i < w; ++i) {
+         short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+         stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
+         z->img_comp[n].idct_kernel(out + i*bs, w2, data);
+      }
+   }
+}
+
 static void stbi__jpeg_finish(stbi__jpeg *z)
 {
    if (z->progressive) {
-      // dequantize and idct the data
-      int i,j,n;
+      // dequantize and idct the data, bands of block rows are independent
+      int n;
+      int parallel = stbi__parallel_enabled(z->s->img_x, z->s->img_y);
       for (n=0; n < z->s->img_n; ++n) {
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
-               stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-            }
-         }
+         stbi__jpeg_finish_job job;
+         job.z = z;
+         job.n = n;
+         job.rows = (z->img_comp[n].y+7) >> 3;
+         job.bands = parallel ? (job.rows+3) / 4 : 1;
+         if (job.bands > 64) job.bands = 64;
+         if (job.bands < 1) job.bands = 1;
+         stbi__parallel(job.bands, stbi__jpeg_finish_task, &job);
       }
    }
 }
@@ -3114,6 +4261,8 @@ static int stbi__process_marker(stbi__jpeg *z, int m)
                v[i] = stbi__get8(z->s);
             if (tc != 0)
                stbi__build_fast_ac(z->fast_ac[th], z->huff_ac + th);
+            else
+               stbi__build_fast_dc(z->fast_dc[th], z->huff_dc + th);
             L -= n;
          }
          return L==0;
@@ -3229,7 +4378,7 @@ static int stbi__free_jpeg_components(stbi__jpeg *z, int ncomp, int why)
 static int stbi__process_frame_header(stbi__jpeg *z, int scan)
 {
    stbi__context *s = z->s;
-   int Lf,p,i,q, h_max=1,v_max=1,c;
+   int Lf,p,i,q, h_max=1,v_max=1,c,cs;
    Lf = stbi__get16be(s);         if (Lf < 11) return stbi__err("bad SOF len","Corrupt JPEG"); // JPEG
    p  = stbi__get8(s);            if (p != 8) return stbi__err("only 8-bit","JPEG format not supported: 8-bit only"); // JPEG baseline
    s->img_y = stbi__get16be(s);   if (s->img_y == 0) return stbi__err("no header height", "JPEG format not supported: delayed height"); // Legal, but we don't handle it--but neither does IJG
@@ -3286,9 +4435,21 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       // discard the extra data until colorspace conversion
       //
       // img_mcu_x, img_mcu_y: <=17 bits; comp[i].h and .v are <=4 (checked earlier)
-      // so these muls can't overflow with 32-bit ints (which we require)
-      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
-      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+      // so these muls can't overflow with 32-bit ints (which we require).
+      //
+      // a scaled decode stores every block at 8 >> scale pixels square.
+      // like libjpeg, subsampled components are reduced less instead of
+      // being upsampled afterwards, as far as both h and v ratios allow
+      cs = z->scale;
+      while (cs > 0 && h_max % (z->img_comp[i].h << (z->scale-cs+1)) == 0
+                    && v_max % (z->img_comp[i].v << (z->scale-cs+1)) == 0)
+         --cs;
+      z->img_comp[i].scale = cs;
+      z->img_comp[i].idct_kernel = cs == 0 ? z->idct_block_kernel
+                                 : cs == 1 ? stbi__idct_block_4x4
+                                 : cs == 2 ? stbi__idct_block_2x2 : stbi__idct_block_1x1;
+      z->img_comp[i].w2 = (z->img_mcu_x * z->img_comp[i].h * 8) >> cs;
+      z->img_comp[i].h2 = (z->img_mcu_y * z->img_comp[i].v * 8) >> cs;
       z->img_comp[i].coeff = 0;
       z->img_comp[i].raw_coeff = 0;
       z->img_comp[i].linebuf = NULL;
@@ -3298,10 +4459,10 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       // align blocks for idct using mmx/sse
       z->img_comp[i].data = (stbi_uc*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
       if (z->progressive) {
-         // w2, h2 are multiples of 8 (see above)
-         z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
-         z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
-         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].w2, z->img_comp[i].h2, sizeof(short), 15);
+         // one 8x8 block of coefficients per block of the full size image
+         z->img_comp[i].coeff_w = z->img_mcu_x * z->img_comp[i].h;
+         z->img_comp[i].coeff_h = z->img_mcu_y * z->img_comp[i].v;
+         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].coeff_w * 8, z->img_comp[i].coeff_h * 8, sizeof(short), 15);
          if (z->img_comp[i].raw_coeff == NULL)
             return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
          z->img_comp[i].coeff = (short*) (((size_t) z->img_comp[i].raw_coeff + 15) & ~15);
@@ -3582,6 +4743,73 @@ static stbi_uc *stbi__resample_row_hv_2_simd(stbi_uc *out, stbi_uc *in_near, stb
 }
 #endif
 
+#ifdef STBI_AVX2
+// vertical then horizontal 2x filter of lo-res pixels [i,i+16) into 32 words,
+// t1 is the filtered pixel i-1. the same math as the sse2 loop, so the result
+// is bit-identical to stbi__resample_row_hv_2
+STBI__AVX2_INLINE static void stbi__resample_hv_2_avx2_16(__m256i *lo, __m256i *hi, stbi_uc const *in_near, stbi_uc const *in_far, int i, int t1)
+{
+   // this uses 3*x + y = 4*x + (y - x)
+   __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (in_far + i)));
+   __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (in_near + i)));
+   __m256i curr  = _mm256_add_epi16(_mm256_slli_epi16(nearw, 2), _mm256_sub_epi16(farw, nearw));
+
+   // "prev" is curr shifted by one pixel with t1 in front, "next" is curr
+   // shifted the other way with the first pixel of the next group behind.
+   // shifts across the two lanes go through alignr with a lane swap
+   __m256i prv0 = _mm256_alignr_epi8(curr, _mm256_permute2x128_si256(curr, curr, 0x08), 14);
+   __m256i nxt0 = _mm256_alignr_epi8(_mm256_permute2x128_si256(curr, curr, 0x81), curr, 2);
+   __m256i prev = _mm256_insert_epi16(prv0, (short) t1, 0);
+   __m256i next = _mm256_insert_epi16(nxt0, (short) (3*in_near[i+16] + in_far[i+16]), 15);
+
+   // even pixels = 3*cur + prev, odd pixels = 3*cur + next
+   __m256i bias = _mm256_set1_epi16(8);
+   __m256i curb = _mm256_add_epi16(_mm256_slli_epi16(curr, 2), bias);
+   __m256i even = _mm256_add_epi16(_mm256_sub_epi16(prev, curr), curb);
+   __m256i odd  = _mm256_add_epi16(_mm256_sub_epi16(next, curr), curb);
+
+   // interleaving within lanes leaves outputs 0-7,16-23 in lo and 8-15,24-31
+   // in hi, which is the order packus wants
+   *lo = _mm256_srli_epi16(_mm256_unpacklo_epi16(even, odd), 4);
+   *hi = _mm256_srli_epi16(_mm256_unpackhi_epi16(even, odd), 4);
+}
+
+// filter the rest of the row from lo-res pixel i0 on, t1 is pixel i0-1.
+// out points at output pixel i0*2
+static void stbi__resample_row_hv_2_tail(stbi_uc *out, stbi_uc const *in_near, stbi_uc const *in_far, int i0, int w, int t1)
+{
+   int i, t0 = t1;
+   t1 = 3*in_near[i0] + in_far[i0];
+   out[0] = stbi__div16(3*t1 + t0 + 8);
+   for (i=i0+1; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[(i-i0)*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[(i-i0)*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[(w-i0)*2-1] = stbi__div4(t1+2);
+}
+
+STBI__AVX2_TARGET
+static stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   int i=0;
+   int t1 = 3*in_near[0] + in_far[0];
+   STBI_NOTUSED(hs);
+
+   // groups of 16, the last pixel is left to the tail for the boundary
+   for (; i < ((w-1) & ~15); i += 16) {
+      __m256i lo, hi;
+      stbi__resample_hv_2_avx2_16(&lo, &hi, in_near, in_far, i, t1);
+      _mm256_storeu_si256((__m256i *) (out + i*2), _mm256_packus_epi16(lo, hi));
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   stbi__resample_row_hv_2_tail(out + i*2, in_near, in_far, i, w, t1);
+   return out;
+}
+#endif
+
 static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
 {
    // resample with nearest-neighbor
@@ -3756,12 +4984,126 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// 16 pixels of YCbCr words (cr, cb already biased and shifted up by 8, see
+// the sse2 version) to RGBA. the low lane's 8 pixels go to out, the high
+// lane's to out + second
+STBI__AVX2_INLINE static void stbi__YCbCr_to_RGBA_avx2_16(stbi_uc *out, int second, __m256i yw, __m256i crw, __m256i cbw)
+{
+   __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+   __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+   __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+   __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+   __m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+   // color transform
+   __m256i yws = _mm256_srli_epi16(yw, 4);
+   __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+   __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+   __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+   __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+   __m256i rws = _mm256_add_epi16(cr0, yws);
+   __m256i gwt = _mm256_add_epi16(cb0, yws);
+   __m256i bws = _mm256_add_epi16(yws, cb1);
+   __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+   // descale
+   __m256i rw = _mm256_srai_epi16(rws, 4);
+   __m256i bw = _mm256_srai_epi16(bws, 4);
+   __m256i gw = _mm256_srai_epi16(gws, 4);
+
+   // back to byte and interleave, within lanes: o0 = px 0-3 | 8-11, o1 = 4-7 | 12-15
+   __m256i brb = _mm256_packus_epi16(rw, bw);
+   __m256i gxb = _mm256_packus_epi16(gw, xw);
+   __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+   __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+   __m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+   __m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+
+   _mm256_storeu_si256((__m256i *) out, _mm256_permute2x128_si256(o0, o1, 0x20));
+   _mm256_storeu_si256((__m256i *) (out + second), _mm256_permute2x128_si256(o0, o1, 0x31));
+}
+
+// y as words with 128 in the low byte, as unpacking under y_bias does in sse2
+STBI__AVX2_INLINE static __m256i stbi__jpeg_y_words_avx2(__m128i y_bytes)
+{
+   return _mm256_or_si256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(y_bytes), 8), _mm256_set1_epi16(128));
+}
+
+// chroma bytes to (c - 128) << 8
+STBI__AVX2_INLINE static __m256i stbi__jpeg_c_words_avx2(__m128i c_bytes)
+{
+   return _mm256_slli_epi16(_mm256_cvtepu8_epi16(_mm_xor_si128(c_bytes, _mm_set1_epi8(-0x80))), 8);
+}
+
+STBI__AVX2_TARGET
+static void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+   // like sse2, only the step == 4 case is accelerated
+   if (step == 4) {
+      for (; i+15 < count; i += 16) {
+         __m256i yw  = stbi__jpeg_y_words_avx2(_mm_loadu_si128((const __m128i *) (y+i)));
+         __m256i crw = stbi__jpeg_c_words_avx2(_mm_loadu_si128((const __m128i *) (pcr+i)));
+         __m256i cbw = stbi__jpeg_c_words_avx2(_mm_loadu_si128((const __m128i *) (pcb+i)));
+         stbi__YCbCr_to_RGBA_avx2_16(out, 32, yw, crw, cbw);
+         out += 64;
+      }
+   }
+
+   stbi__YCbCr_to_RGB_row(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+
+// fused 4:2:0 path: upsamples both chroma rows 2x2 in registers and writes
+// RGBA straight to the output row, skipping the chroma line buffers. count
+// is the output width, w the lo-res chroma width. bit-identical to running
+// stbi__resample_row_hv_2 on cb and cr, then stbi__YCbCr_to_RGB_row
+STBI__AVX2_TARGET
+static void stbi__YCbCr_420_to_RGBA_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc *cb_near, stbi_uc *cb_far, stbi_uc *cr_near, stbi_uc *cr_far, int w, int count)
+{
+   STBI_SIMD_ALIGN(stbi_uc, cb[64]);
+   STBI_SIMD_ALIGN(stbi_uc, cr[64]);
+   int i = 0;
+   int cb_t1 = 3*cb_near[0] + cb_far[0];
+   int cr_t1 = 3*cr_near[0] + cr_far[0];
+
+   // 16 lo-res chroma pixels make 32 output pixels. the filtered chroma
+   // words come out with pixels 0-7,16-23 in lo and 8-15,24-31 in hi, and
+   // unpacking y within lanes yields the same split
+   for (; i < ((w-1) & ~15); i += 16) {
+      __m256i bias = _mm256_set1_epi16(128);
+      __m256i y_bias = _mm256_set1_epi8((char) (unsigned char) 128);
+      __m256i cb_lo, cb_hi, cr_lo, cr_hi;
+      __m256i y_bytes = _mm256_loadu_si256((const __m256i *) (y + i*2));
+      stbi__resample_hv_2_avx2_16(&cb_lo, &cb_hi, cb_near, cb_far, i, cb_t1);
+      stbi__resample_hv_2_avx2_16(&cr_lo, &cr_hi, cr_near, cr_far, i, cr_t1);
+      stbi__YCbCr_to_RGBA_avx2_16(out + i*8, 64,
+            _mm256_unpacklo_epi8(y_bias, y_bytes),
+            _mm256_slli_epi16(_mm256_sub_epi16(cr_lo, bias), 8),
+            _mm256_slli_epi16(_mm256_sub_epi16(cb_lo, bias), 8));
+      stbi__YCbCr_to_RGBA_avx2_16(out + i*8 + 32, 64,
+            _mm256_unpackhi_epi8(y_bias, y_bytes),
+            _mm256_slli_epi16(_mm256_sub_epi16(cr_hi, bias), 8),
+            _mm256_slli_epi16(_mm256_sub_epi16(cb_hi, bias), 8));
+      cb_t1 = 3*cb_near[i+15] + cb_far[i+15];
+      cr_t1 = 3*cr_near[i+15] + cr_far[i+15];
+   }
+
+   // at most 16 lo-res pixels are left, filter them into scratch rows
+   stbi__resample_row_hv_2_tail(cb, cb_near, cb_far, i, w, cb_t1);
+   stbi__resample_row_hv_2_tail(cr, cr_near, cr_far, i, w, cr_t1);
+   stbi__YCbCr_to_RGB_row(out + i*8, y + i*2, cb, cr, count - i*2, 4);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
    j->idct_block_kernel = stbi__idct_block;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
+   j->idct_block2_kernel = NULL;
+   j->YCbCr_420_to_RGBA_kernel = NULL;
 
 #ifdef STBI_SSE2
    if (stbi__sse2_available()) {
@@ -3771,11 +5113,25 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
    }
 #endif
 
+#ifdef STBI_AVX2
+   if (stbi__avx2_available()) {
+      j->idct_block2_kernel = stbi__idct2_avx2;
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+      j->YCbCr_420_to_RGBA_kernel = stbi__YCbCr_420_to_RGBA_avx2;
+   }
+#endif
+
 #ifdef STBI_NEON
    j->idct_block_kernel = stbi__idct_simd;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
 #endif
+
+   // the reduced idcts are picked per component in the frame header
+   j->scale = j->s->scale;
+   if (j->scale)
+      j->idct_block2_kernel = NULL;
 }
 
 // clean up the temporary component buffers
@@ -3801,6 +5157,178 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
+// color-convert one row of n channels from the resampled component rows
+static void stbi__jpeg_convert_row(stbi__jpeg *z, stbi_uc *out, stbi_uc **coutput, int n, int is_rgb, unsigned int w)
+{
+   unsigned int i;
+   if (n >= 3) {
+      stbi_uc *y = coutput[0];
+      if (z->s->img_n == 3) {
+         if (is_rgb) {
+            for (i=0; i < w; ++i) {
+               out[0] = y[i];
+               out[1] = coutput[1][i];
+               out[2] = coutput[2][i];
+               out[3] = 255;
+               out += n;
+            }
+         } else {
+            z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], w, n);
+         }
+      } else if (z->s->img_n == 4) {
+         if (z->app14_color_transform == 0) { // CMYK
+            for (i=0; i < w; ++i) {
+               stbi_uc m = coutput[3][i];
+               out[0] = stbi__blinn_8x8(coutput[0][i], m);
+               out[1] = stbi__blinn_8x8(coutput[1][i], m);
+               out[2] = stbi__blinn_8x8(coutput[2][i], m);
+               out[3] = 255;
+               out += n;
+            }
+         } else if (z->app14_color_transform == 2) { // YCCK
+            z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], w, n);
+            for (i=0; i < w; ++i) {
+               stbi_uc m = coutput[3][i];
+               out[0] = stbi__blinn_8x8(255 - out[0], m);
+               out[1] = stbi__blinn_8x8(255 - out[1], m);
+               out[2] = stbi__blinn_8x8(255 - out[2], m);
+               out += n;
+            }
+         } else { // YCbCr + alpha?  Ignore the fourth channel for now
+            z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], w, n);
+         }
+      } else
+         for (i=0; i < w; ++i) {
+            out[0] = out[1] = out[2] = y[i];
+            out[3] = 255; // not used if n==3
+            out += n;
+         }
+   } else {
+      if (is_rgb) {
+         if (n == 1)
+            for (i=0; i < w; ++i)
+               *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+         else {
+            for (i=0; i < w; ++i, out += 2) {
+               out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+               out[1] = 255;
+            }
+         }
+      } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+         for (i=0; i < w; ++i) {
+            stbi_uc m = coutput[3][i];
+            stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+            stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+            stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+            out[0] = stbi__compute_y(r, g, b);
+            if (n == 2) out[1] = 255;
+            out += n;
+         }
+      } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+         for (i=0; i < w; ++i) {
+            out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+            if (n == 2) out[1] = 255;
+            out += n;
+         }
+      } else {
+         stbi_uc *y = coutput[0];
+         if (n == 1)
+            for (i=0; i < w; ++i) out[i] = y[i];
+         else
+            for (i=0; i < w; ++i) { *out++ = y[i]; *out++ = 255; }
+      }
+   }
+}
+
+// resample and color-convert the next rows output rows, row j going to
+// output + j*stride. linebuf holds one scratch row per component.
+// with n == 3 a row may write one byte past its end, which is fine when the
+// next row directly follows and comes later. otherwise pass a spill row of
+// n*w+1 bytes: then the last row, and every row unless stride is exactly
+// n*w, is built there and copied out
+static void stbi__jpeg_convert_rows(stbi__jpeg *z, stbi_uc *output, ptrdiff_t stride, stbi_uc *spill, stbi__resample *res_comp, stbi_uc **linebuf, int n, int decode_n, int is_rgb, int bgr, unsigned int rows)
+{
+   int k;
+   unsigned int j;
+   unsigned int w = z->s->img_x;
+   stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+   stbi_uc *cnear[4], *cfar[4];
+   // 4:2:0 YCbCr to RGBA can skip the chroma line buffers entirely
+   int fused = z->YCbCr_420_to_RGBA_kernel && n == 4 && decode_n == 3 && z->s->img_n == 3 && !is_rgb
+            && res_comp[0].hs == 1 && res_comp[0].vs == 1
+            && res_comp[1].hs == 2 && res_comp[1].vs == 2
+            && res_comp[2].hs == 2 && res_comp[2].vs == 2;
+   for (j=0; j < rows; ++j) {
+      stbi_uc *row = output + stride * (ptrdiff_t) j;
+      stbi_uc *out = spill && n == 3 && (stride != (ptrdiff_t) (n * w) || j+1 == rows) ? spill : row;
+      for (k=0; k < decode_n; ++k) {
+         stbi__resample *r = &res_comp[k];
+         int y_bot = r->ystep >= (r->vs >> 1);
+         cnear[k] = y_bot ? r->line1 : r->line0;
+         cfar[k]  = y_bot ? r->line0 : r->line1;
+         if (!fused || k == 0)
+            coutput[k] = r->resample(linebuf[k], cnear[k], cfar[k], r->w_lores, r->hs);
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < z->img_comp[k].y)
+               r->line1 += z->img_comp[k].w2;
+         }
+      }
+      if (fused) {
+         z->YCbCr_420_to_RGBA_kernel(out, coutput[0], cnear[1], cfar[1], cnear[2], cfar[2], res_comp[1].w_lores, w);
+      } else {
+         stbi__jpeg_convert_row(z, out, coutput, n, is_rgb, w);
+      }
+      if (bgr) stbi__dest_swap_rb(out, w, n);
+      if (out != row) memcpy(row, out, n * w);
+   }
+}
+
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi_uc *output;
+   ptrdiff_t stride;
+   stbi_uc *scratch;  // scratch_size bytes per band
+   int scratch_size;  // decode_n line buffers of img_x+3 bytes, then one spill row
+   stbi__resample res_comp[4]; // state at row 0
+   int n, decode_n, is_rgb, bgr, bands;
+} stbi__jpeg_convert_job;
+
+static void stbi__jpeg_convert_task(void *task_data, int index)
+{
+   stbi__jpeg_convert_job *job = (stbi__jpeg_convert_job *) task_data;
+   stbi__jpeg *z = job->z;
+   unsigned int j0 = (unsigned int) ((double) index * z->s->img_y / job->bands);
+   unsigned int j1 = (unsigned int) ((double) (index+1) * z->s->img_y / job->bands);
+   unsigned int w = z->s->img_x;
+   stbi_uc *scratch = job->scratch + (size_t) index * job->scratch_size;
+   stbi__resample res_comp[4];
+   stbi_uc *linebuf[4];
+   unsigned int j;
+   int k;
+   if (j0 == j1) return;
+   for (k=0; k < job->decode_n; ++k) {
+      // replay the vertical resample state up to this band's first row
+      stbi__resample *r = &res_comp[k];
+      *r = job->res_comp[k];
+      for (j=0; j < j0; ++j) {
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < z->img_comp[k].y)
+               r->line1 += z->img_comp[k].w2;
+         }
+      }
+      linebuf[k] = scratch + k * (w + 3);
+   }
+   // the band's last row spills through scratch, the first byte of the next
+   // band may already be done
+   stbi__jpeg_convert_rows(z, job->output + job->stride * (ptrdiff_t) j0, job->stride, scratch + job->decode_n * (w + 3),
+                           res_comp, linebuf, job->n, job->decode_n, job->is_rgb, job->bgr, j1 - j0);
+}
+
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
    int n, decode_n, is_rgb;
@@ -3812,6 +5340,18 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // load a jpeg image from whichever source, but leave in YCbCr format
    if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
 
+   // from here on the image is as big as the scaled decode made it
+   if (z->scale) {
+      int k, round = (1 << z->scale) - 1;
+      z->s->img_x = (z->s->img_x + round) >> z->scale;
+      z->s->img_y = (z->s->img_y + round) >> z->scale;
+      for (k=0; k < z->s->img_n; ++k) {
+         int cs = z->img_comp[k].scale;
+         z->img_comp[k].x = (z->img_comp[k].x + (1 << cs) - 1) >> cs;
+         z->img_comp[k].y = (z->img_comp[k].y + (1 << cs) - 1) >> cs;
+      }
+   }
+
    // determine actual number of components to generate
    n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
 
@@ -3829,9 +5369,10 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // resample and color-convert
    {
       int k;
-      unsigned int i,j;
-      stbi_uc *output;
-      stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+      stbi_uc *output, *spill = NULL;
+      ptrdiff_t stride = (ptrdiff_t) n * z->s->img_x;
+      int bgr = 0;
+      stbi__jpeg_convert_job job;
 
       stbi__resample res_comp[4];
 
@@ -3843,8 +5384,9 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
          z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
          if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
-         r->hs      = z->img_h_max / z->img_comp[k].h;
-         r->vs      = z->img_v_max / z->img_comp[k].v;
+         // a component reduced less than the image needs less upsampling
+         r->hs      = (z->img_h_max / z->img_comp[k].h) >> (z->scale - z->img_comp[k].scale);
+         r->vs      = (z->img_v_max / z->img_comp[k].v) >> (z->scale - z->img_comp[k].scale);
          r->ystep   = r->vs >> 1;
          r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
          r->ypos    = 0;
@@ -3857,104 +5399,51 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
          else                               r->resample = stbi__resample_row_generic;
       }
 
-      // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-      if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-      // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
-         }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else if (z->s->img_n == 4) {
-               if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                     out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                     out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(255 - out[0], m);
-                     out[1] = stbi__blinn_8x8(255 - out[1], m);
-                     out[2] = stbi__blinn_8x8(255 - out[2], m);
-                     out += n;
-                  }
-               } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
-                  out += n;
-               }
-         } else {
-            if (is_rgb) {
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
-                     *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-               else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
-                     out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                     out[1] = 255;
-                  }
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  stbi_uc m = coutput[3][i];
-                  stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                  stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                  stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                  out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else {
-               stbi_uc *y = coutput[0];
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-               else
-                  for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
-            }
+      job.bands = 1;
+      job.scratch = NULL;
+      if (stbi__parallel_enabled(z->s->img_x, z->s->img_y)) {
+         job.bands = z->s->img_y / 16 < 64 ? z->s->img_y / 16 : 64;
+         job.scratch_size = decode_n * (z->s->img_x + 3) + n * z->s->img_x + 1;
+         if (job.bands > 1)
+            job.scratch = (stbi_uc *) stbi__malloc_mad2(job.bands, job.scratch_size, 0);
+         if (!job.scratch) job.bands = 1;
+      }
+
+      if (z->s->dest) {
+         // rows go straight to the caller's buffer, which has no slack
+         // after its last row, so 3 channel output needs a spill row
+         stbi__dest *d = z->s->dest;
+         if (!stbi__dest_setup(d, z->s->img_x, z->s->img_y)) { STBI_FREE(job.scratch); stbi__cleanup_jpeg(z); return NULL; }
+         if (n == 3 && job.bands <= 1) {
+            spill = (stbi_uc *) stbi__malloc_mad2(n, z->s->img_x, 1);
+            if (!spill) { STBI_FREE(job.scratch); stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
          }
+         output = d->row0;
+         stride = d->stride;
+         bgr = (d->req->flags & STBI_DEST_BGR) != 0;
+      } else {
+         // can't error after this so, this is safe
+         output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+         if (!output) { STBI_FREE(job.scratch); stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+      }
+
+      // now go ahead and resample, in independent row bands if it's worth it
+      if (job.bands > 1) {
+         for (k=0; k < decode_n; ++k) job.res_comp[k] = res_comp[k];
+         job.z = z;
+         job.output = output;
+         job.stride = stride;
+         job.n = n;
+         job.decode_n = decode_n;
+         job.is_rgb = is_rgb;
+         job.bgr = bgr;
+         stbi__parallel(job.bands, stbi__jpeg_convert_task, &job);
+         STBI_FREE(job.scratch);
+      } else {
+         stbi_uc *linebuf[4];
+         for (k=0; k < decode_n; ++k) linebuf[k] = z->img_comp[k].linebuf;
+         stbi__jpeg_convert_rows(z, output, stride, spill, res_comp, linebuf, n, decode_n, is_rgb, bgr, z->s->img_y);
+         STBI_FREE(spill);
       }
       stbi__cleanup_jpeg(z);
       *out_x = z->s->img_x;
@@ -3969,10 +5458,10 @@ static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int re
    unsigned char* result;
    stbi__jpeg* j = (stbi__jpeg*) stbi__malloc(sizeof(stbi__jpeg));
    if (!j) return stbi__errpuc("outofmem", "Out of memory");
-   STBI_NOTUSED(ri);
    j->s = s;
    stbi__setup_jpeg(j);
    result = load_jpeg_image(j, x,y,comp,req_comp);
+   if (result && s->dest) ri->rows_in_dest = 1;
    STBI_FREE(j);
    return result;
 }
@@ -4024,15 +5513,23 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #ifndef STBI_NO_ZLIB
 
 // fast-way is faster to check than jpeg huffman, but slow way is slower
-#define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
+#define STBI__ZFAST_BITS  10 // accelerate all cases in default tables, and their extra bits
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 #define STBI__ZNSYMS 288 // number of symbols in literal/length alphabet
 
+// kinds of fast_ext entries
+#define STBI__ZFAST_LITERAL  1
+#define STBI__ZFAST_MATCH    2 // a length, or a distance
+#define STBI__ZFAST_END      3
+
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
 {
    stbi__uint16 fast[1 << STBI__ZFAST_BITS];
+   // literal/length and distance tables only: a whole symbol with its extra
+   // bits in one lookup, (value << 16) | (kind << 8) | total bits
+   stbi__uint32 fast_ext[1 << STBI__ZFAST_BITS];
    stbi__uint16 firstcode[16];
    int maxcode[17];
    stbi__uint16 firstsymbol[16];
@@ -4104,6 +5601,31 @@ static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int
    return 1;
 }
 
+// fill fast_ext from fast: symbols below first are literals and the end of
+// block, the count symbols from first on get base plus their extra bits.
+// anything that doesn't fit stays 0 and takes the slow path, as do the
+// symbols that are invalid in a stream
+static void stbi__zbuild_fast_ext(stbi__zhuffman *z, const int *base, const int *extra, int first, int count)
+{
+   int i;
+   for (i=0; i < (1 << STBI__ZFAST_BITS); ++i) {
+      int b = z->fast[i];
+      int s = b >> 9, sym = b & 511;
+      z->fast_ext[i] = 0;
+      if (!b) continue;
+      if (sym < first) {
+         int kind = sym < 256 ? STBI__ZFAST_LITERAL : STBI__ZFAST_END;
+         z->fast_ext[i] = ((stbi__uint32) sym << 16) | (kind << 8) | s;
+      } else if (sym - first < count) {
+         int e = extra[sym - first];
+         if (s + e <= STBI__ZFAST_BITS) {
+            stbi__uint32 v = base[sym - first] + ((i >> s) & ((1 << e) - 1));
+            z->fast_ext[i] = (v << 16) | (STBI__ZFAST_MATCH << 8) | (s + e);
+         }
+      }
+   }
+}
+
 // zlib-from-memory implementation for PNG reading
 //    because PNG allows splitting the zlib stream arbitrarily,
 //    and it's annoying structurally to have PNG call ZLIB call PNG,
@@ -4113,8 +5635,8 @@ static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int
 typedef struct
 {
    stbi_uc *zbuffer, *zbuffer_end;
-   int num_bits;
-   stbi__uint32 code_buffer;
+   int num_bits;             // goes negative once bits past the end are used
+   stbi__uint64 code_buffer; // bits above num_bits are 0 or the bytes that follow
 
    char *zout;
    char *zout_start;
@@ -4134,23 +5656,35 @@ stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
    return stbi__zeof(z) ? 0 : *z->zbuffer++;
 }
 
+// refill to more than 56 bits, or as many as are left. past the end the
+// missing bits read as 0; using them takes num_bits below 0, which the
+// decoder reports as corrupt data
 static void stbi__fill_bits(stbi__zbuf *z)
 {
-   do {
-      if (z->code_buffer >= (1U << z->num_bits)) {
-        z->zbuffer = z->zbuffer_end;  /* treat this as EOF so we fail. */
-        return;
-      }
-      z->code_buffer |= (unsigned int) stbi__zget8(z) << z->num_bits;
+   if (z->zbuffer_end - z->zbuffer >= 8) {
+      // load a whole word and keep the bytes that fit. the ones that only
+      // partly fit are loaded again next time, at the same position
+      stbi_uc *p = z->zbuffer;
+      stbi__uint64 v = ((stbi__uint64) p[7] << 56) | ((stbi__uint64) p[6] << 48)
+                     | ((stbi__uint64) p[5] << 40) | ((stbi__uint64) p[4] << 32)
+                     | ((stbi__uint64) p[3] << 24) | ((stbi__uint64) p[2] << 16)
+                     | ((stbi__uint64) p[1] <<  8) |  (stbi__uint64) p[0];
+      z->code_buffer |= v << z->num_bits;
+      z->zbuffer += (63 - z->num_bits) >> 3;
+      z->num_bits |= 56;
+      return;
+   }
+   while (z->num_bits <= 56 && !stbi__zeof(z)) {
+      z->code_buffer |= (stbi__uint64) *z->zbuffer++ << z->num_bits;
       z->num_bits += 8;
-   } while (z->num_bits <= 24);
+   }
 }
 
 stbi_inline static unsigned int stbi__zreceive(stbi__zbuf *z, int n)
 {
    unsigned int k;
    if (z->num_bits < n) stbi__fill_bits(z);
-   k = z->code_buffer & ((1 << n) - 1);
+   k = (unsigned int) z->code_buffer & ((1 << n) - 1);
    z->code_buffer >>= n;
    z->num_bits -= n;
    return k;
@@ -4161,7 +5695,7 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
    int b,s,k;
    // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = stbi__bit_reverse(a->code_buffer, 16);
+   k = stbi__bit_reverse((int) (a->code_buffer & 0xffff), 16);
    for (s=STBI__ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
@@ -4180,9 +5714,10 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
    int b,s;
    if (a->num_bits < 16) {
       if (stbi__zeof(a)) {
-         return -1;   /* report error for unexpected end of data. */
+         if (a->num_bits < 0) return -1; /* report error for unexpected end of data. */
+      } else {
+         stbi__fill_bits(a);
       }
-      stbi__fill_bits(a);
    }
    b = z->fast[a->code_buffer & STBI__ZFAST_MASK];
    if (b) {
@@ -4230,43 +5765,113 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
+// copy a match whose source starts dist bytes back. the caller made sure
+// there are 16 bytes of room past the end of the match: copies may write up
+// to 15 bytes too many, which later output overwrites
+stbi_inline static char *stbi__zcopy_match(char *zout, int len, int dist)
+{
+   char *end = zout + len;
+   char *p = zout - dist;
+   if (dist >= 16) {
+      do {
+         memcpy(zout, p, 16);
+         zout += 16; p += 16;
+      } while (zout < end);
+   } else if (dist >= 8) {
+      do {
+         memcpy(zout, p, 8);
+         zout += 8; p += 8;
+      } while (zout < end);
+   } else if (dist == 1) { // run of one byte; common in images.
+      memset(zout, *p, len);
+   } else {
+      // short repeating patterns (a run of pixels) overlap themselves
+      do *zout++ = *p++; while (zout < end);
+   }
+   return end;
+}
+
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
-      if (z < 256) {
+      stbi__uint32 e;
+      int z,len,dist;
+      if (a->num_bits < 16) {
+         if (stbi__zeof(a)) {
+            if (a->num_bits < 0) return stbi__err("unexpected end","Corrupt PNG");
+         } else {
+            stbi__fill_bits(a);
+         }
+      }
+      e = a->z_length.fast_ext[a->code_buffer & STBI__ZFAST_MASK];
+      if (e) {
+         a->code_buffer >>= e & 255;
+         a->num_bits -= e & 255;
+         z = (int) (e >> 16);
+         e = (e >> 8) & 255;
+      } else {
+         z = stbi__zhuffman_decode(a, &a->z_length);
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
+         if (z < 256) {
+            e = STBI__ZFAST_LITERAL;
+         } else if (z == 256) {
+            e = STBI__ZFAST_END;
+         } else {
+            z -= 257;
+            len = stbi__zlength_base[z];
+            if (stbi__zlength_extra[z]) len += stbi__zreceive(a, stbi__zlength_extra[z]);
+            z = len;
+            e = STBI__ZFAST_MATCH;
+         }
+      }
+
+      if (e == STBI__ZFAST_LITERAL) {
          if (zout >= a->zout_end) {
             if (!stbi__zexpand(a, zout, 1)) return 0;
             zout = a->zout;
          }
          *zout++ = (char) z;
+      } else if (e == STBI__ZFAST_END) {
+         if (a->num_bits < 0) return stbi__err("unexpected end","Corrupt PNG");
+         a->zout = zout;
+         return 1;
       } else {
-         stbi_uc *p;
-         int len,dist;
-         if (z == 256) {
-            a->zout = zout;
-            return 1;
+         len = z;
+         if (a->num_bits < 16) {
+            if (stbi__zeof(a)) {
+               if (a->num_bits < 0) return stbi__err("unexpected end","Corrupt PNG");
+            } else {
+               stbi__fill_bits(a);
+            }
          }
-         z -= 257;
-         len = stbi__zlength_base[z];
-         if (stbi__zlength_extra[z]) len += stbi__zreceive(a, stbi__zlength_extra[z]);
-         z = stbi__zhuffman_decode(a, &a->z_distance);
-         if (z < 0) return stbi__err("bad huffman code","Corrupt PNG");
-         dist = stbi__zdist_base[z];
-         if (stbi__zdist_extra[z]) dist += stbi__zreceive(a, stbi__zdist_extra[z]);
-         if (zout - a->zout_start < dist) return stbi__err("bad dist","Corrupt PNG");
-         if (zout + len > a->zout_end) {
-            if (!stbi__zexpand(a, zout, len)) return 0;
-            zout = a->zout;
+         e = a->z_distance.fast_ext[a->code_buffer & STBI__ZFAST_MASK];
+         if (e) {
+            a->code_buffer >>= e & 255;
+            a->num_bits -= e & 255;
+            dist = (int) (e >> 16);
+         } else {
+            z = stbi__zhuffman_decode(a, &a->z_distance);
+            if (z < 0) return stbi__err("bad huffman code","Corrupt PNG");
+            dist = stbi__zdist_base[z];
+            if (stbi__zdist_extra[z]) dist += stbi__zreceive(a, stbi__zdist_extra[z]);
          }
-         p = (stbi_uc *) (zout - dist);
-         if (dist == 1) { // run of one byte; common in images.
-            stbi_uc v = *p;
-            if (len) { do *zout++ = v; while (--len); }
+         if (zout - a->zout_start < dist) return stbi__err("bad dist","Corrupt PNG");
+         if (a->zout_end - zout >= len + 16) {
+            zout = stbi__zcopy_match(zout, len, dist);
          } else {
-            if (len) { do *zout++ = *p++; while (--len); }
+            stbi_uc *p;
+            if (zout + len > a->zout_end) {
+               if (!stbi__zexpand(a, zout, len)) return 0;
+               zout = a->zout;
+            }
+            p = (stbi_uc *) (zout - dist);
+            if (dist == 1) { // run of one byte; common in images.
+               stbi_uc v = *p;
+               if (len) { do *zout++ = v; while (--len); }
+            } else {
+               if (len) { do *zout++ = *p++; while (--len); }
+            }
          }
       }
    }
@@ -4319,6 +5924,8 @@ static int stbi__compute_huffman_codes(stbi__zbuf *a)
    if (n != ntot) return stbi__err("bad codelengths","Corrupt PNG");
    if (!stbi__zbuild_huffman(&a->z_length, lencodes, hlit)) return 0;
    if (!stbi__zbuild_huffman(&a->z_distance, lencodes+hlit, hdist)) return 0;
+   stbi__zbuild_fast_ext(&a->z_length, stbi__zlength_base, stbi__zlength_extra, 257, 29);
+   stbi__zbuild_fast_ext(&a->z_distance, stbi__zdist_base, stbi__zdist_extra, 0, 30);
    return 1;
 }
 
@@ -4326,16 +5933,20 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
 {
    stbi_uc header[4];
    int len,nlen,k;
+   if (a->num_bits < 0) return stbi__err("zlib corrupt","Corrupt PNG");
    if (a->num_bits & 7)
       stbi__zreceive(a, a->num_bits & 7); // discard
-   // drain the bit-packed data into header
+   // drain the bit-packed data into header; the buffer may hold up to 8
+   // bytes, more than the header, so the rest goes back to the input
    k = 0;
-   while (a->num_bits > 0) {
+   while (a->num_bits > 0 && k < 4) {
       header[k++] = (stbi_uc) (a->code_buffer & 255); // suppress MSVC run-time check
       a->code_buffer >>= 8;
       a->num_bits -= 8;
    }
-   if (a->num_bits < 0) return stbi__err("zlib corrupt","Corrupt PNG");
+   a->zbuffer -= a->num_bits >> 3;
+   a->num_bits = 0;
+   a->code_buffer = 0;
    // now fill header the normal way
    while (k < 4)
       header[k++] = stbi__zget8(a);
@@ -4413,12 +6024,15 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
             // use fixed code lengths
             if (!stbi__zbuild_huffman(&a->z_length  , stbi__zdefault_length  , STBI__ZNSYMS)) return 0;
             if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance,  32)) return 0;
+            stbi__zbuild_fast_ext(&a->z_length, stbi__zlength_base, stbi__zlength_extra, 257, 29);
+            stbi__zbuild_fast_ext(&a->z_distance, stbi__zdist_base, stbi__zdist_extra, 0, 30);
          } else {
             if (!stbi__compute_huffman_codes(a)) return 0;
          }
          if (!stbi__parse_huffman_block(a)) return 0;
       }
    } while (!final);
+   if (a->num_bits < 0) return stbi__err("unexpected end","Corrupt PNG");
    return 1;
 }
 
@@ -4547,6 +6161,7 @@ typedef struct
    stbi__context *s;
    stbi_uc *idata, *expanded, *out;
    int depth;
+   stbi__dest *dest; // set when rows are unfiltered straight into it
 } stbi__png;
 
 
@@ -4583,6 +6198,203 @@ static int stbi__paeth(int a, int b, int c)
 
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+// SIMD unfiltering of 8-bit rows of 3 or 4 byte pixels. Sub, Avg and Paeth
+// depend on the pixel to the left, so, like libpng, these hold one pixel per
+// register; only None and Up are parallel across the whole row. in_n is 3 or
+// 4 and out_n is in_n or in_n+1, in which case alpha is stored as 255 and
+// there's no separate expansion pass.
+//
+// 3-byte pixels move as 4 bytes except at the end of the row: the extra byte
+// read belongs to the next pixel and the extra byte written is overwritten by
+// it, while past the last pixel the buffers may end.
+
+// the row loop must be inlined per layout so loads and stores are constant
+// sized, which MSVC's stbi_inline already forces
+#if defined(__GNUC__) || defined(__clang__)
+#define STBI__PNG_SIMD_INLINE __attribute__((always_inline)) static inline
+#else
+#define STBI__PNG_SIMD_INLINE stbi_inline static
+#endif
+
+#ifdef STBI_SSE2
+typedef __m128i stbi__png_px;
+
+STBI__PNG_SIMD_INLINE stbi__png_px stbi__png_load_px(const stbi_uc *p, int n, int last)
+{
+   stbi__uint32 v = 0;
+   if (n == 4 || !last) memcpy(&v, p, 4);
+   else memcpy(&v, p, 3);
+   return _mm_cvtsi32_si128((int) v);
+}
+
+STBI__PNG_SIMD_INLINE void stbi__png_store_px(stbi_uc *p, stbi__png_px v, int n, int last)
+{
+   stbi__uint32 w = (stbi__uint32) _mm_cvtsi128_si32(v);
+   if (n == 4 || !last) memcpy(p, &w, 4);
+   else memcpy(p, &w, 3);
+}
+
+#define stbi__png_px_zero()      _mm_setzero_si128()
+#define stbi__png_px_alpha()     _mm_slli_epi32(_mm_cvtsi32_si128(255), 24)
+#define stbi__png_px_add(a,b)    _mm_add_epi8(a, b)
+#define stbi__png_px_or(a,b)     _mm_or_si128(a, b)
+// floor((a+b)/2), pavgb rounds up
+#define stbi__png_px_avg(a,b)    _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)))
+#define stbi__png_px_half(a)     _mm_and_si128(_mm_srli_epi16(a, 1), _mm_set1_epi8(0x7f))
+
+// pa = |b-c|, pb = |a-c| and pc = |a+b-2c| in 16-bit lanes, then the same
+// tie breaking as stbi__paeth
+STBI__PNG_SIMD_INLINE stbi__png_px stbi__png_px_paeth(stbi__png_px a, stbi__png_px b, stbi__png_px c)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i a16 = _mm_unpacklo_epi8(a, zero);
+   __m128i b16 = _mm_unpacklo_epi8(b, zero);
+   __m128i c16 = _mm_unpacklo_epi8(c, zero);
+   __m128i pa = _mm_sub_epi16(b16, c16);
+   __m128i pb = _mm_sub_epi16(a16, c16);
+   __m128i pc = _mm_add_epi16(pa, pb);
+   __m128i smallest, use_a, use_b, pred;
+   pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+   pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+   pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+   smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+   use_a = _mm_cmpeq_epi16(smallest, pa);
+   use_b = _mm_cmpeq_epi16(smallest, pb);
+   pred = _mm_or_si128(_mm_and_si128(use_b, b16), _mm_andnot_si128(use_b, c16));
+   pred = _mm_or_si128(_mm_and_si128(use_a, a16), _mm_andnot_si128(use_a, pred));
+   return _mm_packus_epi16(pred, pred);
+}
+
+// cur = raw + prior over n bytes
+static void stbi__png_add_bytes(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, stbi__uint32 n)
+{
+   stbi__uint32 i = 0;
+   for (; i + 16 <= n; i += 16) {
+      __m128i r = _mm_loadu_si128((const __m128i *) (raw + i));
+      __m128i b = _mm_loadu_si128((const __m128i *) (prior + i));
+      _mm_storeu_si128((__m128i *) (cur + i), _mm_add_epi8(r, b));
+   }
+   for (; i < n; ++i)
+      cur[i] = STBI__BYTECAST(raw[i] + prior[i]);
+}
+#endif // STBI_SSE2
+
+#ifdef STBI_NEON
+typedef uint8x8_t stbi__png_px;
+
+STBI__PNG_SIMD_INLINE stbi__png_px stbi__png_load_px(const stbi_uc *p, int n, int last)
+{
+   stbi__uint32 v = 0;
+   if (n == 4 || !last) memcpy(&v, p, 4);
+   else memcpy(&v, p, 3);
+   return vreinterpret_u8_u32(vdup_n_u32(v));
+}
+
+STBI__PNG_SIMD_INLINE void stbi__png_store_px(stbi_uc *p, stbi__png_px v, int n, int last)
+{
+   stbi__uint32 w = vget_lane_u32(vreinterpret_u32_u8(v), 0);
+   if (n == 4 || !last) memcpy(p, &w, 4);
+   else memcpy(p, &w, 3);
+}
+
+#define stbi__png_px_zero()      vdup_n_u8(0)
+#define stbi__png_px_alpha()     vreinterpret_u8_u32(vdup_n_u32(0xff000000u))
+#define stbi__png_px_add(a,b)    vadd_u8(a, b)
+#define stbi__png_px_or(a,b)     vorr_u8(a, b)
+#define stbi__png_px_avg(a,b)    vhadd_u8(a, b)
+#define stbi__png_px_half(a)     vshr_n_u8(a, 1)
+
+// pc can reach 510; saturating it to 255 doesn't change how it compares
+// against pa and pb, which are at most 255
+STBI__PNG_SIMD_INLINE stbi__png_px stbi__png_px_paeth(stbi__png_px a, stbi__png_px b, stbi__png_px c)
+{
+   uint8x8_t pa = vabd_u8(b, c);
+   uint8x8_t pb = vabd_u8(a, c);
+   uint8x8_t pc = vqmovn_u16(vabdq_u16(vaddl_u8(a, b), vaddl_u8(c, c)));
+   uint8x8_t use_a = vand_u8(vcle_u8(pa, pb), vcle_u8(pa, pc));
+   uint8x8_t use_b = vcle_u8(pb, pc);
+   return vbsl_u8(use_a, a, vbsl_u8(use_b, b, c));
+}
+
+static void stbi__png_add_bytes(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, stbi__uint32 n)
+{
+   stbi__uint32 i = 0;
+   for (; i + 16 <= n; i += 16)
+      vst1q_u8(cur + i, vaddq_u8(vld1q_u8(raw + i), vld1q_u8(prior + i)));
+   for (; i < n; ++i)
+      cur[i] = STBI__BYTECAST(raw[i] + prior[i]);
+}
+#endif // STBI_NEON
+
+// a is the pixel to the left and c the one above it, both 0 at the start of
+// the row. a keeps whatever the filter put in the alpha lane, so it only ever
+// differs from the stored pixel in a lane nothing reads
+STBI__PNG_SIMD_INLINE void stbi__png_unfilter_row_simd_n(stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int filter, stbi__uint32 x, int in_n, int out_n)
+{
+   stbi__png_px alpha = in_n != out_n ? stbi__png_px_alpha() : stbi__png_px_zero();
+   stbi__png_px a = stbi__png_px_zero(), b, c = a;
+   stbi__uint32 i;
+
+   switch (filter) {
+      case STBI__F_none:
+         if (in_n == out_n) { memcpy(cur, raw, x*in_n); break; }
+         for (i=0; i < x; ++i) {
+            a = stbi__png_load_px(raw + i*in_n, in_n, i+1 == x);
+            stbi__png_store_px(cur + i*out_n, stbi__png_px_or(a, alpha), out_n, i+1 == x);
+         }
+         break;
+      case STBI__F_sub:
+      case STBI__F_paeth_first: // the predictor is the left pixel when there's no row above
+         for (i=0; i < x; ++i) {
+            a = stbi__png_px_add(stbi__png_load_px(raw + i*in_n, in_n, i+1 == x), a);
+            stbi__png_store_px(cur + i*out_n, stbi__png_px_or(a, alpha), out_n, i+1 == x);
+         }
+         break;
+      case STBI__F_up:
+         if (in_n == out_n) { stbi__png_add_bytes(cur, raw, prior, x*in_n); break; }
+         for (i=0; i < x; ++i) {
+            b = stbi__png_load_px(prior + i*out_n, out_n, i+1 == x);
+            a = stbi__png_px_add(stbi__png_load_px(raw + i*in_n, in_n, i+1 == x), b);
+            stbi__png_store_px(cur + i*out_n, stbi__png_px_or(a, alpha), out_n, i+1 == x);
+         }
+         break;
+      case STBI__F_avg:
+         for (i=0; i < x; ++i) {
+            b = stbi__png_load_px(prior + i*out_n, out_n, i+1 == x);
+            a = stbi__png_px_add(stbi__png_load_px(raw + i*in_n, in_n, i+1 == x), stbi__png_px_avg(a, b));
+            stbi__png_store_px(cur + i*out_n, stbi__png_px_or(a, alpha), out_n, i+1 == x);
+         }
+         break;
+      case STBI__F_avg_first:
+         for (i=0; i < x; ++i) {
+            a = stbi__png_px_add(stbi__png_load_px(raw + i*in_n, in_n, i+1 == x), stbi__png_px_half(a));
+            stbi__png_store_px(cur + i*out_n, stbi__png_px_or(a, alpha), out_n, i+1 == x);
+         }
+         break;
+      case STBI__F_paeth:
+         for (i=0; i < x; ++i) {
+            b = stbi__png_load_px(prior + i*out_n, out_n, i+1 == x);
+            a = stbi__png_px_add(stbi__png_load_px(raw + i*in_n, in_n, i+1 == x), stbi__png_px_paeth(a, b, c));
+            c = b;
+            stbi__png_store_px(cur + i*out_n, stbi__png_px_or(a, alpha), out_n, i+1 == x);
+         }
+         break;
+   }
+}
+
+// one copy per pixel layout, so the loads and stores have constant sizes
+static void stbi__png_unfilter_row_simd(stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int filter, stbi__uint32 x, int img_n, int out_n)
+{
+   if (img_n == 4)
+      stbi__png_unfilter_row_simd_n(cur, prior, raw, filter, x, 4, 4);
+   else if (out_n == 4)
+      stbi__png_unfilter_row_simd_n(cur, prior, raw, filter, x, 3, 4);
+   else
+      stbi__png_unfilter_row_simd_n(cur, prior, raw, filter, x, 3, 3);
+}
+#endif // STBI_SSE2 || STBI_NEON
+
 // create the png data from post-deflated data
 static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
 {
@@ -4596,10 +6408,27 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    int output_bytes = out_n*bytes;
    int filter_bytes = img_n*bytes;
    int width = x;
+   stbi_uc *row0;
+   ptrdiff_t row_stride = stride;
+   int bgr = 0;
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+   int simd = depth == 8 && (img_n == 3 || img_n == 4);
+#ifdef STBI_SSE2
+   simd = simd && stbi__sse2_available();
+#endif
+#endif
 
    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
-   a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
-   if (!a->out) return stbi__err("outofmem", "Out of memory");
+   if (a->dest) {
+      // 8-bit and not interlaced, the loops below only touch row j
+      row0 = a->dest->row0;
+      row_stride = a->dest->stride;
+      bgr = (a->dest->req->flags & STBI_DEST_BGR) != 0;
+   } else {
+      a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
+      if (!a->out) return stbi__err("outofmem", "Out of memory");
+      row0 = a->out;
+   }
 
    if (!stbi__mad3sizes_valid(img_n, x, depth, 7)) return stbi__err("too large", "Corrupt PNG");
    img_width_bytes = (((img_n * x * depth) + 7) >> 3);
@@ -4611,10 +6440,15 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    if (raw_len < img_len) return stbi__err("not enough pixels","Corrupt PNG");
 
    for (j=0; j < y; ++j) {
-      stbi_uc *cur = a->out + stride*j;
+      stbi_uc *cur = row0 + row_stride*(ptrdiff_t)j;
       stbi_uc *prior;
       int filter = *raw++;
 
+      // swizzle two rows behind, the row above must stay RGB until this one
+      // is unfiltered
+      if (bgr && j >= 2)
+         stbi__dest_swap_rb(cur - 2*row_stride, x, out_n);
+
       if (filter > 4)
          return stbi__err("invalid filter","Corrupt PNG");
 
@@ -4624,11 +6458,19 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
          filter_bytes = 1;
          width = img_width_bytes;
       }
-      prior = cur - stride; // bugfix: need to compute this after 'cur +=' computation above
+      prior = cur - row_stride; // bugfix: need to compute this after 'cur +=' computation above
 
       // if first row, use special filter that doesn't sample previous row
       if (j == 0) filter = first_row_filter[filter];
 
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+      if (simd) {
+         stbi__png_unfilter_row_simd(cur, prior, raw, filter, x, img_n, out_n);
+         raw += x*img_n;
+         continue;
+      }
+#endif
+
       // handle first byte explicitly
       for (k=0; k < filter_bytes; ++k) {
          switch (filter) {
@@ -4708,6 +6550,11 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       }
    }
 
+   if (bgr) {
+      if (y >= 2) stbi__dest_swap_rb(row0 + row_stride*(ptrdiff_t)(y-2), x, out_n);
+      stbi__dest_swap_rb(row0 + row_stride*(ptrdiff_t)(y-1), x, out_n);
+   }
+
    // we make a separate pass to expand bits to pixels; for performance,
    // this could run two scanlines behind the above code, so it won't
    // intefere with filtering but will still be in the cache.
@@ -4841,6 +6688,27 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
    return 1;
 }
 
+// exact size of the decompressed image data: a filter byte in front of every
+// row of every pass
+static stbi__uint32 stbi__png_raw_len(stbi__context *s, int depth, int interlaced)
+{
+   static const int xorig[] = { 0,4,0,2,0,1,0 };
+   static const int yorig[] = { 0,0,4,0,2,0,1 };
+   static const int xspc[]  = { 8,8,4,4,2,2,1 };
+   static const int yspc[]  = { 8,8,8,4,4,2,2 };
+   stbi__uint32 len = 0;
+   int p;
+   if (!interlaced)
+      return ((((s->img_n * s->img_x * depth) + 7) >> 3) + 1) * s->img_y;
+   for (p=0; p < 7; ++p) {
+      stbi__uint32 x = (s->img_x - xorig[p] + xspc[p]-1) / xspc[p];
+      stbi__uint32 y = (s->img_y - yorig[p] + yspc[p]-1) / yspc[p];
+      if (x && y)
+         len += ((((s->img_n * x * depth) + 7) >> 3) + 1) * y;
+   }
+   return len;
+}
+
 static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
 {
    stbi__context *s = z->s;
@@ -4948,7 +6816,7 @@ STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert)
 static STBI_THREAD_LOCAL int stbi__unpremultiply_on_load_local, stbi__unpremultiply_on_load_set;
 static STBI_THREAD_LOCAL int stbi__de_iphone_flag_local, stbi__de_iphone_flag_set;
 
-STBIDEF void stbi__unpremultiply_on_load_thread(int flag_true_if_should_unpremultiply)
+STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpremultiply)
 {
    stbi__unpremultiply_on_load_local = flag_true_if_should_unpremultiply;
    stbi__unpremultiply_on_load_set = 1;
@@ -5025,6 +6893,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
    z->expanded = NULL;
    z->idata = NULL;
    z->out = NULL;
+   z->dest = NULL;
 
    if (!stbi__check_png_header(s)) return 0;
 
@@ -5126,13 +6995,13 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
          }
 
          case STBI__PNG_TYPE('I','E','N','D'): {
-            stbi__uint32 raw_len, bpl;
+            stbi__uint32 raw_len;
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
             if (scan != STBI__SCAN_load) return 1;
             if (z->idata == NULL) return stbi__err("no IDAT","Corrupt PNG");
-            // initial guess for decoded data size to avoid unnecessary reallocs
-            bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
-            raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
+            // the header gives the exact decoded size, so a valid stream
+            // never reallocs
+            raw_len = stbi__png_raw_len(s, z->depth, interlace);
             z->expanded = (stbi_uc *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
             if (z->expanded == NULL) return 0; // zlib should set error
             STBI_FREE(z->idata); z->idata = NULL;
@@ -5140,6 +7009,12 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                s->img_out_n = s->img_n+1;
             else
                s->img_out_n = s->img_n;
+            // with nothing to do after unfiltering, rows can go straight to
+            // the caller's buffer
+            if (s->dest && z->depth == 8 && !interlace && !pal_img_n && !has_trans && !is_iphone && req_comp == s->img_out_n) {
+               if (!stbi__dest_setup(s->dest, s->img_x, s->img_y)) return 0;
+               z->dest = s->dest;
+            }
             if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
             if (has_trans) {
                if (z->depth == 16) {
@@ -5200,8 +7075,14 @@ static void *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp, st
          ri->bits_per_channel = 16;
       else
          return stbi__errpuc("bad bits_per_channel", "PNG not supported: unsupported color depth");
-      result = p->out;
-      p->out = NULL;
+      if (p->dest) {
+         // already in the caller's buffer in the requested layout
+         result = p->dest->row0;
+         ri->rows_in_dest = 1;
+      } else {
+         result = p->out;
+         p->out = NULL;
+      }
       if (req_comp && req_comp != p->s->img_out_n) {
          if (ri->bits_per_channel == 8)
             result = stbi__convert_format((unsigned char *) result, p->s->img_out_n, req_comp, p->s->img_x, p->s->img_y);
@@ -5269,6 +7150,18 @@ static int stbi__png_is16(stbi__context *s)
 }
 #endif
 
+#ifdef STBI_THREAD_LOCAL
+STBIDEF void stbi_reset_thread_settings(void)
+{
+   stbi__vertically_flip_on_load_set = 0;
+   stbi__parallel_for_set = 0;
+#ifndef STBI_NO_PNG
+   stbi__unpremultiply_on_load_set = 0;
+   stbi__de_iphone_flag_set = 0;
+#endif
+}
+#endif
+
 // Microsoft/Windows BMP image
 
 #ifndef STBI_NO_BMP
@@ -6935,7 +8828,7 @@ static void *stbi__load_gif_main(stbi__context *s, int **delays, int *x, int *y,
             }
             memcpy( out + ((layers - 1) * stride), u, stride );
             if (layers >= 2) {
-               two_back = out - 2 * stride;
+               two_back = out + (layers - 2) * stride;
             }
 
             if (delays) {
@@ -6993,6 +8886,162 @@ static int stbi__gif_info(stbi__context *s, int *x, int *y, int *comp)
 {
    return stbi__gif_info_raw(s,x,y,comp);
 }
+
+struct stbi_gif_stream
+{
+   stbi__context s;
+   stbi__gif g;
+   stbi_uc const *data;
+   int len;
+   void *owned;            // file contents read into memory, if any
+#ifdef STBI__MMAP
+   stbi__mapping mapping;
+   int mapped;
+#endif
+   stbi_uc *back[2];       // the last two frames, for "restore previous" disposal
+   int frames;             // frames returned since the start
+};
+
+static void stbi__gif_stream_free_frames(stbi_gif_stream *gs)
+{
+   STBI_FREE(gs->g.out);
+   STBI_FREE(gs->g.history);
+   STBI_FREE(gs->g.background);
+   gs->g.out = gs->g.history = gs->g.background = NULL;
+}
+
+static int stbi__gif_stream_start(stbi_gif_stream *gs)
+{
+   stbi__gif_stream_free_frames(gs);
+   memset(&gs->g, 0, sizeof(gs->g));
+   gs->frames = 0;
+   stbi__start_mem(&gs->s, gs->data, gs->len);
+   if (!stbi__gif_test(&gs->s)) return stbi__err("not GIF", "Image was not as a gif type.");
+   return 1;
+}
+
+static stbi_gif_stream *stbi__gif_stream_open(stbi_gif_stream *gs, int *x, int *y)
+{
+   int w, h;
+   if (!stbi__gif_stream_start(gs) || !stbi__gif_info_raw(&gs->s, &w, &h, NULL)) {
+      stbi_gif_stream_close(gs);
+      return NULL;
+   }
+   if (!stbi__mad3sizes_valid(4, w, h, 0)) {
+      stbi_gif_stream_close(gs);
+      return (stbi_gif_stream *) stbi__errpuc("too large", "GIF image is too large");
+   }
+   stbi__rewind(&gs->s);
+   if (x) *x = w;
+   if (y) *y = h;
+   return gs;
+}
+
+static stbi_gif_stream *stbi__gif_stream_alloc(void)
+{
+   stbi_gif_stream *gs = (stbi_gif_stream *) stbi__malloc(sizeof(stbi_gif_stream));
+   if (!gs) return (stbi_gif_stream *) stbi__errpuc("outofmem", "Out of memory");
+   memset(gs, 0, sizeof(*gs));
+   return gs;
+}
+
+STBIDEF stbi_gif_stream *stbi_gif_stream_open_memory(stbi_uc const *buffer, int len, int *x, int *y)
+{
+   stbi_gif_stream *gs = stbi__gif_stream_alloc();
+   if (!gs) return NULL;
+   gs->data = buffer;
+   gs->len = len;
+   return stbi__gif_stream_open(gs, x, y);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_gif_stream *stbi_gif_stream_open(char const *filename, int *x, int *y)
+{
+   FILE *f;
+   long size;
+   stbi_gif_stream *gs = stbi__gif_stream_alloc();
+   if (!gs) return NULL;
+#ifdef STBI__MMAP
+   if (stbi__map_file(&gs->s, filename, &gs->mapping)) {
+      gs->mapped = 1;
+      gs->data = (stbi_uc *) gs->mapping.data;
+      gs->len = (int) gs->mapping.size;
+      return stbi__gif_stream_open(gs, x, y);
+   }
+#endif
+   // the compressed file is small next to its frames, keep all of it
+   f = stbi__fopen(filename, "rb");
+   if (!f) { STBI_FREE(gs); return (stbi_gif_stream *) stbi__errpuc("can't fopen", "Unable to open file"); }
+   size = -1;
+   if (fseek(f, 0, SEEK_END) == 0) size = ftell(f);
+   if (size <= 0 || size > INT_MAX || fseek(f, 0, SEEK_SET) != 0) {
+      fclose(f);
+      STBI_FREE(gs);
+      return (stbi_gif_stream *) stbi__errpuc("can't read", "Unable to read file");
+   }
+   gs->owned = stbi__malloc((size_t) size);
+   if (!gs->owned || fread(gs->owned, 1, (size_t) size, f) != (size_t) size) {
+      fclose(f);
+      stbi_gif_stream_close(gs);
+      return (stbi_gif_stream *) stbi__errpuc("can't read", "Unable to read file");
+   }
+   fclose(f);
+   gs->data = (stbi_uc *) gs->owned;
+   gs->len = (int) size;
+   return stbi__gif_stream_open(gs, x, y);
+}
+#endif
+
+STBIDEF int stbi_gif_stream_next(stbi_gif_stream *gs, stbi_uc *pixels, int stride_in_bytes, int *delay_ms)
+{
+   stbi__gif *g = &gs->g;
+   stbi_uc *u, *two_back = NULL;
+   int j, row;
+
+   // keep the previous frame, the next one may restore the frame before it
+   if (gs->frames >= 1) {
+      stbi_uc **back = &gs->back[(gs->frames - 1) & 1];
+      if (!*back) {
+         *back = (stbi_uc *) stbi__malloc_mad3(4, g->w, g->h, 0);
+         if (!*back) { stbi__err("outofmem", "Out of memory"); return -1; }
+      }
+      memcpy(*back, g->out, 4 * g->w * g->h);
+      if (gs->frames >= 2)
+         two_back = gs->back[(gs->frames - 2) & 1];
+   }
+
+   u = stbi__gif_load_next(&gs->s, g, NULL, 4, two_back);
+   if (u == (stbi_uc *) &gs->s) return 0;  // end of animated gif marker
+   if (!u) return -1;
+
+   row = 4 * g->w;
+   if (stride_in_bytes == 0) stride_in_bytes = row;
+   for (j = 0; j < g->h; ++j) {
+      int src = stbi__vertically_flip_on_load ? g->h - 1 - j : j;
+      memcpy(pixels + (size_t) j * stride_in_bytes, u + (size_t) src * row, row);
+   }
+   if (delay_ms) *delay_ms = g->delay;
+   ++gs->frames;
+   return 1;
+}
+
+STBIDEF int stbi_gif_stream_rewind(stbi_gif_stream *gs)
+{
+   return stbi__gif_stream_start(gs);
+}
+
+STBIDEF void stbi_gif_stream_close(stbi_gif_stream *gs)
+{
+   if (!gs) return;
+   stbi__gif_stream_free_frames(gs);
+   STBI_FREE(gs->back[0]);
+   STBI_FREE(gs->back[1]);
+   STBI_FREE(gs->owned);
+#ifdef STBI__MMAP
+   if (gs->mapped) stbi__unmap_file(&gs->mapping);
+#endif
+   STBI_FREE(gs);
+}
 #endif
 
 // *************************************************************************************************
@@ -7043,12 +9092,25 @@ static char *stbi__hdr_gettoken(stbi__context *z, char *buffer)
    return buffer;
 }
 
+// 2^(e-136), the scale of an rgbe pixel's mantissas. that is a normal float
+// for e >= 10, so it can be built from bits instead of calling ldexp
+static float stbi__hdr_scale(int e)
+{
+   if (e >= 10) {
+      stbi__uint32 bits = (stbi__uint32) (e - 9) << 23;
+      float f;
+      memcpy(&f, &bits, 4);
+      return f;
+   }
+   return (float) ldexp(1.0f, e - (int)(128 + 8));
+}
+
 static void stbi__hdr_convert(float *output, stbi_uc *input, int req_comp)
 {
    if ( input[3] != 0 ) {
       float f1;
       // Exponent
-      f1 = (float) ldexp(1.0f, input[3] - (int)(128 + 8));
+      f1 = stbi__hdr_scale(input[3]);
       if (req_comp <= 2)
          output[0] = (input[0] + input[1] + input[2]) * f1 / 3;
       else {
@@ -7070,6 +9132,82 @@ static void stbi__hdr_convert(float *output, stbi_uc *input, int req_comp)
    }
 }
 
+// converts one decoded RLE scanline, which is stored as four planes (r, g,
+// b and exponent) of width bytes each
+static void stbi__hdr_convert_row(float *output, stbi_uc *planes, int width, int req_comp)
+{
+   stbi_uc *r = planes, *g = planes + width, *b = planes + 2*width, *e = planes + 3*width;
+   int i = 0;
+#ifdef STBI_SSE2
+   if (req_comp >= 3 && stbi__sse2_available()) {
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i nine = _mm_set1_epi32(9);
+      const __m128i ten = _mm_set1_epi32(10);
+      const __m128 one = _mm_set1_ps(1.0f);
+      // 3 channel pixels are stored 4 floats wide, so keep at least one
+      // pixel for the scalar loop to overwrite the spill of the last store
+      int end = req_comp == 4 ? width : width - 1;
+      for (; i + 4 <= end; i += 4) {
+         stbi__uint32 rv, gv, bv, ev;
+         __m128i r4, g4, b4, e4, scale;
+         __m128 fr, fg, fb, fa;
+         memcpy(&rv, r + i, 4);
+         memcpy(&gv, g + i, 4);
+         memcpy(&bv, b + i, 4);
+         memcpy(&ev, e + i, 4);
+         e4 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int) ev), zero), zero);
+         // exponents 1..9 need a subnormal scale, rare enough to leave to
+         // the scalar code
+         if (_mm_movemask_epi8(_mm_and_si128(_mm_cmplt_epi32(e4, ten), _mm_cmpgt_epi32(e4, zero)))) {
+            int k;
+            for (k=0; k < 4; ++k) {
+               stbi_uc rgbe[4];
+               rgbe[0] = r[i+k]; rgbe[1] = g[i+k]; rgbe[2] = b[i+k]; rgbe[3] = e[i+k];
+               stbi__hdr_convert(output + (i+k)*req_comp, rgbe, req_comp);
+            }
+            continue;
+         }
+         // e == 0 is black: a zero scale
+         scale = _mm_andnot_si128(_mm_cmpeq_epi32(e4, zero), _mm_slli_epi32(_mm_sub_epi32(e4, nine), 23));
+         r4 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int) rv), zero), zero);
+         g4 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int) gv), zero), zero);
+         b4 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int) bv), zero), zero);
+         fr = _mm_mul_ps(_mm_cvtepi32_ps(r4), _mm_castsi128_ps(scale));
+         fg = _mm_mul_ps(_mm_cvtepi32_ps(g4), _mm_castsi128_ps(scale));
+         fb = _mm_mul_ps(_mm_cvtepi32_ps(b4), _mm_castsi128_ps(scale));
+         fa = one;
+         _MM_TRANSPOSE4_PS(fr, fg, fb, fa);
+         _mm_storeu_ps(output + (i+0)*req_comp, fr);
+         _mm_storeu_ps(output + (i+1)*req_comp, fg);
+         _mm_storeu_ps(output + (i+2)*req_comp, fb);
+         _mm_storeu_ps(output + (i+3)*req_comp, fa);
+      }
+   }
+#endif
+   for (; i < width; ++i) {
+      stbi_uc rgbe[4];
+      rgbe[0] = r[i]; rgbe[1] = g[i]; rgbe[2] = b[i]; rgbe[3] = e[i];
+      stbi__hdr_convert(output + i*req_comp, rgbe, req_comp);
+   }
+}
+
+typedef struct
+{
+   float *output;
+   stbi_uc *planes;
+   int width, height, req_comp, bands;
+} stbi__hdr_job;
+
+static void stbi__hdr_convert_task(void *task_data, int band)
+{
+   stbi__hdr_job *job = (stbi__hdr_job *) task_data;
+   int j     = (int) ((stbi__uint64) job->height * band / job->bands);
+   int j_end = (int) ((stbi__uint64) job->height * (band+1) / job->bands);
+   for (; j < j_end; ++j)
+      stbi__hdr_convert_row(job->output + (size_t) j * job->width * job->req_comp,
+                            job->planes + (size_t) j * job->width * 4, job->width, job->req_comp);
+}
+
 static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
 {
    char buffer[STBI__HDR_BUFLEN];
@@ -7080,7 +9218,7 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
    float *hdr_data;
    int len;
    unsigned char count, value;
-   int i, j, k, c1,c2, z;
+   int i, j, k, c1,c2, parallel;
    const char *headerToken;
    STBI_NOTUSED(ri);
 
@@ -7139,10 +9277,14 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
          }
       }
    } else {
-      // Read RLE-encoded data
+      // Read RLE-encoded data. run-length decoding is serial, but with a
+      // parallel-for installed every scanline is kept and converted to
+      // float in row bands afterwards
+      parallel = stbi__parallel_enabled(width, height);
       scanline = NULL;
 
       for (j = 0; j < height; ++j) {
+         stbi_uc *planes;
          c1 = stbi__get8(s);
          c2 = stbi__get8(s);
          len = stbi__get8(s);
@@ -7164,14 +9306,20 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
          len |= stbi__get8(s);
          if (len != width) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("invalid decoded scanline length", "corrupt HDR"); }
          if (scanline == NULL) {
-            scanline = (stbi_uc *) stbi__malloc_mad2(width, 4, 0);
+            scanline = parallel ? (stbi_uc *) stbi__malloc_mad3(width, height, 4, 0) : NULL;
+            if (!scanline) {
+               parallel = 0;
+               scanline = (stbi_uc *) stbi__malloc_mad2(width, 4, 0);
+            }
             if (!scanline) {
                STBI_FREE(hdr_data);
                return stbi__errpf("outofmem", "Out of memory");
             }
          }
+         planes = parallel ? scanline + (size_t) j * width * 4 : scanline;
 
          for (k = 0; k < 4; ++k) {
+            stbi_uc *plane = planes + k * width;
             int nleft;
             i = 0;
             while ((nleft = width - i) > 0) {
@@ -7181,18 +9329,29 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
                   value = stbi__get8(s);
                   count -= 128;
                   if (count > nleft) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
-                  for (z = 0; z < count; ++z)
-                     scanline[i++ * 4 + k] = value;
+                  memset(plane + i, value, count);
                } else {
-                  // Dump
-                  if (count > nleft) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
-                  for (z = 0; z < count; ++z)
-                     scanline[i++ * 4 + k] = stbi__get8(s);
+                  // Dump; an empty one would never finish the scanline
+                  if (count == 0 || count > nleft) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
+                  // a truncated file decodes as zeros, as it did byte by byte
+                  if (!stbi__getn(s, plane + i, count))
+                     memset(plane + i, 0, count);
                }
+               i += count;
             }
          }
-         for (i=0; i < width; ++i)
-            stbi__hdr_convert(hdr_data+(j*width + i)*req_comp, scanline + i*4, req_comp);
+         if (!parallel)
+            stbi__hdr_convert_row(hdr_data + (size_t) j * width * req_comp, planes, width, req_comp);
+      }
+      if (parallel) {
+         stbi__hdr_job job;
+         job.output = hdr_data;
+         job.planes = scanline;
+         job.width = width;
+         job.height = height;
+         job.req_comp = req_comp;
+         job.bands = height / 16 < 64 ? height / 16 : 64;
+         stbi__parallel(job.bands, stbi__hdr_convert_task, &job);
       }
       if (scanline)
          STBI_FREE(scanline);
@@ -7573,6 +9732,56 @@ static int stbi__info_main(stbi__context *s, int *x, int *y, int *comp)
    return stbi__err("unknown image type", "Image not of any known type, or corrupt");
 }
 
+// stbi__info_main that also says which test matched
+static int stbi__info_format(stbi__context *s, stbi_image_info *info)
+{
+   int *x = &info->x, *y = &info->y, *comp = &info->comp;
+   memset(info, 0, sizeof(*info));
+
+   #ifndef STBI_NO_JPEG
+   if (stbi__jpeg_info(s, x, y, comp)) return info->format = STBI_FORMAT_JPEG;
+   #endif
+
+   #ifndef STBI_NO_PNG
+   if (stbi__png_info(s, x, y, comp))  return info->format = STBI_FORMAT_PNG;
+   #endif
+
+   #ifndef STBI_NO_GIF
+   if (stbi__gif_info(s, x, y, comp))  return info->format = STBI_FORMAT_GIF;
+   #endif
+
+   #ifndef STBI_NO_BMP
+   if (stbi__bmp_info(s, x, y, comp))  return info->format = STBI_FORMAT_BMP;
+   #endif
+
+   #ifndef STBI_NO_PSD
+   if (stbi__psd_info(s, x, y, comp))  return info->format = STBI_FORMAT_PSD;
+   #endif
+
+   #ifndef STBI_NO_PIC
+   if (stbi__pic_info(s, x, y, comp))  return info->format = STBI_FORMAT_PIC;
+   #endif
+
+   #ifndef STBI_NO_PNM
+   if (stbi__pnm_info(s, x, y, comp))  return info->format = STBI_FORMAT_PNM;
+   #endif
+
+   #ifndef STBI_NO_HDR
+   if (stbi__hdr_info(s, x, y, comp))  return info->format = STBI_FORMAT_HDR;
+   #endif
+
+   #ifndef STBI_NO_TGA
+   if (stbi__tga_info(s, x, y, comp))  return info->format = STBI_FORMAT_TGA;
+   #endif
+   return stbi__err("unknown image type", "Image not of any known type, or corrupt");
+}
+
+// only these formats have 16-bit variants, and their headers are short
+static int stbi__format_may_be_16(int format)
+{
+   return format == STBI_FORMAT_PNG || format == STBI_FORMAT_PSD || format == STBI_FORMAT_PNM;
+}
+
 static int stbi__is_16_main(stbi__context *s)
 {
    #ifndef STBI_NO_PNG
@@ -7608,6 +9817,7 @@ STBIDEF int stbi_info_from_file(FILE *f, int *x, int *y, int *comp)
    stbi__start_file(&s, f);
    r = stbi__info_main(&s,x,y,comp);
    fseek(f,pos,SEEK_SET);
+   stbi__stop_callbacks(&s);
    return r;
 }
 
@@ -7629,10 +9839,55 @@ STBIDEF int stbi_is_16_bit_from_file(FILE *f)
    stbi__start_file(&s, f);
    r = stbi__is_16_main(&s);
    fseek(f,pos,SEEK_SET);
+   stbi__stop_callbacks(&s);
    return r;
 }
+
+STBIDEF int stbi_info_ex(char const *filename, stbi_image_info *info)
+{
+    FILE *f = stbi__fopen(filename, "rb");
+    int result;
+    if (!f) return stbi__err("can't fopen", "Unable to open file");
+    result = stbi_info_ex_from_file(f, info);
+    fclose(f);
+    return result;
+}
+
+STBIDEF int stbi_info_ex_from_file(FILE *f, stbi_image_info *info)
+{
+   int r;
+   stbi__context s;
+   long pos = ftell(f);
+   stbi__start_file(&s, f);
+   r = stbi__info_format(&s, info);
+   // a rewind only reaches back over the first buffer, start afresh instead
+   if (r && stbi__format_may_be_16(info->format)) {
+      stbi__stop_callbacks(&s);
+      fseek(f,pos,SEEK_SET);
+      stbi__start_file(&s, f);
+      info->is_16_bit = stbi__is_16_main(&s);
+   }
+   info->is_hdr = info->format == STBI_FORMAT_HDR;
+   fseek(f,pos,SEEK_SET);
+   stbi__stop_callbacks(&s);
+   return r != 0;
+}
 #endif // !STBI_NO_STDIO
 
+STBIDEF int stbi_info_ex_from_memory(stbi_uc const *buffer, int len, stbi_image_info *info)
+{
+   stbi__context s;
+   int r;
+   stbi__start_mem(&s,buffer,len);
+   r = stbi__info_format(&s, info);
+   if (r && stbi__format_may_be_16(info->format)) {
+      stbi__start_mem(&s,buffer,len);
+      info->is_16_bit = stbi__is_16_main(&s);
+   }
+   info->is_hdr = info->format == STBI_FORMAT_HDR;
+   return r != 0;
+}
+
 STBIDEF int stbi_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp)
 {
    stbi__context s;
@@ -7642,9 +9897,12 @@ STBIDEF int stbi_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y
 
 STBIDEF int stbi_info_from_callbacks(stbi_io_callbacks const *c, void *user, int *x, int *y, int *comp)
 {
+   int r;
    stbi__context s;
    stbi__start_callbacks(&s, (stbi_io_callbacks *) c, user);
-   return stbi__info_main(&s,x,y,comp);
+   r = stbi__info_main(&s,x,y,comp);
+   stbi__stop_callbacks(&s);
+   return r;
 }
 
 STBIDEF int stbi_is_16_bit_from_memory(stbi_uc const *buffer, int len)
@@ -7656,9 +9914,12 @@ STBIDEF int stbi_is_16_bit_from_memory(stbi_uc const *buffer, int len)
 
 STBIDEF int stbi_is_16_bit_from_callbacks(stbi_io_callbacks const *c, void *user)
 {
+   int r;
    stbi__context s;
    stbi__start_callbacks(&s, (stbi_io_callbacks *) c, user);
-   return stbi__is_16_main(&s);
+   r = stbi__is_16_main(&s);
+   stbi__stop_callbacks(&s);
+   return r;
 }
 
 #endif // STB_IMAGE_IMPLEMENTATION
@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../src/gl_headless.h"
+#include "../src/gl_replay.h"
+
+using namespace gofran;
+
+// Replays a trace written by GLCapture (main_headless -c) on a headless
+// context: the calls before the captured range once as setup, then the
+// range as fast as possible, -l times. Prints frame times and, per GL call,
+// count and time, which is mostly driver cost. -f finishes every frame, so
+// frame times include the GPU; otherwise only the end of the replay waits.
+//
+//   gl_replay [-s widthxheight] [-l loops] [-f] [-o last_frame.ppm] trace
+
+struct replay_options {
+    int width = 800;
+
+    int height = 600;
+
+    int loops = 1;
+
+    bool finish = false;
+
+    std::string output;
+
+    std::string trace;
+};
+
+static bool parse_options(int argc, const char* argv[], replay_options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ("-s" == arg && i + 1 < argc) {
+            if (2 != sscanf(argv[++i], "%dx%d", &options.width, &options.height)) {
+                return false;
+            }
+        } else if ("-l" == arg && i + 1 < argc) {
+            options.loops = std::atoi(argv[++i]);
+        } else if ("-f" == arg) {
+            options.finish = true;
+        } else if ("-o" == arg && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (options.trace.empty()) {
+            options.trace = arg;
+        } else {
+            return false;
+        }
+    }
+    return !options.trace.empty() && options.width > 0 && options.height > 0 && options.loops > 0;
+}
+
+int main(int argc, const char* argv[]) {
+    replay_options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cout << "usage: gl_replay [-s widthxheight] [-l loops] [-f] [-o last_frame.ppm] trace" << std::endl;
+        return 1;
+    }
+
+    GLHeadless headless;
+    if (gli_success != headless.create(options.width, options.height)) {
+        std::cout << "Failed to create headless context" << std::endl;
+        return 1;
+    }
+
+    GLReplay replay;
+    if (gli_success != replay.load(options.trace)) {
+        std::cout << "Failed to load " << options.trace << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (gli_success != replay.setup()) {
+        std::cout << "Truncated trace " << options.trace << std::endl;
+        return 1;
+    }
+    glFinish();
+    double setup_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int loop = 0; loop < options.loops; ++loop) {
+        while (replay.play_frame()) {
+            if (options.finish) {
+                glFinish();
+            }
+        }
+    }
+    glFinish();
+    double replay_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (replay.failed()) {
+        std::cout << "Truncated trace " << options.trace << std::endl;
+        return 1;
+    }
+
+    std::vector<double> frames = replay.frame_times();
+    std::sort(frames.begin(), frames.end());
+    double frames_ms = 0.0;
+    for (double ms : frames) {
+        frames_ms += ms;
+    }
+    std::cout << "setup " << setup_ms << " ms, frames from " << replay.first_frame() << ", "
+            << options.loops << " loops" << std::endl;
+    if (!frames.empty()) {
+        std::cout << frames.size() << " frames in " << replay_ms << " ms: min " << frames.front()
+                << " median " << frames[frames.size() / 2] << " max " << frames.back()
+                << " mean " << frames_ms / frames.size() << " ms" << std::endl;
+    }
+
+    // Most expensive calls first.
+    std::vector<size_t> calls;
+    double calls_ns = 0.0;
+    for (size_t i = 0; i < gl_call_count; ++i) {
+        if (0 != replay.stats()[i].count) {
+            calls.push_back(i);
+            calls_ns += replay.stats()[i].ns;
+        }
+    }
+    std::sort(calls.begin(), calls.end(), [&](size_t a, size_t b) {
+        return replay.stats()[a].ns > replay.stats()[b].ns;
+    });
+
+    std::cout << "call\tcount\tms\tns/call\t%" << std::endl;
+    for (size_t i : calls) {
+        const GLReplay::call_stats_t& stats = replay.stats()[i];
+        std::cout << gl_call_name((gl_call)i) << "\t" << stats.count << "\t" << stats.ns / 1e6
+                << "\t" << stats.ns / stats.count << "\t" << 100.0 * stats.ns / calls_ns << std::endl;
+    }
+
+    if (!options.output.empty() && gli_success != headless.write_ppm(options.output)) {
+        std::cout << "Failed to write " << options.output << std::endl;
+        return 1;
+    }
+    return 0;
+}